@@ -150,6 +150,11 @@ LIKWIDLOCKPATH = /var/run/likwid.lock
 # LIKWID library.
 LIKWIDSOCKETBASE = /tmp/likwid  # -%d will be added automatically to the socket name
 
+# A persistent access daemon (likwid-accessD --persistent, started once by
+# root or a system service) listens on this socket. Clients connect to it
+# instead of starting their own daemon if it exists and is owned by root.
+LIKWIDPERSISTENTSOCKET = /run/likwid-accessD.sock
+
 # The pinning library is put in LD_PRELOAD when using LIKIWD for thread/process
 # pinning. The library overloads the pthread_create function to pin threads
 # directly after their creation
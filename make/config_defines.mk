@@ -12,6 +12,7 @@ DEFINES   += -DVERSION=$(VERSION)         \
              -DGROUPPATH=$(LIKWIDGROUPPATH) \
              -DLIKWIDLOCK=$(LIKWIDLOCKPATH) \
              -DLIKWIDSOCKETBASE=$(LIKWIDSOCKETBASE) \
+             -DLIKWIDPERSISTENTSOCKET=$(LIKWIDPERSISTENTSOCKET) \
              -DGITCOMMIT=$(GITCOMMIT) \
              -D_GNU_SOURCE
 
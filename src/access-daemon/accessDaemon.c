@@ -50,7 +50,12 @@
 #include <getopt.h>
 #include <dirent.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
 
 #include <types.h>
 #include <registers.h>
@@ -153,6 +158,12 @@ static int getBusFromSocket(const uint32_t socket, PciDevice* pcidev, int pathle
 
 static int sockfd = -1;
 static int connfd = -1; /* temporary in to make it compile */
+static int socketLinked = 0;
+static int workersStarted = 0;
+static char* serverPath = NULL;
+static int activatedSocket = 0;
+/* Owner of the requests for the lock file check, the client in shared mode */
+static uid_t clientUid = 0;
 static char* filepath;
 static const char* ident = "accessD";
 static AllowedPrototype allowed = NULL;
@@ -1343,7 +1354,7 @@ clientmem_read(AccessDataRecord *dRecord)
     dRecord->data = 0x0ULL;
 
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -1650,7 +1661,7 @@ servermem_read(AccessDataRecord *dRecord)
     dRecord->data = 0x0ULL;
 
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -1726,7 +1737,7 @@ servermem_freerun_read(AccessDataRecord *dRecord)
     dRecord->data = 0x0ULL;
 
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -1791,7 +1802,7 @@ servermem_write(AccessDataRecord *dRecord)
     dRecord->errorcode = ERR_NOERROR;
 
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -1865,7 +1876,7 @@ servermem_freerun_write(AccessDataRecord *dRecord)
     dRecord->errorcode = ERR_NOERROR;
 
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -1999,7 +2010,7 @@ msr_read(AccessDataRecord * dRecord)
     dRecord->errorcode = ERR_NOERROR;
     dRecord->data = 0;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -2040,7 +2051,7 @@ msr_write(AccessDataRecord * dRecord)
 
     dRecord->errorcode = ERR_NOERROR;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -2437,7 +2448,7 @@ pci_read(AccessDataRecord* dRecord)
     dRecord->errorcode = ERR_NOERROR;
     dRecord->data = 0;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -2526,7 +2537,7 @@ pci_write(AccessDataRecord* dRecord)
 
     dRecord->errorcode = ERR_NOERROR;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -2631,6 +2642,11 @@ static void
 stop_daemon(void)
 {
     kill_client();
+    if (socketLinked)
+    {
+        unlink(filepath);
+        socketLinked = 0;
+    }
 
     if (sockfd != -1)
     {
@@ -2816,7 +2832,7 @@ msr_read_spr(AccessDataRecord * dRecord)
     dRecord->errorcode = ERR_NOERROR;
     dRecord->data = 0;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -2850,7 +2866,7 @@ msr_write_spr(AccessDataRecord * dRecord)
 
     dRecord->errorcode = ERR_NOERROR;
 
-    if (!lock_check())
+    if (!lock_check_uid(clientUid))
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         dRecord->errorcode = ERR_LOCKED;
@@ -3554,15 +3570,804 @@ static void handle_record_spr(AccessDataRecord *record)
     }
 }
 
+static int
+transfer_records(int fd, AccessDataRecord* records, int count, int do_write)
+{
+    char* buf = (char*) records;
+    size_t len = count * sizeof(AccessDataRecord);
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t ret = (do_write ? write(fd, buf + done, len - done) : read(fd, buf + done, len - done));
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+static void
+handle_batch(int fd, AccessDataRecord* header)
+{
+    static __thread AccessDataRecord batch[ACCESS_BATCH_MAX_RECORDS];
+    uint64_t count = header->data;
+
+    if ((count == 0) || (count > ACCESS_BATCH_MAX_RECORDS))
+    {
+        /* The client streams the records right after the header, we cannot
+         * resynchronize if we do not know how many to skip */
+        syslog(LOG_ERR, "ERROR - [%s:%d] invalid batch size %llu", __FILE__, __LINE__, (unsigned long long)count);
+        stop_daemon();
+    }
+    if (transfer_records(fd, batch, count, 0) < 0)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] failed to read batch of %llu records", __FILE__, __LINE__, (unsigned long long)count);
+        stop_daemon();
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+        AccessDataRecord* record = &batch[i];
+        if ((record->type != DAEMON_READ) && (record->type != DAEMON_WRITE) && (record->type != DAEMON_CHECK))
+        {
+            syslog(LOG_ERR, "invalid daemon access type %d in batch", record->type);
+            record->errorcode = ERR_UNKNOWN;
+            continue;
+        }
+        if (!isIntelUncoreDiscovery)
+        {
+            handle_record_default(record);
+        }
+        else
+        {
+            handle_record_spr(record);
+        }
+    }
+    if (transfer_records(fd, batch, count, 1) < 0)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] write failed - %s", __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int
+receive_record(int fd, AccessDataRecord* record, int* passedfd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg = NULL;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    int ret = 0;
+
+    *passedfd = -1;
+    memset(&msg, 0, sizeof(struct msghdr));
+    iov.iov_base = record;
+    iov.iov_len = sizeof(AccessDataRecord);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (ret > 0)
+    {
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+            {
+                memcpy(passedfd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+    }
+    return ret;
+}
+
+static AccessShmChannel*
+map_shm_channel(int fd)
+{
+    struct stat st;
+    int seals = 0;
+    void* ptr = NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(AccessShmChannel))
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] shared memory channel too small", __FILE__, __LINE__);
+        return NULL;
+    }
+    /* The client must not be able to shrink the area while we work on it */
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK))
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] shared memory channel is not sealed", __FILE__, __LINE__);
+        return NULL;
+    }
+    ptr = mmap(NULL, sizeof(AccessShmChannel), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] mmap of shared memory channel failed - %s", __FILE__, __LINE__, strerror(errno));
+        return NULL;
+    }
+    return (AccessShmChannel*) ptr;
+}
+
+static void
+shm_loop(int fd, AccessShmChannel* chan)
+{
+    uint32_t seq = __atomic_load_n(&chan->req_seq, __ATOMIC_ACQUIRE);
+    while (1)
+    {
+        uint32_t cur = __atomic_load_n(&chan->req_seq, __ATOMIC_ACQUIRE);
+        if (cur == seq)
+        {
+            struct timespec timeout = {1, 0};
+            if (syscall(SYS_futex, &chan->req_seq, FUTEX_WAIT, seq, &timeout, NULL, 0) < 0 && errno == ETIMEDOUT)
+            {
+                /* The socket stays open as long as the client lives */
+                char c;
+                if (recv(fd, &c, 1, MSG_PEEK|MSG_DONTWAIT) == 0)
+                {
+                    syslog(LOG_ERR, "ERROR - [%s:%d] remote socket closed", __FILE__, __LINE__);
+                    stop_daemon();
+                }
+            }
+            continue;
+        }
+        seq = cur;
+        uint32_t count = chan->count;
+        if (count > ACCESS_BATCH_MAX_RECORDS)
+        {
+            syslog(LOG_ERR, "ERROR - [%s:%d] invalid batch size %u", __FILE__, __LINE__, count);
+            stop_daemon();
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            /* Work on a private copy, the client can modify the shared area
+             * at any time */
+            AccessDataRecord record = chan->records[i];
+            if (record.type == DAEMON_EXIT)
+            {
+                stop_daemon();
+            }
+            else if ((record.type != DAEMON_READ) && (record.type != DAEMON_WRITE) && (record.type != DAEMON_CHECK))
+            {
+                syslog(LOG_ERR, "invalid daemon access type %d in shared memory request", record.type);
+                record.errorcode = ERR_UNKNOWN;
+            }
+            else if (!isIntelUncoreDiscovery)
+            {
+                handle_record_default(&record);
+            }
+            else
+            {
+                handle_record_spr(&record);
+            }
+            chan->records[i] = record;
+        }
+        __atomic_store_n(&chan->resp_seq, seq, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &chan->resp_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+static void
+handle_shm(int fd, AccessDataRecord* record, int passedfd)
+{
+    AccessShmChannel* chan = NULL;
+    if (passedfd < 0)
+    {
+        record->errorcode = ERR_OPENFAIL;
+    }
+    else
+    {
+        chan = map_shm_channel(passedfd);
+        close(passedfd);
+        record->errorcode = (chan ? ERR_NOERROR : ERR_OPENFAIL);
+    }
+    LOG_AND_EXIT_IF_ERROR(write(fd, (void*) record, sizeof(AccessDataRecord)), write failed);
+    if (chan)
+    {
+        shm_loop(fd, chan);
+    }
+}
+
+static void
+unlink_socket(void)
+{
+    if (__sync_bool_compare_and_swap(&socketLinked, 1, 0))
+    {
+        CHECK_ERROR(unlink(filepath), unlink of socket failed);
+    }
+}
+
+static void
+pin_to_socket(int socket)
+{
+    cpu_set_t cpuset;
+    char fname[1024];
+    char buf[32];
+    CPU_ZERO(&cpuset);
+    for (int cpu = 0; cpu < avail_cpus; cpu++)
+    {
+        FILE* fp = NULL;
+        snprintf(fname, 1023, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        fp = fopen(fname, "r");
+        if (fp)
+        {
+            if (fgets(buf, sizeof(buf), fp) && atoi(buf) == socket)
+            {
+                CPU_SET(cpu, &cpuset);
+            }
+            fclose(fp);
+        }
+    }
+    if (CPU_COUNT(&cpuset) > 0)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    }
+}
+
+static void serve_client(int fd);
+
+static void*
+worker_main(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    int passedfd = -1;
+    AccessDataRecord record;
+
+    /* The first record on a worker connection names the socket it serves */
+    if (receive_record(fd, &record, &passedfd) != sizeof(AccessDataRecord) || record.type != DAEMON_WORKERS)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] invalid worker connection", __FILE__, __LINE__);
+        stop_daemon();
+    }
+    if (passedfd >= 0)
+    {
+        close(passedfd);
+    }
+    pin_to_socket(record.cpu);
+    record.errorcode = ERR_NOERROR;
+    LOG_AND_EXIT_IF_ERROR(write(fd, (void*) &record, sizeof(AccessDataRecord)), write failed);
+    serve_client(fd);
+    return NULL;
+}
+
+static void
+handle_workers(int fd, AccessDataRecord* record)
+{
+    uint64_t num = record->data;
+    struct sockaddr_un addr;
+    socklen_t socklen = sizeof(addr);
+
+    if (workersStarted || !socketLinked || (num == 0) || (num > avail_sockets))
+    {
+        record->errorcode = ERR_UNKNOWN;
+        LOG_AND_EXIT_IF_ERROR(write(fd, (void*) record, sizeof(AccessDataRecord)), write failed);
+        unlink_socket();
+        return;
+    }
+    record->errorcode = ERR_NOERROR;
+    LOG_AND_EXIT_IF_ERROR(write(fd, (void*) record, sizeof(AccessDataRecord)), write failed);
+    for (uint64_t i = 0; i < num; i++)
+    {
+        pthread_t thread;
+        int wfd = -1;
+        alarm(15U);
+        wfd = accept(sockfd, (SA*) &addr, &socklen);
+        alarm(0);
+        if (wfd < 0)
+        {
+            syslog(LOG_ERR, "ERROR - [%s:%d] accept of worker connection failed: %s", __FILE__, __LINE__, strerror(errno));
+            unlink_socket();
+            stop_daemon();
+        }
+        if (pthread_create(&thread, NULL, worker_main, (void*)(intptr_t)wfd) != 0)
+        {
+            syslog(LOG_ERR, "ERROR - [%s:%d] cannot start worker thread", __FILE__, __LINE__);
+            unlink_socket();
+            stop_daemon();
+        }
+        pthread_detach(thread);
+    }
+    workersStarted = 1;
+    unlink_socket();
+}
+
+static void
+serve_client(int fd)
+{
+    int ret = 0;
+    int passedfd = -1;
+    AccessDataRecord dRecord;
+
+    while (1)
+    {
+        ret = receive_record(fd, &dRecord, &passedfd);
+
+        if (ret < 0)
+        {
+            stop_daemon();
+        }
+        else if ((ret == 0) && (dRecord.type != DAEMON_EXIT))
+        {
+            syslog(LOG_ERR, "ERROR - [%s:%d] zero read, remote socket closed before reading", __FILE__, __LINE__);
+            stop_daemon();
+        }
+        else if (ret != sizeof(AccessDataRecord))
+        {
+            syslog(LOG_ERR, "ERROR - [%s:%d] unaligned read", __FILE__, __LINE__);
+            stop_daemon();
+        }
+
+        /* The socket file stays until the client said whether it wants
+         * additional worker connections */
+        if (dRecord.type == DAEMON_WORKERS)
+        {
+            handle_workers(fd, &dRecord);
+            continue;
+        }
+        unlink_socket();
+
+        if (dRecord.type == DAEMON_SHM)
+        {
+            handle_shm(fd, &dRecord, passedfd);
+            continue;
+        }
+        else if (passedfd >= 0)
+        {
+            close(passedfd);
+        }
+
+        if (dRecord.type == DAEMON_BATCH)
+        {
+            handle_batch(fd, &dRecord);
+            continue;
+        }
+
+        if (!isIntelUncoreDiscovery)
+        {
+            handle_record_default(&dRecord);
+        }
+        else
+        {
+            handle_record_spr(&dRecord);
+        }
+
+        LOG_AND_EXIT_IF_ERROR(write(fd, (void*) &dRecord, sizeof(AccessDataRecord)), write failed);
+    }
+}
+
+/* Multi-client server mode: all clients share one daemon. A client (process)
+ * leases every register it writes, other clients get ERR_CONFLICT when they
+ * write or read it. Free-running counters can be read by everyone. */
+
+typedef struct {
+    uint32_t device;
+    uint32_t cpu;
+    uint32_t reg;
+    pid_t owner;
+} AccessLease;
+
+typedef struct {
+    int fd;
+    pid_t pid;
+    uid_t uid;
+    uint32_t events;            /* EPOLLIN or EPOLLOUT while a reply is pending */
+    size_t have;
+    AccessDataRecord msg[ACCESS_BATCH_MAX_RECORDS + 1];
+    size_t outLen;
+    size_t outDone;
+    AccessDataRecord out[ACCESS_BATCH_MAX_RECORDS];
+} AccessClient;
+
+static AccessLease* leases = NULL;
+static uint32_t leaseSize = 0;
+static uint32_t leaseCount = 0;
+static AccessClient** clients = NULL;
+static int numClients = 0;
+
+static uint32_t
+lease_hash(uint32_t device, uint32_t cpu, uint32_t reg)
+{
+    uint32_t h = reg * 0x9E3779B1U;
+    h ^= (cpu + 0x7F4A7C15U) * 0x85EBCA6BU;
+    h ^= device * 0xC2B2AE35U;
+    return h ^ (h >> 16);
+}
+
+static AccessLease*
+lease_find(AccessLease* table, uint32_t size, uint32_t device, uint32_t cpu, uint32_t reg)
+{
+    uint32_t idx = 0;
+    if (size == 0)
+    {
+        return NULL;
+    }
+    idx = lease_hash(device, cpu, reg) & (size - 1);
+    while (table[idx].owner != 0)
+    {
+        if (table[idx].device == device && table[idx].cpu == cpu && table[idx].reg == reg)
+        {
+            return &table[idx];
+        }
+        idx = (idx + 1) & (size - 1);
+    }
+    /* Free slot for insertion */
+    return &table[idx];
+}
+
+static void
+lease_rebuild(uint32_t size, pid_t drop)
+{
+    AccessLease* table = calloc(size, sizeof(AccessLease));
+    if (!table)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] cannot allocate lease table", __FILE__, __LINE__);
+        stop_daemon();
+    }
+    leaseCount = 0;
+    for (uint32_t i = 0; i < leaseSize; i++)
+    {
+        if (leases[i].owner != 0 && leases[i].owner != drop)
+        {
+            *lease_find(table, size, leases[i].device, leases[i].cpu, leases[i].reg) = leases[i];
+            leaseCount++;
+        }
+    }
+    free(leases);
+    leases = table;
+    leaseSize = size;
+}
+
+static void
+lease_add(AccessDataRecord* record, pid_t owner)
+{
+    AccessLease* l = NULL;
+    if (2 * (leaseCount + 1) > leaseSize)
+    {
+        lease_rebuild((leaseSize ? 2 * leaseSize : 1024), 0);
+    }
+    l = lease_find(leases, leaseSize, record->device, record->cpu, record->reg);
+    if (l->owner == 0)
+    {
+        l->device = record->device;
+        l->cpu = record->cpu;
+        l->reg = record->reg;
+        l->owner = owner;
+        leaseCount++;
+    }
+}
+
+static int
+shared_read_register(AccessDataRecord* record)
+{
+    if (record->device >= MMIO_IMC_DEVICE_0_FREERUN && record->device <= MMIO_IMC_DEVICE_3_FREERUN)
+    {
+        return 1;
+    }
+    if (record->device != MSR_DEV)
+    {
+        return 0;
+    }
+    switch (record->reg)
+    {
+        case MSR_PERF_FIXED_CTR0:
+        case MSR_PERF_FIXED_CTR1:
+        case MSR_PERF_FIXED_CTR2:
+        case MSR_PERF_FIXED_CTR3:
+        case MSR_PKG_ENERGY_STATUS:
+        case MSR_PP0_ENERGY_STATUS:
+        case MSR_PP1_ENERGY_STATUS:
+        case MSR_DRAM_ENERGY_STATUS:
+        case MSR_PLATFORM_ENERGY_STATUS:
+        case MSR_AMD17_RAPL_CORE_STATUS:
+        case MSR_AMD17_RAPL_PKG_STATUS:
+        case IA32_THERM_STATUS:
+        case IA32_PACKAGE_THERM_STATUS:
+        case MSR_MPERF:
+        case MSR_APERF:
+        case MSR_PPERF:
+        case MSR_AMD17_RO_APERF:
+        case MSR_AMD17_RO_MPERF:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void
+handle_client_record(AccessClient* client, AccessDataRecord* record)
+{
+    AccessLease* l = NULL;
+    if ((record->type != DAEMON_READ) && (record->type != DAEMON_WRITE) && (record->type != DAEMON_CHECK))
+    {
+        /* No shared memory channels or worker threads for shared daemons,
+         * the clients fall back to plain requests */
+        record->errorcode = ERR_UNKNOWN;
+        return;
+    }
+    /* The daemon runs as root, the lock is checked for the client. Not all
+     * handlers check it themselves (e.g. the SPR discovery units), the
+     * single-client daemon only checks it at startup. */
+    clientUid = client->uid;
+    if (!lock_check_uid(clientUid))
+    {
+        record->errorcode = ERR_LOCKED;
+        record->data = 0x0ULL;
+        return;
+    }
+    if (record->type != DAEMON_CHECK)
+    {
+        l = lease_find(leases, leaseSize, record->device, record->cpu, record->reg);
+        if (l && l->owner != 0 && l->owner != client->pid &&
+            (record->type == DAEMON_WRITE || !shared_read_register(record)))
+        {
+            record->errorcode = ERR_CONFLICT;
+            record->data = 0x0ULL;
+            return;
+        }
+    }
+    if (!isIntelUncoreDiscovery)
+    {
+        handle_record_default(record);
+    }
+    else
+    {
+        handle_record_spr(record);
+    }
+    if (record->type == DAEMON_WRITE && record->errorcode == ERR_NOERROR)
+    {
+        lease_add(record, client->pid);
+    }
+}
+
+static void
+drop_client(int epfd, AccessClient* client)
+{
+    int others = 0;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    for (int i = 0; i < numClients; i++)
+    {
+        if (clients[i] == client)
+        {
+            clients[i] = clients[numClients-1];
+            numClients--;
+            i--;
+        }
+        else if (clients[i]->pid == client->pid)
+        {
+            others++;
+        }
+    }
+    /* Leases belong to the process, not to a single connection */
+    if (others == 0 && leaseSize > 0)
+    {
+        lease_rebuild(leaseSize, client->pid);
+    }
+    syslog(LOG_INFO, "client %d disconnected, %d clients left", client->pid, numClients);
+    free(client);
+}
+
+/* The client sockets are non-blocking. A reply that does not fit into the
+ * socket buffer is kept in the client and sent on EPOLLOUT, meanwhile no
+ * further requests of the client are handled. A client that does not read
+ * its replies only stalls itself, not the daemon.
+ * Returns 1 if the reply is still pending and -1 on errors */
+static int
+flush_client(AccessClient* client)
+{
+    char* buf = (char*) client->out;
+    while (client->outDone < client->outLen)
+    {
+        ssize_t ret = send(client->fd, buf + client->outDone, client->outLen - client->outDone, MSG_NOSIGNAL|MSG_DONTWAIT);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 1;
+        }
+        if (ret <= 0)
+        {
+            return -1;
+        }
+        client->outDone += ret;
+    }
+    client->outLen = 0;
+    client->outDone = 0;
+    return 0;
+}
+
+/* Handles the complete requests in the input buffer until a reply cannot be
+ * sent completely. Returns -1 if the client has to be dropped */
+static int
+process_client(AccessClient* client)
+{
+    size_t need = sizeof(AccessDataRecord);
+    while (client->outLen == 0 && client->have >= sizeof(AccessDataRecord))
+    {
+        AccessDataRecord* header = &client->msg[0];
+        int count = 1;
+        AccessDataRecord* records = header;
+        if (header->type == DAEMON_BATCH)
+        {
+            if (header->data == 0 || header->data > ACCESS_BATCH_MAX_RECORDS)
+            {
+                syslog(LOG_ERR, "ERROR - [%s:%d] invalid batch size from client %d", __FILE__, __LINE__, client->pid);
+                return -1;
+            }
+            count = header->data;
+            records = &client->msg[1];
+            need = (count + 1) * sizeof(AccessDataRecord);
+        }
+        if (client->have < need)
+        {
+            break;
+        }
+        if (header->type == DAEMON_EXIT)
+        {
+            return -1;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            handle_client_record(client, &records[i]);
+        }
+        memcpy(client->out, records, count * sizeof(AccessDataRecord));
+        client->outLen = count * sizeof(AccessDataRecord);
+        client->outDone = 0;
+        client->have -= need;
+        if (client->have > 0)
+        {
+            memmove(client->msg, ((char*)client->msg) + need, client->have);
+        }
+        need = sizeof(AccessDataRecord);
+        if (flush_client(client) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Returns -1 if the client has to be dropped */
+static int
+handle_client(int epfd, AccessClient* client, uint32_t events)
+{
+    struct epoll_event ev;
+    if (client->outLen > 0)
+    {
+        int ret = flush_client(client);
+        if (ret < 0)
+        {
+            return -1;
+        }
+    }
+    if (client->outLen == 0 && (events & (EPOLLIN|EPOLLHUP|EPOLLERR)))
+    {
+        ssize_t ret = recv(client->fd, ((char*)client->msg) + client->have, sizeof(client->msg) - client->have, MSG_DONTWAIT);
+        if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            return -1;
+        }
+        if (ret > 0)
+        {
+            client->have += ret;
+        }
+    }
+    if (process_client(client) < 0)
+    {
+        return -1;
+    }
+    ev.events = (client->outLen > 0 ? EPOLLOUT : EPOLLIN);
+    ev.data.ptr = client;
+    if (ev.events != client->events)
+    {
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ev) < 0)
+        {
+            return -1;
+        }
+        client->events = ev.events;
+    }
+    return 0;
+}
+
+static void
+serve_clients_epoll(void)
+{
+    struct epoll_event ev;
+    struct epoll_event events[64];
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        syslog(LOG_ERR, "ERROR - [%s:%d] epoll_create1 failed - %s", __FILE__, __LINE__, strerror(errno));
+        stop_daemon();
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    LOG_AND_EXIT_IF_ERROR(epoll_ctl(epfd, EPOLL_CTL_ADD, sockfd, &ev), epoll_ctl failed);
+
+    while (1)
+    {
+        int n = epoll_wait(epfd, events, 64, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            syslog(LOG_ERR, "ERROR - [%s:%d] epoll_wait failed - %s", __FILE__, __LINE__, strerror(errno));
+            stop_daemon();
+        }
+        for (int i = 0; i < n; i++)
+        {
+            AccessClient* client = (AccessClient*) events[i].data.ptr;
+            if (client == NULL)
+            {
+                struct ucred cred;
+                socklen_t credlen = sizeof(struct ucred);
+                AccessClient** tmp = NULL;
+                int fd = accept4(sockfd, NULL, NULL, SOCK_CLOEXEC|SOCK_NONBLOCK);
+                if (fd < 0)
+                {
+                    continue;
+                }
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) < 0)
+                {
+                    close(fd);
+                    continue;
+                }
+                client = calloc(1, sizeof(AccessClient));
+                tmp = realloc(clients, (numClients + 1) * sizeof(AccessClient*));
+                if (!client || !tmp)
+                {
+                    free(client);
+                    if (tmp)
+                    {
+                        clients = tmp;
+                    }
+                    close(fd);
+                    continue;
+                }
+                clients = tmp;
+                client->fd = fd;
+                client->pid = cred.pid;
+                client->uid = cred.uid;
+                clients[numClients++] = client;
+                client->events = EPOLLIN;
+                ev.events = EPOLLIN;
+                ev.data.ptr = client;
+                if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                {
+                    drop_client(epfd, client);
+                    continue;
+                }
+                syslog(LOG_INFO, "client %d (uid %d) connected", cred.pid, cred.uid);
+            }
+            else if (handle_client(epfd, client, events[i].events) < 0)
+            {
+                drop_client(epfd, client);
+            }
+        }
+    }
+}
+
 /* #####  MAIN FUNCTION DEFINITION   ################## */
 
-int main(void)
+int main(int argc, char** argv)
 {
     int ret;
     pid_t pid = getpid();
     struct sockaddr_un  addr1;
     socklen_t socklen;
-    AccessDataRecord dRecord;
     mode_t oldumask;
     uint32_t numHWThreads = sysconf(_SC_NPROCESSORS_CONF);
     uint32_t model;
@@ -3574,7 +4379,42 @@ int main(void)
 
     openlog(ident, 0, LOG_USER);
 
-    if (!lock_check())
+    clientUid = getuid();
+    if ((argc == 3) && (strcmp(argv[1], "-s") == 0))
+    {
+        serverPath = argv[2];
+    }
+    else if ((argc == 2) && (strcmp(argv[1], "--persistent") == 0))
+    {
+        serverPath = TOSTRING(LIKWIDPERSISTENTSOCKET);
+    }
+    else if ((getenv("LISTEN_PID") != NULL) && (atoi(getenv("LISTEN_PID")) == pid) &&
+             (getenv("LISTEN_FDS") != NULL) && (atoi(getenv("LISTEN_FDS")) >= 1))
+    {
+        /* systemd socket activation, the listening socket is the first
+         * passed file descriptor */
+        int listening = 0;
+        socklen_t len = sizeof(int);
+        if ((getsockopt(3, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0) || (!listening))
+        {
+            syslog(LOG_ERR, "Socket passed by systemd is not listening.\n");
+            exit(EXIT_FAILURE);
+        }
+        activatedSocket = 1;
+        serverPath = "systemd";
+    }
+    if (serverPath)
+    {
+        /* Only root may start a daemon that serves other users */
+        if (getuid() != 0)
+        {
+            syslog(LOG_ERR, "Only root can start a shared daemon.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* A shared daemon checks the lock for each client */
+    if (!serverPath && !lock_check())
     {
         syslog(LOG_ERR,"Access to performance counters is locked.\n");
         stop_daemon();
@@ -3761,63 +4601,107 @@ int main(void)
         }
     }
 
-    /* setup filename for socket */
-    filepath = (char*) calloc(sizeof(addr1.sun_path), 1);
-    snprintf(filepath, sizeof(addr1.sun_path), TOSTRING(LIKWIDSOCKETBASE) "-%d", pid);
-
-    /* get a socket */
-    LOG_AND_EXIT_IF_ERROR(sockfd = socket(AF_LOCAL, SOCK_STREAM, 0), socket failed);
-
-    /* initialize socket data structure */
-    bzero(&addr1, sizeof(addr1));
-    addr1.sun_family = AF_LOCAL;
-    strncpy(addr1.sun_path, filepath, (sizeof(addr1.sun_path) - 1)); /* null terminated by the bzero() above! */
-
-    /* Change the file mode mask so only the calling user has access
-     * and switch the user/gid with which the following socket creation runs. */
-    oldumask = umask(077);
-    CHECK_ERROR(setfsuid(getuid()), setfsuid failed);
-
-    /* bind and listen on socket */
-    LOG_AND_EXIT_IF_ERROR(bind(sockfd, (SA*) &addr1, sizeof(addr1)), bind failed);
-    LOG_AND_EXIT_IF_ERROR(listen(sockfd, 1), listen failed);
-    LOG_AND_EXIT_IF_ERROR(chmod(filepath, S_IRUSR|S_IWUSR), chmod failed);
-
-    socklen = sizeof(addr1);
-
-    { /* Init signal handler */
-        struct sigaction sia;
-        sia.sa_handler = Signal_Handler;
-        sigemptyset(&sia.sa_mask);
-        sia.sa_flags = 0;
-        sigaction(SIGALRM, &sia, NULL);
-        sigaction(SIGPIPE, &sia, NULL);
-        sigaction(SIGTERM, &sia, NULL);
-    }
-
-    /* setup an alarm to stop the daemon if there is no connect.*/
-    alarm(15U);
-
-    if ((connfd = accept(sockfd, (SA*) &addr1, &socklen)) < 0)
+    if (activatedSocket)
     {
-        if (errno == EINTR)
+        /* systemd owns the socket file */
+        sockfd = 3;
+        fcntl(sockfd, F_SETFD, FD_CLOEXEC);
         {
-            syslog(LOG_ERR, "exiting due to timeout - no client connected after 15 seconds.");
+            struct sigaction sia;
+            sia.sa_handler = Signal_Handler;
+            sigemptyset(&sia.sa_mask);
+            sia.sa_flags = 0;
+            sigaction(SIGTERM, &sia, NULL);
+            sia.sa_handler = SIG_IGN;
+            sigaction(SIGPIPE, &sia, NULL);
         }
-        else
+    }
+    else if (serverPath)
+    {
+        /* Persistent daemon shared by all users, the socket is accessible
+         * for everyone like the setuid daemon itself */
+        filepath = (char*) calloc(sizeof(addr1.sun_path), 1);
+        strncpy(filepath, serverPath, sizeof(addr1.sun_path) - 1);
+        LOG_AND_EXIT_IF_ERROR(sockfd = socket(AF_LOCAL, SOCK_STREAM|SOCK_CLOEXEC, 0), socket failed);
+        bzero(&addr1, sizeof(addr1));
+        addr1.sun_family = AF_LOCAL;
+        strncpy(addr1.sun_path, filepath, (sizeof(addr1.sun_path) - 1));
+        unlink(filepath);
+        LOG_AND_EXIT_IF_ERROR(bind(sockfd, (SA*) &addr1, sizeof(addr1)), bind failed);
+        LOG_AND_EXIT_IF_ERROR(listen(sockfd, SOMAXCONN), listen failed);
+        LOG_AND_EXIT_IF_ERROR(chmod(filepath, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH), chmod failed);
+        socketLinked = 1;
         {
-            syslog(LOG_ERR, "accept() failed:  %s", strerror(errno));
+            struct sigaction sia;
+            sia.sa_handler = Signal_Handler;
+            sigemptyset(&sia.sa_mask);
+            sia.sa_flags = 0;
+            sigaction(SIGTERM, &sia, NULL);
+            sia.sa_handler = SIG_IGN;
+            sigaction(SIGPIPE, &sia, NULL);
         }
-        CHECK_ERROR(unlink(filepath), unlink of socket failed);
-        exit(EXIT_FAILURE);
     }
+    else
+    {
+        /* setup filename for socket */
+        filepath = (char*) calloc(sizeof(addr1.sun_path), 1);
+        snprintf(filepath, sizeof(addr1.sun_path), TOSTRING(LIKWIDSOCKETBASE) "-%d", pid);
+
+        /* get a socket */
+        LOG_AND_EXIT_IF_ERROR(sockfd = socket(AF_LOCAL, SOCK_STREAM, 0), socket failed);
+
+        /* initialize socket data structure */
+        bzero(&addr1, sizeof(addr1));
+        addr1.sun_family = AF_LOCAL;
+        strncpy(addr1.sun_path, filepath, (sizeof(addr1.sun_path) - 1)); /* null terminated by the bzero() above! */
+
+        /* Change the file mode mask so only the calling user has access
+         * and switch the user/gid with which the following socket creation runs. */
+        oldumask = umask(077);
+        CHECK_ERROR(setfsuid(getuid()), setfsuid failed);
+
+        /* bind and listen on socket */
+        LOG_AND_EXIT_IF_ERROR(bind(sockfd, (SA*) &addr1, sizeof(addr1)), bind failed);
+        LOG_AND_EXIT_IF_ERROR(listen(sockfd, 1), listen failed);
+        LOG_AND_EXIT_IF_ERROR(chmod(filepath, S_IRUSR|S_IWUSR), chmod failed);
+
+        socklen = sizeof(addr1);
+
+        { /* Init signal handler */
+            struct sigaction sia;
+            sia.sa_handler = Signal_Handler;
+            sigemptyset(&sia.sa_mask);
+            sia.sa_flags = 0;
+            sigaction(SIGALRM, &sia, NULL);
+            sigaction(SIGPIPE, &sia, NULL);
+            sigaction(SIGTERM, &sia, NULL);
+        }
+
+        /* setup an alarm to stop the daemon if there is no connect.*/
+        alarm(15U);
 
-    alarm(0);
-    CHECK_ERROR(unlink(filepath), unlink of socket failed);
+        if ((connfd = accept(sockfd, (SA*) &addr1, &socklen)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                syslog(LOG_ERR, "exiting due to timeout - no client connected after 15 seconds.");
+            }
+            else
+            {
+                syslog(LOG_ERR, "accept() failed:  %s", strerror(errno));
+            }
+            CHECK_ERROR(unlink(filepath), unlink of socket failed);
+            exit(EXIT_FAILURE);
+        }
 
-    /* Restore the old umask and fs ids. */
-    (void) umask(oldumask);
-    CHECK_ERROR(setfsuid(geteuid()), setfsuid failed);
+        alarm(0);
+        /* The socket file is removed with the first request, see serve_client() */
+        socketLinked = 1;
+
+        /* Restore the old umask and fs ids. */
+        (void) umask(oldumask);
+        CHECK_ERROR(setfsuid(geteuid()), setfsuid failed);
+    }
 
     {
         char* msr_file_name = (char*) malloc(MAX_PATH_LENGTH * sizeof(char));
@@ -3954,36 +4838,11 @@ int main(void)
         }
     }
 LOOP:
-    while (1)
+    if (serverPath)
     {
-        ret = read(connfd, (void*) &dRecord, sizeof(AccessDataRecord));
-
-        if (ret < 0)
-        {
-            stop_daemon();
-        }
-        else if ((ret == 0) && (dRecord.type != DAEMON_EXIT))
-        {
-            syslog(LOG_ERR, "ERROR - [%s:%d] zero read, remote socket closed before reading", __FILE__, __LINE__);
-            stop_daemon();
-        }
-        else if (ret != sizeof(AccessDataRecord))
-        {
-            syslog(LOG_ERR, "ERROR - [%s:%d] unaligned read", __FILE__, __LINE__);
-            stop_daemon();
-        }
-
-        if (!isIntelUncoreDiscovery)
-        {
-            handle_record_default(&dRecord);
-        }
-        else
-        {
-            handle_record_spr(&dRecord);
-        }
-
-        LOG_AND_EXIT_IF_ERROR(write(connfd, (void*) &dRecord, sizeof(AccessDataRecord)), write failed);
+        serve_clients_epoll();
     }
+    serve_client(connfd);
 
     /* never reached */
     return EXIT_SUCCESS;
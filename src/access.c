@@ -63,6 +63,69 @@ static int (*access_write)(PciDeviceIndex dev, const int cpu, uint32_t reg, uint
 static int (*access_init) (int cpu_id) = NULL;
 static void (*access_finalize) (int cpu_id) = NULL;
 static int (*access_check) (PciDeviceIndex dev, int cpu_id) = NULL;
+static int (*access_batch) (const int cpu_id, AccessDataRecord* records, int count) = NULL;
+
+typedef struct {
+    int count;
+    int size;
+    int cursor;
+    AccessDataRecord* records;
+} HPMPrefetchCache;
+
+static HPMPrefetchCache* prefetchCache = NULL;
+
+/* #####   FUNCTION DEFINITIONS  -  LOCAL TO THIS SOURCE FILE   ########### */
+
+static void
+HPMallocCpuLists(void)
+{
+    if (registeredCpuList == NULL)
+    {
+        registeredCpuList = malloc(cpuid_topology.numHWThreads* sizeof(int));
+        memset(registeredCpuList, 0, cpuid_topology.numHWThreads* sizeof(int));
+        registeredCpus = 0;
+    }
+    if (prefetchCache == NULL)
+    {
+        prefetchCache = calloc(cpuid_topology.numHWThreads, sizeof(HPMPrefetchCache));
+    }
+}
+
+static int
+HPMprefetchLookup(int cpu_id, PciDeviceIndex dev, uint32_t reg, uint64_t* data)
+{
+    HPMPrefetchCache* cache = &prefetchCache[cpu_id];
+    /* The readers mostly request the registers in the order they were
+     * prefetched, so start searching at the last hit */
+    for (int i = 0; i < cache->count; i++)
+    {
+        int idx = (cache->cursor + i) % cache->count;
+        AccessDataRecord* rec = &cache->records[idx];
+        if (rec->device == dev && rec->reg == reg)
+        {
+            *data = rec->data;
+            /* Each prefetched value is handed out once, a second read goes
+             * to the hardware again */
+            rec->device = MAX_NUM_PCI_DEVICES;
+            cache->cursor = (idx + 1) % cache->count;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static void
+HPMprefetchInvalidate(int cpu_id, PciDeviceIndex dev, uint32_t reg)
+{
+    HPMPrefetchCache* cache = &prefetchCache[cpu_id];
+    for (int i = 0; i < cache->count; i++)
+    {
+        if (cache->records[i].device == dev && cache->records[i].reg == reg)
+        {
+            cache->records[i].device = MAX_NUM_PCI_DEVICES;
+        }
+    }
+}
 
 /* #####   FUNCTION DEFINITIONS  -  EXPORTED FUNCTIONS   ################## */
 
@@ -80,12 +143,7 @@ HPMinit(void)
 {
     int ret = 0;
     topology_init();
-    if (registeredCpuList == NULL)
-    {
-        registeredCpuList = malloc(cpuid_topology.numHWThreads* sizeof(int));
-        memset(registeredCpuList, 0, cpuid_topology.numHWThreads* sizeof(int));
-        registeredCpus = 0;
-    }
+    HPMallocCpuLists();
     if (access_init == NULL)
     {
 #if defined(__x86_64__) || defined(__i386__)
@@ -101,6 +159,7 @@ HPMinit(void)
             access_write = &access_client_write;
             access_finalize = &access_client_finalize;
             access_check = &access_client_check;
+            access_batch = &access_client_batch;
         }
         else if (config.daemonMode == ACCESSMODE_DIRECT)
         {
@@ -127,12 +186,7 @@ int
 HPMaddThread(int cpu_id)
 {
     int ret;
-    if (registeredCpuList == NULL)
-    {
-        registeredCpuList = malloc(cpuid_topology.numHWThreads* sizeof(int));
-        memset(registeredCpuList, 0, cpuid_topology.numHWThreads* sizeof(int));
-        registeredCpus = 0;
-    }
+    HPMallocCpuLists();
     if (registeredCpuList[cpu_id] == 0)
     {
         if (access_init != NULL)
@@ -177,6 +231,15 @@ HPMfinalize()
         registeredCpuList = NULL;
         registeredCpus = 0;
     }
+    if (prefetchCache)
+    {
+        for (int i = 0; i < cpuid_topology.numHWThreads; i++)
+        {
+            free(prefetchCache[i].records);
+        }
+        free(prefetchCache);
+        prefetchCache = NULL;
+    }
     if (access_init != NULL)
         access_init = NULL;
     if (access_finalize != NULL)
@@ -187,6 +250,8 @@ HPMfinalize()
         access_write = NULL;
     if (access_check != NULL)
         access_check = NULL;
+    if (access_batch != NULL)
+        access_batch = NULL;
     return;
 }
 
@@ -208,6 +273,11 @@ HPMread(int cpu_id, PciDeviceIndex dev, uint32_t reg, uint64_t* data)
     {
         return -ENODEV;
     }
+    if (prefetchCache[cpu_id].count > 0 && HPMprefetchLookup(cpu_id, dev, reg, &tmp) == 0)
+    {
+        *data = tmp;
+        return 0;
+    }
     err = access_read(dev, cpu_id, reg, &tmp);
     *data = tmp;
     return err;
@@ -230,10 +300,155 @@ HPMwrite(int cpu_id, PciDeviceIndex dev, uint32_t reg, uint64_t data)
     {
         return -ENODEV;
     }
+    if (prefetchCache[cpu_id].count > 0)
+    {
+        HPMprefetchInvalidate(cpu_id, dev, reg);
+    }
     err = access_write(dev, cpu_id, reg, data);
     return err;
 }
 
+int
+HPMbatch(int cpu_id, AccessDataRecord* records, int count)
+{
+    if ((records == NULL) || (count < 0))
+    {
+        return -EFAULT;
+    }
+    if ((cpu_id < 0) || (cpu_id >= cpuid_topology.numHWThreads))
+    {
+        return -ERANGE;
+    }
+    if (registeredCpuList[cpu_id] == 0)
+    {
+        return -ENODEV;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (records[i].device >= MAX_NUM_PCI_DEVICES)
+        {
+            return -EFAULT;
+        }
+    }
+    if (count == 0)
+    {
+        return 0;
+    }
+    if (access_batch)
+    {
+        return access_batch(cpu_id, records, count);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int err = 0;
+        switch (records[i].type)
+        {
+            case DAEMON_READ:
+                err = HPMread(cpu_id, records[i].device, records[i].reg, &records[i].data);
+                break;
+            case DAEMON_WRITE:
+                err = HPMwrite(cpu_id, records[i].device, records[i].reg, records[i].data);
+                break;
+            case DAEMON_CHECK:
+                err = (HPMcheck(records[i].device, cpu_id) == 1 ? 0 : -ENODEV);
+                break;
+            default:
+                records[i].errorcode = ERR_UNKNOWN;
+                continue;
+        }
+        records[i].errorcode = (err == 0 ? ERR_NOERROR : ERR_RWFAIL);
+    }
+    return 0;
+}
+
+/* Returns the prefetch buffer of the CPU with space for count records, the
+ * caller fills it and passes it to HPMprefetch(). Returns NULL if batching is
+ * not available, then there is nothing to prefetch. */
+AccessDataRecord*
+HPMprefetchBuffer(int cpu_id, int count)
+{
+    HPMPrefetchCache* cache = NULL;
+    /* Only the access daemon gains from batching, direct accesses are
+     * single syscalls anyway */
+    if ((access_batch == NULL) || (count <= 0))
+    {
+        return NULL;
+    }
+    if ((cpu_id < 0) || (cpu_id >= cpuid_topology.numHWThreads) || (registeredCpuList[cpu_id] == 0))
+    {
+        return NULL;
+    }
+    cache = &prefetchCache[cpu_id];
+    cache->count = 0;
+    cache->cursor = 0;
+    if (count > cache->size)
+    {
+        AccessDataRecord* tmp = realloc(cache->records, count * sizeof(AccessDataRecord));
+        if (!tmp)
+        {
+            return NULL;
+        }
+        cache->records = tmp;
+        cache->size = count;
+    }
+    return cache->records;
+}
+
+int
+HPMprefetch(int cpu_id, AccessDataRecord* records, int count)
+{
+    int err = 0;
+    HPMPrefetchCache* cache = NULL;
+    if ((access_batch == NULL) || (count <= 0))
+    {
+        return 0;
+    }
+    if ((cpu_id < 0) || (cpu_id >= cpuid_topology.numHWThreads) || (registeredCpuList[cpu_id] == 0))
+    {
+        return -ENODEV;
+    }
+    cache = &prefetchCache[cpu_id];
+    if (records != cache->records)
+    {
+        if (HPMprefetchBuffer(cpu_id, count) == NULL)
+        {
+            return -ENOMEM;
+        }
+        memcpy(cache->records, records, count * sizeof(AccessDataRecord));
+    }
+    cache->count = 0;
+    cache->cursor = 0;
+    for (int i = 0; i < count; i++)
+    {
+        cache->records[i].type = DAEMON_READ;
+    }
+    err = HPMbatch(cpu_id, cache->records, count);
+    if (err < 0)
+    {
+        return err;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (cache->records[i].errorcode != ERR_NOERROR)
+        {
+            /* Failed reads are retried by HPMread to get the proper error */
+            cache->records[i].device = MAX_NUM_PCI_DEVICES;
+        }
+    }
+    cache->count = count;
+    return 0;
+}
+
+void
+HPMprefetchClear(int cpu_id)
+{
+    if (prefetchCache && (cpu_id >= 0) && (cpu_id < cpuid_topology.numHWThreads))
+    {
+        prefetchCache[cpu_id].count = 0;
+        prefetchCache[cpu_id].cursor = 0;
+    }
+}
+
 int
 HPMcheck(PciDeviceIndex dev, int cpu_id)
 {
@@ -42,8 +42,13 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <sys/syscall.h>
+#include <linux/futex.h>
+#include <errno.h>
+#include <poll.h>
 
 #include <types.h>
 #include <error.h>
@@ -65,6 +70,13 @@ static int globalSocket = -1;
 static pid_t masterPid = 0;
 static int cpuSockets_open = 0;
 static int *cpuSockets = NULL;
+static AccessShmChannel **cpuShm = NULL;
+static AccessShmChannel *globalShm = NULL;
+static int sharedDaemon = -1;
+static int numWorkerSockets = 0;
+static int *workerSockets = NULL;
+static AccessShmChannel **workerShm = NULL;
+static pthread_mutex_t *workerLocks = NULL;
 static int nr_daemons = 0;
 static pid_t *daemon_pids = NULL;
 static int *daemon_pinned = NULL;
@@ -87,6 +99,7 @@ access_client_strerror(AccessErrorType det)
         case ERR_DAEMONBUSY: return "daemon already has a same/higher priority client";
         case ERR_NODEV:      return "no such pci device";
         case ERR_LOCKED:     return "access to registers is locked";
+        case ERR_CONFLICT:   return "register is in use by another client of the daemon";
         default:             return "UNKNOWN errorcode";
     }
 }
@@ -103,6 +116,7 @@ access_client_errno(AccessErrorType det)
         case ERR_RWFAIL:     return -EIO;
         case ERR_DAEMONBUSY: return -EBUSY;
         case ERR_NODEV:      return -ENODEV;
+        case ERR_CONFLICT:   return -EBUSY;
         default:             return -EFAULT;
     }
 }
@@ -122,23 +136,345 @@ access_client_catch_signal()
     return 0;
 }
 
+static AccessShmChannel*
+access_client_shm_setup(int socket_fd)
+{
+    int fd = -1;
+    AccessShmChannel* chan = NULL;
+    AccessDataRecord record;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg = NULL;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+
+    fd = memfd_create("likwid-access", MFD_CLOEXEC|MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Cannot create shared memory channel: %s, strerror(errno));
+        return NULL;
+    }
+    if ((ftruncate(fd, sizeof(AccessShmChannel)) < 0) ||
+        (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL) < 0))
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Cannot prepare shared memory channel: %s, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    chan = mmap(NULL, sizeof(AccessShmChannel), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (chan == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    memset(chan, 0, sizeof(AccessShmChannel));
+
+    memset(&record, 0, sizeof(AccessDataRecord));
+    record.type = DAEMON_SHM;
+    record.errorcode = ERR_OPENFAIL;
+    memset(&msg, 0, sizeof(struct msghdr));
+    memset(&ctrl, 0, sizeof(ctrl));
+    iov.iov_base = &record;
+    iov.iov_len = sizeof(AccessDataRecord);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    if ((sendmsg(socket_fd, &msg, 0) != sizeof(AccessDataRecord)) ||
+        (read(socket_fd, &record, sizeof(AccessDataRecord)) != sizeof(AccessDataRecord)) ||
+        (record.errorcode != ERR_NOERROR))
+    {
+        /* Older daemons answer with ERR_UNKNOWN, keep using the socket */
+        DEBUG_PRINT(DEBUGLEV_INFO, Access daemon does not support shared memory channels);
+        munmap(chan, sizeof(AccessShmChannel));
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    return chan;
+}
+
 static int
-access_client_startDaemon(int cpu_id)
+access_client_shm_transfer(int socket, AccessShmChannel* chan, AccessDataRecord* records, int count, int wait)
+{
+    for (int off = 0; off < count; off += ACCESS_BATCH_MAX_RECORDS)
+    {
+        int num = count - off;
+        uint32_t seq = 0;
+        if (num > ACCESS_BATCH_MAX_RECORDS)
+        {
+            num = ACCESS_BATCH_MAX_RECORDS;
+        }
+        memcpy(chan->records, &records[off], num * sizeof(AccessDataRecord));
+        chan->count = num;
+        seq = chan->req_seq + 1;
+        __atomic_store_n(&chan->req_seq, seq, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &chan->req_seq, FUTEX_WAKE, 1, NULL, NULL, 0);
+        if (!wait)
+        {
+            continue;
+        }
+        while (1)
+        {
+            uint32_t cur = __atomic_load_n(&chan->resp_seq, __ATOMIC_ACQUIRE);
+            struct timespec timeout = {1, 0};
+            if (cur == seq)
+            {
+                break;
+            }
+            if (syscall(SYS_futex, &chan->resp_seq, FUTEX_WAIT, cur, &timeout, NULL, 0) < 0 && errno == ETIMEDOUT)
+            {
+                /* The daemon closes the socket when it terminates */
+                struct pollfd pfd = {socket, POLLIN, 0};
+                if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP|POLLERR)))
+                {
+                    ERROR_PRINT(Access daemon terminated);
+                    return -EBADFD;
+                }
+            }
+        }
+        memcpy(&records[off], chan->records, num * sizeof(AccessDataRecord));
+    }
+    return 0;
+}
+
+static int
+access_client_connect(const char* path, int cpu_id)
 {
-    /* Check the function of the daemon here */
     int res = 0;
     char* filepath;
+    struct sockaddr_un address;
+    size_t address_length;
+    int timeout = 1000;
+    int socket_fd = -1;
+
+    socket_fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    if (socket_fd < 0)
+    {
+        ERROR_PRINT(socket() failed);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_LOCAL;
+    address_length = sizeof(address);
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    filepath = strdup(address.sun_path);
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Waiting for socket file %s, address.sun_path);
+    while (access(address.sun_path, F_OK) && timeout > 0)
+    {
+        usleep(2500);
+        timeout--;
+    }
+    if (!access(address.sun_path, F_OK))
+    {
+        DEBUG_PRINT(DEBUGLEV_DEVELOP, Socket file %s exists, address.sun_path);
+    }
+    timeout = 1000;
+
+    res = connect(socket_fd, (struct sockaddr *) &address, address_length);
+    while (res && timeout > 0)
+    {
+        usleep(2500);
+        res = connect(socket_fd, (struct sockaddr *) &address, address_length);
+
+        if (res == 0)
+        {
+            break;
+        }
+
+        timeout--;
+        DEBUG_PRINT(DEBUGLEV_INFO, Still waiting for socket %s for CPU %d..., filepath, cpu_id);
+    }
+
+    if (timeout <= 0)
+    {
+        ERRNO_PRINT;  /* should hopefully still work, as we make no syscalls in between. */
+        fprintf(stderr, "Exiting due to timeout: The socket file at '%s' could not be\n", filepath);
+        fprintf(stderr, "opened within 10 seconds. Consult the error message above\n");
+        fprintf(stderr, "this to find out why. If the error is 'no such file or directoy',\n");
+        fprintf(stderr, "it usually means that likwid-accessD just failed to start.\n");
+        free(filepath);
+        close(socket_fd);
+        return -1;
+    }
+    DEBUG_PRINT(DEBUGLEV_INFO, Successfully opened socket %s to daemon for CPU %d, filepath, cpu_id);
+    free(filepath);
+    return socket_fd;
+}
+
+static int
+access_client_connectPersistent(int cpu_id)
+{
+    struct sockaddr_un address;
+    struct stat stats;
+    struct ucred cred;
+    socklen_t credlen = sizeof(struct ucred);
+    int socket_fd = -1;
+
+    /* Only a socket created by root belongs to a daemon that enforces the
+     * lock and the allow-lists for every client. There is nothing to wait
+     * for, the daemon is either running or we start our own. */
+    if (stat(TOSTRING(LIKWIDPERSISTENTSOCKET), &stats) < 0)
+    {
+        return -1;
+    }
+    if ((!S_ISSOCK(stats.st_mode)) || (stats.st_uid != 0))
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Ignoring socket %s not owned by root, TOSTRING(LIKWIDPERSISTENTSOCKET));
+        return -1;
+    }
+    socket_fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    if (socket_fd < 0)
+    {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_LOCAL;
+    strncpy(address.sun_path, TOSTRING(LIKWIDPERSISTENTSOCKET), sizeof(address.sun_path) - 1);
+    if ((connect(socket_fd, (struct sockaddr *) &address, sizeof(address)) < 0) ||
+        (getsockopt(socket_fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) < 0) ||
+        (cred.uid != 0))
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Cannot use persistent daemon at %s, TOSTRING(LIKWIDPERSISTENTSOCKET));
+        close(socket_fd);
+        return -1;
+    }
+    DEBUG_PRINT(DEBUGLEV_INFO, Using persistent daemon at %s for CPU %d, TOSTRING(LIKWIDPERSISTENTSOCKET), cpu_id);
+    return socket_fd;
+}
+
+static int
+access_client_useShm(void)
+{
+    return ((getenv("LIKWID_ACCESS_SHM") != NULL) && (atoi(getenv("LIKWID_ACCESS_SHM")) > 0));
+}
+
+static void
+access_client_stopWorkers(void)
+{
+    for (int i = 0; i < numWorkerSockets; i++)
+    {
+        if (workerShm[i])
+        {
+            munmap(workerShm[i], sizeof(AccessShmChannel));
+        }
+        if (workerSockets[i] >= 0)
+        {
+            close(workerSockets[i]);
+        }
+        pthread_mutex_destroy(&workerLocks[i]);
+    }
+    free(workerSockets);
+    workerSockets = NULL;
+    free(workerShm);
+    workerShm = NULL;
+    free(workerLocks);
+    workerLocks = NULL;
+    numWorkerSockets = 0;
+}
+
+static int
+access_client_startWorkers(int socket_fd, const char* path, int cpu_id)
+{
+    int num = cpuid_topology.numSockets;
+    AccessDataRecord record;
+
+    memset(&record, 0, sizeof(AccessDataRecord));
+    record.type = DAEMON_WORKERS;
+    record.data = num;
+    record.errorcode = ERR_OPENFAIL;
+    if ((write(socket_fd, &record, sizeof(AccessDataRecord)) != sizeof(AccessDataRecord)) ||
+        (read(socket_fd, &record, sizeof(AccessDataRecord)) != sizeof(AccessDataRecord)) ||
+        (record.errorcode != ERR_NOERROR))
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Access daemon does not support worker threads);
+        return -ENOTSUP;
+    }
+    workerSockets = malloc(num * sizeof(int));
+    workerShm = calloc(num, sizeof(AccessShmChannel*));
+    workerLocks = malloc(num * sizeof(pthread_mutex_t));
+    if (!workerSockets || !workerShm || !workerLocks)
+    {
+        free(workerSockets);
+        free(workerShm);
+        free(workerLocks);
+        workerSockets = NULL;
+        workerShm = NULL;
+        workerLocks = NULL;
+        return -ENOMEM;
+    }
+    for (int i = 0; i < num; i++)
+    {
+        workerSockets[i] = -1;
+        pthread_mutex_init(&workerLocks[i], NULL);
+    }
+    /* The daemon waits for all connections, so errors are fatal here */
+    numWorkerSockets = num;
+    for (int i = 0; i < num; i++)
+    {
+        workerSockets[i] = access_client_connect(path, cpu_id);
+        if (workerSockets[i] < 0)
+        {
+            access_client_stopWorkers();
+            return -EBADFD;
+        }
+        memset(&record, 0, sizeof(AccessDataRecord));
+        record.type = DAEMON_WORKERS;
+        record.cpu = i;
+        record.errorcode = ERR_OPENFAIL;
+        if ((write(workerSockets[i], &record, sizeof(AccessDataRecord)) != sizeof(AccessDataRecord)) ||
+            (read(workerSockets[i], &record, sizeof(AccessDataRecord)) != sizeof(AccessDataRecord)) ||
+            (record.errorcode != ERR_NOERROR))
+        {
+            access_client_stopWorkers();
+            return -EBADFD;
+        }
+        if (access_client_useShm())
+        {
+            workerShm[i] = access_client_shm_setup(workerSockets[i]);
+        }
+    }
+    DEBUG_PRINT(DEBUGLEV_INFO, Using %d worker connections to the access daemon, num);
+    return 0;
+}
+
+static int
+access_client_startDaemon(int cpu_id)
+{
+    /* Check the function of the daemon here */
     char *newargv[] = { NULL };
     char *newenv[] = { NULL };
     char *safeexeprog = TOSTRING(ACCESSDAEMON);
     char exeprog[1024];
-    struct sockaddr_un address;
-    size_t address_length;
+    char sockpath[sizeof(((struct sockaddr_un*)0)->sun_path)];
     int  ret;
     pid_t pid;
-    int timeout = 1000;
     int socket_fd = -1;
-    int print_once = 0;
+
+    if (getenv("LIKWID_ACCESS_SOCKET") != NULL)
+    {
+        /* Connect to a running shared daemon instead of starting our own */
+        socket_fd = access_client_connect(getenv("LIKWID_ACCESS_SOCKET"), cpu_id);
+        if ((socket_fd >= 0) && access_client_useShm())
+        {
+            cpuShm[cpu_id] = access_client_shm_setup(socket_fd);
+        }
+        return socket_fd;
+    }
+    socket_fd = access_client_connectPersistent(cpu_id);
+    if (socket_fd >= 0)
+    {
+        return socket_fd;
+    }
 
     if (config.daemonPath != NULL)
     {
@@ -183,60 +519,87 @@ access_client_startDaemon(int cpu_id)
         return pid;
     }
 
-    socket_fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+    snprintf(sockpath, sizeof(sockpath), TOSTRING(LIKWIDSOCKETBASE) "-%d", pid);
+    socket_fd = access_client_connect(sockpath, cpu_id);
     if (socket_fd < 0)
     {
-        ERROR_PRINT(socket() failed);
         return -1;
     }
-
-    address.sun_family = AF_LOCAL;
-    address_length = sizeof(address);
-    snprintf(address.sun_path, sizeof(address.sun_path), TOSTRING(LIKWIDSOCKETBASE) "-%d", pid);
-    filepath = strdup(address.sun_path);
-    DEBUG_PRINT(DEBUGLEV_DEVELOP, Waiting for socket file %s, address.sun_path);
-    while (access(address.sun_path, F_OK) && timeout > 0)
+    daemon_pids[cpu_id] = pid;
+    nr_daemons++;
+    if (sharedDaemon == 1)
     {
-        usleep(2500);
-        timeout--;
+        /* Must be the first request, the daemon removes the socket file
+         * afterwards */
+        if (access_client_startWorkers(socket_fd, sockpath, cpu_id) < 0)
+        {
+            sharedDaemon = 0;
+        }
     }
-    if (!access(address.sun_path, F_OK))
+    if (access_client_useShm())
     {
-        DEBUG_PRINT(DEBUGLEV_DEVELOP, Socket file %s exists, address.sun_path);
+        cpuShm[cpu_id] = access_client_shm_setup(socket_fd);
+        if (cpuShm[cpu_id])
+        {
+            DEBUG_PRINT(DEBUGLEV_INFO, Using shared memory channel to daemon for CPU %d, cpu_id);
+        }
     }
-    timeout = 1000;
+    return socket_fd;
+}
 
-    res = connect(socket_fd, (struct sockaddr *) &address, address_length);
-    while (res && timeout > 0)
+static int
+access_client_socket(const int cpu_id, pthread_mutex_t** lockptr, AccessShmChannel** chan)
+{
+    int socket = globalSocket;
+    *lockptr = &globalLock;
+    *chan = globalShm;
+    if (numWorkerSockets > 0)
     {
-        usleep(2500);
-        res = connect(socket_fd, (struct sockaddr *) &address, address_length);
-
-        if (res == 0)
+        int sock = affinity_thread2socket_lookup[cpu_id];
+        if ((sock >= 0) && (sock < numWorkerSockets))
         {
-            break;
+            *lockptr = &workerLocks[sock];
+            *chan = workerShm[sock];
+            return workerSockets[sock];
         }
-
-        timeout--;
-        DEBUG_PRINT(DEBUGLEV_INFO, Still waiting for socket %s for CPU %d..., filepath, cpu_id);
+        return socket;
+    }
+    if (cpuSockets[cpu_id] < 0 && gettid() != masterPid)
+    {
+        pthread_mutex_lock(&cpuLocks[cpu_id]);
+        cpuSockets[cpu_id] = access_client_startDaemon(cpu_id);
+        cpuSockets_open++;
+        /* Connections to a shared or persistent daemon have no private
+         * daemon process, sched_setaffinity(0) would pin the caller */
+        if (!daemon_pinned[cpu_id] && daemon_pids[cpu_id] != 0)
+        {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(cpu_id, &cpuset);
+            DEBUG_PRINT(DEBUGLEV_INFO, Pinning daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
+            sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
+            daemon_pinned[cpu_id] = 1;
+        }
+        pthread_mutex_unlock(&cpuLocks[cpu_id]);
+    }
+    else if (cpuSockets[cpu_id] > 0 && gettid() == masterPid &&
+             cpuSockets_open > 1 && !daemon_pinned[cpu_id] && daemon_pids[cpu_id] != 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_id, &cpuset);
+        DEBUG_PRINT(DEBUGLEV_INFO, Pinning master daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
+        sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
+        daemon_pinned[cpu_id] = 1;
     }
 
-    if (timeout <= 0)
+    if ((cpuSockets[cpu_id] >= 0) && (cpuSockets[cpu_id] != globalSocket))
     {
-        ERRNO_PRINT;  /* should hopefully still work, as we make no syscalls in between. */
-        fprintf(stderr, "Exiting due to timeout: The socket file at '%s' could not be\n", filepath);
-        fprintf(stderr, "opened within 10 seconds. Consult the error message above\n");
-        fprintf(stderr, "this to find out why. If the error is 'no such file or directoy',\n");
-        fprintf(stderr, "it usually means that likwid-accessD just failed to start.\n");
-        free(filepath);
-        close(socket_fd);
-        return -1;
+        socket = cpuSockets[cpu_id];
+        *lockptr = &cpuLocks[cpu_id];
+        *chan = cpuShm[cpu_id];
     }
-    DEBUG_PRINT(DEBUGLEV_INFO, Successfully opened socket %s to daemon for CPU %d, filepath, cpu_id);
-    free(filepath);
-    daemon_pids[cpu_id] = pid;
-    nr_daemons++;
-    return socket_fd;
+    return socket;
 }
 
 /* #####   FUNCTION DEFINITIONS  -  EXPORTED FUNCTIONS   ################## */
@@ -251,6 +614,7 @@ access_client_init(int cpu_id)
     {
         cpuSockets = malloc(cpuid_topology.numHWThreads * sizeof(int));
         memset(cpuSockets, -1, cpuid_topology.numHWThreads * sizeof(int));
+        cpuShm = calloc(cpuid_topology.numHWThreads, sizeof(AccessShmChannel*));
     }
     if (!daemon_pids)
     {
@@ -270,10 +634,20 @@ access_client_init(int cpu_id)
 #if defined(__x86_64__) || defined(__i386__)
     access_x86_rdpmc_init(cpu_id);
 #endif
+    if (sharedDaemon < 0)
+    {
+        sharedDaemon = ((getenv("LIKWID_ACCESS_SHARED_DAEMON") != NULL) &&
+                        (atoi(getenv("LIKWID_ACCESS_SHARED_DAEMON")) > 0));
+    }
     if (masterPid != 0 && gettid() == masterPid)
     {
         return 0;
     }
+    if (numWorkerSockets > 0)
+    {
+        /* All threads share the worker connections of the first daemon */
+        return 0;
+    }
     if (cpuSockets[cpu_id] < 0)
     {
         pthread_mutex_lock(&cpuLocks[cpu_id]);
@@ -290,6 +664,7 @@ access_client_init(int cpu_id)
         {
             pthread_mutex_lock(&globalLock);
             globalSocket = cpuSockets[cpu_id];
+            globalShm = cpuShm[cpu_id];
             masterPid = gettid();
             pthread_mutex_unlock(&globalLock);
         }
@@ -304,6 +679,7 @@ access_client_read(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
     int ret;
     int socket = globalSocket;
     pthread_mutex_t* lockptr = &globalLock;
+    AccessShmChannel* chan = NULL;
     AccessDataRecord record;
     memset(&record, 0, sizeof(AccessDataRecord));
     record.cpu = cpu_id;
@@ -315,38 +691,7 @@ access_client_read(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
         return -ENOENT;
     }
 
-    if (cpuSockets[cpu_id] < 0 && gettid() != masterPid)
-    {
-        pthread_mutex_lock(&cpuLocks[cpu_id]);
-        cpuSockets[cpu_id] = access_client_startDaemon(cpu_id);
-        cpuSockets_open++;
-        if (!daemon_pinned[cpu_id])
-        {
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(cpu_id, &cpuset);
-            DEBUG_PRINT(DEBUGLEV_INFO, Pinning daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
-            sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
-            daemon_pinned[cpu_id] = 1;
-        }
-        pthread_mutex_unlock(&cpuLocks[cpu_id]);
-    }
-    else if (cpuSockets[cpu_id] > 0 && gettid() == masterPid &&
-             cpuSockets_open > 1 && !daemon_pinned[cpu_id])
-    {
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(cpu_id, &cpuset);
-        DEBUG_PRINT(DEBUGLEV_INFO, Pinning master daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
-        sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
-        daemon_pinned[cpu_id] = 1;
-    }
-
-    if ((cpuSockets[cpu_id] >= 0) && (cpuSockets[cpu_id] != globalSocket))
-    {
-        socket = cpuSockets[cpu_id];
-        lockptr = &cpuLocks[cpu_id];
-    }
+    socket = access_client_socket(cpu_id, &lockptr, &chan);
 
     if (dev != MSR_DEV)
     {
@@ -366,8 +711,15 @@ access_client_read(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
         record.type = DAEMON_READ;
 
         pthread_mutex_lock(lockptr);
-        CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
-        CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        if (chan)
+        {
+            access_client_shm_transfer(socket, chan, &record, 1, 1);
+        }
+        else
+        {
+            CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
+            CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        }
         *data = record.data;
         pthread_mutex_unlock(lockptr);
 
@@ -405,6 +757,7 @@ access_client_write(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
     record.cpu = cpu_id;
     record.device = MSR_DEV;
     pthread_mutex_t* lockptr = &globalLock;
+    AccessShmChannel* chan = NULL;
     record.errorcode = ERR_OPENFAIL;
 
     if (cpuSockets_open == 0)
@@ -412,38 +765,7 @@ access_client_write(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
         return -ENOENT;
     }
 
-    if (cpuSockets[cpu_id] < 0 && gettid() != masterPid)
-    {
-        pthread_mutex_lock(&cpuLocks[cpu_id]);
-        cpuSockets[cpu_id] = access_client_startDaemon(cpu_id);
-        cpuSockets_open++;
-        if (!daemon_pinned[cpu_id])
-        {
-            cpu_set_t cpuset;
-            CPU_ZERO(&cpuset);
-            CPU_SET(cpu_id, &cpuset);
-            DEBUG_PRINT(DEBUGLEV_INFO, Pinning daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
-            sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
-            daemon_pinned[cpu_id] = 1;
-        }
-        pthread_mutex_unlock(&cpuLocks[cpu_id]);
-    }
-    else if (cpuSockets[cpu_id] > 0 && gettid() == masterPid &&
-             cpuSockets_open > 1 && !daemon_pinned[cpu_id])
-    {
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(cpu_id, &cpuset);
-        DEBUG_PRINT(DEBUGLEV_INFO, Pinning master daemon %d to CPU %d, daemon_pids[cpu_id], cpu_id);
-        sched_setaffinity(daemon_pids[cpu_id], sizeof(cpu_set_t), &cpuset);
-        daemon_pinned[cpu_id] = 1;
-    }
-
-    if ((cpuSockets[cpu_id] >= 0) && (cpuSockets[cpu_id] != socket))
-    {
-        socket = cpuSockets[cpu_id];
-        lockptr = &cpuLocks[cpu_id];
-    }
+    socket = access_client_socket(cpu_id, &lockptr, &chan);
 
     if (dev != MSR_DEV)
     {
@@ -457,8 +779,15 @@ access_client_write(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
         record.type = DAEMON_WRITE;
 
         pthread_mutex_lock(lockptr);
-        CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
-        CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        if (chan)
+        {
+            access_client_shm_transfer(socket, chan, &record, 1, 1);
+        }
+        else
+        {
+            CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
+            CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        }
         pthread_mutex_unlock(lockptr);
 
         if (record.errorcode != ERR_NOERROR)
@@ -483,6 +812,100 @@ access_client_write(PciDeviceIndex dev, const int cpu_id, uint32_t reg, uint64_t
     return 0;
 }
 
+int
+access_client_batch(const int cpu_id, AccessDataRecord* records, int count)
+{
+    int socket = -1;
+    pthread_mutex_t* lockptr = NULL;
+    AccessShmChannel* chan = NULL;
+    AccessDataRecord header;
+    struct iovec iov[2];
+
+    if (cpuSockets_open == 0)
+    {
+        return -ENOENT;
+    }
+    socket = access_client_socket(cpu_id, &lockptr, &chan);
+    if (socket == -1)
+    {
+        return -EBADFD;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        records[i].cpu = cpu_id;
+        if (records[i].device != MSR_DEV)
+        {
+            records[i].cpu = affinity_thread2socket_lookup[cpu_id];
+        }
+        if (records[i].type == DAEMON_READ)
+        {
+            records[i].data = 0x0ULL;
+        }
+        records[i].errorcode = ERR_OPENFAIL;
+    }
+
+    if (chan)
+    {
+        int ret = 0;
+        pthread_mutex_lock(lockptr);
+        ret = access_client_shm_transfer(socket, chan, records, count, 1);
+        pthread_mutex_unlock(lockptr);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    for (int off = 0; !chan && off < count; off += ACCESS_BATCH_MAX_RECORDS)
+    {
+        int num = count - off;
+        size_t len = 0;
+        size_t done = 0;
+        if (num > ACCESS_BATCH_MAX_RECORDS)
+        {
+            num = ACCESS_BATCH_MAX_RECORDS;
+        }
+        memset(&header, 0, sizeof(AccessDataRecord));
+        header.cpu = cpu_id;
+        header.type = DAEMON_BATCH;
+        header.data = num;
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(AccessDataRecord);
+        iov[1].iov_base = &records[off];
+        iov[1].iov_len = num * sizeof(AccessDataRecord);
+        len = num * sizeof(AccessDataRecord);
+
+        pthread_mutex_lock(lockptr);
+        if (writev(socket, iov, 2) != (ssize_t)(iov[0].iov_len + iov[1].iov_len))
+        {
+            pthread_mutex_unlock(lockptr);
+            ERROR_PRINT(socket write failed);
+            return -EBADFD;
+        }
+        while (done < len)
+        {
+            ssize_t ret = read(socket, ((char*)&records[off]) + done, len - done);
+            if (ret <= 0)
+            {
+                pthread_mutex_unlock(lockptr);
+                ERROR_PRINT(socket read failed);
+                return -EBADFD;
+            }
+            done += ret;
+        }
+        pthread_mutex_unlock(lockptr);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (records[i].errorcode != ERR_NOERROR)
+        {
+            DEBUG_PRINT(DEBUGLEV_DEVELOP, Got error '%s' from access daemon for batched access to reg 0x%X on device %d,
+                        access_client_strerror(records[i].errorcode), records[i].reg, records[i].device);
+        }
+    }
+    return 0;
+}
+
 void
 access_client_finalize(int cpu_id)
 {
@@ -492,10 +915,24 @@ access_client_finalize(int cpu_id)
         memset(&record, 0, sizeof(AccessDataRecord));
         record.type = DAEMON_EXIT;
         record.cpu = cpu_id;
-        CHECK_ERROR(write(cpuSockets[cpu_id], &record, sizeof(AccessDataRecord)),socket write failed);
+        if (cpuShm[cpu_id])
+        {
+            access_client_shm_transfer(cpuSockets[cpu_id], cpuShm[cpu_id], &record, 1, 0);
+        }
+        else
+        {
+            CHECK_ERROR(write(cpuSockets[cpu_id], &record, sizeof(AccessDataRecord)),socket write failed);
+        }
         if (cpuSockets[cpu_id] == globalSocket)
         {
             globalSocket = -1;
+            globalShm = NULL;
+            access_client_stopWorkers();
+        }
+        if (cpuShm[cpu_id])
+        {
+            munmap(cpuShm[cpu_id], sizeof(AccessShmChannel));
+            cpuShm[cpu_id] = NULL;
         }
         CHECK_ERROR(close(cpuSockets[cpu_id]),socket close failed);
         cpuSockets[cpu_id] = -1;
@@ -512,6 +949,7 @@ access_client_finalize(int cpu_id)
     if (cpuSockets_open == 0)
     {
         globalSocket = -1;
+        globalShm = NULL;
     }
     masterPid = 0;
 #if defined(__x86_64__) || defined(__i386__)
@@ -524,6 +962,7 @@ access_client_check(PciDeviceIndex dev, int cpu_id)
 {
     int socket = globalSocket;
     pthread_mutex_t* lockptr = &globalLock;
+    AccessShmChannel* chan = globalShm;
 
     AccessDataRecord record;
     memset(&record, 0, sizeof(AccessDataRecord));
@@ -539,12 +978,24 @@ access_client_check(PciDeviceIndex dev, int cpu_id)
     {
         socket = cpuSockets[cpu_id];
         lockptr = &cpuLocks[cpu_id];
+        chan = cpuShm[cpu_id];
+    }
+    if ((numWorkerSockets > 0) && (cpuSockets_open > 0))
+    {
+        socket = access_client_socket(cpu_id, &lockptr, &chan);
     }
     if ((cpuSockets[cpu_id] > 0) || ((cpuSockets_open == 1) && (globalSocket > 0)))
     {
         pthread_mutex_lock(lockptr);
-        CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
-        CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        if (chan)
+        {
+            access_client_shm_transfer(socket, chan, &record, 1, 1);
+        }
+        else
+        {
+            CHECK_ERROR(write(socket, &record, sizeof(AccessDataRecord)), socket write failed);
+            CHECK_ERROR(read(socket, &record, sizeof(AccessDataRecord)), socket read failed);
+        }
         pthread_mutex_unlock(lockptr);
         if (record.errorcode == ERR_NOERROR )
         {
@@ -579,9 +1030,18 @@ void __attribute__((destructor (104))) close_access_client(void)
                 cpuSockets[i] = -1;
                 cpuSockets_open--;
             }
+            if (cpuShm[i])
+            {
+                munmap(cpuShm[i], sizeof(AccessShmChannel));
+                cpuShm[i] = NULL;
+            }
         }
         free(cpuSockets);
         cpuSockets = NULL;
+        free(cpuShm);
+        cpuShm = NULL;
+        globalShm = NULL;
+        access_client_stopWorkers();
         cpuSockets_open = 0;
     }
     if (daemon_pids)
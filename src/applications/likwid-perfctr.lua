@@ -120,6 +120,12 @@ local function usage(config)
         io.stdout:write("perf_event specific options:\n")
         io.stdout:write("--perfpid <pid>\t\t Measure given PID\n")
         io.stdout:write("--execpid\t\t Use the PID of wrapped application for measurements\n")
+        io.stdout:write("--sample <period>\t Sample the instruction address every <period> events of the core counters\n")
+        io.stdout:write("\t\t\t and print the functions with the most samples per event\n")
+        io.stdout:write("--sampleout <file>\t Write all sampled addresses to <file> (CSV)\n")
+        io.stdout:write("--pertask\t\t Count the core events per thread of the PID given with --perfpid or --execpid\n")
+        io.stdout:write("--cgroup <path>\t\t Count the core events only for the tasks of the cgroup <path>\n")
+        io.stdout:write("\t\t\t (e.g. /sys/fs/cgroup/<path>) on the CPUs of its cpuset\n")
     end
     io.stdout:write("\n")
     examples()
@@ -196,12 +202,16 @@ if config["daemonMode"] == -1 then
 end
 perfflags = nil
 perfpid = nil
+sample_period = nil
+sample_out = nil
+pertask = false
+cgroup = nil
 nan2value = '-'
 cputopo = nil
 cpuinfo = nil
 cliopts = { "a", "c:", "C:", "e", "E:", "g:", "h", "H", "i", "m", "M:", "o:", "O", "P", "s:", "S:", "t:", "v", "V:",
     "T:", "f", "group:", "help", "info", "version", "verbose:", "output:", "skip:", "marker", "force", "stats",
-    "execpid", "perfflags:", "perfpid:", "Z", "outprefix:" }
+    "execpid", "perfflags:", "perfpid:", "Z", "outprefix:", "sample:", "sampleout:", "pertask", "cgroup:" }
 
 
 ---------------------------
@@ -237,6 +247,169 @@ end
 
 likwid.catchSignal()
 
+-- Resolves offsets in a module to function names with addr2line
+local function sampleSymbols(module, offsets)
+    local symbols = {}
+    if likwid.access(module, "r") ~= 0 then
+        return symbols
+    end
+    -- The module path comes from /proc/<pid>/maps, quote it for the shell
+    local quoted = "'"..module:gsub("'", "'\\''").."'"
+    local chunk = 256
+    for i = 1, #offsets, chunk do
+        local last = math.min(i + chunk - 1, #offsets)
+        local addrs = {}
+        for j = i, last do
+            table.insert(addrs, string.format("0x%x", offsets[j]))
+        end
+        local f = io.popen(string.format("addr2line -f -C -e %s %s 2>/dev/null", quoted, table.concat(addrs, " ")))
+        if f ~= nil then
+            for j = i, last do
+                local func = f:read("*l")
+                local srcline = f:read("*l")
+                if func == nil or srcline == nil then
+                    break
+                end
+                if func ~= "??" then
+                    symbols[offsets[j]] = func
+                end
+            end
+            f:close()
+        end
+    end
+    return symbols
+end
+
+-- Prints the functions with the most samples for each event and writes all
+-- sampled addresses to sampleout if given
+function printSamples(groups, cpulist, sampleout)
+    local maxSymbols = 10
+    local out = nil
+    if sampleout ~= nil then
+        out = io.open(sampleout, "w")
+        if out == nil then
+            print_stderr(string.format("Cannot open sample output file %s", sampleout))
+        else
+            out:write("Group,Event,Counter,Samples,Address,Offset,Module,Symbol\n")
+        end
+    end
+    for _, g in pairs(groups) do
+        for e = 1, likwid.getNumberOfEvents(g) do
+            local addrs = {}
+            local total = 0
+            for t = 1, #cpulist do
+                for _, smpl in pairs(likwid.getSamples(g, e, t)) do
+                    local key = tostring(smpl.module)..":"..tostring(smpl.offset)
+                    if addrs[key] == nil then
+                        addrs[key] = {module = smpl.module, offset = smpl.offset, address = smpl.address, count = 0}
+                    end
+                    addrs[key].count = addrs[key].count + smpl.count
+                    total = total + smpl.count
+                end
+            end
+            if total > 0 then
+                local modules = {}
+                for _, a in pairs(addrs) do
+                    if a.module ~= nil then
+                        if modules[a.module] == nil then
+                            modules[a.module] = {}
+                        end
+                        table.insert(modules[a.module], a)
+                    end
+                end
+                for m, list in pairs(modules) do
+                    local offsets = {}
+                    for _, a in pairs(list) do
+                        table.insert(offsets, a.offset)
+                    end
+                    local symbols = sampleSymbols(m, offsets)
+                    for _, a in pairs(list) do
+                        a.symbol = symbols[a.offset]
+                    end
+                end
+                local funcs = {}
+                local eventname = likwid.getNameOfEvent(g, e)
+                local countername = likwid.getNameOfCounter(g, e)
+                for _, a in pairs(addrs) do
+                    local module = a.module or "[unknown]"
+                    local name = a.symbol or "[unknown]"
+                    local key = module.."|"..name
+                    if funcs[key] == nil then
+                        funcs[key] = {module = module:match("([^/]+)$") or module, symbol = name, count = 0}
+                    end
+                    funcs[key].count = funcs[key].count + a.count
+                    if out ~= nil then
+                        out:write(string.format("%d,%s,%s,%d,0x%x,0x%x,%s,%s\n", g, eventname, countername,
+                                  a.count, a.address, a.offset, module, name))
+                    end
+                end
+                local list = {}
+                for _, f in pairs(funcs) do
+                    table.insert(list, f)
+                end
+                table.sort(list, function(a, b) return a.count > b.count end)
+                local tab = {{"Function"}, {"Module"}, {"Samples"}, {"Share [%]"}}
+                for i = 1, math.min(maxSymbols, #list) do
+                    table.insert(tab[1], list[i].symbol)
+                    table.insert(tab[2], list[i].module)
+                    table.insert(tab[3], tostring(math.tointeger(list[i].count)))
+                    table.insert(tab[4], string.format("%.2f", 100.0 * list[i].count / total))
+                end
+                if use_csv then
+                    print(string.format("TABLE,Group %d Samples,%s,%s,%d", g, eventname, countername, total))
+                    likwid.printcsv(tab, #tab)
+                else
+                    print(string.format("Samples of %s (%s), group %d: %d", eventname, countername, g, total))
+                    likwid.printtable(tab)
+                end
+            end
+        end
+    end
+    if out ~= nil then
+        out:close()
+    end
+end
+
+-- Prints the per-thread results of per-task counting. The process result is
+-- the result of the first HW thread.
+function printTasks(groups)
+    for _, g in pairs(groups) do
+        local ntasks = likwid.getNumberOfTasks(g)
+        if ntasks > 0 then
+            local tab = {{"Event"}, {"Counter"}}
+            for e = 1, likwid.getNumberOfEvents(g) do
+                table.insert(tab[1], likwid.getNameOfEvent(g, e))
+                table.insert(tab[2], likwid.getNameOfCounter(g, e))
+            end
+            for t = 1, ntasks do
+                local col = {string.format("TID %d", likwid.getTaskId(g, t))}
+                for e = 1, likwid.getNumberOfEvents(g) do
+                    local r = likwid.getTaskResult(g, e, t)
+                    if r ~= r then
+                        table.insert(col, "-")
+                    else
+                        table.insert(col, tostring(math.tointeger(r) or r))
+                    end
+                end
+                table.insert(tab, col)
+            end
+            local col = {"Process"}
+            for e = 1, likwid.getNumberOfEvents(g) do
+                local r = likwid.getResult(g, e, 1)
+                table.insert(col, tostring(math.tointeger(r) or r))
+            end
+            table.insert(tab, col)
+            if use_csv then
+                print(string.format("TABLE,Group %d Tasks,%d", g, ntasks))
+                likwid.printcsv(tab, #tab)
+            else
+                print(string.format("Per-task results of group %d, %d threads:", g, ntasks))
+                likwid.printtable(tab)
+            end
+        end
+    end
+end
+
 local function perfctr_exit(exitcode)
     if likwid.access(nvMarkerFile, "e") == 0 then
         os.remove(nvMarkerFile)
@@ -337,6 +510,23 @@ for opt, arg in likwid.getopt(arg, cliopts) do
             perfpid = arg
             execpid = false
         end
+    elseif (opt == "sample") then
+        sample_period = tonumber(arg)
+        if sample_period == nil or sample_period <= 0 then
+            print_stderr("Option --sample requires a positive sampling period")
+            perfctr_exit(1)
+        end
+        sample_period = math.tointeger(sample_period)
+    elseif (opt == "sampleout") then
+        sample_out = arg
+    elseif (opt == "pertask") then
+        pertask = true
+    elseif (opt == "cgroup") then
+        if likwid.access(arg, "r") ~= 0 then
+            print_stderr(string.format("Cannot access cgroup %s", arg))
+            perfctr_exit(1)
+        end
+        cgroup = arg
     elseif (opt == "outprefix") then
         outprefix = arg
     elseif (opt == "E") then
@@ -481,6 +671,12 @@ if perfpid and (not execpid) and (not cpulist) then
         num_cpus, cpulist = likwid.cpustr_to_cpulist(rawlist)
     end
 end
+if cgroup and (not cpulist) then
+    local rawlist = likwid.perfctr_cgroup_cpulist(cgroup)
+    if rawlist then
+        num_cpus, cpulist = likwid.cpustr_to_cpulist(rawlist)
+    end
+end
 
 io.stdout:setvbuf("no")
 cpuinfo = likwid.getCpuInfo()
@@ -984,6 +1180,41 @@ elseif use_timeline == true and use_stethoscope == true then
     print_stderr("Cannot run Timeline and Stethoscope mode simultaneously")
     perfctr_exit(0)
 end
+if sample_period ~= nil then
+    if config["daemonMode"] ~= -1 then
+        print_stderr("Sampling (--sample) requires ACCESSMODE=perf_event")
+        perfctr_exit(1)
+    elseif use_marker == true then
+        print_stderr("Cannot run Marker API and sampling simultaneously")
+        perfctr_exit(1)
+    end
+end
+if pertask then
+    if config["daemonMode"] ~= -1 then
+        print_stderr("Per-task counting (--pertask) requires ACCESSMODE=perf_event")
+        perfctr_exit(1)
+    elseif perfpid == nil and not execpid then
+        print_stderr("Per-task counting (--pertask) requires --perfpid or --execpid")
+        perfctr_exit(1)
+    elseif use_marker == true or sample_period ~= nil then
+        print_stderr("Per-task counting (--pertask) cannot be used with the Marker API or sampling")
+        perfctr_exit(1)
+    end
+end
+if cgroup ~= nil then
+    if config["daemonMode"] ~= -1 then
+        print_stderr("Counting per cgroup (--cgroup) requires ACCESSMODE=perf_event")
+        perfctr_exit(1)
+    elseif perfpid ~= nil or pertask then
+        print_stderr("Option --cgroup cannot be used with --perfpid or --pertask")
+        perfctr_exit(1)
+    elseif use_marker == true then
+        print_stderr("Cannot run Marker API and counting per cgroup simultaneously")
+        perfctr_exit(1)
+    end
+    -- The events are bound to the cgroup instead of the application
+    execpid = false
+end
 
 if use_stethoscope == false and use_timeline == false and use_marker == false then
     use_wrapper = true
@@ -1271,6 +1502,10 @@ elseif #execList > 0 then
 end
 
 
+if cgroup ~= nil and likwid.setCgroup(cgroup) < 0 then
+    likwid.killProgram(pid)
+    perfctr_exit(1)
+end
 if forceOverwrite == 1 and os.getenv("LIKWID_FORCE") ~= tostring(forceOverwrite) then
     likwid.setenv("LIKWID_FORCE", tostring(forceOverwrite))
 end
@@ -1282,6 +1517,9 @@ for i, event_string in pairs(event_string_list) do
         if perfpid ~= nil and perfflags ~= nil then
             likwid.setenv("LIKWID_PERF_FLAGS", tostring(perfflags))
         end
+        if perfpid ~= nil and pertask then
+            likwid.setenv("LIKWID_PERF_PERTASK", "1")
+        end
         local gid = likwid.addEventSet(event_string)
         if gid < 0 then
             likwid.finalize()
@@ -1325,6 +1563,9 @@ end
 
 if #event_string_list > 0 then
     activeGroup = group_ids[1]
+    if sample_period ~= nil then
+        likwid.setSamplingPeriod(sample_period)
+    end
     ret = likwid.setupCounters(activeGroup)
     if ret < 0 then
         likwid.killProgram(pid)
@@ -1407,6 +1648,15 @@ if use_wrapper or use_timeline then
 
     if use_wrapper and #group_ids == 1 then
         duration = 30.E06
+        -- Drain the sample buffers while the application runs, the
+        -- addresses are resolved with its memory mappings
+        if sample_period ~= nil then
+            duration = 1.E05
+        end
+        -- Threads created by the application get own counters at each read
+        if pertask then
+            duration = 1.E05
+        end
     end
 
     if #event_string_list > 0 then
@@ -1522,7 +1772,7 @@ end
 if use_marker == true then
     if #event_string_list > 0 then
         if likwid.access(markerFile, "e") >= 0 then
-            results, metrics = likwid.getMarkerResults(markerFile, cpulist, nan2value)
+            results, metrics, exresults, exmetrics, rawresults, rawmetrics = likwid.getMarkerResults(markerFile, cpulist, nan2value)
             if not results then
                 print_stderr("Failure reading Marker API result file.")
             elseif #results == 0 then
@@ -1530,6 +1780,12 @@ if use_marker == true then
             else
                 for r = 1, #results do
                     likwid.printOutput(results[r], metrics[r], cpulist, r, print_stats)
+                    if exresults[r] then
+                        likwid.printOutput(exresults[r], exmetrics[r], cpulist, r, print_stats, "exclusive")
+                    end
+                    if rawresults[r] then
+                        likwid.printOutput(rawresults[r], rawmetrics[r], cpulist, r, print_stats, "uncorrected")
+                    end
                 end
             end
             os.remove(markerFile)
@@ -1584,6 +1840,12 @@ elseif use_timeline == false then
         results = likwid.getResults(nan2value)
         metrics = likwid.getMetrics(nan2value)
         likwid.printOutput(results, metrics, cpulist, nil, print_stats)
+        if sample_period ~= nil then
+            printSamples(group_ids, cpulist, sample_out)
+        end
+        if pertask then
+            printTasks(group_ids)
+        end
     end
 end
 
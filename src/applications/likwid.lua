@@ -64,6 +64,13 @@ likwid.finalize = likwid_finalize
 likwid.getEventsAndCounters = likwid_getEventsAndCounters
 likwid.getResult = likwid_getResult
 likwid.getLastResult = likwid_getLastResult
+likwid.getResultQuality = likwid_getResultQuality
+likwid.setSamplingPeriod = likwid_setSamplingPeriod
+likwid.getSamples = likwid_getSamples
+likwid.setCgroup = likwid_setCgroup
+likwid.getNumberOfTasks = likwid_getNumberOfTasks
+likwid.getTaskId = likwid_getTaskId
+likwid.getTaskResult = likwid_getTaskResult
 likwid.getMetric = likwid_getMetric
 likwid.getLastMetric = likwid_getLastMetric
 likwid.getNumberOfGroups = likwid_getNumberOfGroups
@@ -154,6 +161,15 @@ likwid.markerRegionTime = likwid_markerRegionTime
 likwid.markerRegionCount = likwid_markerRegionCount
 likwid.markerRegionResult = likwid_markerRegionResult
 likwid.markerRegionMetric = likwid_markerRegionMetric
+likwid.markerRegionPercentile = likwid_markerRegionPercentile
+likwid.markerRegionSampled = likwid_markerRegionSampled
+likwid.markerRegionError = likwid_markerRegionError
+likwid.markerRegionParent = likwid_markerRegionParent
+likwid.markerRegionExclusiveTime = likwid_markerRegionExclusiveTime
+likwid.markerRegionExclusiveResult = likwid_markerRegionExclusiveResult
+likwid.markerRegionExclusiveMetric = likwid_markerRegionExclusiveMetric
+likwid.markerRegionOverhead = likwid_markerRegionOverhead
+likwid.markerRegionUncorrectedMetric = likwid_markerRegionUncorrectedMetric
 likwid.initFreq = likwid_initFreq
 likwid.getCpuClockBase = likwid_getCpuClockBase
 likwid.getCpuClockCurrent = likwid_getCpuClockCurrent
@@ -862,11 +878,22 @@ end
 
 likwid.tableToMinMaxAvgSum = tableMinMaxAvgSum
 
-local function printOutput(results, metrics, cpulist, region, stats)
+local function printOutput(results, metrics, cpulist, region, stats, variant)
     local maxLineFields = 0
     local cpuinfo = likwid_getCpuInfo()
     local clock = likwid.getCpuClock()
     local regionName = likwid.markerRegionTag(region)
+    -- Exclusive or uncorrected results of a region (see getMarkerResults)
+    local regionTime = likwid.markerRegionTime
+    if variant == "exclusive" then
+        regionName = regionName.." (exclusive)"
+        regionTime = likwid.markerRegionExclusiveTime
+    elseif variant == "uncorrected" then
+        regionName = regionName.." (uncorrected)"
+        regionTime = function(r, c)
+            return likwid.markerRegionTime(r, c) + likwid.markerRegionOverhead(r, 0, c)
+        end
+    end
     local regionThreads = likwid.markerRegionThreads(region)
     local cur_cpulist = cpulist
     if region ~= nil then
@@ -883,11 +910,50 @@ local function printOutput(results, metrics, cpulist, region, stats)
         local groupName = likwid.getNameOfGroup(g)
         if region ~= nil then
             infotab[1] = {"Region Info","RDTSC Runtime [s]","call count"}
+            -- Sampled regions (LIKWID_MARKER_SAMPLE) report extrapolated values
+            local sampled = false
+            for c, cpu in pairs(cur_cpulist) do
+                if likwid.markerRegionSampled(region, c) < likwid.markerRegionCount(region, c) then
+                    sampled = true
+                end
+            end
+            if sampled then
+                table.insert(infotab[1], "measured calls")
+                table.insert(infotab[1], "RDTSC Runtime error [s]")
+            end
+            -- Per-call percentiles if the run recorded histograms (LIKWID_MARKER_HISTOGRAM)
+            local percentiles = {}
+            if likwid.markerRegionPercentile(region, 0, 0, 50) ~= nil then
+                for _, p in pairs({50, 99, 99.9}) do
+                    table.insert(infotab[1], string.format("runtime p%s [s]", tostring(p)))
+                    table.insert(percentiles, {0, p, "%.6f"})
+                end
+                for e, _ in pairs(group) do
+                    if likwid.markerRegionPercentile(region, e, 0, 50) ~= nil then
+                        for _, p in pairs({50, 99, 99.9}) do
+                            table.insert(infotab[1], string.format("%s p%s", likwid.getNameOfEvent(g, e), tostring(p)))
+                            table.insert(percentiles, {e, p, "%e"})
+                        end
+                    end
+                end
+            end
             for c, cpu in pairs(cur_cpulist) do
                 local tmpList = {}
                 table.insert(tmpList, "HWThread "..tostring(cpu))
-                table.insert(tmpList, string.format("%.6f", likwid.markerRegionTime(region, c)))
+                table.insert(tmpList, string.format("%.6f", regionTime(region, c)))
                 table.insert(tmpList, tostring(likwid.markerRegionCount(region, c)))
+                if sampled then
+                    table.insert(tmpList, tostring(likwid.markerRegionSampled(region, c)))
+                    table.insert(tmpList, string.format("%.6f", likwid.markerRegionError(region, 0, c)))
+                end
+                for _, pct in pairs(percentiles) do
+                    local value = likwid.markerRegionPercentile(region, pct[1], c, pct[2])
+                    if value ~= nil then
+                        table.insert(tmpList, string.format(pct[3], value))
+                    else
+                        table.insert(tmpList, "-")
+                    end
+                end
                 table.insert(infotab, tmpList)
             end
         end
@@ -913,7 +979,7 @@ local function printOutput(results, metrics, cpulist, region, stats)
                 if region == nil then
                     table.insert(tmpList, string.format("%e", runtime))
                 else
-                    table.insert(tmpList, string.format("%e", likwid.markerRegionTime(region, c)))
+                    table.insert(tmpList, string.format("%e", regionTime(region, c)))
                 end
             end
             for e, event in pairs(group) do
@@ -925,6 +991,36 @@ local function printOutput(results, metrics, cpulist, region, stats)
         if #cpulist > 1 or stats == true then
             firsttab_combined = tableMinMaxAvgSum(firsttab, 2, 1)
         end
+        -- Events multiplexed by the kernel (perf_event) were not counted all
+        -- the time, their results are scaled. Show the counted time fraction.
+        local qualitytab = {}
+        if region == nil then
+            local multiplexed = false
+            qualitytab[1] = {"Event"}
+            qualitytab[2] = {"Counter"}
+            for e, event in pairs(group) do
+                table.insert(qualitytab[1], likwid.getNameOfEvent(g, e).." counted [%]")
+                table.insert(qualitytab[2], likwid.getNameOfCounter(g, e))
+            end
+            for c, cpu in pairs(cur_cpulist) do
+                local tmpList = {"HWThread "..tostring(cpu)}
+                for e, event in pairs(group) do
+                    local q = likwid.getResultQuality(g, e, c)
+                    if q == q then
+                        if q < 1.0 then
+                            multiplexed = true
+                        end
+                        table.insert(tmpList, string.format("%.1f", q*100))
+                    else
+                        table.insert(tmpList, "-")
+                    end
+                end
+                table.insert(qualitytab, tmpList)
+            end
+            if not multiplexed then
+                qualitytab = {}
+            end
+        end
         if likwid.getNumberOfMetrics(g) > 0 then
             secondtab[1] = {"Metric"}
             secondtab_combined[1] = {"Metric"}
@@ -944,7 +1040,7 @@ local function printOutput(results, metrics, cpulist, region, stats)
                 secondtab_combined = tableMinMaxAvgSum(secondtab, 1, 1)
             end
         end
-        maxLineFields = math.max(#firsttab, #firsttab_combined,
+        maxLineFields = math.max(#firsttab, #firsttab_combined, #qualitytab,
                                  #secondtab, #secondtab_combined)
         if use_csv then
             print(string.format("STRUCT,Info,3%s",string.rep(",",maxLineFields-3)))
@@ -960,6 +1056,10 @@ local function printOutput(results, metrics, cpulist, region, stats)
                 likwid.printcsv(infotab, maxLineFields)
             end
             likwid.printcsv(firsttab, maxLineFields)
+            if #qualitytab > 0 then
+                print(string.format("TABLE,Group %d Multiplexing,%s,%d%s",g,groupName,#qualitytab[1]-1,string.rep(",",maxLineFields-4)))
+                likwid.printcsv(qualitytab, maxLineFields)
+            end
         else
             if outfile ~= nil then
                 print(likwid.hline)
@@ -977,6 +1077,10 @@ local function printOutput(results, metrics, cpulist, region, stats)
                 likwid.printtable(infotab)
             end
             likwid.printtable(firsttab)
+            if #qualitytab > 0 then
+                print("Multiplexed events, the results are scaled to the whole runtime:")
+                likwid.printtable(qualitytab)
+            end
         end
         if #cur_cpulist > 1 or stats == true then
             if use_csv then
@@ -1079,13 +1183,14 @@ local function getMetrics(nan2value)
         nan2value = '-'
     end
     for i=1,nr_groups do
-        results[i] = {}
+        results[i] = likwid_getMetricsAll(i) or {}
         local nr_metrics = likwid_getNumberOfMetrics(i)
         for j=1,nr_metrics do
-            results[i][j] = {}
+            if not results[i][j] then
+                results[i][j] = {}
+            end
             for k=1, nr_threads do
-                results[i][j][k] = likwid_getMetric(i,j, k)
-                if results[i][j][k] ~= results[i][j][k] then
+                if results[i][j][k] == nil or results[i][j][k] ~= results[i][j][k] then
                     results[i][j][k] = nan2value
                 end
             end
@@ -1104,13 +1209,14 @@ local function getLastMetrics(nan2value)
         nan2value = '-'
     end
     for i=1,nr_groups do
-        results[i] = {}
+        results[i] = likwid_getLastMetricsAll(i) or {}
         local nr_metrics = likwid_getNumberOfMetrics(i)
         for j=1,nr_metrics do
-            results[i][j] = {}
+            if not results[i][j] then
+                results[i][j] = {}
+            end
             for k=1, nr_threads do
-                results[i][j][k] = likwid_getLastMetric(i,j, k)
-                if results[i][j][k] ~= results[i][j][k] then
+                if results[i][j][k] == nil or results[i][j][k] ~= results[i][j][k] then
                     results[i][j][k] = nan2value
                 end
             end
@@ -1134,39 +1240,67 @@ local function getMarkerResults(filename, cpulist, nan2value)
     end
     results = {}
     metrics = {}
+    -- Regions with nested regions additionally get their exclusive results,
+    -- regions with overhead correction their uncorrected results
+    local exresults = {}
+    local exmetrics = {}
+    local rawresults = {}
+    local rawmetrics = {}
+    local hasChildren = {}
+    local corrected = {}
     for i=1, likwid.markerNumRegions() do
-        local regionName = likwid.markerRegionTag(i)
+        local parent = likwid.markerRegionParent(i)
+        if parent > 0 then
+            hasChildren[parent] = true
+        end
+        for j=1, likwid.markerRegionThreads(i) do
+            if likwid.markerRegionOverhead(i, 0, j) > 0 then
+                corrected[i] = true
+            end
+        end
+    end
+    local function uncorrectedResult(i, k, j)
+        return likwid.markerRegionResult(i, k, j) + likwid.markerRegionOverhead(i, k, j)
+    end
+    local function readRegion(i, resultFunc, metricFunc)
         local groupID = likwid.markerRegionGroup(i)
         local regionThreads = likwid.markerRegionThreads(i)
-        results[i] = {}
-        metrics[i] = {}
-        results[i][groupID] = {}
-        metrics[i][groupID] = {}
+        local res = {}
+        local met = {}
+        res[groupID] = {}
+        met[groupID] = {}
         for k=1, likwid.markerRegionEvents(i) do
-            local eventName = likwid.getNameOfEvent(groupID, k)
-            local counterName = likwid.getNameOfCounter(groupID, k)
-            results[i][groupID][k] = {}
+            res[groupID][k] = {}
             for j=1, regionThreads do
-                results[i][groupID][k][j] = likwid.markerRegionResult(i,k,j)
-                if results[i][groupID][k][j] ~= results[i][groupID][k][j] then
-                    results[i][groupID][k][j] = nan2value
+                res[groupID][k][j] = resultFunc(i,k,j)
+                if res[groupID][k][j] ~= res[groupID][k][j] then
+                    res[groupID][k][j] = nan2value
                 end
             end
         end
         if likwid.getNumberOfMetrics(groupID) > 0 then
             for k=1, likwid.getNumberOfMetrics(groupID) do
-                local metricName = likwid.getNameOfMetric(groupID, k)
-                metrics[i][likwid.markerRegionGroup(i)][k] = {}
+                met[groupID][k] = {}
                 for j=1, regionThreads do
-                    metrics[i][groupID][k][j] = likwid.markerRegionMetric(i,k,j)
-                    if metrics[i][groupID][k][j] ~= metrics[i][groupID][k][j] then
-                        metrics[i][groupID][k][j] = nan2value
+                    met[groupID][k][j] = metricFunc(i,k,j)
+                    if met[groupID][k][j] ~= met[groupID][k][j] then
+                        met[groupID][k][j] = nan2value
                     end
                 end
             end
         end
+        return res, met
     end
-    return results, metrics
+    for i=1, likwid.markerNumRegions() do
+        results[i], metrics[i] = readRegion(i, likwid.markerRegionResult, likwid.markerRegionMetric)
+        if hasChildren[i] then
+            exresults[i], exmetrics[i] = readRegion(i, likwid.markerRegionExclusiveResult, likwid.markerRegionExclusiveMetric)
+        end
+        if corrected[i] then
+            rawresults[i], rawmetrics[i] = readRegion(i, uncorrectedResult, likwid.markerRegionUncorrectedMetric)
+        end
+    end
+    return results, metrics, exresults, exmetrics, rawresults, rawmetrics
 end
 
 likwid.getMarkerResults = getMarkerResults
@@ -1837,4 +1971,23 @@ local function perfctr_pid_cpulist(pid)
 end
 likwid.perfctr_pid_cpulist = perfctr_pid_cpulist
 
+local function perfctr_cgroup_cpulist(path)
+    local cpulist = nil
+    for _, name in pairs({"cpuset.cpus.effective", "cpuset.cpus"}) do
+        local f = io.open(path .. "/" .. name, "r")
+        if f ~= nil then
+            local l = f:read("*line")
+            f:close()
+            if l ~= nil then
+                cpulist = l:match("^%s*([0-9%-,]+)")
+            end
+            if cpulist ~= nil then
+                break
+            end
+        end
+    end
+    return cpulist
+end
+likwid.perfctr_cgroup_cpulist = perfctr_cgroup_cpulist
+
 return likwid
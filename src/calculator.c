@@ -68,6 +68,7 @@
 #include <math.h> // Temporary
 #include <getopt.h>
 #include <calculator_stack.h>
+#include <calculator.h>
 
 /* #####   MACROS  -  LOCAL TO THIS SOURCE FILE   ######################### */
 
@@ -1131,3 +1132,574 @@ freeTokens:
 
     return ret;
 }
+
+/* Added for LIKWID: Compilation of formulas into postfix instructions that
+ * work directly on doubles. The metric formulas of a group are compiled once
+ * and evaluated with the counter values in variable slots, so there is no
+ * string substitution, tokenizing and number formatting per evaluation.
+ * Formulas that cannot be compiled can still be evaluated with calculate_infix. */
+
+typedef enum
+{
+    CALC_CONST = 0,
+    CALC_VAR,
+    CALC_NEG,
+    CALC_ADD,
+    CALC_SUB,
+    CALC_MUL,
+    CALC_DIV,
+    CALC_MOD,
+    CALC_POW,
+    CALC_FUNC
+} CalcOpcode;
+
+typedef enum
+{
+    CALC_FUNC_ABS = 0,
+    CALC_FUNC_FLOOR,
+    CALC_FUNC_CEIL,
+    CALC_FUNC_SIN,
+    CALC_FUNC_COS,
+    CALC_FUNC_TAN,
+    CALC_FUNC_ASIN,
+    CALC_FUNC_ACOS,
+    CALC_FUNC_ATAN,
+    CALC_FUNC_SQRT,
+    CALC_FUNC_CBRT,
+    CALC_FUNC_LOG,
+    CALC_FUNC_EXP,
+    CALC_FUNC_MIN,
+    CALC_FUNC_MAX,
+    CALC_FUNC_SUM,
+    CALC_FUNC_AVG,
+    CALC_FUNC_MEDIAN,
+    CALC_FUNC_VAR
+} CalcFunction;
+
+static struct {
+    char* name;
+    CalcFunction func;
+    bool variadic;
+} calcFunctions[] = {
+    {"abs", CALC_FUNC_ABS, false},
+    {"floor", CALC_FUNC_FLOOR, false},
+    {"ceil", CALC_FUNC_CEIL, false},
+    {"sin", CALC_FUNC_SIN, false},
+    {"cos", CALC_FUNC_COS, false},
+    {"tan", CALC_FUNC_TAN, false},
+    {"arcsin", CALC_FUNC_ASIN, false},
+    {"asin", CALC_FUNC_ASIN, false},
+    {"arccos", CALC_FUNC_ACOS, false},
+    {"acos", CALC_FUNC_ACOS, false},
+    {"arctan", CALC_FUNC_ATAN, false},
+    {"atan", CALC_FUNC_ATAN, false},
+    {"sqrt", CALC_FUNC_SQRT, false},
+    {"cbrt", CALC_FUNC_CBRT, false},
+    {"log", CALC_FUNC_LOG, false},
+    {"exp", CALC_FUNC_EXP, false},
+    {"min", CALC_FUNC_MIN, true},
+    {"max", CALC_FUNC_MAX, true},
+    {"sum", CALC_FUNC_SUM, true},
+    {"avg", CALC_FUNC_AVG, true},
+    {"mean", CALC_FUNC_AVG, true},
+    {"median", CALC_FUNC_MEDIAN, true},
+    {"var", CALC_FUNC_VAR, true},
+};
+
+typedef struct
+{
+    CalcOpcode op;
+    int arg; /* variable slot or function */
+    int nargs; /* number of function arguments */
+    number value;
+} CalcInstr;
+
+struct CalcExpr
+{
+    int numInstr;
+    int sizeInstr;
+    int depth;
+    int maxDepth;
+    CalcInstr* instr;
+};
+
+typedef struct
+{
+    char* pos;
+    int numVars;
+    char** varNames;
+    CalcExpr* expr;
+} CalcParser;
+
+static int calc_parseExpr(CalcParser* p);
+
+static int
+calc_emit(CalcParser* p, CalcOpcode op, int arg, int nargs, number value)
+{
+    CalcExpr* e = p->expr;
+    if (e->numInstr == e->sizeInstr)
+    {
+        int size = (e->sizeInstr > 0 ? 2 * e->sizeInstr : 16);
+        CalcInstr* tmp = realloc(e->instr, size * sizeof(CalcInstr));
+        if (!tmp)
+            return -1;
+        e->instr = tmp;
+        e->sizeInstr = size;
+    }
+    e->instr[e->numInstr].op = op;
+    e->instr[e->numInstr].arg = arg;
+    e->instr[e->numInstr].nargs = nargs;
+    e->instr[e->numInstr].value = value;
+    e->numInstr++;
+    // Track the stack depth the evaluation needs
+    switch (op)
+    {
+        case CALC_CONST:
+        case CALC_VAR:
+            e->depth++;
+            break;
+        case CALC_NEG:
+            break;
+        case CALC_FUNC:
+            e->depth -= nargs - 1;
+            break;
+        default:
+            e->depth--;
+            break;
+    }
+    if (e->depth > e->maxDepth)
+        e->maxDepth = e->depth;
+    return 0;
+}
+
+static void
+calc_skipSpaces(CalcParser* p)
+{
+    while (*p->pos == ' ' || *p->pos == '\t')
+        p->pos++;
+}
+
+static bool
+calc_isIdentChar(char ch, bool first)
+{
+    return (type(ch) == text || ch == '_' || (!first && type(ch) == digit));
+}
+
+static int
+calc_parseFunction(CalcParser* p, int func)
+{
+    int nargs = 0;
+    // p->pos is at the opening paren
+    p->pos++;
+    do
+    {
+        if (calc_parseExpr(p) < 0)
+            return -1;
+        nargs++;
+        calc_skipSpaces(p);
+    } while (*p->pos == ',' && p->pos++);
+    if (*p->pos != ')')
+        return -1;
+    p->pos++;
+    if (!calcFunctions[func].variadic && nargs != 1)
+        return -1;
+    return calc_emit(p, CALC_FUNC, calcFunctions[func].func, nargs, 0);
+}
+
+static int
+calc_parsePrimary(CalcParser* p)
+{
+    int i;
+    calc_skipSpaces(p);
+    if (type(*p->pos) == digit || type(*p->pos) == decimal)
+    {
+        char* end = NULL;
+        number value = strtod(p->pos, &end);
+        if (end == p->pos)
+            return -1;
+        p->pos = end;
+        return calc_emit(p, CALC_CONST, 0, 0, value);
+    }
+    else if (calc_isIdentChar(*p->pos, true))
+    {
+        char* start = p->pos;
+        size_t len = 0;
+        while (calc_isIdentChar(*p->pos, false))
+            p->pos++;
+        len = p->pos - start;
+        // Variables take precedence like the counter substitution in calc_metric
+        for (i = 0; i < p->numVars; i++)
+        {
+            if (p->varNames[i] && strlen(p->varNames[i]) == len && strncmp(p->varNames[i], start, len) == 0)
+                return calc_emit(p, CALC_VAR, i, 0, 0);
+        }
+        calc_skipSpaces(p);
+        if (*p->pos == '(')
+        {
+            for (i = 0; i < (int)(sizeof(calcFunctions)/sizeof(calcFunctions[0])); i++)
+            {
+                if (strlen(calcFunctions[i].name) == len && strncmp(calcFunctions[i].name, start, len) == 0)
+                    return calc_parseFunction(p, i);
+            }
+            return -1;
+        }
+        if (len == 3 && strncmp(start, "nan", 3) == 0)
+            return calc_emit(p, CALC_CONST, 0, 0, NAN);
+        if (len == 3 && strncmp(start, "inf", 3) == 0)
+            return calc_emit(p, CALC_CONST, 0, 0, INFINITY);
+        return -1;
+    }
+    else if (*p->pos == '(')
+    {
+        p->pos++;
+        if (calc_parseExpr(p) < 0)
+            return -1;
+        calc_skipSpaces(p);
+        if (*p->pos != ')')
+            return -1;
+        p->pos++;
+        return 0;
+    }
+    return -1;
+}
+
+static int
+calc_parseUnary(CalcParser* p)
+{
+    calc_skipSpaces(p);
+    if (*p->pos == '-')
+    {
+        // A sign binds stronger than '^' like negative numbers in tokenize()
+        p->pos++;
+        if (calc_parseUnary(p) < 0)
+            return -1;
+        return calc_emit(p, CALC_NEG, 0, 0, 0);
+    }
+    return calc_parsePrimary(p);
+}
+
+static int
+calc_parsePower(CalcParser* p)
+{
+    if (calc_parseUnary(p) < 0)
+        return -1;
+    calc_skipSpaces(p);
+    if (*p->pos == '^')
+    {
+        // right associative
+        p->pos++;
+        if (calc_parsePower(p) < 0)
+            return -1;
+        return calc_emit(p, CALC_POW, 0, 0, 0);
+    }
+    return 0;
+}
+
+static int
+calc_parseTerm(CalcParser* p)
+{
+    if (calc_parsePower(p) < 0)
+        return -1;
+    calc_skipSpaces(p);
+    while (type(*p->pos) == multop)
+    {
+        char op = *p->pos++;
+        if (calc_parsePower(p) < 0)
+            return -1;
+        if (calc_emit(p, (op == '*' ? CALC_MUL : (op == '/' ? CALC_DIV : CALC_MOD)), 0, 0, 0) < 0)
+            return -1;
+        calc_skipSpaces(p);
+    }
+    return 0;
+}
+
+static int
+calc_parseExpr(CalcParser* p)
+{
+    if (calc_parseTerm(p) < 0)
+        return -1;
+    calc_skipSpaces(p);
+    while (type(*p->pos) == addop)
+    {
+        char op = *p->pos++;
+        if (calc_parseTerm(p) < 0)
+            return -1;
+        if (calc_emit(p, (op == '+' ? CALC_ADD : CALC_SUB), 0, 0, 0) < 0)
+            return -1;
+        calc_skipSpaces(p);
+    }
+    return 0;
+}
+
+int
+calculate_compile(char* finfix, int numVars, char** varNames, CalcExpr** expr)
+{
+    CalcParser p;
+    if (!finfix || !expr)
+        return -1;
+    *expr = NULL;
+    p.pos = finfix;
+    p.numVars = numVars;
+    p.varNames = varNames;
+    p.expr = calloc(1, sizeof(CalcExpr));
+    if (!p.expr)
+        return -1;
+    if (calc_parseExpr(&p) < 0)
+    {
+        calculate_free(p.expr);
+        return -1;
+    }
+    calc_skipSpaces(&p);
+    if (*p.pos != '\0' || p.expr->depth != 1)
+    {
+        calculate_free(p.expr);
+        return -1;
+    }
+    *expr = p.expr;
+    return 0;
+}
+
+static int
+calc_compareNumbers(const void* a, const void* b)
+{
+    number x = *(const number*)a;
+    number y = *(const number*)b;
+    return (x > y) - (x < y);
+}
+
+static number
+calc_doFunc(CalcFunction func, number* args, int nargs)
+{
+    int i;
+    number result = args[0];
+    switch (func)
+    {
+        case CALC_FUNC_ABS:
+            return fabs(result);
+        case CALC_FUNC_FLOOR:
+            return floor(result);
+        case CALC_FUNC_CEIL:
+            return ceil(result);
+        case CALC_FUNC_SIN:
+            return sin(result);
+        case CALC_FUNC_COS:
+            return cos(result);
+        case CALC_FUNC_TAN:
+            return tan(result);
+        case CALC_FUNC_ASIN:
+            return asin(result);
+        case CALC_FUNC_ACOS:
+            return acos(result);
+        case CALC_FUNC_ATAN:
+            return atan(result);
+        case CALC_FUNC_SQRT:
+            return sqrt(result);
+        case CALC_FUNC_CBRT:
+            return cbrt(result);
+        case CALC_FUNC_LOG:
+            return log(result);
+        case CALC_FUNC_EXP:
+            return exp(result);
+        case CALC_FUNC_MIN:
+            for (i = 1; i < nargs; i++)
+                if (args[i] < result)
+                    result = args[i];
+            return result;
+        case CALC_FUNC_MAX:
+            for (i = 1; i < nargs; i++)
+                if (args[i] > result)
+                    result = args[i];
+            return result;
+        case CALC_FUNC_SUM:
+        case CALC_FUNC_AVG:
+            for (i = 1; i < nargs; i++)
+                result += args[i];
+            return (func == CALC_FUNC_AVG ? result / nargs : result);
+        case CALC_FUNC_MEDIAN:
+            // lower median like doFunc()
+            qsort(args, nargs, sizeof(number), calc_compareNumbers);
+            return args[(nargs + 1) / 2 - 1];
+        case CALC_FUNC_VAR:
+            {
+                number mean = 0;
+                for (i = 0; i < nargs; i++)
+                    mean += args[i];
+                mean /= nargs;
+                result = 0;
+                for (i = 0; i < nargs; i++)
+                    result += (args[i] - mean) * (args[i] - mean);
+                return result / nargs;
+            }
+    }
+    return NAN;
+}
+
+int
+calculate_eval(CalcExpr* expr, double* vars, double *result)
+{
+    int i;
+    int top = -1;
+    if (!expr || !result)
+        return -1;
+    number stack[expr->maxDepth > 0 ? expr->maxDepth : 1];
+    for (i = 0; i < expr->numInstr; i++)
+    {
+        CalcInstr* in = &expr->instr[i];
+        number rside;
+        switch (in->op)
+        {
+            case CALC_CONST:
+                stack[++top] = in->value;
+                break;
+            case CALC_VAR:
+                // Invalid values count as zero like in calc_metric
+                rside = vars[in->arg];
+                stack[++top] = (isnan(rside) || isinf(rside) ? 0.0 : rside);
+                break;
+            case CALC_NEG:
+                stack[top] = -stack[top];
+                break;
+            case CALC_FUNC:
+                top -= in->nargs - 1;
+                stack[top] = calc_doFunc(in->arg, &stack[top], in->nargs);
+                break;
+            default:
+                rside = stack[top--];
+                switch (in->op)
+                {
+                    case CALC_ADD:
+                        stack[top] += rside;
+                        break;
+                    case CALC_SUB:
+                        stack[top] -= rside;
+                        break;
+                    case CALC_MUL:
+                        stack[top] *= rside;
+                        break;
+                    case CALC_DIV:
+                    case CALC_MOD:
+                        if (rside == 0)
+                            stack[top] = (stack[top] == 0 ? NAN : INFINITY);
+                        else if (in->op == CALC_DIV)
+                            stack[top] /= rside;
+                        else
+                            stack[top] -= ((int)(stack[top] / rside)) * rside;
+                        break;
+                    case CALC_POW:
+                        stack[top] = pow(stack[top], rside);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+        }
+    }
+    *result = (top == 0 ? stack[0] : NAN);
+    return (top == 0 ? 0 : -1);
+}
+
+/* Evaluates the formula for num sets of variables at once. The variables
+ * are stored slot by slot (vars[slot*num + i]), so every instruction is a
+ * simple loop over the sets. */
+int
+calculate_evalMany(CalcExpr* expr, int num, double* vars, double* result)
+{
+    int i, j, k;
+    int top = -1;
+    number* stack = NULL;
+    number* args = NULL;
+    if (!expr || !vars || !result || num <= 0)
+        return -1;
+    stack = malloc((expr->maxDepth > 0 ? expr->maxDepth : 1) * num * sizeof(number));
+    args = malloc((expr->maxDepth > 0 ? expr->maxDepth : 1) * sizeof(number));
+    if (!stack || !args)
+    {
+        free(stack);
+        free(args);
+        return -1;
+    }
+    for (i = 0; i < expr->numInstr; i++)
+    {
+        CalcInstr* in = &expr->instr[i];
+        number* r = NULL;
+        number* l = NULL;
+        switch (in->op)
+        {
+            case CALC_CONST:
+                l = &stack[(++top) * num];
+                for (j = 0; j < num; j++)
+                    l[j] = in->value;
+                break;
+            case CALC_VAR:
+                l = &stack[(++top) * num];
+                r = &vars[in->arg * num];
+                // Invalid values count as zero like in calc_metric
+                for (j = 0; j < num; j++)
+                    l[j] = (isnan(r[j]) || isinf(r[j]) ? 0.0 : r[j]);
+                break;
+            case CALC_NEG:
+                l = &stack[top * num];
+                for (j = 0; j < num; j++)
+                    l[j] = -l[j];
+                break;
+            case CALC_FUNC:
+                top -= in->nargs - 1;
+                l = &stack[top * num];
+                for (j = 0; j < num; j++)
+                {
+                    for (k = 0; k < in->nargs; k++)
+                        args[k] = l[k * num + j];
+                    l[j] = calc_doFunc(in->arg, args, in->nargs);
+                }
+                break;
+            default:
+                r = &stack[(top--) * num];
+                l = &stack[top * num];
+                switch (in->op)
+                {
+                    case CALC_ADD:
+                        for (j = 0; j < num; j++)
+                            l[j] += r[j];
+                        break;
+                    case CALC_SUB:
+                        for (j = 0; j < num; j++)
+                            l[j] -= r[j];
+                        break;
+                    case CALC_MUL:
+                        for (j = 0; j < num; j++)
+                            l[j] *= r[j];
+                        break;
+                    case CALC_DIV:
+                        for (j = 0; j < num; j++)
+                            l[j] = (r[j] == 0 ? (l[j] == 0 ? NAN : INFINITY) : l[j] / r[j]);
+                        break;
+                    case CALC_MOD:
+                        for (j = 0; j < num; j++)
+                            l[j] = (r[j] == 0 ? (l[j] == 0 ? NAN : INFINITY) : l[j] - ((int)(l[j] / r[j])) * r[j]);
+                        break;
+                    case CALC_POW:
+                        for (j = 0; j < num; j++)
+                            l[j] = pow(l[j], r[j]);
+                        break;
+                    default:
+                        break;
+                }
+                break;
+        }
+    }
+    if (top == 0)
+        memcpy(result, stack, num * sizeof(number));
+    free(stack);
+    free(args);
+    return (top == 0 ? 0 : -1);
+}
+
+void
+calculate_free(CalcExpr* expr)
+{
+    if (expr)
+    {
+        free(expr->instr);
+        free(expr);
+    }
+}
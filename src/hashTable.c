@@ -3,8 +3,9 @@
  *
  *      Filename:  hashTable.c
  *
- *      Description: Hashtable implementation based on SGLIB.
- *                   Used for Marker API result handling.
+ *      Description: Open-addressing hashtable without locks and with
+ *                   preallocated result slots. Used for Marker API result
+ *                   handling.
  *
  *      Version:   <VERSION>
  *      Released:  <DATE>
@@ -42,43 +43,388 @@
 #include <types.h>
 #include <hashTable.h>
 #include <likwid.h>
+#include <histogram.h>
+
+/* #####   MACROS  -  LOCAL TO THIS SOURCE FILE   ######################### */
+
+#define HASHTABLE_DEFAULT_REGIONS 512
+/* Tags up to this length are stored in the slot, longer ones (e.g. the keys of
+ * deeply nested regions) are allocated */
+#define HASHTABLE_INLINE_TAG 256
+#define HASHTABLE_CACHELINE 64
+#define HASHTABLE_ROUNDUP(x) ((((x) + HASHTABLE_CACHELINE - 1) / HASHTABLE_CACHELINE) * HASHTABLE_CACHELINE)
 
 /* #####   VARIABLES  -  LOCAL TO THIS SOURCE FILE   ###################### */
 
+/* One entry of the open-addressing index. The hash is claimed with a CAS,
+ * results is published after the slot is fully initialized. Lookups of the
+ * same tag wait for the publication. If no slot is left, the entry gets
+ * slotsExhausted instead, so the lookups do not wait forever. */
+typedef struct {
+    uint64_t hash;
+    LikwidThreadResults* volatile results;
+} HashTableEntry;
+
+/* Header of a preallocated result slot. The counter arrays of the slot follow
+ * directly behind it. Slots are cache-line aligned. The label points to tag
+ * or to an allocated copy of longer tags. */
 typedef struct {
+    LikwidThreadResults results;
+    struct tagbstring label;
+    char tag[HASHTABLE_INLINE_TAG];
+} HashTableSlot;
+
+#define HASHTABLE_SLOT_TAG(slot) ((char*)(slot)->label.data)
+
+struct ThreadList {
     pthread_t tid;
     uint32_t coreId;
     uint32_t hashIndex;
-    GHashTable* hashTable;
-} ThreadList;
+    uint32_t numEntries;
+    HashTableEntry* entries;
+    char* slots;
+    LikwidThreadResults** handleResults;
+};
 
 static ThreadList* threadList[MAX_NUM_THREADS];
+static uint32_t numSlots = HASHTABLE_DEFAULT_REGIONS;
+static size_t slotSize = 0;
+static int numEvents = 0;
+static int numHistograms = 0;
+static LikwidThreadResults slotsExhausted;
+
+/* #####   FUNCTION DEFINITIONS  -  LOCAL TO THIS SOURCE FILE   ########### */
+
+static uint64_t
+hashTable_hash(const char* str, int len)
+{
+    /* FNV-1a, the zero hash marks empty entries */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return (hash ? hash : 1);
+}
+
+static void
+hashTable_freeThread(ThreadList* resPtr)
+{
+    if (resPtr->slots)
+    {
+        uint32_t used = MIN(resPtr->hashIndex, numSlots);
+        for (uint32_t j = 0; j < used; j++)
+        {
+            HashTableSlot* slot = (HashTableSlot*) (resPtr->slots + (j * slotSize));
+            if (slot->label.data != (unsigned char*) slot->tag)
+            {
+                free(slot->label.data);
+            }
+        }
+    }
+    if (resPtr->entries)
+    {
+        free(resPtr->entries);
+    }
+    if (resPtr->slots)
+    {
+        free(resPtr->slots);
+    }
+    if (resPtr->handleResults)
+    {
+        free(resPtr->handleResults);
+    }
+    free(resPtr);
+}
+
+static ThreadList*
+hashTable_allocThread(int coreID)
+{
+    ThreadList* resPtr = (ThreadList*) malloc(sizeof(ThreadList));
+    if (!resPtr)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for the hash table of CPU %d\n",
+                sizeof(ThreadList), coreID);
+        return NULL;
+    }
+    /* initialize structure */
+    resPtr->tid =  pthread_self();
+    resPtr->coreId  = coreID;
+    resPtr->hashIndex = 0;
+    resPtr->numEntries = 2 * numSlots;
+    resPtr->entries = (HashTableEntry*) calloc(resPtr->numEntries, sizeof(HashTableEntry));
+    resPtr->handleResults = (LikwidThreadResults**) calloc(numSlots, sizeof(LikwidThreadResults*));
+    /* The slot memory is not touched here, so the pages are first touched by
+     * the thread measuring on this CPU */
+    if (posix_memalign((void**)&resPtr->slots, HASHTABLE_CACHELINE, numSlots * slotSize) != 0)
+    {
+        resPtr->slots = NULL;
+    }
+    if ((!resPtr->entries) || (!resPtr->handleResults) || (!resPtr->slots))
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for the hash table of CPU %d\n",
+                (resPtr->numEntries * sizeof(HashTableEntry)) +
+                (numSlots * (slotSize + sizeof(LikwidThreadResults*))), coreID);
+        hashTable_freeThread(resPtr);
+        return NULL;
+    }
+    return resPtr;
+}
+
+static ThreadList*
+hashTable_newThread(int coreID)
+{
+    ThreadList* resPtr = hashTable_allocThread(coreID);
+    if (!resPtr)
+    {
+        return NULL;
+    }
+    /* Another thread might have created the table for the same CPU in between */
+    if (!__sync_bool_compare_and_swap(&threadList[coreID], NULL, resPtr))
+    {
+        hashTable_freeThread(resPtr);
+        resPtr = threadList[coreID];
+    }
+    return resPtr;
+}
+
+static LikwidThreadResults*
+hashTable_initSlot(ThreadList* resPtr, const char* tag, int len)
+{
+    char* slotTag = NULL;
+    if (len >= HASHTABLE_INLINE_TAG)
+    {
+        slotTag = malloc(len + 1);
+        if (!slotTag)
+        {
+            fprintf(stderr, "Failed to allocate %d bytes for region tag %.*s\n", len + 1, len, tag);
+            return NULL;
+        }
+    }
+    uint32_t index = __sync_fetch_and_add(&resPtr->hashIndex, 1);
+    if (index >= numSlots)
+    {
+        fprintf(stderr, "Too many regions for CPU %d, increase LIKWID_MARKER_MAX_REGIONS (currently %u)\n",
+                resPtr->coreId, numSlots);
+        free(slotTag);
+        return NULL;
+    }
+    HashTableSlot* slot = (HashTableSlot*) (resPtr->slots + (index * slotSize));
+    char* data = ((char*)slot) + HASHTABLE_ROUNDUP(sizeof(HashTableSlot));
+    LikwidThreadResults* res = &slot->results;
+
+    if (!slotTag)
+    {
+        slotTag = slot->tag;
+    }
+    memcpy(slotTag, tag, len);
+    slotTag[len] = '\0';
+    slot->label.mlen = -1;
+    slot->label.slen = len;
+    slot->label.data = (unsigned char*) slotTag;
+
+    res->label = &slot->label;
+    res->index = index;
+    res->time = 0.0;
+    res->count = 0;
+    res->groupID = -1;
+    res->cpuID = resPtr->coreId;
+    res->state = MARKER_STATE_NEW;
+    res->StartPMcounters = (double*) data;
+    res->PMcounters = (double*) (data + (numEvents * sizeof(double)));
+    res->PMcountersSquares = (double*) (data + (2 * numEvents * sizeof(double)));
+    res->parentPMcounters = (double*) (data + (3 * numEvents * sizeof(double)));
+    res->StartOverflows = (int*) (data + (4 * numEvents * sizeof(double)));
+    res->histograms = NULL;
+    res->sampleRate = 0;
+    res->sampleRandom = 0;
+    res->sampleCountdown = 0;
+    res->sampled = 0;
+    res->measuring = 0;
+    res->timeSquares = 0.0;
+    res->parent = NULL;
+    res->parentCalls = 0;
+    res->parentSampled = 0;
+    res->parentResets = 0;
+    res->resets = 0;
+    res->parentTime = 0.0;
+    for (int i = 0; i < numEvents; i++)
+    {
+        res->PMcounters[i] = 0.0;
+        res->PMcountersSquares[i] = 0.0;
+        res->parentPMcounters[i] = 0.0;
+        res->StartPMcounters[i] = 0.0;
+        res->StartOverflows[i] = 0;
+    }
+    if (numHistograms > 0)
+    {
+        res->histograms = (uint32_t*) (data + HASHTABLE_ROUNDUP(numEvents * (4 * sizeof(double) + sizeof(int))));
+        memset(res->histograms, 0, numHistograms * HISTOGRAM_BUCKETS * sizeof(uint32_t));
+    }
+    return res;
+}
+
+static LikwidThreadResults*
+hashTable_lookup(ThreadList* resPtr, bstring label, int create)
+{
+    const char* tag = bdata(label);
+    int len = blength(label);
+    uint64_t hash = hashTable_hash(tag, len);
+    uint32_t mask = resPtr->numEntries - 1;
+    uint32_t pos = hash & mask;
+
+    for (uint32_t i = 0; i < resPtr->numEntries; i++)
+    {
+        HashTableEntry* entry = &resPtr->entries[pos];
+        uint64_t entryHash = entry->hash;
+        if (entryHash == 0)
+        {
+            if (!create)
+            {
+                return NULL;
+            }
+            if (__sync_bool_compare_and_swap(&entry->hash, 0, hash))
+            {
+                /* if region is not known create new region and publish it */
+                LikwidThreadResults* res = hashTable_initSlot(resPtr, tag, len);
+                __sync_synchronize();
+                entry->results = (res ? res : &slotsExhausted);
+                return res;
+            }
+            entryHash = entry->hash;
+        }
+        if (entryHash == hash)
+        {
+            LikwidThreadResults* res = NULL;
+            /* Wait until a concurrent insert of the entry is published */
+            while ((res = entry->results) == NULL);
+            if (res == &slotsExhausted)
+            {
+                return NULL;
+            }
+            if ((blength(res->label) == len) && (memcmp(res->label->data, tag, len) == 0))
+            {
+                return res;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
 
 /* #####   FUNCTION DEFINITIONS  -  EXPORTED FUNCTIONS   ################## */
 
+/* Adds the calls of a nested region inside of its measured enclosing region
+ * to the children sums of the enclosing region. The calls are extrapolated
+ * with the sampling ratio of the nested region. */
+static void
+hashTable_addChild(LikwidResults* parent, LikwidThreadResults* child, uint32_t numberOfThreads, int threadId)
+{
+    double scale = ((double)child->parentCalls) / child->parentSampled;
+    if (parent->children == NULL)
+    {
+        parent->children = (double**) calloc(numberOfThreads, sizeof(double*));
+        if (parent->children == NULL)
+        {
+            return;
+        }
+    }
+    if (parent->children[threadId] == NULL)
+    {
+        parent->children[threadId] = (double*) calloc(numEvents + 1, sizeof(double));
+        if (parent->children[threadId] == NULL)
+        {
+            return;
+        }
+    }
+    parent->children[threadId][0] += child->parentTime * scale;
+    for (int k = 0; k < numEvents; k++)
+    {
+        parent->children[threadId][k+1] += child->parentPMcounters[k] * scale;
+    }
+}
+
+static void
+hashTable_allocSampled(LikwidResults* results, uint32_t numberOfThreads)
+{
+    results->sampled = (uint32_t*) malloc(numberOfThreads * sizeof(uint32_t));
+    results->errors = (double**) calloc(numberOfThreads, sizeof(double*));
+    if (!results->sampled || !results->errors)
+    {
+        fprintf(stderr, "Failed to allocate space for the sampling results\n");
+        free(results->sampled);
+        free(results->errors);
+        results->sampled = NULL;
+        results->errors = NULL;
+        return;
+    }
+    for (uint32_t j = 0; j < numberOfThreads; j++)
+    {
+        results->sampled[j] = UINT32_MAX;
+        results->errors[j] = (double*) calloc(numEvents + 1, sizeof(double));
+        if (!results->errors[j])
+        {
+            fprintf(stderr, "Failed to allocate space for the sampling results\n");
+            for (uint32_t k = 0; k < j; k++)
+            {
+                free(results->errors[k]);
+            }
+            free(results->sampled);
+            free(results->errors);
+            results->sampled = NULL;
+            results->errors = NULL;
+            return;
+        }
+    }
+}
+
 void
-hashTable_init()
+hashTable_init(int maxEvents, int maxHistograms)
 {
+    char* regionStr = getenv("LIKWID_MARKER_MAX_REGIONS");
+    /* The tables of a previous run are freed with the old sizes */
     for (int i=0; i<MAX_NUM_THREADS; i++)
     {
+        if (threadList[i] != NULL)
+        {
+            hashTable_freeThread(threadList[i]);
+        }
         threadList[i] = NULL;
     }
+    numSlots = HASHTABLE_DEFAULT_REGIONS;
+    if (regionStr != NULL)
+    {
+        int regions = atoi(regionStr);
+        if (regions > 0)
+        {
+            numSlots = 1;
+            while (numSlots < (uint32_t)regions)
+            {
+                numSlots *= 2;
+            }
+        }
+    }
+    numEvents = maxEvents;
+    numHistograms = maxHistograms;
+    slotSize = HASHTABLE_ROUNDUP(sizeof(HashTableSlot)) +
+               HASHTABLE_ROUNDUP(numEvents * (4 * sizeof(double) + sizeof(int))) +
+               (numHistograms * HISTOGRAM_BUCKETS * sizeof(uint32_t));
+}
+
+uint32_t
+hashTable_getMaxRegions(void)
+{
+    return numSlots;
 }
 
 void
 hashTable_initThread(int coreID)
 {
-    ThreadList* resPtr = threadList[coreID];
     /* check if thread was already initialized */
-    if (resPtr == NULL)
+    if (threadList[coreID] == NULL)
     {
-        resPtr = (ThreadList*) malloc(sizeof(ThreadList));
-        /* initialize structure */
-        resPtr->tid =  pthread_self();
-        resPtr->coreId  = coreID;
-        resPtr->hashIndex = 0;
-        resPtr->hashTable = g_hash_table_new(g_str_hash, g_str_equal);
-        threadList[coreID] = resPtr;
+        hashTable_newThread(coreID);
     }
 }
 
@@ -86,57 +432,93 @@ int
 hashTable_test(bstring label)
 {
     int coreID = likwid_getProcessorId();
-    LikwidThreadResults* resEntry = NULL;
     ThreadList* resPtr = threadList[coreID];
-    resEntry = g_hash_table_lookup(resPtr->hashTable, (gpointer) bdata(label));
-    if (resEntry != NULL)
+    if ((resPtr != NULL) && (hashTable_lookup(resPtr, label, 0) != NULL))
         return 1;
     return 0;
 }
 
+ThreadList*
+hashTable_getThreadList(int coreID)
+{
+    ThreadList* resPtr = threadList[coreID];
+
+    /* check if thread was already initialized */
+    if (resPtr == NULL)
+    {
+        resPtr = hashTable_newThread(coreID);
+    }
+    return resPtr;
+}
 
 int
 hashTable_get(bstring label, LikwidThreadResults** resEntry)
 {
     int coreID = likwid_getProcessorId();
-    ThreadList* resPtr = threadList[coreID];
+    ThreadList* resPtr = hashTable_getThreadList(coreID);
 
-    /* check if thread was already initialized */
+    (*resEntry) = (resPtr ? hashTable_lookup(resPtr, label, 1) : NULL);
+
+    return coreID;
+}
+
+/* Tables that are not registered for a CPU and not part of the results,
+ * e.g. for the calibration of the Marker API overhead */
+ThreadList*
+hashTable_newList(int coreID)
+{
+    return hashTable_allocThread(coreID);
+}
+
+void
+hashTable_freeList(ThreadList* list)
+{
+    if (list)
+    {
+        hashTable_freeThread(list);
+    }
+}
+
+int
+hashTable_getList(ThreadList* resPtr, bstring label, LikwidThreadResults** resEntry)
+{
     if (resPtr == NULL)
     {
-        resPtr = (ThreadList*) malloc(sizeof(ThreadList));
-        /* initialize structure */
-        resPtr->tid =  pthread_self();
-        resPtr->coreId  = coreID;
-        resPtr->hashIndex = 0;
-        resPtr->hashTable = g_hash_table_new(g_str_hash, g_str_equal);
-        threadList[coreID] = resPtr;
+        (*resEntry) = NULL;
+        return -1;
     }
+    (*resEntry) = hashTable_lookup(resPtr, label, 1);
 
-    (*resEntry) = g_hash_table_lookup(resPtr->hashTable, (gpointer) bdata(label));
+    return resPtr->coreId;
+}
 
-    /* if region is not known create new region and add to hashtable */
-    if ( (*resEntry) == NULL )
+int
+hashTable_getHandle(ThreadList* resPtr, uint32_t slot, LikwidThreadResults** resEntry)
+{
+    (*resEntry) = NULL;
+    if ((resPtr != NULL) && (slot < numSlots))
     {
-        (*resEntry) = (LikwidThreadResults*) malloc(sizeof(LikwidThreadResults));
-        (*resEntry)->label = bstrcpy (label);
-        (*resEntry)->time = 0.0;
-        (*resEntry)->count = 0;
-        (*resEntry)->index = resPtr->hashIndex++;
-        (*resEntry)->state = MARKER_STATE_NEW;
-        for (int i=0; i< NUM_PMC; i++)
-        {
-            (*resEntry)->PMcounters[i] = 0.0;
-            (*resEntry)->StartPMcounters[i] = 0.0;
-        }
+        (*resEntry) = resPtr->handleResults[slot];
+    }
+    return (resPtr ? resPtr->coreId : -1);
+}
 
-        g_hash_table_insert(
-                resPtr->hashTable,
-                (gpointer) g_strdup(bdata(label)),
-                (gpointer) (*resEntry));
+int
+hashTable_setHandle(ThreadList* resPtr, uint32_t slot, bstring label, LikwidThreadResults** resEntry)
+{
+    if (resPtr == NULL)
+    {
+        (*resEntry) = NULL;
+        return -1;
+    }
+    (*resEntry) = hashTable_lookup(resPtr, label, 1);
+    /* Handles beyond the cache size are resolved through the index every time */
+    if (slot < numSlots)
+    {
+        resPtr->handleResults[slot] = (*resEntry);
     }
 
-    return coreID;
+    return resPtr->coreId;
 }
 
 void
@@ -147,18 +529,26 @@ hashTable_finalize(int* numThreads, int* numRegions, LikwidResults** results)
     uint32_t numberOfRegions = 0;
     GHashTable* regionLookup;
 
-    regionLookup = g_hash_table_new(g_str_hash, g_str_equal);
-    /* determine number of active threads */
+    regionLookup = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    /* determine number of active threads and assign the region IDs in the
+     * order the regions were created */
     for (int i=0; i<MAX_NUM_THREADS; i++)
     {
-        if (threadList[i] != NULL)
+        ThreadList* resPtr = threadList[i];
+        if (resPtr != NULL)
         {
+            uint32_t threadNumberOfRegions = MIN(resPtr->hashIndex, numSlots);
             numberOfThreads++;
-            uint32_t threadNumberOfRegions = g_hash_table_size(threadList[i]->hashTable);
-            /*  Determine maximum number of regions */
-            if (numberOfRegions < threadNumberOfRegions)
+            for (uint32_t j = 0; j < threadNumberOfRegions; j++)
             {
-                numberOfRegions = threadNumberOfRegions;
+                HashTableSlot* slot = (HashTableSlot*) (resPtr->slots + (j * slotSize));
+                if (g_hash_table_lookup(regionLookup, HASHTABLE_SLOT_TAG(slot)) == NULL)
+                {
+                    /* The value is the region ID plus one to distinguish ID 0 from not found */
+                    g_hash_table_insert(regionLookup, g_strdup(HASHTABLE_SLOT_TAG(slot)),
+                                        (gpointer)(uintptr_t)(numberOfRegions + 1));
+                    numberOfRegions++;
+                }
             }
         }
     }
@@ -223,57 +613,110 @@ hashTable_finalize(int* numThreads, int* numRegions, LikwidResults** results)
                     }
                 }
             }
+            (*results)[i].tag = NULL;
+            (*results)[i].threadCount = numberOfThreads;
+            (*results)[i].eventCount = numEvents;
+            (*results)[i].histCount = numHistograms;
+            (*results)[i].histEvents = NULL;
+            (*results)[i].histograms = NULL;
+            (*results)[i].sampled = NULL;
+            (*results)[i].errors = NULL;
+            (*results)[i].parent = -1;
+            (*results)[i].children = NULL;
+            (*results)[i].overheads = NULL;
+            if (numHistograms > 0)
+            {
+                /* The histograms point into the slots of the hash table */
+                (*results)[i].histograms = (uint32_t**) calloc(numberOfThreads * numHistograms, sizeof(uint32_t*));
+            }
         }
     }
 
-    uint32_t regionIds[numberOfRegions];
-
-    for (int core=0; core<MAX_NUM_THREADS; core++)
+    for (int core=0; core<MAX_NUM_THREADS && (*results); core++)
     {
         ThreadList* resPtr = threadList[core];
 
         if (resPtr != NULL)
         {
-            LikwidThreadResults* threadResult  = NULL;
-            GHashTableIter iter;
-            gpointer key, value;
-            g_hash_table_iter_init (&iter, resPtr->hashTable);
+            uint32_t threadNumberOfRegions = MIN(resPtr->hashIndex, numSlots);
 
             /* iterate over all regions in thread */
-            while (g_hash_table_iter_next (&iter, &key, &value))
+            for (uint32_t j = 0; j < threadNumberOfRegions; j++)
             {
-                threadResult = (LikwidThreadResults*) value;
-                uint32_t* regionId = (uint32_t*) g_hash_table_lookup(regionLookup, key);
+                HashTableSlot* slot = (HashTableSlot*) (resPtr->slots + (j * slotSize));
+                LikwidThreadResults* threadResult = &slot->results;
+                uint32_t regionId = (uint32_t)(uintptr_t)g_hash_table_lookup(regionLookup, HASHTABLE_SLOT_TAG(slot)) - 1;
 
                 /* is region not yet registered, this is the case for the first
-                 * processed CPU core that has a hash table.
+                 * processed CPU core that has the region.
                  */
-                if ( regionId == NULL )
+                if ( (*results)[regionId].tag == NULL )
                 {
-                    (*results)[threadResult->index].tag = bstrcpy (threadResult->label);
-                    (*results)[threadResult->index].groupID = threadResult->groupID;
-                    regionIds[threadResult->index] = threadResult->index;
-                    regionId = regionIds + threadResult->index;
-                    /* The region id is added to a temporary hash table with the
-                     * region label as key to get it back for all following
-                     * threads.
-                     */
-                    g_hash_table_insert(regionLookup, g_strdup(key), (regionIds+threadResult->index));
+                    (*results)[regionId].tag = bstrcpy (threadResult->label);
+                    (*results)[regionId].groupID = threadResult->groupID;
+                }
+                else if ((*results)[regionId].groupID < 0)
+                {
+                    (*results)[regionId].groupID = threadResult->groupID;
                 }
 
-                (*results)[*regionId].count[threadId] = threadResult->count;
-                (*results)[*regionId].time[threadId] = threadResult->time;
-                (*results)[*regionId].cpulist[threadId] = threadResult->cpuID;
+                (*results)[regionId].count[threadId] = threadResult->count;
+                (*results)[regionId].time[threadId] = threadResult->time;
+                (*results)[regionId].cpulist[threadId] = threadResult->cpuID;
 
-                for ( int j=0; j < NUM_PMC; j++ )
+                for ( int k=0; k < numEvents; k++ )
+                {
+                    (*results)[regionId].counters[threadId][k] = threadResult->PMcounters[k];
+                }
+                if ((*results)[regionId].histograms)
+                {
+                    for ( int h=0; h < numHistograms; h++ )
+                    {
+                        (*results)[regionId].histograms[(threadId * numHistograms) + h] =
+                                threadResult->histograms + (h * HISTOGRAM_BUCKETS);
+                    }
+                }
+                if (threadResult->parent != NULL)
+                {
+                    /* The results are the first member of the parent's slot */
+                    HashTableSlot* parentSlot = (HashTableSlot*) threadResult->parent;
+                    (*results)[regionId].parent = (int)(uintptr_t)g_hash_table_lookup(regionLookup, HASHTABLE_SLOT_TAG(parentSlot)) - 1;
+                }
+                if (((*results)[regionId].parent >= 0) && (threadResult->parentSampled > 0) &&
+                    (threadResult->parentResets == threadResult->parent->resets))
+                {
+                    hashTable_addChild(&(*results)[(*results)[regionId].parent], threadResult, numberOfThreads, threadId);
+                }
+                if ((threadResult->sampleRate > 1) && ((*results)[regionId].sampled == NULL))
                 {
-                    (*results)[*regionId].counters[threadId][j] = threadResult->PMcounters[j];
+                    hashTable_allocSampled(&(*results)[regionId], numberOfThreads);
+                }
+                if ((*results)[regionId].sampled)
+                {
+                    /* The sums of squares are turned into error estimates by the Marker API */
+                    (*results)[regionId].sampled[threadId] = threadResult->sampled;
+                    (*results)[regionId].errors[threadId][0] = threadResult->timeSquares;
+                    for ( int k=0; k < numEvents; k++ )
+                    {
+                        (*results)[regionId].errors[threadId][k+1] = threadResult->PMcountersSquares[k];
+                    }
                 }
             }
 
             threadId++;
         }
     }
+    for ( uint32_t i=0; i < numberOfRegions && (*results); i++ )
+    {
+        for ( uint32_t j=0; j < numberOfThreads && (*results)[i].sampled; j++ )
+        {
+            /* Threads without sampling measured all calls */
+            if ((*results)[i].sampled[j] == UINT32_MAX)
+            {
+                (*results)[i].sampled[j] = (*results)[i].count[j];
+            }
+        }
+    }
     g_hash_table_destroy(regionLookup);
     regionLookup = NULL;
     (*numThreads) = numberOfThreads;
@@ -287,10 +730,8 @@ void __attribute__((destructor (102))) hashTable_finalizeDestruct(void)
         ThreadList* resPtr = threadList[core];
         if (resPtr != NULL)
         {
-            g_hash_table_destroy(resPtr->hashTable);
-            free(resPtr);
+            hashTable_freeThread(resPtr);
             threadList[core] = NULL;
         }
     }
 }
-
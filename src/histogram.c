@@ -0,0 +1,98 @@
+/*
+ * =======================================================================================
+ *
+ *      Filename:  histogram.c
+ *
+ *      Description:  Fixed-size log-linear histograms for Marker API regions
+ *
+ *      Version:   <VERSION>
+ *      Released:  <DATE>
+ *
+ *      Author:   Thomas Gruber (tr), thomas.roehl@googlemail.com
+ *      Project:  likwid
+ *
+ *      Copyright (C) 2016 RRZE, University Erlangen-Nuremberg
+ *
+ *      This program is free software: you can redistribute it and/or modify it under
+ *      the terms of the GNU General Public License as published by the Free Software
+ *      Foundation, either version 3 of the License, or (at your option) any later
+ *      version.
+ *
+ *      This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *      WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *      PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along with
+ *      this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * =======================================================================================
+ */
+
+/* #####   HEADER FILE INCLUDES   ######################################### */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <histogram.h>
+
+/* #####   FUNCTION DEFINITIONS  -  EXPORTED FUNCTIONS   ################## */
+
+double
+histogram_value(uint32_t index)
+{
+    if (index < HISTOGRAM_LINEAR)
+    {
+        return (double)index;
+    }
+    uint32_t shift = ((index - HISTOGRAM_LINEAR) / HISTOGRAM_HALF) + 1;
+    uint64_t sub = ((index - HISTOGRAM_LINEAR) % HISTOGRAM_HALF) + HISTOGRAM_HALF;
+    /* Middle of the value range covered by the bucket */
+    return (double)(sub << shift) + ((double)((1ULL << shift) - 1) / 2.0);
+}
+
+uint64_t
+histogram_count(const uint32_t* buckets)
+{
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        count += buckets[i];
+    }
+    return count;
+}
+
+void
+histogram_add(uint32_t* dest, const uint32_t* src)
+{
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        dest[i] += src[i];
+    }
+}
+
+double
+histogram_percentile(const uint32_t* buckets, double percentile)
+{
+    uint64_t count = histogram_count(buckets);
+    uint64_t rank = 0;
+    uint64_t sum = 0;
+    if ((count == 0) || (percentile < 0) || (percentile > 100))
+    {
+        return NAN;
+    }
+    rank = (uint64_t)ceil((percentile / 100.0) * (double)count);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        sum += buckets[i];
+        if (sum >= rank)
+        {
+            return histogram_value(i);
+        }
+    }
+    return NAN;
+}
@@ -38,5 +38,9 @@ void HPMfinalize();
 int HPMread(int cpu_id, PciDeviceIndex dev, uint32_t reg, uint64_t* data);
 int HPMwrite(int cpu_id, PciDeviceIndex dev, uint32_t reg, uint64_t data);
 int HPMcheck(PciDeviceIndex dev, int cpu_id);
+int HPMbatch(int cpu_id, AccessDataRecord* records, int count);
+AccessDataRecord* HPMprefetchBuffer(int cpu_id, int count);
+int HPMprefetch(int cpu_id, AccessDataRecord* records, int count);
+void HPMprefetchClear(int cpu_id);
 
 #endif /* ACCESS_H */
@@ -37,9 +37,22 @@ typedef enum {
     DAEMON_READ = 0,
     DAEMON_WRITE,
     DAEMON_CHECK,
-    DAEMON_EXIT
+    DAEMON_EXIT,
+    DAEMON_BATCH,
+    DAEMON_SHM,
+    DAEMON_WORKERS
 } AccessType;
 
+/* A DAEMON_BATCH record carries the number of following records in its data
+ * field. The daemon executes the records in order and replies with all of
+ * them in one message, each with its own errorcode. */
+#define ACCESS_BATCH_MAX_RECORDS 512
+
+/* A DAEMON_WORKERS record as first request asks the daemon to accept as
+ * many additional connections as given in the data field. Each of them
+ * starts with another DAEMON_WORKERS record that carries the socket in the
+ * cpu field and is served by a daemon thread pinned to that socket. */
+
 typedef enum {
     ERR_NOERROR = 0,  /* no error */
     ERR_UNKNOWN,      /* unknown command */
@@ -48,7 +61,8 @@ typedef enum {
     ERR_RWFAIL,       /* failure to read/write msr */
     ERR_DAEMONBUSY,   /* daemon already has another client */
     ERR_NODEV,        /* No such device */
-    ERR_LOCKED        /* Global lock is set */
+    ERR_LOCKED,       /* Global lock is set */
+    ERR_CONFLICT      /* Register is leased by another client */
 } AccessErrorType;
 
 typedef struct {
@@ -60,6 +74,19 @@ typedef struct {
     AccessErrorType errorcode; /* Only in replies - 0 if no error. */
 } AccessDataRecord;
 
+/* Shared memory channel between client and daemon. The client passes a
+ * sealed memfd with a DAEMON_SHM record over the socket, afterwards all
+ * requests go through this area: the client fills records and count and
+ * bumps req_seq, the daemon executes the records in place and sets resp_seq
+ * to the same value. Both sides sleep on the sequence words with futexes. */
+typedef struct {
+    uint32_t req_seq;
+    uint32_t resp_seq;
+    uint32_t count;
+    uint32_t reserved;
+    AccessDataRecord records[ACCESS_BATCH_MAX_RECORDS];
+} AccessShmChannel;
+
 extern int accessClient_mode;
 
 #endif /*ACCESSCLIENT_TYPES_H*/
@@ -33,4 +33,13 @@
 
 int calculate_infix(char* finfix, double *result);
 
+/* A formula compiled once into postfix instructions. Identifiers refer to
+ * slots in the variable array passed to calculate_eval */
+typedef struct CalcExpr CalcExpr;
+
+int calculate_compile(char* finfix, int numVars, char** varNames, CalcExpr** expr);
+int calculate_eval(CalcExpr* expr, double* vars, double *result);
+int calculate_evalMany(CalcExpr* expr, int num, double* vars, double* result);
+void calculate_free(CalcExpr* expr);
+
 #endif
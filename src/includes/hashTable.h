@@ -35,10 +35,19 @@
 #include <bstrlib.h>
 #include <types.h>
 
-extern void hashTable_init();
+typedef struct ThreadList ThreadList;
+
+extern void hashTable_init(int maxEvents, int maxHistograms);
+extern uint32_t hashTable_getMaxRegions(void);
 void hashTable_initThread(int coreID);
 extern int hashTable_test(bstring label);
 extern int hashTable_get(bstring regionTag, LikwidThreadResults** result);
+extern ThreadList* hashTable_getThreadList(int coreID);
+extern ThreadList* hashTable_newList(int coreID);
+extern void hashTable_freeList(ThreadList* list);
+extern int hashTable_getList(ThreadList* list, bstring regionTag, LikwidThreadResults** result);
+extern int hashTable_getHandle(ThreadList* list, uint32_t slot, LikwidThreadResults** result);
+extern int hashTable_setHandle(ThreadList* list, uint32_t slot, bstring regionTag, LikwidThreadResults** result);
 extern void hashTable_finalize(int* numberOfThreads, int* numberOfRegions, LikwidResults** results);
 
 #endif /*CPUID_H*/
@@ -0,0 +1,67 @@
+/*
+ * =======================================================================================
+ *
+ *      Filename:  histogram.h
+ *
+ *      Description:  Header File histogram Module.
+ *                    Fixed-size log-linear histograms (HDR-style) for
+ *                    per-invocation values of Marker API regions
+ *
+ *      Version:   <VERSION>
+ *      Released:  <DATE>
+ *
+ *      Author:   Thomas Gruber (tr), thomas.roehl@googlemail.com
+ *      Project:  likwid
+ *
+ *      Copyright (C) 2016 RRZE, University Erlangen-Nuremberg
+ *
+ *      This program is free software: you can redistribute it and/or modify it under
+ *      the terms of the GNU General Public License as published by the Free Software
+ *      Foundation, either version 3 of the License, or (at your option) any later
+ *      version.
+ *
+ *      This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ *      WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ *      PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along with
+ *      this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * =======================================================================================
+ */
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Values below 2^HISTOGRAM_SUB_BITS are counted exactly. Above, each power of
+ * two is split into 2^(HISTOGRAM_SUB_BITS-1) linear buckets, so the relative
+ * error of a reported value is below 2^-HISTOGRAM_SUB_BITS (1.6%). */
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_LINEAR (1U << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_HALF (1U << (HISTOGRAM_SUB_BITS - 1))
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + ((64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_HALF))
+
+static inline uint32_t
+histogram_index(uint64_t value)
+{
+    if (value < HISTOGRAM_LINEAR)
+    {
+        return (uint32_t)value;
+    }
+    int shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BITS + 1;
+    return HISTOGRAM_LINEAR + ((shift - 1) * HISTOGRAM_HALF) + (uint32_t)((value >> shift) - HISTOGRAM_HALF);
+}
+
+static inline void
+histogram_record(uint32_t* buckets, uint64_t value)
+{
+    buckets[histogram_index(value)]++;
+}
+
+extern double histogram_value(uint32_t index);
+extern uint64_t histogram_count(const uint32_t* buckets);
+extern void histogram_add(uint32_t* dest, const uint32_t* src);
+extern double histogram_percentile(const uint32_t* buckets, double percentile);
+
+#endif /*HISTOGRAM_H*/
@@ -47,10 +47,32 @@ typedef struct LikwidThreadResults{
     int groupID;
     int cpuID;
     uint32_t count;
-    double StartPMcounters[NUM_PMC];
-    int StartOverflows[NUM_PMC];
-    double PMcounters[NUM_PMC];
+    double* StartPMcounters;
+    int* StartOverflows;
+    double* PMcounters;
+    uint32_t* histograms;
     LikwidThreadStates state;
+    /* Sampling (LIKWID_MARKER_SAMPLE): only every sampleRate-th call is
+     * measured, the sums of squares are used for the error estimate */
+    uint32_t sampleRate;
+    uint32_t sampleRandom;
+    uint32_t sampleCountdown;
+    uint32_t sampled;
+    int measuring;
+    double timeSquares;
+    double* PMcountersSquares;
+    /* Call path: the enclosing region and the sums of the calls measured
+     * while the enclosing region was measured. The calls are sampled with the
+     * rate of this region, the sums are scaled with parentCalls/parentSampled
+     * and subtracted from the enclosing region for its exclusive values. The
+     * sums are only valid as long as the enclosing region was not reset. */
+    struct LikwidThreadResults* parent;
+    uint32_t parentCalls;
+    uint32_t parentSampled;
+    uint32_t parentResets;
+    uint32_t resets;
+    double parentTime;
+    double* parentPMcounters;
 } LikwidThreadResults;
 
 typedef struct {
@@ -81,6 +103,60 @@ typedef struct {
     uint32_t*  count;
     int* cpulist;
     double** counters;
+    int histCount;
+    int* histEvents;
+    uint32_t** histograms;
+    /* Only for sampled regions: number of measured calls and the standard
+     * error of the extrapolated totals (index 0 is the time, then the events) */
+    uint32_t* sampled;
+    double** errors;
+    /* Call path: ID of the enclosing region (-1 for top-level regions) and the
+     * sums of the nested regions (index 0 is the time, then the events) */
+    int parent;
+    double** children;
+    /* Only with LIKWID_MARKER_OVERHEAD: the Marker API overhead subtracted from
+     * the time and the events (index 0 is the time, then the events) */
+    double** overheads;
 } LikwidResults;
 
+/* Binary Marker API result file. All offsets are in bytes from the start of
+ * the file and aligned to 8 bytes, so the file can be mapped and used without
+ * parsing. The values of a region are stored as columns over its threads. */
+#define LIKWID_MARKER_FILE_MAGIC "LIKWIDMF"
+#define LIKWID_MARKER_FILE_VERSION 4
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t histogramBuckets;
+    int32_t numberOfThreads;
+    int32_t numberOfRegions;
+    int32_t numberOfGroups;
+    uint32_t reserved;
+    uint64_t regionOffset;      /* LikwidMarkerFileRegion[numberOfRegions] */
+    uint64_t stringOffset;      /* NUL-terminated region tags */
+    uint64_t stringSize;
+    uint64_t fileSize;
+} LikwidMarkerFileHeader;
+
+typedef struct {
+    uint64_t tagOffset;         /* relative to stringOffset */
+    int32_t groupID;
+    uint32_t threadCount;
+    uint32_t eventCount;
+    uint32_t histCount;
+    uint64_t cpulistOffset;     /* int32_t[threadCount] */
+    uint64_t countOffset;       /* uint32_t[threadCount] */
+    uint64_t timeOffset;        /* double[threadCount] */
+    uint64_t counterOffset;     /* double[threadCount][eventCount] */
+    uint64_t errorOffset;       /* double[threadCount][eventCount+1] or 0 if not sampled */
+    uint64_t sampledOffset;     /* uint32_t[threadCount] or 0 if not sampled */
+    int32_t parent;             /* ID of the enclosing region or -1 */
+    uint32_t reserved;
+    uint64_t childOffset;       /* double[threadCount][eventCount+1] or 0 without nested regions */
+    uint64_t overheadOffset;    /* double[threadCount][eventCount+1] or 0 without overhead correction */
+    uint64_t histEventOffset;   /* int32_t[histCount], -1 is the runtime */
+    uint64_t histogramOffset;   /* uint32_t[threadCount][histCount][histogramBuckets] */
+} LikwidMarkerFileRegion;
+
 #endif /*LIBPERFCTR_H*/
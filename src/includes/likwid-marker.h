@@ -56,6 +56,18 @@ Shortcut for likwid_markerStartRegion() with \a regionTag if compiled with -DLIK
 Shortcut for likwid_markerStopRegion() with \a regionTag if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
 */
 /*!
+\def LIKWID_MARKER_REGISTER_H(regionTag, handle)
+Shortcut for likwid_markerRegisterRegionH() with \a regionTag and \a handle if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
+*/
+/*!
+\def LIKWID_MARKER_START_H(handle)
+Shortcut for likwid_markerStartRegionH() with \a handle if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
+*/
+/*!
+\def LIKWID_MARKER_STOP_H(handle)
+Shortcut for likwid_markerStopRegionH() with \a handle if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
+*/
+/*!
 \def LIKWID_MARKER_GET(regionTag, nevents, events, time, count)
 Shortcut for likwid_markerGetResults() for \a regionTag if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
 */
@@ -64,6 +76,10 @@ Shortcut for likwid_markerGetResults() for \a regionTag if compiled with -DLIKWI
 Shortcut for likwid_markerNextGroup() if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
 */
 /*!
+\def LIKWID_MARKER_SAMPLE(regionTag, rate)
+Shortcut for likwid_markerSetSampleRate() with deterministic sampling if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
+*/
+/*!
 \def LIKWID_MARKER_RESET(regionTag)
 Shortcut for likwid_markerResetRegion() if compiled with -DLIKWID_PERFMON. Otherwise no operation is performed
 */
@@ -85,9 +101,13 @@ Shortcut for likwid_markerWriteFile() if compiled with -DLIKWID_PERFMON. Otherwi
 #define LIKWID_MARKER_REGISTER(regionTag) likwid_markerRegisterRegion(regionTag)
 #define LIKWID_MARKER_START(regionTag) likwid_markerStartRegion(regionTag)
 #define LIKWID_MARKER_STOP(regionTag) likwid_markerStopRegion(regionTag)
+#define LIKWID_MARKER_REGISTER_H(regionTag, handle) likwid_markerRegisterRegionH(regionTag, handle)
+#define LIKWID_MARKER_START_H(handle) likwid_markerStartRegionH(handle)
+#define LIKWID_MARKER_STOP_H(handle) likwid_markerStopRegionH(handle)
 #define LIKWID_MARKER_CLOSE likwid_markerClose()
 #define LIKWID_MARKER_WRITE_FILE(markerfile) likwid_markerWriteFile(markerfile)
 #define LIKWID_MARKER_RESET(regionTag) likwid_markerResetRegion(regionTag)
+#define LIKWID_MARKER_SAMPLE(regionTag, rate) likwid_markerSetSampleRate(regionTag, rate, 0)
 #define LIKWID_MARKER_GET(regionTag, nevents, events, time, count) likwid_markerGetRegion(regionTag, nevents, events, time, count)
 #else  /* LIKWID_PERFMON */
 #define LIKWID_MARKER_INIT
@@ -96,10 +116,14 @@ Shortcut for likwid_markerWriteFile() if compiled with -DLIKWID_PERFMON. Otherwi
 #define LIKWID_MARKER_REGISTER(regionTag)
 #define LIKWID_MARKER_START(regionTag)
 #define LIKWID_MARKER_STOP(regionTag)
+#define LIKWID_MARKER_REGISTER_H(regionTag, handle)
+#define LIKWID_MARKER_START_H(handle)
+#define LIKWID_MARKER_STOP_H(handle)
 #define LIKWID_MARKER_CLOSE
 #define LIKWID_MARKER_WRITE_FILE(markerfile)
 #define LIKWID_MARKER_GET(regionTag, nevents, events, time, count)
 #define LIKWID_MARKER_RESET(regionTag)
+#define LIKWID_MARKER_SAMPLE(regionTag, rate)
 #endif /* LIKWID_PERFMON */
 
 
@@ -155,13 +155,18 @@ structures of LIKWID. Reads environment variables:
 - LIKWID_EVENTS (event string)
 - LIKWID_THREADS (cpu list separated by ,)
 - LIKWID_GROUPS (amount of groups)
+- LIKWID_MARKER_MAX_REGIONS (optional, maximal number of regions per thread and of region handles, default 512)
+- LIKWID_MARKER_HISTOGRAM (optional, record per-call histograms of the runtime with 1 or of the runtime and a comma-separated list of counters)
+- LIKWID_MARKER_SAMPLE (optional, comma-separated list of region:N or region:N:random to measure only one of N calls of a region)
+- LIKWID_MARKER_OVERHEAD (optional, calibrate the overhead of a start/stop pair per thread and subtract it from the regions with 1)
 */
 extern void likwid_markerInit(void) __attribute__((visibility("default")));
 /*! \brief Initialize LIKWID's marker API for the current thread
 
 Must be called in parallel region of the application to set up basic data
 structures of LIKWID. Before you can call likwid_markerThreadInit() you have to
-call likwid_markerInit().
+call likwid_markerInit(). With LIKWID_MARKER_OVERHEAD, the overhead of the
+Marker API is calibrated for the thread.
 
 */
 extern void likwid_markerThreadInit(void)
@@ -179,13 +184,16 @@ extern void likwid_markerNextGroup(void) __attribute__((visibility("default")));
 
 Must be called in serial region of the application. It gathers all data of
 regions and writes them out to a file (filepath in env variable
-LIKWID_FILEPATH).
+LIKWID_FILEPATH). The file is written in a binary format that can be mapped
+without parsing. Set the env variable LIKWID_MARKER_FORMAT=text to write the
+text format of previous LIKWID versions.
 */
 extern void likwid_markerClose(void) __attribute__((visibility("default")));
 /*! \brief Write marker API results to a file
 
 Must be called in serial region of the application. It gathers all data of
-regions and writes them out to file.
+regions and writes them out to file. The format is selected like for
+likwid_markerClose().
 @param markerfile [in] The file to write to
 @return Error
 */
@@ -208,7 +216,8 @@ e.g. if the code to be measured is run in a parallel region, this function must
 also be called in a parallel region (typically the same parallel region as the
 measured code). If this function is to be called multiple times in one parallel
 region, place a barrier ("#pragma omp barrier" or similar) before each call to
-likwid_markerStartRegion
+likwid_markerStartRegion. Regions started while another region is running are
+nested regions, they are stored per call path (e.g. "outer/inner").
 @param regionTag [in] Store data using this string
 @return Error code of start operation
 */
@@ -229,6 +238,53 @@ call to likwid_markerStopRegion
 */
 extern int likwid_markerStopRegion(const char *regionTag)
     __attribute__((visibility("default")));
+/*! \brief Register a measurement region and return a handle for it
+
+Registers the region like likwid_markerRegisterRegion() and returns an integer
+handle for it. The handle can be used with likwid_markerStartRegionH() and
+likwid_markerStopRegionH() which skip the formatting and hashing of the region
+tag. The same tag always resolves to the same handle, so it is sufficient to
+register a region once per thread.
+@param regionTag [in] Initialize data using this string
+@param handle [out] Handle of the region
+@return Error code
+*/
+extern int likwid_markerRegisterRegionH(const char *regionTag, int *handle)
+    __attribute__((visibility("default")));
+/*! \brief Start a measurement region using a handle
+
+Same as likwid_markerStartRegion() but the region is selected by a handle
+returned by likwid_markerRegisterRegionH().
+@param handle [in] Handle of the region
+@return Error code of start operation
+*/
+extern int likwid_markerStartRegionH(int handle)
+    __attribute__((visibility("default")));
+/*! \brief Stop a measurement region using a handle
+
+Same as likwid_markerStopRegion() but the region is selected by a handle
+returned by likwid_markerRegisterRegionH().
+@param handle [in] Handle of the region
+@return Error code of stop operation
+*/
+extern int likwid_markerStopRegionH(int handle)
+    __attribute__((visibility("default")));
+/*! \brief Measure only a sample of the calls of a region
+
+Only every rate-th call of the region (or randomly one of rate calls if
+random is set) reads the counters and the timer, the other calls are only
+counted. At likwid_markerClose() the time and the counter values are
+extrapolated to all calls and the standard error of each extrapolated total
+is stored in the result file. Must be called after likwid_markerInit() and
+before the region is started for the first time. The rates can also be set
+with the env variable LIKWID_MARKER_SAMPLE.
+@param regionTag [in] Region to sample
+@param rate [in] Measure one of rate calls
+@param random [in] Select the measured calls randomly instead of every rate-th call
+@return Error code
+*/
+extern int likwid_markerSetSampleRate(const char *regionTag, int rate, int random)
+    __attribute__((visibility("default")));
 /*! \brief Reset a measurement region
 
 Reset the values of all configured counters and timers.
@@ -1034,6 +1090,97 @@ multipliers.
 */
 extern double perfmon_getLastResult(int groupId, int eventId, int threadId)
     __attribute__((visibility("default")));
+/*! \brief Get the fraction of the measurement time an event was counted
+
+With ACCESSMODE=perf_event, event sets can use more core counters than the
+hardware provides (virtual PMC counters after the physical ones). The kernel multiplexes
+the events and the results are scaled by time_enabled/time_running. The
+returned value is time_running/time_enabled of the last measurement, so 1.0
+means the event was counted all the time and the result is exact. For all
+other access modes, it is always 1.0.
+@param [in] groupId ID of the group that should be read
+@param [in] eventId ID of the event that should be read
+@param [in] threadId ID of the thread/cpu that should be read
+@return Fraction of the time counted (0.0 - 1.0) or NAN on error
+*/
+extern double perfmon_getResultQuality(int groupId, int eventId, int threadId)
+    __attribute__((visibility("default")));
+
+/*! \brief Histogram entry of a sampled event
+
+\sa perfmon_getSamples
+*/
+typedef struct {
+    uint64_t address; /*!< \brief Sampled instruction address in the process */
+    uint64_t offset; /*!< \brief Address in the module as used by addr2line, the address if the module is unknown */
+    uint64_t count; /*!< \brief Number of samples at the address */
+    char* module; /*!< \brief Path of the mapped file containing the address or NULL */
+} PerfmonSample;
+
+/*! \brief Set the sampling period for the core events
+
+With ACCESSMODE=perf_event, the core events (FIXC and PMC counters) of the
+following perfmon_setupCounters() calls record the instruction address every
+\a period events. The events are counted as before and the samples can be read
+with perfmon_getSamples(). Setting the period resets all sample histograms.
+@param [in] period Number of events between two samples, 0 disables sampling
+@return 0 on success, -ENOTSUP for other access modes
+*/
+extern int perfmon_setSamplingPeriod(uint64_t period) __attribute__((visibility("default")));
+/*! \brief Get the histogram of the sampled addresses of an event
+
+Returns the sampled addresses with their counts for the given group, event and
+thread. The samples are collected at each read and stop of the counters. The
+list belongs to LIKWID and is valid until the next call of this function with
+the same arguments.
+@param [in] groupId ID of the group
+@param [in] eventId ID of the event
+@param [in] threadId ID of the thread/cpu
+@param [out] samples List of samples
+@return Number of entries in \a samples or error (<0)
+*/
+extern int perfmon_getSamples(int groupId, int eventId, int threadId, PerfmonSample** samples) __attribute__((visibility("default")));
+/*! \brief Restrict the core events to the tasks of a cgroup
+
+With ACCESSMODE=perf_event, the core events of the following
+perfmon_setupCounters() calls count only while a task of the cgroup runs on the
+CPU (PERF_FLAG_PID_CGROUP). The events are still opened per CPU, so measure
+the CPUs of the cpuset of the cgroup. Uncore events are counted for all tasks.
+@param [in] path Path of the cgroup directory, e.g. /sys/fs/cgroup/<path>, NULL to count all tasks
+@return 0 on success, -ENOTSUP for other access modes or error (<0) if the cgroup cannot be opened
+*/
+extern int perfmon_setCgroup(const char* path) __attribute__((visibility("default")));
+/*! \brief Get the number of software threads counted in per-task mode
+
+With ACCESSMODE=perf_event and the environment variables LIKWID_PERF_PID and
+LIKWID_PERF_PERTASK=1, the core events are counted for each thread of the
+process instead of per CPU. The threads existing at perfmon_setupCounters()
+get inherited counters, the sum is the process result reported for the first
+thread of the group set. Threads created later are found at each start and
+read of the counters and get own counters, so they are not restarted.
+@param [in] groupId ID of the group
+@return Number of threads (tasks) or error (<0)
+*/
+extern int perfmon_getNumberOfTasks(int groupId) __attribute__((visibility("default")));
+/*! \brief Get the thread ID (TID) of a task in per-task mode
+
+@param [in] groupId ID of the group
+@param [in] taskId ID of the task (0 - perfmon_getNumberOfTasks()-1)
+@return Thread ID or error (<0)
+*/
+extern int perfmon_getTaskId(int groupId, int taskId) __attribute__((visibility("default")));
+/*! \brief Get the result of an event for a task in per-task mode
+
+Returns the accumulated result of all measurement cycles for a software thread.
+If the process had only one thread at setup, the counts of the threads found
+later are excluded from its result. Otherwise the result of a thread existing at
+setup includes the threads it created before they were found.
+@param [in] groupId ID of the group
+@param [in] eventId ID of the event
+@param [in] taskId ID of the task (0 - perfmon_getNumberOfTasks()-1)
+@return The task result or NAN if the event is not counted per task
+*/
+extern double perfmon_getTaskResult(int groupId, int eventId, int taskId) __attribute__((visibility("default")));
 /*! \brief Get the metric result of the specified group, counter and thread
 
 Get the metric result of all measurement cycles. It reads all raw results for
@@ -1056,6 +1203,25 @@ for the given groupId and threadId.
 */
 extern double perfmon_getLastMetric(int groupId, int metricId, int threadId)
     __attribute__((visibility("default")));
+/*! \brief Get the metric results of all metrics and threads of the specified group
+
+Calculates all metrics of the group for all threads in one call. This is
+cheaper than calling perfmon_getMetric for each metric and thread.
+@param [in] groupId ID of the group that should be read
+@param [out] out Array with perfmon_getNumberOfMetrics(groupId) * perfmon_getNumberOfThreads() entries, the result of metric m for thread t is stored at out[m * perfmon_getNumberOfThreads() + t]
+@return 0 on success, error code otherwise
+*/
+extern int perfmon_getMetricsAll(int groupId, double* out)
+    __attribute__((visibility("default")));
+/*! \brief Get the last metric results of all metrics and threads of the specified group
+
+Like perfmon_getMetricsAll but for the last measurement cycle.
+@param [in] groupId ID of the group that should be read
+@param [out] out Array with perfmon_getNumberOfMetrics(groupId) * perfmon_getNumberOfThreads() entries, the result of metric m for thread t is stored at out[m * perfmon_getNumberOfThreads() + t]
+@return 0 on success, error code otherwise
+*/
+extern int perfmon_getLastMetricsAll(int groupId, double* out)
+    __attribute__((visibility("default")));
 
 /*! \brief Get the number of configured event groups
 
@@ -1168,7 +1334,31 @@ extern int perfmon_getNumberOfMetrics(int groupId)
 extern double perfmon_getLastTimeOfGroup(int groupId)
     __attribute__((visibility("default")));
 
+/*! \brief Get the accumulated measurement time of a thread
+
+The sum of the intervals between the reads of the thread's counters. The
+metrics of the thread are computed with this time.
+@param [in] groupId ID of group
+@param [in] threadId ID of thread
+@return Time in seconds the thread was measured with the event group
+*/
+extern double perfmon_getTimeOfThread(int groupId, int threadId)
+    __attribute__((visibility("default")));
+
+/*! \brief Get the last measurement time of a thread
+
+The counters of the threads are read one after the other, so the interval
+between the last two reads differs per thread and from the group time.
+@param [in] groupId ID of group
+@param [in] threadId ID of thread
+@return Time in seconds between the last two reads of the thread's counters
+*/
+extern double perfmon_getLastTimeOfThread(int groupId, int threadId)
+    __attribute__((visibility("default")));
+
 /*! \brief Read the output file of the Marker API
+
+Binary files are mapped into memory, text files are parsed.
 @param [in] filename Filename with Marker API results
 @return 0 or negative error number
 */
@@ -1253,6 +1443,107 @@ extern double perfmon_getResultOfRegionThread(int region, int event, int thread)
 extern double perfmon_getMetricOfRegionThread(int region, int metricId,
                                               int threadId)
     __attribute__((visibility("default")));
+/*! \brief Get the enclosing region of a nested region
+
+Regions started while another region is running are stored per call path, the
+tag of a nested region is the path of tags separated by '/'.
+@param [in] region ID of region
+@return ID of the enclosing region or -1 for top-level regions
+*/
+extern int perfmon_getParentOfRegion(int region)
+    __attribute__((visibility("default")));
+/*! \brief Get the exclusive measurement time of a region for a thread
+
+The exclusive time is the measurement time without the time spent in nested
+regions.
+@param [in] region ID of region
+@param [in] thread ID of thread
+@return Exclusive measurement time of a region for a thread
+*/
+extern double perfmon_getExclusiveTimeOfRegion(int region, int thread)
+    __attribute__((visibility("default")));
+/*! \brief Get the exclusive event result of a region for an event and thread
+
+The exclusive result is the result without the counts of nested regions. For
+events that are not summed up over calls (e.g. temperatures), it is the
+inclusive result.
+@param [in] region ID of region
+@param [in] event ID of event
+@param [in] thread ID of thread
+@return Exclusive result of a region for an event and thread
+*/
+extern double perfmon_getExclusiveResultOfRegionThread(int region, int event,
+                                                       int thread)
+    __attribute__((visibility("default")));
+/*! \brief Get the exclusive metric result of a region for a metric and thread
+
+The metric is calculated with the exclusive time and event results.
+@param [in] region ID of region
+@param [in] metricId ID of metric
+@param [in] threadId ID of thread
+@return Exclusive metric result of a region for a thread
+*/
+extern double perfmon_getExclusiveMetricOfRegionThread(int region, int metricId,
+                                                       int threadId)
+    __attribute__((visibility("default")));
+/*! \brief Get the Marker API overhead subtracted from a region result
+
+With LIKWID_MARKER_OVERHEAD, the overhead of an empty start/stop pair is
+calibrated per thread and subtracted for every measured call of a region. The
+uncorrected value is the result plus the subtracted overhead.
+@param [in] region ID of region
+@param [in] event ID of event or -1 for the measurement time
+@param [in] thread ID of thread
+@return Subtracted overhead (0 without overhead correction)
+*/
+extern double perfmon_getOverheadOfRegionThread(int region, int event, int thread)
+    __attribute__((visibility("default")));
+/*! \brief Get the metric result of a region without overhead correction
+
+The metric is calculated with the time and event results including the
+Marker API overhead (see perfmon_getOverheadOfRegionThread()).
+@param [in] region ID of region
+@param [in] metricId ID of metric
+@param [in] threadId ID of thread
+@return Uncorrected metric result of a region for a thread
+*/
+extern double perfmon_getUncorrectedMetricOfRegionThread(int region, int metricId,
+                                                         int threadId)
+    __attribute__((visibility("default")));
+/*! \brief Get the number of measured calls of a region for a thread
+
+For sampled regions (LIKWID_MARKER_SAMPLE), only a part of the calls is
+measured. For all other regions, it is equal to the call count.
+@param [in] region ID of region
+@param [in] thread ID of thread
+@return Number of measured calls of a region for a thread
+*/
+extern int perfmon_getSampledCountOfRegion(int region, int thread)
+    __attribute__((visibility("default")));
+/*! \brief Get the error estimate of an extrapolated result of a sampled region
+
+The error is the standard error of the extrapolated total, assuming the
+measured calls are a random sample of all calls.
+@param [in] region ID of region
+@param [in] event ID of event or -1 for the measurement time
+@param [in] thread ID of thread
+@return Standard error (0 for regions without sampling, NAN if less than two calls were measured)
+*/
+extern double perfmon_getErrorOfRegionThread(int region, int event, int thread)
+    __attribute__((visibility("default")));
+/*! \brief Get a percentile of the per-call values of a region
+
+Requires that the application was run with LIKWID_MARKER_HISTOGRAM. Values are
+taken from log-linear histograms, so the relative error is below 2%.
+@param [in] region ID of region
+@param [in] event ID of event or -1 for the runtime of a call (in seconds)
+@param [in] thread ID of thread or -1 to merge the histograms of all threads
+@param [in] percentile Percentile between 0 and 100
+@return Percentile of the per-call values or NAN if no histogram is available
+*/
+extern double perfmon_getRegionPercentile(int region, int event, int thread,
+                                          double percentile)
+    __attribute__((visibility("default")));
 
 /** @}*/
 
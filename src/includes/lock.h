@@ -50,7 +50,7 @@ lock_acquire(int* var, int newval)
 }
 
 static int
-lock_check(void)
+lock_check_uid(uid_t uid)
 {
     struct stat buf;
     int lock_handle = -1;
@@ -80,7 +80,7 @@ lock_check(void)
         /* There is a lock file and we can open it. Check if we own it. */
         stat(filepath, &buf);
 
-        if ( buf.st_uid == getuid() )  /* Succeed, we own the lock */
+        if ( buf.st_uid == uid )  /* Succeed, we own the lock */
         {
             result = 1;
         }
@@ -99,4 +99,10 @@ lock_check(void)
     return result;
 }
 
+static int
+lock_check(void)
+{
+    return lock_check_uid(getuid());
+}
+
 #endif /*LOCK_H*/
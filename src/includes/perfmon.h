@@ -41,6 +41,7 @@
 #define FREEZE_FLAG_CLEAR_CTL (1ULL<<0)
 
 extern uint64_t **currentConfig;
+extern LikwidResults* markerResults;
 
 extern int (*perfmon_startCountersThread) (int thread_id, PerfmonEventSet* eventSet);
 extern int (*perfmon_stopCountersThread) (int thread_id, PerfmonEventSet* eventSet);
@@ -53,5 +54,8 @@ extern int (*initThreadArch) (int cpu_id);
 extern int getCounterTypeOffset(int index);
 extern uint64_t perfmon_getMaxCounterValue(RegisterType type);
 extern char** getArchRegisterTypeNames();
+extern int perfmon_prefetchCounters(int thread_id, PerfmonEventSet* eventSet, int uncore);
+/* The calling thread changed its affinity (likwid_pinThread/likwid_pinProcess) */
+extern void perfmon_resetThreadAffinity(void);
 
 #endif /*PERFMON_H*/
@@ -1700,6 +1700,8 @@ int perfmon_readCountersThread_broadwell(int thread_id, PerfmonEventSet* eventSe
     }
     BDW_FREEZE_UNCORE;
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
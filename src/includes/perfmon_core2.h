@@ -259,6 +259,8 @@ int perfmon_readCountersThread_core2(int thread_id, PerfmonEventSet* eventSet)
         VERBOSEPRINTREG(cpu_id, MSR_PERF_GLOBAL_CTRL, 0x0ULL, RESET_PMC_FLAGS)
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, 0);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         counter_result = 0x0ULL;
@@ -398,6 +398,8 @@ int perfmon_readCountersThread_goldmont(int thread_id, PerfmonEventSet* eventSet
         VERBOSEPRINTREG(cpu_id, MSR_PERF_GLOBAL_CTRL, 0x0ULL, RESET_PMC_FLAGS)
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
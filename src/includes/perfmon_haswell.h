@@ -1693,6 +1693,8 @@ int perfmon_readCountersThread_haswell(int thread_id, PerfmonEventSet* eventSet)
 
     HASEP_FREEZE_UNCORE;
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -1738,6 +1738,8 @@ int perfmon_readCountersThread_icelake(int thread_id, PerfmonEventSet* eventSet)
         }
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -229,6 +229,8 @@ int perfmon_readCountersThread_interlagos(int thread_id, PerfmonEventSet* eventS
     int cpu_id = groupSet->threads[thread_id].processorId;
     uint64_t tmp;
 
+    perfmon_prefetchCounters(thread_id, eventSet, 0);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -1344,6 +1344,8 @@ int perfmon_readCountersThread_ivybridge(int thread_id, PerfmonEventSet* eventSe
         ivb_uncore_freeze(cpu_id, eventSet);
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -178,6 +178,8 @@ int perfmon_readCountersThread_k10(int thread_id, PerfmonEventSet* eventSet)
     uint64_t tmp;
     int cpu_id = groupSet->threads[thread_id].processorId;
 
+    perfmon_prefetchCounters(thread_id, eventSet, 0);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -294,6 +294,8 @@ int perfmon_readCountersThread_kabini(int thread_id, PerfmonEventSet* eventSet)
         haveTLock = 1;
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveSLock || haveTLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
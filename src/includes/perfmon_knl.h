@@ -1060,6 +1060,8 @@ int perfmon_readCountersThread_knl(int thread_id, PerfmonEventSet* eventSet)
     }
     KNL_FREEZE_UNCORE;
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -37,6 +37,10 @@
 #include <linux/perf_event.h>
 #include <linux/version.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <elf.h>
+#include <dirent.h>
 #include <asm/unistd.h>
 #include <string.h>
 #include <bstrlib.h>
@@ -47,11 +51,138 @@ static int** cpu_event_fds = NULL;
 static int active_cpus = 0;
 static int perf_event_initialized = 0;
 /*static int informed_paranoid = 0;*/
-static int running_group = -1;
 static int perf_event_num_cpus = 0;
 static int perf_disable_uncore = 0;
 static int perf_event_paranoid = -1;
 
+/* Core counters are read in userspace with rdpmc through the mmap page of the
+ * event if the kernel allows it (cap_user_rdpmc), otherwise with read() */
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_EVENT_RDPMC
+#endif
+static struct perf_event_mmap_page*** cpu_event_pages = NULL;
+/* Number of general-purpose core counters, a core group with more PMC events
+ * could never be scheduled, so further PMC events start a new group that is
+ * multiplexed by the kernel */
+static int perf_event_num_pmc = 0;
+/* LIKWID_PERF_NOGROUP: open all events alone, read once at init */
+static int perf_event_nogroup = -1;
+
+/* The core counters and the counters of each Uncore PMU of a CPU are opened
+ * as one perf_event group, so they are scheduled on the PMU together and a
+ * single read() of the group leader returns all values */
+#define PERF_EVENT_GROUP_CORE ((uint32_t)-1)
+#define PERF_EVENT_GROUP_FORMAT (PERF_FORMAT_GROUP|PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING)
+
+typedef struct {
+    int leader;                 /* fd of the group leader */
+    uint32_t pmu;               /* attr.type of the members or PERF_EVENT_GROUP_CORE */
+    int numEvents;
+    int numPmc;
+    RegisterIndex* events;      /* members in the order of the group read */
+    int valid;                  /* last read of the group succeeded */
+    uint64_t enabled;           /* time_enabled and time_running of the last read */
+    uint64_t running;
+} PerfEventGroup;
+
+typedef struct {
+    int numGroups;
+    PerfEventGroup* groups;
+    int* group;                 /* group of each counter or -1 if opened alone */
+    int multiplexed;            /* more PMC events than physical counters */
+    long long* values;          /* values of the last group reads */
+    uint64_t* buffer;           /* nr, time_enabled, time_running, values[nr] */
+} PerfEventCpuGroups;
+
+static PerfEventCpuGroups* cpu_event_groups = NULL;
+
+/* Sampling mode: the core events are opened with sample_period and write the
+ * instruction pointer of each sample into a ring buffer that is mapped
+ * together with the control page. The buffers are drained at each read and
+ * the samples are counted per address in a hash table per event and thread. */
+#define PERF_EVENT_SAMPLE_PAGES 64
+static uint64_t perf_event_sample_period = 0;
+static char** cpu_event_sampled = NULL;
+
+typedef struct {
+    uint64_t address;
+    uint32_t pid;
+    int module;                 /* index in perf_event_modules or -1 */
+    uint64_t offset;
+    uint64_t count;
+} PerfEventSampleEntry;
+
+typedef struct {
+    int numEntries;
+    int size;                   /* power of two */
+    PerfEventSampleEntry* entries;
+    PerfmonSample* samples;     /* returned by perfmon_getSamples */
+    uint64_t lost;
+} PerfEventSampleHist;
+
+/* Histograms per group, event and thread */
+typedef struct {
+    int numHists;
+    PerfEventSampleHist* hists;
+} PerfEventSampleGroup;
+
+static PerfEventSampleGroup* perf_event_sample_hists = NULL;
+static int perf_event_sample_groups = 0;
+
+/* Executable mappings of the sampled processes read from /proc/<pid>/maps,
+ * they are kept after the process exited to resolve the last samples */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t pgoff;
+    int module;
+} PerfEventMapping;
+
+typedef struct {
+    uint32_t pid;
+    int numMappings;
+    PerfEventMapping* mappings;
+    uint64_t drain;             /* drain in which the mappings were read */
+} PerfEventProcess;
+
+static PerfEventProcess* perf_event_procs = NULL;
+static int perf_event_num_procs = 0;
+static char** perf_event_modules = NULL;
+static int* perf_event_module_exec = NULL;
+static int perf_event_num_modules = 0;
+static uint64_t perf_event_num_drains = 0;
+static pthread_mutex_t perf_event_sample_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Per-task counting, see perf_event_task_mode() */
+typedef struct {
+    pid_t tid;
+    int root;                   /* inherited counters opened at setup */
+    int parent;                 /* root the thread descends from or -1 */
+    int* fds;                   /* per event of the event set */
+    long long* start;
+    double* results;
+    double* quality;
+} PerfEventTask;
+
+typedef struct {
+    pid_t pid;
+    int numEvents;
+    int numTasks;
+    int numRoots;
+    int size;
+    int running;
+    struct perf_event_attr* attrs;
+    char* counted;              /* event is counted per task */
+    PerfEventTask* tasks;
+} PerfEventTaskSet;
+
+static PerfEventTaskSet* perf_event_task_sets = NULL;
+static int perf_event_task_groups = 0;
+
+/* Counting restricted to a cgroup, core events are opened with the file
+ * descriptor of the cgroup directory as pid and PERF_FLAG_PID_CGROUP */
+static int perf_event_cgroup_fd = -1;
+
 static char* perfEventOptionNames[] = {
     [EVENT_OPTION_EDGE] = "edge",
     [EVENT_OPTION_ANYTHREAD] = "any",
@@ -84,15 +215,1322 @@ static char* perfEventOptionNames[] = {
 #endif
 };
 
-static long
-perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
-                int cpu, int group_fd, unsigned long flags)
+static long
+perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
+                int cpu, int group_fd, unsigned long flags)
+{
+    int ret;
+
+    ret = syscall(__NR_perf_event_open, hw_event, pid, cpu,
+                   group_fd, flags);
+    return ret;
+}
+
+static int
+perf_event_is_sampled(int cpu_id, RegisterIndex index)
+{
+    return (cpu_event_sampled && cpu_event_sampled[cpu_id] && cpu_event_sampled[cpu_id][index]);
+}
+
+static size_t
+perf_event_map_size(int cpu_id, RegisterIndex index)
+{
+    if (perf_event_is_sampled(cpu_id, index))
+    {
+        return (1 + PERF_EVENT_SAMPLE_PAGES) * sysconf(_SC_PAGESIZE);
+    }
+    return sysconf(_SC_PAGESIZE);
+}
+
+static void
+perf_event_map_page(int cpu_id, RegisterIndex index)
+{
+    void* page = NULL;
+    int prot = PROT_READ;
+    if (cpu_event_pages == NULL || cpu_event_pages[cpu_id] == NULL || cpu_event_fds[cpu_id][index] < 0)
+    {
+        return;
+    }
+#ifndef PERF_EVENT_RDPMC
+    if (!perf_event_is_sampled(cpu_id, index))
+    {
+        return;
+    }
+#endif
+    /* The ring buffer of sampled events requires write access to data_tail */
+    if (perf_event_is_sampled(cpu_id, index))
+    {
+        prot |= PROT_WRITE;
+    }
+    page = mmap(NULL, perf_event_map_size(cpu_id, index), prot, MAP_SHARED, cpu_event_fds[cpu_id][index], 0);
+    if (page == MAP_FAILED)
+    {
+        DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot map page of event %d on CPU %d: %s, index, cpu_id, strerror(errno));
+        return;
+    }
+    cpu_event_pages[cpu_id][index] = (struct perf_event_mmap_page*)page;
+}
+
+static void
+perf_event_unmap_page(int cpu_id, RegisterIndex index)
+{
+    if (cpu_event_pages != NULL && cpu_event_pages[cpu_id] != NULL && cpu_event_pages[cpu_id][index] != NULL)
+    {
+        munmap(cpu_event_pages[cpu_id][index], perf_event_map_size(cpu_id, index));
+        cpu_event_pages[cpu_id][index] = NULL;
+    }
+    if (perf_event_is_sampled(cpu_id, index))
+    {
+        cpu_event_sampled[cpu_id][index] = 0;
+    }
+}
+
+#ifdef PERF_EVENT_RDPMC
+static inline uint64_t
+perf_event_rdpmc(uint32_t counter)
+{
+    uint32_t low, high;
+    __asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Userspace read following the protocol in linux/perf_event.h. Only valid on
+ * the CPU the event is counting on and while the event is scheduled on the PMU. */
+static int
+perf_event_read_rdpmc(struct perf_event_mmap_page* pc, long long* value)
+{
+    uint32_t seq, idx;
+    int64_t count = 0;
+    do
+    {
+        seq = pc->lock;
+        __asm__ volatile("" ::: "memory");
+        idx = pc->index;
+        /* Multiplexed events need the scaling of a read() */
+        if (!pc->cap_user_rdpmc || idx == 0 || pc->time_enabled != pc->time_running)
+        {
+            return -1;
+        }
+        count = perf_event_rdpmc(idx - 1);
+        count <<= 64 - pc->pmc_width;
+        count >>= 64 - pc->pmc_width;
+        count += pc->offset;
+        __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+    *value = count;
+    return 0;
+}
+#endif
+
+/* Extrapolates the value of a multiplexed event to the whole time it was
+ * enabled. The quality is the fraction of the time the event was counted. */
+static long long
+perf_event_scale(long long value, uint64_t enabled, uint64_t running, double* quality)
+{
+    *quality = 1.0;
+    if (enabled == 0 || running >= enabled)
+    {
+        return value;
+    }
+    *quality = (double)running/(double)enabled;
+    if (running == 0)
+    {
+        return 0;
+    }
+    return (long long)((double)value * ((double)enabled/(double)running));
+}
+
+/* read() of an event that is not in a group, read_format is
+ * TOTAL_TIME_ENABLED|TOTAL_TIME_RUNNING */
+static int
+perf_event_read_single(int fd, long long* value, double* quality)
+{
+    uint64_t buffer[3] = {0, 0, 0};
+    int ret = read(fd, buffer, sizeof(buffer));
+    if (ret != sizeof(buffer))
+    {
+        return -1;
+    }
+    *value = perf_event_scale((long long)buffer[0], buffer[1], buffer[2], quality);
+    return 0;
+}
+
+/* rdpmc reads the PMC of the CPU the caller runs on. The current CPU of a thread
+ * that may run on other CPUs can change right after sched_getcpu(), so rdpmc
+ * is only used if the calling thread is pinned to exactly this CPU. The
+ * affinity is queried once per thread (-2 unknown, -1 not pinned to a single
+ * CPU), likwid_pinThread() and likwid_pinProcess() reset it. */
+#ifdef PERF_EVENT_RDPMC
+static __thread int perf_event_pinned_cpu = -2;
+#endif
+
+static int
+perf_event_pinned_to(int cpu_id)
+{
+#ifdef PERF_EVENT_RDPMC
+    if (cpu_event_pages == NULL || cpu_event_pages[cpu_id] == NULL)
+    {
+        return 0;
+    }
+    if (perf_event_pinned_cpu == -2)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        perf_event_pinned_cpu = -1;
+        if ((sched_getaffinity(0, sizeof(cpu_set_t), &cpuset) == 0) && (CPU_COUNT(&cpuset) == 1))
+        {
+            for (int i = 0; i < CPU_SETSIZE; i++)
+            {
+                if (CPU_ISSET(i, &cpuset))
+                {
+                    perf_event_pinned_cpu = i;
+                    break;
+                }
+            }
+        }
+    }
+    return (perf_event_pinned_cpu == cpu_id);
+#else
+    return 0;
+#endif
+}
+
+void perfmon_resetAffinity_perfevent(void)
+{
+#ifdef PERF_EVENT_RDPMC
+    perf_event_pinned_cpu = -2;
+#endif
+}
+
+/* Returns the current value of an event, either with rdpmc or with read().
+ * on_cpu is the result of perf_event_pinned_to(cpu_id). */
+static int
+perf_event_read_counter(int cpu_id, int on_cpu, RegisterIndex index, long long* value, double* quality)
+{
+    int ret = 0;
+#ifdef PERF_EVENT_RDPMC
+    struct perf_event_mmap_page* pc = (on_cpu ? cpu_event_pages[cpu_id][index] : NULL);
+    if (pc != NULL && pc->cap_user_rdpmc)
+    {
+        if (perf_event_read_rdpmc(pc, value) == 0)
+        {
+            *quality = 1.0;
+            return 0;
+        }
+    }
+#endif
+    VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, FREEZE_COUNTER);
+    ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_DISABLE, 0);
+    ret = perf_event_read_single(cpu_event_fds[cpu_id][index], value, quality);
+    VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, UNFREEZE_COUNTER);
+    ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_ENABLE, 0);
+    return ret;
+}
+
+static int
+perf_event_group_pmu(RegisterType type, struct perf_event_attr* attr, int is_uncore, uint32_t* pmu)
+{
+    if (cpu_event_groups == NULL || perf_event_nogroup > 0)
+    {
+        return -1;
+    }
+    /* PERF events are software or generic events and the METRICS events
+     * require the TOPDOWN_SLOTS event as leader, both stay alone */
+    switch (type)
+    {
+        case FIXED:
+        case PMC:
+        case IPMC:
+        case FPMC:
+            *pmu = PERF_EVENT_GROUP_CORE;
+            return 0;
+        case PERF:
+        case METRICS:
+            return -1;
+        default:
+            break;
+    }
+    if (is_uncore)
+    {
+        *pmu = attr->type;
+        return 0;
+    }
+    return -1;
+}
+
+static void
+perf_event_group_clear(int cpu_id)
+{
+    PerfEventCpuGroups* cg = (cpu_event_groups ? &cpu_event_groups[cpu_id] : NULL);
+    if (cg == NULL || cg->groups == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < cg->numGroups; i++)
+    {
+        free(cg->groups[i].events);
+        cg->groups[i].events = NULL;
+        cg->groups[i].numEvents = 0;
+    }
+    cg->numGroups = 0;
+    for (int j = 0; j < perfmon_numCounters; j++)
+    {
+        cg->group[j] = -1;
+    }
+}
+
+/* Opens an event in the group of its PMU on the CPU. The first event of a PMU
+ * becomes the leader. If the kernel refuses the event as group member, it is
+ * opened alone like before. */
+static int
+perf_event_open_group(int cpu_id, RegisterIndex index, RegisterType type, int is_uncore,
+                      struct perf_event_attr* attr, pid_t pid, unsigned long flags)
+{
+    int fd = -1;
+    int gid = -1;
+    uint32_t pmu = 0;
+    PerfEventCpuGroups* cg = NULL;
+    if (perf_event_group_pmu(type, attr, is_uncore, &pmu) == 0)
+    {
+        int is_pmc = (pmu == PERF_EVENT_GROUP_CORE && type != FIXED);
+        cg = &cpu_event_groups[cpu_id];
+        for (int i = 0; i < cg->numGroups; i++)
+        {
+            if (cg->groups[i].pmu == pmu &&
+                (!is_pmc || perf_event_num_pmc <= 0 || cg->groups[i].numPmc < perf_event_num_pmc))
+            {
+                gid = i;
+                break;
+            }
+        }
+        /* Only a group leader can be pinned, the group is scheduled as a whole.
+         * Multiplexed core groups must rotate, so none of them is pinned. */
+        if (gid >= 0 || (pmu == PERF_EVENT_GROUP_CORE && cg->multiplexed))
+        {
+            attr->pinned = 0;
+        }
+        attr->read_format = PERF_EVENT_GROUP_FORMAT;
+        fd = perf_event_open(attr, pid, cpu_id, (gid >= 0 ? cg->groups[gid].leader : -1), flags);
+        if (fd >= 0)
+        {
+            PerfEventGroup* g = NULL;
+            RegisterIndex* tmp = NULL;
+            if (gid < 0)
+            {
+                gid = cg->numGroups;
+                g = &cg->groups[gid];
+                g->leader = fd;
+                g->pmu = pmu;
+                g->numEvents = 0;
+                g->numPmc = 0;
+                g->events = NULL;
+                g->valid = 0;
+                g->enabled = 0;
+                g->running = 0;
+                cg->numGroups++;
+            }
+            g = &cg->groups[gid];
+            tmp = realloc(g->events, (g->numEvents+1) * sizeof(RegisterIndex));
+            if (tmp == NULL)
+            {
+                close(fd);
+                return -ENOMEM;
+            }
+            g->events = tmp;
+            g->events[g->numEvents] = index;
+            g->numEvents++;
+            if (is_pmc)
+            {
+                g->numPmc++;
+            }
+            cg->group[index] = gid;
+            DEBUG_PRINT(DEBUGLEV_DEVELOP, Event %d on CPU %d in group %d (leader fd %d position %d), index, cpu_id, gid, g->leader, g->numEvents-1);
+            return fd;
+        }
+        DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot add event %d on CPU %d to group: %s, index, cpu_id, strerror(errno));
+    }
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return perf_event_open(attr, pid, cpu_id, -1, flags);
+}
+
+static void
+perf_event_group_ioctl(int cpu_id, unsigned long request)
+{
+    PerfEventCpuGroups* cg = (cpu_event_groups ? &cpu_event_groups[cpu_id] : NULL);
+    if (cg == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < cg->numGroups; i++)
+    {
+        ioctl(cg->groups[i].leader, request, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/* Reads all groups of a CPU into the values array. When the caller is pinned
+ * to the CPU (on_cpu, see perf_event_pinned_to) and all members are mapped,
+ * the counters are read with rdpmc instead. */
+static void
+perf_event_group_read(int cpu_id, int on_cpu)
+{
+    PerfEventCpuGroups* cg = (cpu_event_groups ? &cpu_event_groups[cpu_id] : NULL);
+    if (cg == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < cg->numGroups; i++)
+    {
+        PerfEventGroup* g = &cg->groups[i];
+        int ret = 0;
+        g->valid = 0;
+#ifdef PERF_EVENT_RDPMC
+        if (on_cpu)
+        {
+            int k = 0;
+            for (k = 0; k < g->numEvents; k++)
+            {
+                struct perf_event_mmap_page* pc = cpu_event_pages[cpu_id][g->events[k]];
+                if (pc == NULL || perf_event_read_rdpmc(pc, &cg->values[g->events[k]]) != 0)
+                {
+                    break;
+                }
+            }
+            if (k == g->numEvents)
+            {
+                g->enabled = 0;
+                g->running = 0;
+                g->valid = 1;
+                continue;
+            }
+        }
+#endif
+        ret = read(g->leader, cg->buffer, (3 + g->numEvents) * sizeof(uint64_t));
+        if (ret < (int)(3 * sizeof(uint64_t)) || cg->buffer[0] != (uint64_t)g->numEvents)
+        {
+            DEBUG_PRINT(DEBUGLEV_DEVELOP, Failed to read group %d on CPU %d, i, cpu_id);
+            continue;
+        }
+        g->enabled = cg->buffer[1];
+        g->running = cg->buffer[2];
+        for (int k = 0; k < g->numEvents; k++)
+        {
+            cg->values[g->events[k]] = (long long)cg->buffer[3+k];
+            VERBOSEPRINTREG(cpu_id, g->leader, cg->values[g->events[k]], READ_COUNTER);
+        }
+        g->valid = 1;
+    }
+}
+
+/* Scaled value of an event from the last perf_event_group_read(), returns -1
+ * if the event is not in a group or the group read failed */
+static int
+perf_event_group_value(int cpu_id, RegisterIndex index, long long* value, double* quality)
+{
+    PerfEventGroup* g = NULL;
+    PerfEventCpuGroups* cg = (cpu_event_groups ? &cpu_event_groups[cpu_id] : NULL);
+    if (cg == NULL || cg->group == NULL || cg->group[index] < 0)
+    {
+        return -1;
+    }
+    g = &cg->groups[cg->group[index]];
+    if (!g->valid)
+    {
+        return -1;
+    }
+    *value = perf_event_scale(cg->values[index], g->enabled, g->running, quality);
+    return 0;
+}
+
+static int
+perf_event_is_grouped(int cpu_id, RegisterIndex index)
+{
+    return (cpu_event_groups && cpu_event_groups[cpu_id].group && cpu_event_groups[cpu_id].group[index] >= 0);
+}
+
+static void
+perf_event_group_free(int cpu_id)
+{
+    PerfEventCpuGroups* cg = (cpu_event_groups ? &cpu_event_groups[cpu_id] : NULL);
+    if (cg == NULL)
+    {
+        return;
+    }
+    perf_event_group_clear(cpu_id);
+    free(cg->groups);
+    free(cg->group);
+    free(cg->values);
+    free(cg->buffer);
+    memset(cg, 0, sizeof(PerfEventCpuGroups));
+}
+
+static int
+perf_event_add_module(const char* path)
+{
+    int exec = 0;
+    char** tmp = NULL;
+    int* tmpexec = NULL;
+    for (int i = 0; i < perf_event_num_modules; i++)
+    {
+        if (strcmp(perf_event_modules[i], path) == 0)
+        {
+            return i;
+        }
+    }
+    /* Addresses in non-PIE executables are used as they are, for shared
+     * objects and PIE executables the offset in the file is used */
+    FILE* fp = fopen(path, "r");
+    if (fp != NULL)
+    {
+        unsigned char ident[EI_NIDENT+2];
+        if (fread(ident, sizeof(unsigned char), EI_NIDENT+2, fp) == EI_NIDENT+2 &&
+            memcmp(ident, ELFMAG, SELFMAG) == 0)
+        {
+            uint16_t e_type = 0;
+            memcpy(&e_type, &ident[EI_NIDENT], sizeof(uint16_t));
+            exec = (e_type == ET_EXEC);
+        }
+        fclose(fp);
+    }
+    tmp = realloc(perf_event_modules, (perf_event_num_modules+1) * sizeof(char*));
+    if (tmp == NULL)
+    {
+        return -1;
+    }
+    perf_event_modules = tmp;
+    tmpexec = realloc(perf_event_module_exec, (perf_event_num_modules+1) * sizeof(int));
+    if (tmpexec == NULL)
+    {
+        return -1;
+    }
+    perf_event_module_exec = tmpexec;
+    perf_event_modules[perf_event_num_modules] = strdup(path);
+    if (perf_event_modules[perf_event_num_modules] == NULL)
+    {
+        return -1;
+    }
+    perf_event_module_exec[perf_event_num_modules] = exec;
+    perf_event_num_modules++;
+    return perf_event_num_modules-1;
+}
+
+static int
+perf_event_read_mappings(PerfEventProcess* proc)
+{
+    char line[1024];
+    char fname[64];
+    FILE* fp = NULL;
+    snprintf(fname, sizeof(fname), "/proc/%u/maps", proc->pid);
+    fp = fopen(fname, "r");
+    if (fp == NULL)
+    {
+        return -errno;
+    }
+    proc->numMappings = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        unsigned long long start = 0, end = 0, pgoff = 0;
+        char perms[8];
+        int pathpos = 0;
+        PerfEventMapping* tmp = NULL;
+        if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &end, perms, &pgoff, &pathpos) < 4 || pathpos == 0)
+        {
+            continue;
+        }
+        if (perms[2] != 'x' || line[pathpos] != '/')
+        {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        tmp = realloc(proc->mappings, (proc->numMappings+1) * sizeof(PerfEventMapping));
+        if (tmp == NULL)
+        {
+            break;
+        }
+        proc->mappings = tmp;
+        proc->mappings[proc->numMappings].start = start;
+        proc->mappings[proc->numMappings].end = end;
+        proc->mappings[proc->numMappings].pgoff = pgoff;
+        proc->mappings[proc->numMappings].module = perf_event_add_module(&line[pathpos]);
+        proc->numMappings++;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static PerfEventMapping*
+perf_event_find_mapping(PerfEventProcess* proc, uint64_t address)
+{
+    for (int i = 0; i < proc->numMappings; i++)
+    {
+        if (address >= proc->mappings[i].start && address < proc->mappings[i].end)
+        {
+            return &proc->mappings[i];
+        }
+    }
+    return NULL;
+}
+
+/* Resolves an address of a process to a module and the offset in it. The
+ * mappings are read again if the address is unknown, e.g. after a dlopen, but
+ * at most once per drain of a ring buffer. Kernel addresses, [vdso] and
+ * anonymous (JIT) code are never found in the file-backed mappings. */
+static void
+perf_event_resolve_sample(PerfEventSampleEntry* e, uint64_t drain)
+{
+    PerfEventProcess* proc = NULL;
+    PerfEventMapping* map = NULL;
+    e->module = -1;
+    e->offset = e->address;
+    pthread_mutex_lock(&perf_event_sample_lock);
+    for (int i = 0; i < perf_event_num_procs; i++)
+    {
+        if (perf_event_procs[i].pid == e->pid)
+        {
+            proc = &perf_event_procs[i];
+            break;
+        }
+    }
+    if (proc == NULL)
+    {
+        PerfEventProcess* tmp = realloc(perf_event_procs, (perf_event_num_procs+1) * sizeof(PerfEventProcess));
+        if (tmp == NULL)
+        {
+            pthread_mutex_unlock(&perf_event_sample_lock);
+            return;
+        }
+        perf_event_procs = tmp;
+        proc = &perf_event_procs[perf_event_num_procs];
+        proc->pid = e->pid;
+        proc->numMappings = 0;
+        proc->mappings = NULL;
+        proc->drain = drain;
+        perf_event_num_procs++;
+        perf_event_read_mappings(proc);
+    }
+    map = perf_event_find_mapping(proc, e->address);
+    if (map == NULL && (int64_t)e->address >= 0 && proc->drain != drain)
+    {
+        proc->drain = drain;
+        if (perf_event_read_mappings(proc) == 0)
+        {
+            map = perf_event_find_mapping(proc, e->address);
+        }
+    }
+    if (map != NULL && map->module >= 0)
+    {
+        e->module = map->module;
+        if (!perf_event_module_exec[map->module])
+        {
+            e->offset = e->address - map->start + map->pgoff;
+        }
+    }
+    pthread_mutex_unlock(&perf_event_sample_lock);
+}
+
+/* The table grows on first use by the reading threads, which may run
+ * concurrently in the reader pool (LIKWID_READ_THREADS) */
+static PerfEventSampleHist*
+perf_event_get_hist(PerfmonEventSet* eventSet, int event, int thread_id)
+{
+    PerfEventSampleHist* h = NULL;
+    int groupId = (int)(eventSet - groupSet->groups);
+    if (groupId < 0 || groupId >= groupSet->numberOfGroups)
+    {
+        return NULL;
+    }
+    pthread_mutex_lock(&perf_event_sample_lock);
+    if (groupId >= perf_event_sample_groups)
+    {
+        PerfEventSampleGroup* tmp = realloc(perf_event_sample_hists, (groupId+1) * sizeof(PerfEventSampleGroup));
+        if (tmp == NULL)
+        {
+            pthread_mutex_unlock(&perf_event_sample_lock);
+            return NULL;
+        }
+        perf_event_sample_hists = tmp;
+        for (int i = perf_event_sample_groups; i <= groupId; i++)
+        {
+            perf_event_sample_hists[i].numHists = 0;
+            perf_event_sample_hists[i].hists = NULL;
+        }
+        perf_event_sample_groups = groupId+1;
+    }
+    if (perf_event_sample_hists[groupId].hists == NULL)
+    {
+        int numHists = eventSet->numberOfEvents * groupSet->numberOfThreads;
+        perf_event_sample_hists[groupId].hists = calloc(numHists, sizeof(PerfEventSampleHist));
+        if (perf_event_sample_hists[groupId].hists != NULL)
+        {
+            perf_event_sample_hists[groupId].numHists = numHists;
+        }
+    }
+    if (perf_event_sample_hists[groupId].hists != NULL)
+    {
+        h = &perf_event_sample_hists[groupId].hists[event * groupSet->numberOfThreads + thread_id];
+    }
+    pthread_mutex_unlock(&perf_event_sample_lock);
+    return h;
+}
+
+static int
+perf_event_add_sample(PerfEventSampleHist* h, uint64_t address, uint32_t pid, uint64_t drain)
+{
+    uint64_t slot = 0;
+    if (h->numEntries * 4 >= h->size * 3)
+    {
+        int newsize = (h->size > 0 ? 2 * h->size : 1024);
+        PerfEventSampleEntry* entries = calloc(newsize, sizeof(PerfEventSampleEntry));
+        if (entries == NULL)
+        {
+            return -ENOMEM;
+        }
+        for (int i = 0; i < h->size; i++)
+        {
+            if (h->entries[i].count > 0)
+            {
+                slot = (h->entries[i].address ^ ((uint64_t)h->entries[i].pid * 0x9E3779B97F4A7C15ULL)) & (newsize-1);
+                while (entries[slot].count > 0)
+                {
+                    slot = (slot + 1) & (newsize-1);
+                }
+                entries[slot] = h->entries[i];
+            }
+        }
+        free(h->entries);
+        h->entries = entries;
+        h->size = newsize;
+    }
+    slot = (address ^ ((uint64_t)pid * 0x9E3779B97F4A7C15ULL)) & (h->size-1);
+    while (h->entries[slot].count > 0)
+    {
+        if (h->entries[slot].address == address && h->entries[slot].pid == pid)
+        {
+            h->entries[slot].count++;
+            return 0;
+        }
+        slot = (slot + 1) & (h->size-1);
+    }
+    h->entries[slot].address = address;
+    h->entries[slot].pid = pid;
+    h->entries[slot].count = 1;
+    perf_event_resolve_sample(&h->entries[slot], drain);
+    h->numEntries++;
+    return 0;
+}
+
+static void
+perf_event_ring_copy(const char* data, uint64_t size, uint64_t pos, void* dest, size_t len)
+{
+    uint64_t off = pos % size;
+    if (off + len <= size)
+    {
+        memcpy(dest, data + off, len);
+    }
+    else
+    {
+        memcpy(dest, data + off, size - off);
+        memcpy((char*)dest + (size - off), data, len - (size - off));
+    }
+}
+
+/* Drains the ring buffer of a sampled event into the histogram */
+static void
+perf_event_read_samples(int cpu_id, RegisterIndex index, PerfEventSampleHist* h, uint64_t drain)
+{
+    struct perf_event_mmap_page* pc = NULL;
+    const char* data = NULL;
+    uint64_t size = PERF_EVENT_SAMPLE_PAGES * sysconf(_SC_PAGESIZE);
+    uint64_t head = 0, tail = 0;
+    if (h == NULL || !perf_event_is_sampled(cpu_id, index))
+    {
+        return;
+    }
+    pc = cpu_event_pages[cpu_id][index];
+    if (pc == NULL)
+    {
+        return;
+    }
+    data = (const char*)pc + sysconf(_SC_PAGESIZE);
+    head = pc->data_head;
+    __sync_synchronize();
+    tail = pc->data_tail;
+    while (tail < head)
+    {
+        struct perf_event_header hdr;
+        perf_event_ring_copy(data, size, tail, &hdr, sizeof(hdr));
+        if (hdr.size < sizeof(hdr))
+        {
+            break;
+        }
+        if (hdr.type == PERF_RECORD_SAMPLE)
+        {
+            /* PERF_SAMPLE_IP | PERF_SAMPLE_TID */
+            uint64_t body[2];
+            perf_event_ring_copy(data, size, tail + sizeof(hdr), body, sizeof(body));
+            perf_event_add_sample(h, body[0], (uint32_t)(body[1] & 0xFFFFFFFFULL), drain);
+        }
+        else if (hdr.type == PERF_RECORD_LOST)
+        {
+            uint64_t body[2];
+            perf_event_ring_copy(data, size, tail + sizeof(hdr), body, sizeof(body));
+            h->lost += body[1];
+        }
+        tail += hdr.size;
+    }
+    __sync_synchronize();
+    pc->data_tail = tail;
+}
+
+static void
+perf_event_free_samples(void)
+{
+    for (int g = 0; g < perf_event_sample_groups; g++)
+    {
+        for (int i = 0; i < perf_event_sample_hists[g].numHists; i++)
+        {
+            free(perf_event_sample_hists[g].hists[i].entries);
+            free(perf_event_sample_hists[g].hists[i].samples);
+        }
+        free(perf_event_sample_hists[g].hists);
+    }
+    free(perf_event_sample_hists);
+    perf_event_sample_hists = NULL;
+    perf_event_sample_groups = 0;
+    for (int i = 0; i < perf_event_num_procs; i++)
+    {
+        free(perf_event_procs[i].mappings);
+    }
+    free(perf_event_procs);
+    perf_event_procs = NULL;
+    perf_event_num_procs = 0;
+    for (int i = 0; i < perf_event_num_modules; i++)
+    {
+        free(perf_event_modules[i]);
+    }
+    free(perf_event_modules);
+    free(perf_event_module_exec);
+    perf_event_modules = NULL;
+    perf_event_module_exec = NULL;
+    perf_event_num_modules = 0;
+}
+
+static void
+perf_event_drain_samples(int thread_id, PerfmonEventSet* eventSet)
+{
+    int cpu_id = groupSet->threads[thread_id].processorId;
+    uint64_t drain = 0;
+    if (perf_event_sample_period == 0)
+    {
+        return;
+    }
+    drain = __sync_add_and_fetch(&perf_event_num_drains, 1);
+    for (int i = 0; i < eventSet->numberOfEvents; i++)
+    {
+        RegisterIndex index = eventSet->events[i].index;
+        if (eventSet->events[i].threadCounter[thread_id].init == TRUE && perf_event_is_sampled(cpu_id, index))
+        {
+            perf_event_read_samples(cpu_id, index, perf_event_get_hist(eventSet, i, thread_id), drain);
+        }
+    }
+}
+
+int perfmon_setSamplingPeriod_perfevent(uint64_t period)
+{
+    pthread_mutex_lock(&perf_event_sample_lock);
+    perf_event_free_samples();
+    perf_event_sample_period = period;
+    pthread_mutex_unlock(&perf_event_sample_lock);
+    return 0;
+}
+
+int perfmon_getSamplesThread_perfevent(int thread_id, PerfmonEventSet* eventSet, int event, PerfmonSample** samples)
+{
+    int n = 0;
+    PerfEventSampleHist* h = NULL;
+    if (perf_event_sample_period == 0 || perf_event_sample_hists == NULL)
+    {
+        *samples = NULL;
+        return 0;
+    }
+    h = perf_event_get_hist(eventSet, event, thread_id);
+    if (h == NULL || h->numEntries == 0)
+    {
+        *samples = NULL;
+        return 0;
+    }
+    free(h->samples);
+    h->samples = malloc(h->numEntries * sizeof(PerfmonSample));
+    if (h->samples == NULL)
+    {
+        *samples = NULL;
+        return -ENOMEM;
+    }
+    for (int i = 0; i < h->size && n < h->numEntries; i++)
+    {
+        PerfEventSampleEntry* e = &h->entries[i];
+        if (e->count == 0)
+        {
+            continue;
+        }
+        h->samples[n].address = e->address;
+        h->samples[n].offset = e->offset;
+        h->samples[n].count = e->count;
+        h->samples[n].module = (e->module >= 0 ? perf_event_modules[e->module] : NULL);
+        n++;
+    }
+    if (h->lost > 0)
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, Lost %llu samples of event %s on thread %d, (unsigned long long)h->lost, eventSet->events[event].event.name, thread_id);
+    }
+    *samples = h->samples;
+    return n;
+}
+
+/* Per-task counting: with LIKWID_PERF_PERTASK=1 and LIKWID_PERF_PID, the core
+ * events are counted per software thread of the process (pid=tid, cpu=-1)
+ * instead of per CPU. All task counters belong to the first thread of the
+ * group set, which reports the process result. The threads existing at setup
+ * (roots) get inherited counters, so the process result includes all threads
+ * created later. Threads found in /proc/<pid>/task at start and read get own
+ * counters for the per-thread results. */
+static int
+perf_event_task_type(RegisterType type)
+{
+    return (type == FIXED || type == PMC || type == PERF);
+}
+
+static pid_t
+perf_event_task_mode(void)
+{
+    char* env = getenv("LIKWID_PERF_PERTASK");
+    char* pidstr = getenv("LIKWID_PERF_PID");
+    if (env == NULL || atoi(env) == 0 || pidstr == NULL)
+    {
+        return -1;
+    }
+    return (pid_t)atoi(pidstr);
+}
+
+static PerfEventTaskSet*
+perf_event_find_taskset(PerfmonEventSet* eventSet)
+{
+    int groupId = (int)(eventSet - groupSet->groups);
+    if (groupId < 0 || groupId >= perf_event_task_groups || perf_event_task_sets[groupId].attrs == NULL)
+    {
+        return NULL;
+    }
+    return &perf_event_task_sets[groupId];
+}
+
+static PerfEventTaskSet*
+perf_event_get_taskset(PerfmonEventSet* eventSet)
+{
+    int groupId = (int)(eventSet - groupSet->groups);
+    PerfEventTaskSet* ts = NULL;
+    if (groupId < 0 || groupId >= groupSet->numberOfGroups)
+    {
+        return NULL;
+    }
+    if (groupId >= perf_event_task_groups)
+    {
+        PerfEventTaskSet* tmp = realloc(perf_event_task_sets, (groupId+1) * sizeof(PerfEventTaskSet));
+        if (tmp == NULL)
+        {
+            return NULL;
+        }
+        perf_event_task_sets = tmp;
+        memset(&perf_event_task_sets[perf_event_task_groups], 0, (groupId+1-perf_event_task_groups) * sizeof(PerfEventTaskSet));
+        perf_event_task_groups = groupId+1;
+    }
+    ts = &perf_event_task_sets[groupId];
+    if (ts->attrs == NULL)
+    {
+        ts->attrs = calloc(eventSet->numberOfEvents, sizeof(struct perf_event_attr));
+        ts->counted = calloc(eventSet->numberOfEvents, sizeof(char));
+        if (ts->attrs == NULL || ts->counted == NULL)
+        {
+            free(ts->attrs);
+            free(ts->counted);
+            ts->attrs = NULL;
+            ts->counted = NULL;
+            return NULL;
+        }
+        ts->numEvents = eventSet->numberOfEvents;
+    }
+    return ts;
+}
+
+static int
+perf_event_task_open(PerfEventTaskSet* ts, PerfEventTask* t, int event)
+{
+    struct perf_event_attr attr = ts->attrs[event];
+    /* Own counters of later threads run in parallel to the inherited ones,
+     * so they must not be pinned to be multiplexed if required */
+    attr.inherit = t->root;
+    attr.pinned = 0;
+    attr.disabled = (ts->running ? 0 : 1);
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+    t->fds[event] = perf_event_open(&attr, t->tid, -1, -1, 0);
+    if (t->fds[event] < 0)
+    {
+        DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot open event %d for task %d: %s, event, t->tid, strerror(errno));
+        return -errno;
+    }
+    t->start[event] = 0;
+    return 0;
+}
+
+static void
+perf_event_task_close(PerfEventTaskSet* ts)
+{
+    for (int i = 0; i < ts->numTasks; i++)
+    {
+        for (int e = 0; e < ts->numEvents; e++)
+        {
+            if (ts->tasks[i].fds[e] >= 0)
+            {
+                close(ts->tasks[i].fds[e]);
+                ts->tasks[i].fds[e] = -1;
+            }
+        }
+    }
+    ts->running = 0;
+}
+
+static int
+perf_event_task_add(PerfEventTaskSet* ts, pid_t tid, int root)
+{
+    int opened = 0;
+    PerfEventTask* t = NULL;
+    if (ts->numTasks == ts->size)
+    {
+        int size = (ts->size > 0 ? 2 * ts->size : 16);
+        PerfEventTask* tmp = realloc(ts->tasks, size * sizeof(PerfEventTask));
+        if (tmp == NULL)
+        {
+            return -ENOMEM;
+        }
+        ts->tasks = tmp;
+        ts->size = size;
+    }
+    t = &ts->tasks[ts->numTasks];
+    t->tid = tid;
+    t->root = root;
+    t->parent = -1;
+    t->fds = malloc(ts->numEvents * sizeof(int));
+    t->start = calloc(ts->numEvents, sizeof(long long));
+    t->results = calloc(ts->numEvents, sizeof(double));
+    t->quality = malloc(ts->numEvents * sizeof(double));
+    if (!t->fds || !t->start || !t->results || !t->quality)
+    {
+        free(t->fds);
+        free(t->start);
+        free(t->results);
+        free(t->quality);
+        return -ENOMEM;
+    }
+    for (int e = 0; e < ts->numEvents; e++)
+    {
+        t->fds[e] = -1;
+        t->quality[e] = 1.0;
+        if (ts->counted[e] && perf_event_task_open(ts, t, e) == 0)
+        {
+            opened++;
+        }
+    }
+    if (opened == 0)
+    {
+        /* The thread exited in between */
+        free(t->fds);
+        free(t->start);
+        free(t->results);
+        free(t->quality);
+        return -ESRCH;
+    }
+    if (root)
+    {
+        ts->numRoots++;
+    }
+    else if (ts->numRoots == 1)
+    {
+        /* All later threads descend from the only root, their counts are
+         * removed from its inherited counters in the per-thread results */
+        for (int i = 0; i < ts->numTasks; i++)
+        {
+            if (ts->tasks[i].root)
+            {
+                t->parent = i;
+                break;
+            }
+        }
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Counting task %d of process %d (%s), tid, ts->pid, (root ? "inherited" : "own"));
+    ts->numTasks++;
+    return 0;
+}
+
+/* Adds counters for all threads of the process that are not counted yet */
+static void
+perf_event_task_scan(PerfEventTaskSet* ts, int root)
+{
+    char path[64];
+    DIR* dir = NULL;
+    struct dirent* ent = NULL;
+    snprintf(path, sizeof(path), "/proc/%d/task", ts->pid);
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return;
+    }
+    while ((ent = readdir(dir)) != NULL)
+    {
+        int known = 0;
+        pid_t tid = 0;
+        if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+        {
+            continue;
+        }
+        tid = (pid_t)atoi(ent->d_name);
+        for (int i = 0; i < ts->numTasks; i++)
+        {
+            if (ts->tasks[i].tid == tid)
+            {
+                known = 1;
+                break;
+            }
+        }
+        if (!known)
+        {
+            perf_event_task_add(ts, tid, root);
+        }
+    }
+    closedir(dir);
+}
+
+static int
+perf_event_task_setup(PerfmonEventSet* eventSet, pid_t pid)
+{
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    if (ts == NULL)
+    {
+        return -ENOMEM;
+    }
+    ts->pid = pid;
+    if (ts->numTasks == 0)
+    {
+        perf_event_task_scan(ts, 1);
+        if (ts->numTasks == 0)
+        {
+            ERROR_PRINT(Cannot count the threads of process %d, pid);
+            return -ESRCH;
+        }
+        return 0;
+    }
+    /* Setup after a group switch, the known threads keep their results */
+    for (int i = 0; i < ts->numTasks; i++)
+    {
+        for (int e = 0; e < ts->numEvents; e++)
+        {
+            if (ts->counted[e])
+            {
+                perf_event_task_open(ts, &ts->tasks[i], e);
+            }
+        }
+    }
+    perf_event_task_scan(ts, 0);
+    return 0;
+}
+
+static void
+perf_event_task_start(int thread_id, PerfmonEventSet* eventSet)
+{
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    if (ts == NULL || thread_id != 0)
+    {
+        return;
+    }
+    for (int i = 0; i < ts->numTasks; i++)
+    {
+        for (int e = 0; e < ts->numEvents; e++)
+        {
+            if (ts->tasks[i].fds[e] >= 0)
+            {
+                ioctl(ts->tasks[i].fds[e], PERF_EVENT_IOC_RESET, 0);
+                ts->tasks[i].start[e] = 0;
+            }
+        }
+    }
+    for (int e = 0; e < ts->numEvents; e++)
+    {
+        if (ts->counted[e])
+        {
+            eventSet->events[e].threadCounter[thread_id].startData = 0x0ULL;
+            eventSet->events[e].threadCounter[thread_id].counterData = 0x0ULL;
+            eventSet->events[e].threadCounter[thread_id].quality = 1.0;
+        }
+    }
+    for (int i = 0; i < ts->numTasks; i++)
+    {
+        for (int e = 0; e < ts->numEvents; e++)
+        {
+            if (ts->tasks[i].fds[e] >= 0)
+            {
+                ioctl(ts->tasks[i].fds[e], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    ts->running = 1;
+    perf_event_task_scan(ts, 0);
+}
+
+/* Reads all task counters, accumulates the per-thread results and stores
+ * the sum of the inherited counters as process result of the first thread */
+static void
+perf_event_task_read(int thread_id, PerfmonEventSet* eventSet, int stop)
+{
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    if (ts == NULL || thread_id != 0)
+    {
+        return;
+    }
+    if (!stop)
+    {
+        perf_event_task_scan(ts, 0);
+    }
+    for (int e = 0; e < ts->numEvents; e++)
+    {
+        long long sum = 0;
+        double minq = 1.0;
+        if (!ts->counted[e])
+        {
+            continue;
+        }
+        for (int i = 0; i < ts->numTasks; i++)
+        {
+            PerfEventTask* t = &ts->tasks[i];
+            long long value = 0;
+            double quality = 1.0;
+            if (t->fds[e] < 0)
+            {
+                continue;
+            }
+            if (stop)
+            {
+                ioctl(t->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+            }
+            if (perf_event_read_single(t->fds[e], &value, &quality) != 0)
+            {
+                continue;
+            }
+            t->results[e] += (double)(value - t->start[e]);
+            t->start[e] = (stop ? 0 : value);
+            t->quality[e] = quality;
+            if (stop)
+            {
+                ioctl(t->fds[e], PERF_EVENT_IOC_RESET, 0);
+            }
+            if (t->root)
+            {
+                sum += value;
+                if (quality < minq)
+                {
+                    minq = quality;
+                }
+            }
+        }
+        eventSet->events[e].threadCounter[thread_id].counterData = sum;
+        eventSet->events[e].threadCounter[thread_id].quality = minq;
+    }
+    if (stop)
+    {
+        ts->running = 0;
+    }
+}
+
+static void
+perf_event_task_free(void)
 {
-    int ret;
+    for (int g = 0; g < perf_event_task_groups; g++)
+    {
+        PerfEventTaskSet* ts = &perf_event_task_sets[g];
+        perf_event_task_close(ts);
+        for (int i = 0; i < ts->numTasks; i++)
+        {
+            free(ts->tasks[i].fds);
+            free(ts->tasks[i].start);
+            free(ts->tasks[i].results);
+            free(ts->tasks[i].quality);
+        }
+        free(ts->tasks);
+        free(ts->attrs);
+        free(ts->counted);
+    }
+    free(perf_event_task_sets);
+    perf_event_task_sets = NULL;
+    perf_event_task_groups = 0;
+}
 
-    ret = syscall(__NR_perf_event_open, hw_event, pid, cpu,
-                   group_fd, flags);
-    return ret;
+int perfmon_getNumberOfTasks_perfevent(PerfmonEventSet* eventSet)
+{
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    return (ts != NULL ? ts->numTasks : 0);
+}
+
+int perfmon_getTaskId_perfevent(PerfmonEventSet* eventSet, int task)
+{
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    if (ts == NULL || task < 0 || task >= ts->numTasks)
+    {
+        return -EINVAL;
+    }
+    return (int)ts->tasks[task].tid;
+}
+
+double perfmon_getTaskResult_perfevent(PerfmonEventSet* eventSet, int event, int task)
+{
+    double result = 0.0;
+    PerfEventTaskSet* ts = perf_event_find_taskset(eventSet);
+    if (ts == NULL || task < 0 || task >= ts->numTasks || event < 0 || event >= ts->numEvents)
+    {
+        return NAN;
+    }
+    if (!ts->counted[event])
+    {
+        return NAN;
+    }
+    result = ts->tasks[task].results[event];
+    for (int i = 0; i < ts->numTasks; i++)
+    {
+        if (ts->tasks[i].parent == task)
+        {
+            result -= ts->tasks[i].results[event];
+        }
+    }
+    return (result > 0 ? result : 0.0);
+}
+
+int perfmon_setCgroup_perfevent(const char* path)
+{
+    int fd = -1;
+    if (path != NULL && strlen(path) > 0)
+    {
+        fd = open(path, O_RDONLY|O_DIRECTORY);
+        if (fd < 0)
+        {
+            ERROR_PRINT(Cannot open cgroup %s, path);
+            return -errno;
+        }
+    }
+    if (perf_event_cgroup_fd >= 0)
+    {
+        close(perf_event_cgroup_fd);
+    }
+    perf_event_cgroup_fd = fd;
+    if (fd >= 0)
+    {
+        DEBUG_PRINT(DEBUGLEV_DEVELOP, Counting core events of cgroup %s, path);
+    }
+    return 0;
 }
 
 int perfevent_paranoid_value()
@@ -192,6 +1630,62 @@ int perfmon_init_perfevent(int cpu_id)
         memset(cpu_event_fds[cpu_id], -1, perfmon_numCounters * sizeof(int));
         active_cpus += 1;
     }
+    if (cpu_event_pages == NULL)
+    {
+        cpu_event_pages = calloc(cpuid_topology.numHWThreads, sizeof(struct perf_event_mmap_page**));
+    }
+    if (cpu_event_pages != NULL && cpu_event_pages[cpu_id] == NULL)
+    {
+        cpu_event_pages[cpu_id] = calloc(perfmon_numCounters, sizeof(struct perf_event_mmap_page*));
+    }
+    if (cpu_event_sampled == NULL)
+    {
+        cpu_event_sampled = calloc(cpuid_topology.numHWThreads, sizeof(char*));
+    }
+    if (cpu_event_sampled != NULL && cpu_event_sampled[cpu_id] == NULL)
+    {
+        cpu_event_sampled[cpu_id] = calloc(perfmon_numCounters, sizeof(char));
+    }
+    if (perf_event_nogroup < 0)
+    {
+        perf_event_nogroup = (getenv("LIKWID_PERF_NOGROUP") != NULL);
+    }
+    if (cpu_event_groups == NULL)
+    {
+        cpu_event_groups = calloc(cpuid_topology.numHWThreads, sizeof(PerfEventCpuGroups));
+    }
+    if (cpu_event_groups != NULL && cpu_event_groups[cpu_id].groups == NULL)
+    {
+        PerfEventCpuGroups* cg = &cpu_event_groups[cpu_id];
+        cg->groups = calloc(perfmon_numCounters, sizeof(PerfEventGroup));
+        cg->group = malloc(perfmon_numCounters * sizeof(int));
+        cg->values = calloc(perfmon_numCounters, sizeof(long long));
+        cg->buffer = calloc(3 + perfmon_numCounters, sizeof(uint64_t));
+        if (!cg->groups || !cg->group || !cg->values || !cg->buffer)
+        {
+            free(cg->groups);
+            free(cg->group);
+            free(cg->values);
+            free(cg->buffer);
+            memset(cg, 0, sizeof(PerfEventCpuGroups));
+            return -ENOMEM;
+        }
+        memset(cg->group, -1, perfmon_numCounters * sizeof(int));
+    }
+    if (perf_event_num_pmc == 0)
+    {
+        perf_event_num_pmc = cpuid_info.perf_num_ctr;
+        if (perf_event_num_pmc == 0)
+        {
+            for (int i = 0; i < perfmon_numCounters - perfmon_numVirtualCounters; i++)
+            {
+                if (counter_map[i].type == PMC)
+                {
+                    perf_event_num_pmc++;
+                }
+            }
+        }
+    }
     perf_event_num_cpus = cpuid_topology.numHWThreads;
     if (cpuid_info.family == ZEN3_FAMILY && (cpuid_info.model == ZEN4_RYZEN || cpuid_info.model == ZEN4_EPYC))
     {
@@ -216,12 +1710,145 @@ struct perf_event_config_format {
 };
 
 
-int parse_event_config(char* base, char* option, int* num_formats, struct perf_event_config_format **formats)
+/* The format descriptions and PMU types in sysfs are the same for all CPUs.
+ * They are read once and copied for each setup, which is done in parallel
+ * for the CPUs. */
+typedef struct {
+    char* path;
+    int type;
+    int num_formats;
+    struct perf_event_config_format* formats;
+} PerfEventSysfsEntry;
+
+static PerfEventSysfsEntry* perf_event_sysfs_cache = NULL;
+static int perf_event_sysfs_entries = 0;
+static int perf_event_sysfs_size = 0;
+static pthread_mutex_t perf_event_sysfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static PerfEventSysfsEntry*
+perf_event_sysfs_lookup(const char* path)
+{
+    for (int i = 0; i < perf_event_sysfs_entries; i++)
+    {
+        if (strcmp(perf_event_sysfs_cache[i].path, path) == 0)
+        {
+            return &perf_event_sysfs_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static PerfEventSysfsEntry*
+perf_event_sysfs_add(const char* path)
+{
+    PerfEventSysfsEntry* e = NULL;
+    if (perf_event_sysfs_entries == perf_event_sysfs_size)
+    {
+        int size = (perf_event_sysfs_size > 0 ? 2 * perf_event_sysfs_size : 64);
+        PerfEventSysfsEntry* tmp = realloc(perf_event_sysfs_cache, size * sizeof(PerfEventSysfsEntry));
+        if (tmp == NULL)
+        {
+            return NULL;
+        }
+        perf_event_sysfs_cache = tmp;
+        perf_event_sysfs_size = size;
+    }
+    e = &perf_event_sysfs_cache[perf_event_sysfs_entries];
+    e->path = strdup(path);
+    if (e->path == NULL)
+    {
+        return NULL;
+    }
+    e->type = -1;
+    e->num_formats = 0;
+    e->formats = NULL;
+    perf_event_sysfs_entries++;
+    return e;
+}
+
+static void
+perf_event_sysfs_free(void)
+{
+    pthread_mutex_lock(&perf_event_sysfs_lock);
+    for (int i = 0; i < perf_event_sysfs_entries; i++)
+    {
+        free(perf_event_sysfs_cache[i].path);
+        free(perf_event_sysfs_cache[i].formats);
+    }
+    free(perf_event_sysfs_cache);
+    perf_event_sysfs_cache = NULL;
+    perf_event_sysfs_entries = 0;
+    perf_event_sysfs_size = 0;
+    pthread_mutex_unlock(&perf_event_sysfs_lock);
+}
+
+static int
+perf_event_read_format(char* path, int* num_formats, struct perf_event_config_format **formats)
 {
     int err = 0;
     struct tagbstring config_reg = bsStatic("config:");
     struct tagbstring config1_reg = bsStatic("config1:");
     struct tagbstring config2_reg = bsStatic("config2:");
+    FILE *fp = fopen(path, "r");
+    if (fp)
+    {
+        bstring src = bread ((bNread) fread, fp);
+        struct bstrList* formatList = bsplit(src, ',');
+        struct perf_event_config_format *flist = malloc(formatList->qty * sizeof(struct perf_event_config_format));
+        if (flist)
+        {
+            int nf = 0;
+            for (int i = 0; i < formatList->qty; i++)
+            {
+                flist[nf].reg = INVALID;
+                flist[nf].start = -1;
+                flist[nf].end = -1;
+                if (bstrncmp(formatList->entry[i], &config_reg, blength(&config_reg)) == BSTR_OK)
+                {
+                    flist[nf].reg = CONFIG;
+                    bdelete(formatList->entry[i], 0, blength(&config_reg));
+                }
+                else if (bstrncmp(formatList->entry[i], &config1_reg, blength(&config1_reg)) == BSTR_OK)
+                {
+                    flist[nf].reg = CONFIG1;
+                    bdelete(formatList->entry[i], 0, blength(&config1_reg));
+                }
+                else if (bstrncmp(formatList->entry[i], &config2_reg, blength(&config2_reg)) == BSTR_OK)
+                {
+                    flist[nf].reg = CONFIG2;
+                    bdelete(formatList->entry[i], 0, blength(&config2_reg));
+                }
+                else
+                {
+                    if (nf > 0)
+                    {
+                        flist[nf].reg = flist[0].reg;
+                    }
+                }
+                int s = -1;
+                int e = -1;
+                int c = sscanf(bdata(formatList->entry[i]), "%d-%d", &s, &e);
+                flist[nf].start = (c >= 1 ? s : -1);
+                flist[nf].end = (c == 2 ? e : -1);
+                nf++;
+            }
+            *formats = flist;
+            *num_formats = nf;
+        }
+        else
+        {
+            err = -ENOMEM;
+        }
+        bstrListDestroy(formatList);
+        bdestroy(src);
+        fclose(fp);
+    }
+    return err;
+}
+
+int parse_event_config(char* base, char* option, int* num_formats, struct perf_event_config_format **formats)
+{
+    int err = 0;
     if (!base || !option || !num_formats || !formats)
     {
         return -EINVAL;
@@ -231,60 +1858,30 @@ int parse_event_config(char* base, char* option, int* num_formats, struct perf_e
     if (strlen(base) > 0 && strlen(option) > 0)
     {
         bstring path = bformat("%s/format/%s", base, option);
-        FILE *fp = fopen(bdata(path), "r");
-        if (fp)
+        pthread_mutex_lock(&perf_event_sysfs_lock);
+        PerfEventSysfsEntry* e = perf_event_sysfs_lookup(bdata(path));
+        if (e == NULL)
         {
-            bstring src = bread ((bNread) fread, fp);
-            struct bstrList* formatList = bsplit(src, ',');
-            struct perf_event_config_format *flist = malloc(formatList->qty * sizeof(struct perf_event_config_format));
-            if (flist)
+            e = perf_event_sysfs_add(bdata(path));
+            if (e != NULL)
             {
-                int nf = 0;
-                for (int i = 0; i < formatList->qty; i++)
-                {
-                    flist[nf].reg = INVALID;
-                    flist[nf].start = -1;
-                    flist[nf].end = -1;
-                    if (bstrncmp(formatList->entry[i], &config_reg, blength(&config_reg)) == BSTR_OK)
-                    {
-                        flist[nf].reg = CONFIG;
-                        bdelete(formatList->entry[i], 0, blength(&config_reg));
-                    }
-                    else if (bstrncmp(formatList->entry[i], &config1_reg, blength(&config1_reg)) == BSTR_OK)
-                    {
-                        flist[nf].reg = CONFIG1;
-                        bdelete(formatList->entry[i], 0, blength(&config1_reg));
-                    }
-                    else if (bstrncmp(formatList->entry[i], &config2_reg, blength(&config2_reg)) == BSTR_OK)
-                    {
-                        flist[nf].reg = CONFIG2;
-                        bdelete(formatList->entry[i], 0, blength(&config2_reg));
-                    }
-                    else
-                    {
-                        if (nf > 0)
-                        {
-                            flist[nf].reg = flist[0].reg;
-                        }
-                    }
-                    int s = -1;
-                    int e = -1;
-                    int c = sscanf(bdata(formatList->entry[i]), "%d-%d", &s, &e);
-                    flist[nf].start = (c >= 1 ? s : -1);
-                    flist[nf].end = (c == 2 ? e : -1);
-                    nf++;
-                }
-                *formats = flist;
-                *num_formats = nf;
+                err = perf_event_read_format(bdata(path), &e->num_formats, &e->formats);
+            }
+        }
+        if (e != NULL && e->num_formats > 0)
+        {
+            *formats = malloc(e->num_formats * sizeof(struct perf_event_config_format));
+            if (*formats != NULL)
+            {
+                memcpy(*formats, e->formats, e->num_formats * sizeof(struct perf_event_config_format));
+                *num_formats = e->num_formats;
             }
             else
             {
                 err = -ENOMEM;
             }
-            bstrListDestroy(formatList);
-            bdestroy(src);
-            fclose(fp);
         }
+        pthread_mutex_unlock(&perf_event_sysfs_lock);
         bdestroy(path);
     }
     else
@@ -318,6 +1915,15 @@ int read_perf_event_type(char* folder)
     }
     int type = -1;
     bstring path = bformat("%s/type", folder);
+    pthread_mutex_lock(&perf_event_sysfs_lock);
+    PerfEventSysfsEntry* e = perf_event_sysfs_lookup(bdata(path));
+    if (e != NULL)
+    {
+        type = e->type;
+        pthread_mutex_unlock(&perf_event_sysfs_lock);
+        bdestroy(path);
+        return type;
+    }
     FILE *fp = fopen(bdata(path), "r");
     if (fp)
     {
@@ -328,6 +1934,12 @@ int read_perf_event_type(char* folder)
         bdestroy(src);
         fclose(fp);
     }
+    e = perf_event_sysfs_add(bdata(path));
+    if (e != NULL)
+    {
+        e->type = type;
+    }
+    pthread_mutex_unlock(&perf_event_sysfs_lock);
     bdestroy(path);
     return type;
 }
@@ -948,11 +2560,12 @@ int perfmon_setupCountersThread_perfevent(
     int ret;
     int cpu_id = groupSet->threads[thread_id].processorId;
     struct perf_event_attr attr;
-    int group_fd = -1;
     int is_uncore = 0;
     pid_t allpid = -1;
+    pid_t taskpid = perf_event_task_mode();
     unsigned long allflags = 0;
     char* env_perf_pid = getenv("LIKWID_PERF_PID");
+    PerfEventTaskSet* ts = NULL;
 
     if (!perf_event_initialized)
     {
@@ -962,7 +2575,17 @@ int perfmon_setupCountersThread_perfevent(
     {
         allpid = (pid_t)atoi(env_perf_pid);
     }
-    if (perf_event_paranoid > 0 && getuid() != 0)
+    if (perf_event_cgroup_fd >= 0)
+    {
+        if (taskpid >= 0)
+        {
+            ERROR_PLAIN_PRINT(Per-task counting cannot be restricted to a cgroup);
+            return -EINVAL;
+        }
+        allpid = perf_event_cgroup_fd;
+        allflags |= PERF_FLAG_PID_CGROUP;
+    }
+    else if (perf_event_paranoid > 0 && getuid() != 0)
     {
         if (allpid == -1)
         {
@@ -974,7 +2597,7 @@ int perfmon_setupCountersThread_perfevent(
 
     if (getenv("LIKWID_PERF_FLAGS") != NULL)
     {
-        allflags = strtoul(getenv("LIKWID_PERF_FLAGS"), NULL, 16);
+        allflags |= strtoul(getenv("LIKWID_PERF_FLAGS"), NULL, 16);
     }
     if (groupSet->activeGroup >= 0)
     {
@@ -982,10 +2605,40 @@ int perfmon_setupCountersThread_perfevent(
         {
             if (cpu_event_fds[cpu_id][j] != -1)
             {
+                perf_event_unmap_page(cpu_id, j);
                 close(cpu_event_fds[cpu_id][j]);
                 cpu_event_fds[cpu_id][j] = -1;
             }
         }
+        perf_event_group_clear(cpu_id);
+        if (thread_id == 0)
+        {
+            for (int g = 0; g < perf_event_task_groups; g++)
+            {
+                perf_event_task_close(&perf_event_task_sets[g]);
+            }
+        }
+    }
+    if (taskpid >= 0 && thread_id == 0)
+    {
+        ts = perf_event_get_taskset(eventSet);
+        if (ts == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    if (cpu_event_groups != NULL)
+    {
+        int numPmc = 0;
+        for (int i = 0; i < eventSet->numberOfEvents; i++)
+        {
+            RegisterType t = eventSet->events[i].type;
+            if (t == PMC || t == IPMC || t == FPMC)
+            {
+                numPmc++;
+            }
+        }
+        cpu_event_groups[cpu_id].multiplexed = (perf_event_num_pmc > 0 && numPmc > perf_event_num_pmc);
     }
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
@@ -1403,18 +3056,48 @@ int perfmon_setupCountersThread_perfevent(
             default:
                 break;
         }
+        if (ret == 0 && taskpid >= 0 && perf_event_task_type(type))
+        {
+            /* Counted per task by the first thread, see perf_event_task_setup() */
+            if (ts != NULL)
+            {
+                ts->attrs[i] = attr;
+                ts->counted[i] = 1;
+                eventSet->events[i].threadCounter[thread_id].init = TRUE;
+            }
+            continue;
+        }
         if (ret == 0)
         {
             pid_t curpid = allpid;
+            unsigned long curflags = allflags;
             if (is_uncore && curpid >= 0)
             {
+                /* Uncore events cannot be bound to a process or cgroup */
                 curpid = -1;
+                curflags &= ~PERF_FLAG_PID_CGROUP;
             }
 
             if (!is_uncore)
             {
-                DEBUG_PRINT(DEBUGLEV_DEVELOP, perf_event_open: cpu_id=%d pid=%d flags=%d, cpu_id, curpid, allflags);
-                cpu_event_fds[cpu_id][index] = perf_event_open(&attr, curpid, cpu_id, -1, allflags);
+                int sampled = (perf_event_sample_period > 0 && (type == FIXED || type == PMC) && cpu_event_sampled && cpu_event_sampled[cpu_id]);
+                if (sampled)
+                {
+                    attr.sample_period = perf_event_sample_period;
+                    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+                    cpu_event_sampled[cpu_id][index] = 1;
+                }
+                DEBUG_PRINT(DEBUGLEV_DEVELOP, perf_event_open: cpu_id=%d pid=%d flags=%d, cpu_id, curpid, curflags);
+                cpu_event_fds[cpu_id][index] = perf_event_open_group(cpu_id, index, type, is_uncore, &attr, curpid, curflags);
+                if (sampled && cpu_event_fds[cpu_id][index] < 0)
+                {
+                    /* Not every event can sample (e.g. TOPDOWN_SLOTS), count it instead */
+                    DEBUG_PRINT(DEBUGLEV_INFO, Event %s cannot be sampled on CPU %d: %s, event->name, cpu_id, strerror(errno));
+                    attr.sample_period = 0;
+                    attr.sample_type = 0;
+                    cpu_event_sampled[cpu_id][index] = 0;
+                    cpu_event_fds[cpu_id][index] = perf_event_open_group(cpu_id, index, type, is_uncore, &attr, curpid, curflags);
+                }
             }
             else if ((perf_disable_uncore == 0) && (has_lock))
             {
@@ -1423,8 +3106,8 @@ int perfmon_setupCountersThread_perfevent(
                     DEBUG_PRINT(DEBUGLEV_INFO, Cannot measure Uncore with perf_event_paranoid value = %d, perf_event_paranoid);
                     perf_disable_uncore = 1;
                 }
-                DEBUG_PRINT(DEBUGLEV_DEVELOP, perf_event_open: cpu_id=%d pid=%d flags=%d type=%d config=0x%llX disabled=%d inherit=%d exclusive=%d config1=0x%llX config2=0x%llX, cpu_id, curpid, allflags, attr.type, attr.config, attr.disabled, attr.inherit, attr.exclusive, attr.config1, attr.config2);
-                cpu_event_fds[cpu_id][index] = perf_event_open(&attr, curpid, cpu_id, -1, allflags);
+                DEBUG_PRINT(DEBUGLEV_DEVELOP, perf_event_open: cpu_id=%d pid=%d flags=%d type=%d config=0x%llX disabled=%d inherit=%d exclusive=%d config1=0x%llX config2=0x%llX, cpu_id, curpid, curflags, attr.type, attr.config, attr.disabled, attr.inherit, attr.exclusive, attr.config1, attr.config2);
+                cpu_event_fds[cpu_id][index] = perf_event_open_group(cpu_id, index, type, is_uncore, &attr, curpid, curflags);
             }
             else
             {
@@ -1433,12 +3116,11 @@ int perfmon_setupCountersThread_perfevent(
             if (cpu_event_fds[cpu_id][index] < 0)
             {
                 ERROR_PRINT(Setup of event %s on CPU %d failed: %s, event->name, cpu_id, strerror(errno));
-                DEBUG_PRINT(DEBUGLEV_DEVELOP, open error: cpu_id=%d pid=%d flags=%d type=%d config=0x%llX disabled=%d inherit=%d exclusive=%d config1=0x%llX config2=0x%llX, cpu_id, curpid, allflags, attr.type, attr.config, attr.disabled, attr.inherit, attr.exclusive, attr.config1, attr.config2);
+                DEBUG_PRINT(DEBUGLEV_DEVELOP, open error: cpu_id=%d pid=%d flags=%d type=%d config=0x%llX disabled=%d inherit=%d exclusive=%d config1=0x%llX config2=0x%llX, cpu_id, curpid, curflags, attr.type, attr.config, attr.disabled, attr.inherit, attr.exclusive, attr.config1, attr.config2);
             }
-            if (group_fd < 0)
+            else if (type == FIXED || type == PMC)
             {
-                group_fd = cpu_event_fds[cpu_id][index];
-                running_group = group_fd;
+                perf_event_map_page(cpu_id, index);
             }
             eventSet->events[i].threadCounter[thread_id].init = TRUE;
         }
@@ -1451,6 +3133,14 @@ int perfmon_setupCountersThread_perfevent(
             }
         }
     }
+    if (ts != NULL)
+    {
+        ret = perf_event_task_setup(eventSet, taskpid);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
     return 0;
 }
 
@@ -1462,6 +3152,9 @@ int perfmon_startCountersThread_perfevent(int thread_id, PerfmonEventSet* eventS
     {
         return -(thread_id+1);
     }
+    VERBOSEPRINTREG(cpu_id, 0x0, 0x0, RESET_COUNTER);
+    perf_event_group_ioctl(cpu_id, PERF_EVENT_IOC_RESET);
+    perf_event_group_read(cpu_id, perf_event_pinned_to(cpu_id));
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -1469,16 +3162,31 @@ int perfmon_startCountersThread_perfevent(int thread_id, PerfmonEventSet* eventS
             RegisterIndex index = eventSet->events[i].index;
             if (cpu_event_fds[cpu_id][index] < 0)
                 continue;
-            VERBOSEPRINTREG(cpu_id, 0x0, 0x0, RESET_COUNTER);
-            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_RESET, 0);
             PerfmonCounter *c = &eventSet->events[i].threadCounter[thread_id];
+            double quality = 1.0;
             c->startData = 0x0ULL;
             c->counterData = 0x0ULL;
+            c->quality = 1.0;
+            if (perf_event_is_grouped(cpu_id, index))
+            {
+                long long tmp = 0x0LL;
+                if (eventSet->events[i].type == POWER && perf_event_group_value(cpu_id, index, &tmp, &quality) == 0)
+                {
+                    c->startData = tmp;
+                }
+                VERBOSEPRINTREG(cpu_id, 0x0, c->startData, START_COUNTER);
+                continue;
+            }
+            VERBOSEPRINTREG(cpu_id, 0x0, 0x0, RESET_COUNTER);
+            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_RESET, 0);
             if (eventSet->events[i].type == POWER)
             {
-                ret = read(cpu_event_fds[cpu_id][index],
-                        &eventSet->events[i].threadCounter[thread_id].startData,
-                        sizeof(long long));
+                long long tmp = 0x0LL;
+                ret = perf_event_read_single(cpu_event_fds[cpu_id][index], &tmp, &quality);
+                if (ret == 0)
+                {
+                    c->startData = tmp;
+                }
             }
             VERBOSEPRINTREG(cpu_id, 0x0,
                             c->startData,
@@ -1486,6 +3194,8 @@ int perfmon_startCountersThread_perfevent(int thread_id, PerfmonEventSet* eventS
             ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_ENABLE, 0);
         }
     }
+    perf_event_group_ioctl(cpu_id, PERF_EVENT_IOC_ENABLE);
+    perf_event_task_start(thread_id, eventSet);
     return 0;
 }
 
@@ -1494,23 +3204,37 @@ int perfmon_stopCountersThread_perfevent(int thread_id, PerfmonEventSet* eventSe
     int ret;
     int cpu_id = groupSet->threads[thread_id].processorId;
     long long tmp = 0;
+    double quality = 1.0;
     if (!perf_event_initialized)
     {
         return -(thread_id+1);
     }
+    VERBOSEPRINTREG(cpu_id, 0x0, 0x0, FREEZE_COUNTER);
+    perf_event_group_ioctl(cpu_id, PERF_EVENT_IOC_DISABLE);
+    perf_event_group_read(cpu_id, perf_event_pinned_to(cpu_id));
+    perf_event_drain_samples(thread_id, eventSet);
+    perf_event_task_read(thread_id, eventSet, 1);
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
         {
             RegisterIndex index = eventSet->events[i].index;
+            int grouped = perf_event_is_grouped(cpu_id, index);
             if (cpu_event_fds[cpu_id][index] < 0)
                 continue;
-            VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, FREEZE_COUNTER);
-            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_DISABLE, 0);
             tmp = 0x0LL;
-            ret = read(cpu_event_fds[cpu_id][index], &tmp, sizeof(long long));
-            VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], tmp, READ_COUNTER);
-            if (ret == sizeof(long long))
+            if (grouped)
+            {
+                ret = perf_event_group_value(cpu_id, index, &tmp, &quality);
+            }
+            else
+            {
+                VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, FREEZE_COUNTER);
+                ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_DISABLE, 0);
+                ret = perf_event_read_single(cpu_event_fds[cpu_id][index], &tmp, &quality);
+                VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], tmp, READ_COUNTER);
+            }
+            if (ret == 0)
             {
 #if defined(__ARM_ARCH_8A)
                 if (cpuid_info.vendor == FUJITSU_ARM && cpuid_info.part == FUJITSU_A64FX)
@@ -1531,12 +3255,17 @@ int perfmon_stopCountersThread_perfevent(int thread_id, PerfmonEventSet* eventSe
                 }
 #endif
                 eventSet->events[i].threadCounter[thread_id].counterData = tmp;
-
+                eventSet->events[i].threadCounter[thread_id].quality = quality;
+            }
+            if (!grouped)
+            {
+                ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_RESET, 0);
+                VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, RESET_COUNTER);
             }
-            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_RESET, 0);
-            VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, RESET_COUNTER);
         }
     }
+    perf_event_group_ioctl(cpu_id, PERF_EVENT_IOC_RESET);
+    VERBOSEPRINTREG(cpu_id, 0x0, 0x0, RESET_COUNTER);
     return 0;
 }
 
@@ -1545,10 +3274,16 @@ int perfmon_readCountersThread_perfevent(int thread_id, PerfmonEventSet* eventSe
     int ret;
     int cpu_id = groupSet->threads[thread_id].processorId;
     long long tmp = 0;
+    double quality = 1.0;
+    int on_cpu = 0;
     if (!perf_event_initialized)
     {
         return -(thread_id+1);
     }
+    on_cpu = perf_event_pinned_to(cpu_id);
+    perf_event_group_read(cpu_id, on_cpu);
+    perf_event_drain_samples(thread_id, eventSet);
+    perf_event_task_read(thread_id, eventSet, 0);
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -1556,12 +3291,17 @@ int perfmon_readCountersThread_perfevent(int thread_id, PerfmonEventSet* eventSe
             RegisterIndex index = eventSet->events[i].index;
             if (cpu_event_fds[cpu_id][index] < 0)
                 continue;
-            VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, FREEZE_COUNTER);
-            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_DISABLE, 0);
             tmp = 0x0LL;
-            ret = read(cpu_event_fds[cpu_id][index], &tmp, sizeof(long long));
+            if (perf_event_is_grouped(cpu_id, index))
+            {
+                ret = perf_event_group_value(cpu_id, index, &tmp, &quality);
+            }
+            else
+            {
+                ret = perf_event_read_counter(cpu_id, on_cpu, index, &tmp, &quality);
+            }
             VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], tmp, READ_COUNTER);
-            if (ret == sizeof(long long))
+            if (ret == 0)
             {
 #if defined(__ARM_ARCH_8A)
                 if (cpuid_info.vendor == FUJITSU_ARM && cpuid_info.part == FUJITSU_A64FX)
@@ -1582,9 +3322,8 @@ int perfmon_readCountersThread_perfevent(int thread_id, PerfmonEventSet* eventSe
                 }
 #endif
                 eventSet->events[i].threadCounter[thread_id].counterData = tmp;
+                eventSet->events[i].threadCounter[thread_id].quality = quality;
             }
-            VERBOSEPRINTREG(cpu_id, cpu_event_fds[cpu_id][index], 0x0, UNFREEZE_COUNTER);
-            ioctl(cpu_event_fds[cpu_id][index], PERF_EVENT_IOC_ENABLE, 0);
         }
     }
     return 0;
@@ -1601,6 +3340,7 @@ int perfmon_finalizeCountersThread_perfevent(int thread_id, PerfmonEventSet* eve
             {
                 if (cpu_event_fds[cpu_id][j] > 0)
                 {
+                    perf_event_unmap_page(cpu_id, j);
                     ioctl(cpu_event_fds[cpu_id][j], PERF_EVENT_IOC_DISABLE, 0);
                     ioctl(cpu_event_fds[cpu_id][j], PERF_EVENT_IOC_RESET, 0);
                     close(cpu_event_fds[cpu_id][j]);
@@ -1616,6 +3356,21 @@ int perfmon_finalizeCountersThread_perfevent(int thread_id, PerfmonEventSet* eve
             active_cpus--;
         }
     }
+    if (cpu_event_pages != NULL)
+    {
+        free(cpu_event_pages[cpu_id]);
+        cpu_event_pages[cpu_id] = NULL;
+    }
+    if (cpu_event_sampled != NULL)
+    {
+        free(cpu_event_sampled[cpu_id]);
+        cpu_event_sampled[cpu_id] = NULL;
+    }
+    perf_event_group_free(cpu_id);
+    if (thread_id == 0)
+    {
+        perf_event_task_free();
+    }
     return 0;
 }
 
@@ -1635,4 +3390,39 @@ void __attribute__((destructor (101))) close_perfmon_perfevent(void)
         free(cpu_event_fds);
         cpu_event_fds = NULL;
     }
+    if (cpu_event_pages != NULL)
+    {
+        for (int i = 0; i < perf_event_num_cpus; i++)
+        {
+            free(cpu_event_pages[i]);
+        }
+        free(cpu_event_pages);
+        cpu_event_pages = NULL;
+    }
+    if (cpu_event_groups != NULL)
+    {
+        for (int i = 0; i < perf_event_num_cpus; i++)
+        {
+            perf_event_group_free(i);
+        }
+        free(cpu_event_groups);
+        cpu_event_groups = NULL;
+    }
+    if (cpu_event_sampled != NULL)
+    {
+        for (int i = 0; i < perf_event_num_cpus; i++)
+        {
+            free(cpu_event_sampled[i]);
+        }
+        free(cpu_event_sampled);
+        cpu_event_sampled = NULL;
+    }
+    perf_event_free_samples();
+    perf_event_task_free();
+    perf_event_sysfs_free();
+    if (perf_event_cgroup_fd >= 0)
+    {
+        close(perf_event_cgroup_fd);
+        perf_event_cgroup_fd = -1;
+    }
 }
@@ -1562,6 +1562,8 @@ int perfmon_readCountersThread_skylake(int thread_id, PerfmonEventSet* eventSet)
 
     SKL_UNCORE_FREEZE;
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -38,6 +38,7 @@
 #include <timer.h>
 #include <inttypes.h>
 #include <perfgroup.h>
+#include <calculator.h>
 
 #define MAX_EVENT_OPTIONS NUM_EVENT_OPTIONS
 
@@ -206,11 +207,12 @@ typedef struct {
     uint64_t    counterData; /*!< \brief Intermediate data from the counters */
     double      lastResult; /*!< \brief Last measurement result*/
     double      fullResult; /*!< \brief Aggregated measurement result */
+    double      quality; /*!< \brief Fraction of the measurement time the event was counted, below 1 if multiplexed */
 #if defined(__x86_64__) || defined(__i386__) || defined(__ARM_ARCH_8A) || defined(__ARM_ARCH_7A__)
-    uint64_t    _padding[2]; /*!< \brief Padding to one  64B cache line */
+    uint64_t    _padding[1]; /*!< \brief Padding to one  64B cache line */
 #endif
 #if defined(_ARCH_PPC)
-    uint64_t    _padding[10]; /*!< \brief Padding to one 128B cache line */
+    uint64_t    _padding[9]; /*!< \brief Padding to one 128B cache line */
 #endif
 } PerfmonCounter;
 
@@ -227,6 +229,19 @@ typedef struct {
     PerfmonCounter*     threadCounter; /*!< \brief List of counter data for each thread, list length is \a numberOfThreads in PerfmonGroupSet */
 } PerfmonEventSetEntry;
 
+/*! \brief Structure holding the read times of a thread
+
+The counters of the threads are not read at the same time, so each thread
+gets the TSC timestamps of its last two reads to compute rates over its
+own interval.
+\extends PerfmonEventSet
+*/
+typedef struct {
+    TimerData   timer; /*!< \brief Timestamps of the previous (start) and the last (stop) read */
+    double      lastTime; /*!< \brief Time in seconds between the last two reads */
+    double      runTime; /*!< \brief Sum of all read intervals in seconds */
+} PerfmonThreadTime;
+
 /*! \brief Structure specifying an performance monitoring event group
 
 A PerfmonEventSet holds a set of event and counter combinations and some global information about all eventSet entries
@@ -246,6 +261,9 @@ typedef struct {
     uint64_t              regTypeMask6; /*!< \brief Bitmask6 for easy checks which types are included in the eventSet */
     GroupState            state; /*!< \brief Current state of the event group (configured, started, none) */
     GroupInfo             group; /*!< \brief Structure holding the performance group information */
+    int                   numMetricExprs; /*!< \brief Number of entries in \a metricExprs */
+    CalcExpr**            metricExprs; /*!< \brief Compiled metric formulas, NULL for formulas evaluated by string substitution */
+    PerfmonThreadTime*    threadTimes; /*!< \brief Read times for each thread, list length is \a numberOfThreads in PerfmonGroupSet */
 } PerfmonEventSet;
 
 /*! \brief Structure specifying all performance monitoring event groups
@@ -279,6 +297,7 @@ extern PciDevice* pci_devices;
 /* perfmon datatypes */
 extern PerfmonGroupSet *groupSet;
 extern int perfmon_numCounters;
+extern int perfmon_numVirtualCounters;
 extern int perfmon_numCoreCounters;
 extern int perfmon_numUncoreCounters;
 extern int perfmon_numArchEvents;
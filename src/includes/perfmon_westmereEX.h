@@ -1219,6 +1219,8 @@ int perfmon_readCountersThread_westmereEX(int thread_id, PerfmonEventSet* eventS
     }
     wex_uncore_freeze(cpu_id, eventSet, FREEZE_FLAG_ONLYFREEZE);
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -412,6 +412,8 @@ int perfmon_readCountersThread_zen(int thread_id, PerfmonEventSet* eventSet)
         haveCLock = 1;
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveSLock || haveL3Lock || haveCLock || haveDLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
@@ -428,6 +428,8 @@ int perfmon_readCountersThread_zen3(int thread_id, PerfmonEventSet* eventSet)
         haveMLock = 1;
     }
 
+    perfmon_prefetchCounters(thread_id, eventSet, haveSLock || haveL3Lock || haveCLock || haveMLock);
+
     for (int i=0;i < eventSet->numberOfEvents;i++)
     {
         if (eventSet->events[i].threadCounter[thread_id].init == TRUE)
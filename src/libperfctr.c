@@ -55,6 +55,16 @@
 #include <perfmon.h>
 #include <bstrlib.h>
 #include <voltage.h>
+#include <histogram.h>
+
+/* #####   MACROS  -  LOCAL TO THIS SOURCE FILE   ######################### */
+
+/* Maximal nesting depth of Marker API regions */
+#define LIKWID_MARKER_MAX_DEPTH 64
+/* Number of empty start/stop pairs measured for the overhead calibration */
+#define MARKER_CALIBRATION_RUNS 100
+/* Tag of the dummy region used for the calibration */
+#define MARKER_CALIBRATION_TAG "likwid_overhead_calibration"
 
 /* #####   VARIABLES  -  LOCAL TO THIS SOURCE FILE   ###################### */
 
@@ -67,17 +77,422 @@ static int realThreads2Cpu[MAX_NUM_THREADS] = { [ 0 ... (MAX_NUM_THREADS-1)] = -
 static int num_cpus = 0;
 static int registered_cpus = 0;
 static pthread_mutex_t globalLock = PTHREAD_MUTEX_INITIALIZER;
+/* More software threads than CPUs share the region results of a CPU, the
+ * start and stop of regions are serialized per CPU in this case */
 static int use_locks = 0;
 static pthread_mutex_t threadLocks[MAX_NUM_THREADS] = { [ 0 ... (MAX_NUM_THREADS-1)] = PTHREAD_MUTEX_INITIALIZER};
 static int maxRegionNameLength = 100;
+/* The handle table is allocated at init and never moves, so the start and stop
+ * calls read it without a lock. New handles are published by numRegionHandles. */
+static bstring* regionHandles = NULL;
+static int numRegionHandles = 0;
+static int maxRegionHandles = 0;
+
+/* Identity of the calling thread used in the hot path of the Marker API. It is
+ * filled at the first Marker API call of a thread (or likwid_markerThreadInit)
+ * and kept as long as the thread is pinned to a single CPU. Changing the
+ * affinity through likwid_pinThread invalidates it. */
+typedef struct {
+    int valid;
+    int generation;
+    int cpuId;
+    int threadId;
+    ThreadList* list;
+} MarkerThreadIdentity;
+
+static __thread MarkerThreadIdentity threadIdentity = { 0, 0, -1, -1, NULL };
+/* Incremented at each likwid_markerInit to invalidate identities of previous runs */
+static int markerGeneration = 0;
+
+/* Per-invocation histograms (LIKWID_MARKER_HISTOGRAM). Histogram 0 records the
+ * runtime in nanoseconds, the others the selected counters. histogramOfEvent
+ * maps the events of each group to their histogram (0 if none). */
+static int numHistograms = 0;
+static int histogramMaxEvents = 0;
+static int* histogramOfEvent = NULL;
+
+/* Sampling rates of regions (LIKWID_MARKER_SAMPLE or likwid_markerSetSampleRate).
+ * The rate is resolved once per region and thread at the first start. */
+typedef struct {
+    bstring tag;
+    uint32_t rate;
+    uint32_t random;
+} MarkerSampleRate;
+
+/* Stack of the started regions of a thread. Nested regions are stored per
+ * call path, the key of a region contains the path of its enclosing regions. */
+typedef struct {
+    int generation;
+    int depth;
+    LikwidThreadResults* regions[LIKWID_MARKER_MAX_DEPTH];
+} MarkerRegionStack;
+
+static __thread MarkerRegionStack regionStack = { 0, 0, { NULL } };
+
+static MarkerSampleRate* sampleRates = NULL;
+static int numSampleRates = 0;
+static __thread uint64_t sampleSeed = 0;
+
+/* Overhead of an empty start/stop pair (LIKWID_MARKER_OVERHEAD) per thread and
+ * group. Index 0 is the runtime, then the events of the group. It is measured
+ * once per thread and group and subtracted from the regions at close. */
+static int overheadCorrection = 0;
+static int overheadMaxEvents = 0;
+static double* markerOverheads = NULL;
+static int* overheadCalibrated = NULL;
 
 
 /* #####   MACROS  -  LOCAL TO THIS SOURCE FILE   ######################### */
 
 #define gettid() syscall(SYS_gettid)
 
+/* Maximal length of a histogram line in the Marker API file */
+#define MARKER_HISTOGRAM_LINE_BUCKETS 64
+/* Alignment of the sections in the binary Marker API file */
+#define MARKER_FILE_ROUNDUP(x) ((((uint64_t)(x)) + 7ULL) & ~7ULL)
+
 /* #####   FUNCTION DEFINITIONS  -  LOCAL TO THIS SOURCE FILE   ########### */
 
+static inline int
+isAccumulatingCounter(int index)
+{
+    return ((counter_map[index].type != THERMAL) &&
+            (counter_map[index].type != VOLTAGE) &&
+            (counter_map[index].type != MBOX0TMP));
+}
+
+static MarkerRegionStack*
+getRegionStack(void)
+{
+    if (regionStack.generation != markerGeneration)
+    {
+        regionStack.generation = markerGeneration;
+        regionStack.depth = 0;
+    }
+    return &regionStack;
+}
+
+static inline LikwidThreadResults*
+getEnclosingRegion(MarkerRegionStack* stack)
+{
+    return (stack->depth > 0 ? stack->regions[stack->depth - 1] : NULL);
+}
+
+/* Key of a region in the hash table: <path of enclosing regions>/<tag>-<group> */
+static bstring
+getRegionKey(const char* regionTag, int len, LikwidThreadResults* parent)
+{
+    if (parent != NULL)
+    {
+        int plen = bstrrchr(parent->label, '-');
+        return bformat("%.*s/%.*s-%d", plen, bdata(parent->label), len, regionTag, groupSet->activeGroup);
+    }
+    return bformat("%.*s-%d", len, regionTag, groupSet->activeGroup);
+}
+
+/* Checks whether the last path element of a region is regionTag */
+static int
+isRegion(LikwidThreadResults* results, const char* regionTag, int len)
+{
+    const char* label = bdata(results->label);
+    int end = bstrrchr(results->label, '-');
+    int tlen = strnlen(regionTag, len);
+    int start = end - tlen;
+    return ((start >= 0) &&
+            ((start == 0) || (label[start-1] == '/')) &&
+            (strncmp(label + start, regionTag, tlen) == 0));
+}
+
+static void
+popRegion(MarkerRegionStack* stack, int idx)
+{
+    /* Regions may be stopped out of order, the following ones move down */
+    for (int i = idx; i < stack->depth - 1; i++)
+    {
+        stack->regions[i] = stack->regions[i+1];
+    }
+    stack->depth--;
+}
+
+static int
+findRegion(MarkerRegionStack* stack, const char* regionTag, int len)
+{
+    for (int i = stack->depth - 1; i >= 0; i--)
+    {
+        if (isRegion(stack->regions[i], regionTag, len))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int
+setSampleRate(const char* regionTag, int len, uint32_t rate, uint32_t random)
+{
+    int i = 0;
+    bstring tag = blk2bstr(regionTag, MIN(len, 100));
+    for (i = 0; i < numSampleRates; i++)
+    {
+        if (bstrcmp(sampleRates[i].tag, tag) == 0)
+        {
+            break;
+        }
+    }
+    if (i == numSampleRates)
+    {
+        MarkerSampleRate* tmp = realloc(sampleRates, (numSampleRates + 1) * sizeof(MarkerSampleRate));
+        if (!tmp)
+        {
+            bdestroy(tag);
+            return -ENOMEM;
+        }
+        sampleRates = tmp;
+        sampleRates[i].tag = tag;
+        numSampleRates++;
+    }
+    else
+    {
+        bdestroy(tag);
+    }
+    sampleRates[i].rate = (rate > 0 ? rate : 1);
+    sampleRates[i].random = random;
+    return 0;
+}
+
+static void
+setupSampleRates(const char* sampleStr)
+{
+    bstring bSampleStr = bfromcstr(sampleStr);
+    struct bstrList* entries = bsplit(bSampleStr, ',');
+    for (int i = 0; i < entries->qty; i++)
+    {
+        /* Format is <region>:<N> or <region>:<N>:random */
+        uint32_t random = 0;
+        bstring entry = entries->entry[i];
+        btrimws(entry);
+        int pos = bstrrchr(entry, ':');
+        if ((pos > 0) && (strcmp(bdataofs(entry, pos + 1), "random") == 0))
+        {
+            random = 1;
+            btrunc(entry, pos);
+            pos = bstrrchr(entry, ':');
+        }
+        int rate = (pos > 0 ? atoi(bdataofs(entry, pos + 1)) : 0);
+        if (rate <= 0)
+        {
+            fprintf(stderr, "WARN: Invalid sampling rate '%s' in LIKWID_MARKER_SAMPLE\n", bdata(entry));
+            continue;
+        }
+        setSampleRate(bdata(entry), pos, rate, random);
+    }
+    bstrListDestroy(entries);
+    bdestroy(bSampleStr);
+}
+
+static void
+resolveSampleRate(LikwidThreadResults* results)
+{
+    /* The label contains the group ID as suffix */
+    int len = bstrrchr(results->label, '-');
+    uint32_t rate = 1;
+    uint32_t random = 0;
+    pthread_mutex_lock(&globalLock);
+    for (int i = 0; i < numSampleRates; i++)
+    {
+        if ((blength(sampleRates[i].tag) == len) &&
+            (strncmp(bdata(sampleRates[i].tag), bdata(results->label), len) == 0))
+        {
+            rate = sampleRates[i].rate;
+            random = sampleRates[i].random;
+        }
+    }
+    pthread_mutex_unlock(&globalLock);
+    results->sampleRandom = random;
+    results->sampleCountdown = 0;
+    results->sampleRate = rate;
+}
+
+static inline int
+sampleCall(LikwidThreadResults* results)
+{
+    if (results->sampleRandom)
+    {
+        /* xorshift64 */
+        if (sampleSeed == 0)
+        {
+            sampleSeed = (((uint64_t)gettid()) << 32) ^ 0x9E3779B97F4A7C15ULL;
+        }
+        sampleSeed ^= sampleSeed << 13;
+        sampleSeed ^= sampleSeed >> 7;
+        sampleSeed ^= sampleSeed << 17;
+        return ((sampleSeed % results->sampleRate) == 0);
+    }
+    if (results->sampleCountdown == 0)
+    {
+        results->sampleCountdown = results->sampleRate - 1;
+        return 1;
+    }
+    results->sampleCountdown--;
+    return 0;
+}
+
+/* Extrapolates the sum of n measured calls to all calls and replaces the sum of
+ * squares with the standard error of the extrapolated total */
+static void
+extrapolateSample(double* sum, double* squares, double calls, double sampled)
+{
+    if (sampled >= calls)
+    {
+        *squares = 0.0;
+        return;
+    }
+    if (sampled == 0)
+    {
+        *squares = NAN;
+        return;
+    }
+    double mean = *sum / sampled;
+    *sum = mean * calls;
+    if (sampled < 2)
+    {
+        *squares = NAN;
+        return;
+    }
+    double var = (*squares - (sampled * mean * mean)) / (sampled - 1);
+    if (var < 0)
+    {
+        var = 0;
+    }
+    *squares = calls * sqrt(var / sampled) * sqrt(1.0 - (sampled / calls));
+}
+
+static void
+extrapolateSamples(LikwidResults* results, int numberOfRegions, int numberOfThreads)
+{
+    for (int i = 0; i < numberOfRegions; i++)
+    {
+        if ((results[i].sampled == NULL) || (results[i].groupID < 0))
+        {
+            continue;
+        }
+        PerfmonEventSet* set = &groupSet->groups[results[i].groupID];
+        for (int j = 0; j < numberOfThreads; j++)
+        {
+            double* errors = results[i].errors[j];
+            if (errors == NULL)
+            {
+                continue;
+            }
+            if ((results[i].children) && (results[i].children[j]) &&
+                (results[i].sampled[j] > 0) && (results[i].sampled[j] < results[i].count[j]))
+            {
+                /* Nested regions are only accounted in measured calls */
+                double scale = ((double)results[i].count[j]) / results[i].sampled[j];
+                for (int k = 0; k <= set->numberOfEvents; k++)
+                {
+                    results[i].children[j][k] *= scale;
+                }
+            }
+            if ((results[i].overheads) && (results[i].overheads[j]) &&
+                (results[i].sampled[j] > 0) && (results[i].sampled[j] < results[i].count[j]))
+            {
+                /* The overhead was subtracted for the measured calls */
+                double scale = ((double)results[i].count[j]) / results[i].sampled[j];
+                for (int k = 0; k <= set->numberOfEvents; k++)
+                {
+                    results[i].overheads[j][k] *= scale;
+                }
+            }
+            extrapolateSample(&results[i].time[j], &errors[0], results[i].count[j], results[i].sampled[j]);
+            for (int k = 0; k < set->numberOfEvents; k++)
+            {
+                if (isAccumulatingCounter(set->events[k].index))
+                {
+                    extrapolateSample(&results[i].counters[j][k], &errors[k+1],
+                                      results[i].count[j], results[i].sampled[j]);
+                }
+                else
+                {
+                    errors[k+1] = 0.0;
+                }
+            }
+        }
+    }
+}
+
+static int*
+getNewRegionIDs(int numberOfRegions, int* validRegions)
+{
+    int* ids = malloc(numberOfRegions * sizeof(int));
+    if (ids)
+    {
+        for (int i = 0, newRegionID = 0; i < numberOfRegions; i++)
+        {
+            ids[i] = (validRegions[i] > 0 ? newRegionID++ : -1);
+        }
+    }
+    return ids;
+}
+
+static void
+writeParents(FILE* file, LikwidResults* results, int numberOfRegions, int* validRegions)
+{
+    int* ids = getNewRegionIDs(numberOfRegions, validRegions);
+    for (int i = 0; i < numberOfRegions && ids; i++)
+    {
+        int parent = results[i].parent;
+        if ((ids[i] >= 0) && (parent >= 0) && (parent < numberOfRegions) && (ids[parent] >= 0))
+        {
+            fprintf(file, "P %d %d\n", ids[i], ids[parent]);
+        }
+    }
+    free(ids);
+}
+
+/* Writes a line with the time and event values of a thread, used for the sums
+ * of nested regions (C) and the subtracted overheads (O) */
+static void
+writeThreadValues(FILE* file, char type, int region, LikwidResults* results, double** values, int thread)
+{
+    if ((values == NULL) || (thread >= results->threadCount) ||
+        (results->cpulist[thread] < 0) || (values[thread] == NULL))
+    {
+        return;
+    }
+    int nevents = MIN(groupSet->groups[results->groupID].numberOfEvents, NUM_PMC);
+    bstring l = bformat("%c %d %d %d ", type, region, results->cpulist[thread], nevents);
+    for (int k = 0; k <= nevents; k++)
+    {
+        bstring tmp = bformat("%e ", values[thread][k]);
+        bconcat(l, tmp);
+        bdestroy(tmp);
+    }
+    fprintf(file, "%s\n", bdata(l));
+    bdestroy(l);
+}
+
+static void
+writeSamples(FILE* file, int region, LikwidResults* results, int thread)
+{
+    if ((results->sampled == NULL) || (thread >= results->threadCount) ||
+        (results->cpulist[thread] < 0) || (results->errors[thread] == NULL))
+    {
+        return;
+    }
+    int nevents = MIN(groupSet->groups[results->groupID].numberOfEvents, NUM_PMC);
+    bstring l = bformat("S %d %d %u %d ", region, results->cpulist[thread],
+                        results->sampled[thread], nevents);
+    for (int k = 0; k <= nevents; k++)
+    {
+        bstring tmp = bformat("%e ", results->errors[thread][k]);
+        bconcat(l, tmp);
+        bdestroy(tmp);
+    }
+    fprintf(file, "%s\n", bdata(l));
+    bdestroy(l);
+}
+
 
 
 static int
@@ -109,6 +524,31 @@ getThreadID(int cpu_id)
     return -1;
 }
 
+static MarkerThreadIdentity*
+getThreadIdentity(void)
+{
+    if ((!threadIdentity.valid) || (threadIdentity.generation != markerGeneration))
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        sched_getaffinity(gettid(),sizeof(cpu_set_t), &cpu_set);
+        if (CPU_COUNT(&cpu_set) > 1)
+        {
+            /* Unpinned threads can migrate, so the identity cannot be cached */
+            threadIdentity.cpuId = sched_getcpu();
+        }
+        else
+        {
+            threadIdentity.cpuId = getProcessorID(&cpu_set);
+            threadIdentity.valid = 1;
+        }
+        threadIdentity.generation = markerGeneration;
+        threadIdentity.threadId = getThreadID(threadIdentity.cpuId);
+        threadIdentity.list = hashTable_getThreadList(threadIdentity.cpuId);
+    }
+    return &threadIdentity;
+}
+
 static double
 calculateMarkerResult(RegisterIndex index, uint64_t start, uint64_t stop, int overflows)
 {
@@ -147,6 +587,573 @@ calculateMarkerResult(RegisterIndex index, uint64_t start, uint64_t stop, int ov
     return result;
 }
 
+static int markerStartRegionTag(const char* regionTag, MarkerThreadIdentity* ident, ThreadList* list);
+static int markerStopRegionTag(const char* regionTag, MarkerThreadIdentity* ident, TimerData* timestamp);
+
+/* Measures empty start/stop pairs of a dummy region on the calling thread for
+ * the active group. The region lives in a separate table, so the calls include
+ * the tag formatting and the hash table lookup of a real region without
+ * adding the region to the results. The minimum of all runs is used as
+ * overhead of a region call. Enclosing regions would count the calibration,
+ * so it is skipped if the thread has an open region and done at the next
+ * start of an outermost region. */
+static void
+calibrateOverhead(MarkerThreadIdentity* ident)
+{
+    int group = groupSet->activeGroup;
+    int thread_id = ident->threadId;
+    TimerData timestamp;
+    if ((!overheadCorrection) || (thread_id < 0) || (thread_id >= groupSet->numberOfThreads))
+    {
+        return;
+    }
+    int idx = (thread_id * groupSet->numberOfGroups) + group;
+    if ((overheadCalibrated[idx]) || (getRegionStack()->depth > 0))
+    {
+        return;
+    }
+    PerfmonEventSet* set = &groupSet->groups[group];
+    double* overhead = &markerOverheads[idx * (overheadMaxEvents + 1)];
+    double* last = calloc(set->numberOfEvents + 1, sizeof(double));
+    ThreadList* list = hashTable_newList(ident->cpuId);
+    if ((!last) || (!list))
+    {
+        free(last);
+        hashTable_freeList(list);
+        return;
+    }
+    /* Set before the runs, the starts of the runs do not calibrate again */
+    overheadCalibrated[idx] = 1;
+    for (int r = 0; r < MARKER_CALIBRATION_RUNS; r++)
+    {
+        if (markerStartRegionTag(MARKER_CALIBRATION_TAG, ident, list) < 0)
+        {
+            overheadCalibrated[idx] = 0;
+            break;
+        }
+        LikwidThreadResults* results = getEnclosingRegion(getRegionStack());
+        timer_stop(&timestamp);
+        if (markerStopRegionTag(MARKER_CALIBRATION_TAG, ident, &timestamp) < 0)
+        {
+            overheadCalibrated[idx] = 0;
+            break;
+        }
+        /* The results accumulate, the run is the difference to the previous one */
+        double runtime = results->time - last[0];
+        last[0] = results->time;
+        overhead[0] = (r == 0 ? runtime : MIN(overhead[0], runtime));
+        for (int i = 0; i < set->numberOfEvents; i++)
+        {
+            double result = 0.0;
+            if ((set->events[i].type != NOTYPE) && (isAccumulatingCounter(set->events[i].index)))
+            {
+                result = results->PMcounters[i] - last[i+1];
+                last[i+1] = results->PMcounters[i];
+            }
+            overhead[i+1] = (r == 0 ? result : MIN(overhead[i+1], result));
+        }
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Marker overhead of thread %d group %d: %e s, thread_id, group, overhead[0]);
+    free(last);
+    hashTable_freeList(list);
+}
+
+static double*
+getOverhead(int cpu_id, int group)
+{
+    int t = getThreadID(cpu_id);
+    if (t < 0)
+    {
+        return NULL;
+    }
+    int idx = (t * groupSet->numberOfGroups) + group;
+    return (overheadCalibrated[idx] ? &markerOverheads[idx * (overheadMaxEvents + 1)] : NULL);
+}
+
+/* Subtracts the overhead of the measured calls from a sum. The sum of squares
+ * of sampled regions is shifted accordingly to keep the variance. */
+static double
+subtractOverhead(double* sum, double* squares, double calls, double overhead)
+{
+    double sub = MAX(MIN(*sum, calls * overhead), 0.0);
+    if ((squares) && (calls > 0))
+    {
+        double shift = sub / calls;
+        *squares += (calls * shift * shift) - (2 * shift * (*sum));
+    }
+    *sum -= sub;
+    return sub;
+}
+
+static void
+subtractOverheads(LikwidResults* results, int numberOfRegions, int numberOfThreads)
+{
+    if (!overheadCorrection)
+    {
+        return;
+    }
+    for (int i = 0; i < numberOfRegions; i++)
+    {
+        if (results[i].groupID < 0)
+        {
+            continue;
+        }
+        PerfmonEventSet* set = &groupSet->groups[results[i].groupID];
+        for (int j = 0; j < numberOfThreads; j++)
+        {
+            double* overhead = NULL;
+            if ((results[i].cpulist[j] < 0) || (results[i].count[j] == 0))
+            {
+                continue;
+            }
+            overhead = getOverhead(results[i].cpulist[j], results[i].groupID);
+            if (overhead == NULL)
+            {
+                continue;
+            }
+            if ((results[i].overheads == NULL) &&
+                ((results[i].overheads = calloc(numberOfThreads, sizeof(double*))) == NULL))
+            {
+                return;
+            }
+            results[i].overheads[j] = calloc(set->numberOfEvents + 1, sizeof(double));
+            if (results[i].overheads[j] == NULL)
+            {
+                continue;
+            }
+            /* The overhead is part of the measured calls only */
+            double calls = (results[i].sampled ? results[i].sampled[j] : results[i].count[j]);
+            double* errors = ((results[i].sampled && results[i].errors[j]) ? results[i].errors[j] : NULL);
+            results[i].overheads[j][0] = subtractOverhead(&results[i].time[j], (errors ? &errors[0] : NULL),
+                                                          calls, overhead[0]);
+            for (int k = 0; k < set->numberOfEvents; k++)
+            {
+                if ((isAccumulatingCounter(set->events[k].index)) && (!isnan(results[i].counters[j][k])))
+                {
+                    results[i].overheads[j][k+1] = subtractOverhead(&results[i].counters[j][k],
+                                                                    (errors ? &errors[k+1] : NULL),
+                                                                    calls, overhead[k+1]);
+                }
+            }
+        }
+    }
+}
+
+static int
+setupOverheads(int maxEvents)
+{
+    int slots = groupSet->numberOfThreads * groupSet->numberOfGroups;
+    overheadMaxEvents = maxEvents;
+    markerOverheads = calloc(slots * (maxEvents + 1), sizeof(double));
+    overheadCalibrated = calloc(slots, sizeof(int));
+    if ((!markerOverheads) || (!overheadCalibrated))
+    {
+        free(markerOverheads);
+        free(overheadCalibrated);
+        markerOverheads = NULL;
+        overheadCalibrated = NULL;
+        return -ENOMEM;
+    }
+    overheadCorrection = 1;
+    return 0;
+}
+
+static int
+setupHistograms(const char* histStr, int maxEvents)
+{
+    int ret = 0;
+    bstring bHistStr = bfromcstr(histStr);
+    struct bstrList* counters = bsplit(bHistStr, ',');
+
+    numHistograms = 1;
+    histogramMaxEvents = maxEvents;
+    histogramOfEvent = calloc(numberOfGroups * maxEvents, sizeof(int));
+    if (!histogramOfEvent)
+    {
+        numHistograms = 0;
+        ret = -ENOMEM;
+    }
+    else if (!((counters->qty == 1) && (biseqcstr(counters->entry[0], "1"))))
+    {
+        /* A list of counter names selects the counters recorded in addition to the runtime */
+        for (int c = 0; c < counters->qty; c++)
+        {
+            int found = 0;
+            btrimws(counters->entry[c]);
+            for (int g = 0; g < numberOfGroups; g++)
+            {
+                PerfmonEventSet* set = &groupSet->groups[groups[g]];
+                for (int e = 0; e < set->numberOfEvents; e++)
+                {
+                    if (biseqcstr(counters->entry[c], counter_map[set->events[e].index].key))
+                    {
+                        histogramOfEvent[(groups[g] * maxEvents) + e] = numHistograms;
+                        found = 1;
+                    }
+                }
+            }
+            if (found)
+            {
+                numHistograms++;
+            }
+            else
+            {
+                fprintf(stderr, "WARN: Counter %s for histograms not used in any event set\n",
+                                bdata(counters->entry[c]));
+            }
+        }
+    }
+    bstrListDestroy(counters);
+    bdestroy(bHistStr);
+    return ret;
+}
+
+/* Returns the event recorded by histogram h of a region, -1 for the runtime
+ * and -2 if the histogram belongs to a counter outside of the region's group */
+static int
+histogramEvent(LikwidResults* results, int h)
+{
+    if (results->histEvents)
+    {
+        /* Results read from a file already know their events */
+        return results->histEvents[h];
+    }
+    if (h == 0)
+    {
+        return -1;
+    }
+    if (histogramOfEvent != NULL)
+    {
+        int nevents = groupSet->groups[results->groupID].numberOfEvents;
+        for (int e = 0; e < nevents; e++)
+        {
+            if (histogramOfEvent[(results->groupID * histogramMaxEvents) + e] == h)
+            {
+                return e;
+            }
+        }
+    }
+    return -2;
+}
+
+static void
+writeHistograms(FILE* file, int region, LikwidResults* results, int thread)
+{
+    if ((results->histograms == NULL) || (thread >= results->threadCount) ||
+        (results->cpulist[thread] < 0))
+    {
+        return;
+    }
+    for (int h = 0; h < results->histCount; h++)
+    {
+        int event = histogramEvent(results, h);
+        uint32_t* buckets = results->histograms[(thread * results->histCount) + h];
+        if ((buckets == NULL) || (event < -1))
+        {
+            continue;
+        }
+        /* Only filled buckets are written, split over multiple lines */
+        int filled = 0;
+        bstring l = NULL;
+        for (uint32_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            if (buckets[b] == 0)
+            {
+                continue;
+            }
+            if (l == NULL)
+            {
+                l = bformat("H %d %d %d ", region, results->cpulist[thread], event);
+            }
+            bstring tmp = bformat("%u,%u ", b, buckets[b]);
+            bconcat(l, tmp);
+            bdestroy(tmp);
+            filled++;
+            if (filled == MARKER_HISTOGRAM_LINE_BUCKETS)
+            {
+                fprintf(file, "%s\n", bdata(l));
+                bdestroy(l);
+                l = NULL;
+                filled = 0;
+            }
+        }
+        if (l != NULL)
+        {
+            fprintf(file, "%s\n", bdata(l));
+            bdestroy(l);
+        }
+    }
+}
+
+static int
+useTextMarkerFile(void)
+{
+    char* format = getenv("LIKWID_MARKER_FORMAT");
+    return ((format != NULL) && (strcmp(format, "text") == 0));
+}
+
+static int
+writePadding(FILE* file, uint64_t* pos)
+{
+    static const char zeros[8] = {0};
+    uint64_t pad = MARKER_FILE_ROUNDUP(*pos) - *pos;
+    *pos += pad;
+    return (pad > 0 ? (fwrite(zeros, 1, pad, file) == pad) : 1);
+}
+
+static int
+writeBinaryMarkerFile(const char* markerfile, LikwidResults* results,
+                      int numberOfRegions, int* validRegions, int numberOfThreads)
+{
+    int ret = 0;
+    int ok = 1;
+    int newNumberOfRegions = 0;
+    uint64_t pos = 0;
+    LikwidMarkerFileHeader header;
+    LikwidMarkerFileRegion* regions = NULL;
+    int** histEvents = NULL;
+    int* newRegionIDs = NULL;
+    uint32_t* emptyHistogram = NULL;
+    double* emptyValues = NULL;
+    FILE* file = NULL;
+
+    for (int i = 0; i < numberOfRegions; i++)
+    {
+        if (validRegions[i] > 0)
+            newNumberOfRegions++;
+    }
+    regions = calloc(newNumberOfRegions, sizeof(LikwidMarkerFileRegion));
+    histEvents = calloc(newNumberOfRegions, sizeof(int*));
+    newRegionIDs = getNewRegionIDs(numberOfRegions, validRegions);
+    emptyHistogram = calloc(HISTOGRAM_BUCKETS, sizeof(uint32_t));
+    emptyValues = calloc(NUM_PMC + 1, sizeof(double));
+    if ((newNumberOfRegions > 0 && (!regions || !histEvents)) ||
+        (numberOfRegions > 0 && !newRegionIDs) || !emptyHistogram || !emptyValues)
+    {
+        ret = -ENOMEM;
+        goto cleanup;
+    }
+
+    /* Compute the layout of the file before writing it */
+    memset(&header, 0, sizeof(LikwidMarkerFileHeader));
+    memcpy(header.magic, LIKWID_MARKER_FILE_MAGIC, sizeof(header.magic));
+    header.version = LIKWID_MARKER_FILE_VERSION;
+    header.histogramBuckets = HISTOGRAM_BUCKETS;
+    header.numberOfThreads = numberOfThreads;
+    header.numberOfRegions = newNumberOfRegions;
+    header.numberOfGroups = numberOfGroups;
+    header.regionOffset = MARKER_FILE_ROUNDUP(sizeof(LikwidMarkerFileHeader));
+    header.stringOffset = header.regionOffset + (newNumberOfRegions * sizeof(LikwidMarkerFileRegion));
+    for (int i = 0, r = 0; i < numberOfRegions; i++)
+    {
+        if (validRegions[i] == 0)
+            continue;
+        regions[r].tagOffset = header.stringSize;
+        header.stringSize += blength(results[i].tag) + 1;
+        r++;
+    }
+    pos = MARKER_FILE_ROUNDUP(header.stringOffset + header.stringSize);
+    for (int i = 0, r = 0; i < numberOfRegions; i++)
+    {
+        if (validRegions[i] == 0)
+            continue;
+        LikwidMarkerFileRegion* region = &regions[r];
+        region->groupID = results[i].groupID;
+        region->parent = -1;
+        if ((results[i].parent >= 0) && (results[i].parent < numberOfRegions))
+            region->parent = newRegionIDs[results[i].parent];
+        region->eventCount = MIN(groupSet->groups[results[i].groupID].numberOfEvents, NUM_PMC);
+        int threads = MIN(numberOfThreads, results[i].threadCount);
+        for (int j = 0; j < threads; j++)
+        {
+            if (results[i].cpulist[j] >= 0)
+                region->threadCount++;
+        }
+        if (results[i].histograms && results[i].histCount > 0)
+        {
+            histEvents[r] = malloc(results[i].histCount * sizeof(int));
+            if (!histEvents[r])
+            {
+                ret = -ENOMEM;
+                goto cleanup;
+            }
+            for (int h = 0; h < results[i].histCount; h++)
+            {
+                histEvents[r][h] = histogramEvent(&results[i], h);
+                if (histEvents[r][h] >= -1)
+                    region->histCount++;
+            }
+        }
+        region->cpulistOffset = pos;
+        pos += region->threadCount * sizeof(int32_t);
+        region->countOffset = pos;
+        pos = MARKER_FILE_ROUNDUP(pos + (region->threadCount * sizeof(uint32_t)));
+        region->timeOffset = pos;
+        pos += region->threadCount * sizeof(double);
+        region->counterOffset = pos;
+        pos += region->threadCount * region->eventCount * sizeof(double);
+        if (results[i].children)
+        {
+            region->childOffset = pos;
+            pos += region->threadCount * (region->eventCount + 1) * sizeof(double);
+        }
+        if (results[i].overheads)
+        {
+            region->overheadOffset = pos;
+            pos += region->threadCount * (region->eventCount + 1) * sizeof(double);
+        }
+        if (results[i].sampled)
+        {
+            region->errorOffset = pos;
+            pos += region->threadCount * (region->eventCount + 1) * sizeof(double);
+            region->sampledOffset = pos;
+            pos += region->threadCount * sizeof(uint32_t);
+        }
+        region->histEventOffset = pos;
+        pos = MARKER_FILE_ROUNDUP(pos + (region->histCount * sizeof(int32_t)));
+        region->histogramOffset = pos;
+        pos += ((uint64_t)region->threadCount) * region->histCount * HISTOGRAM_BUCKETS * sizeof(uint32_t);
+        r++;
+    }
+    header.fileSize = pos;
+
+    file = fopen(markerfile, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Cannot open file %s\n", markerfile);
+        fprintf(stderr, "%s", strerror(errno));
+        ret = -errno;
+        goto cleanup;
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP,
+            Creating binary Marker file %s with %d regions %d groups and %d threads,
+            markerfile, newNumberOfRegions, numberOfGroups, numberOfThreads);
+    pos = 0;
+    ok &= (fwrite(&header, sizeof(LikwidMarkerFileHeader), 1, file) == 1);
+    pos += sizeof(LikwidMarkerFileHeader);
+    ok &= writePadding(file, &pos);
+    if (newNumberOfRegions > 0)
+    {
+        ok &= (fwrite(regions, sizeof(LikwidMarkerFileRegion), newNumberOfRegions, file) == newNumberOfRegions);
+        pos += newNumberOfRegions * sizeof(LikwidMarkerFileRegion);
+    }
+    for (int i = 0; i < numberOfRegions; i++)
+    {
+        if (validRegions[i] == 0)
+            continue;
+        ok &= (fwrite(bdata(results[i].tag), 1, blength(results[i].tag) + 1, file) == blength(results[i].tag) + 1);
+        pos += blength(results[i].tag) + 1;
+    }
+    ok &= writePadding(file, &pos);
+    for (int i = 0, r = 0; i < numberOfRegions && ok; i++)
+    {
+        if (validRegions[i] == 0)
+            continue;
+        LikwidMarkerFileRegion* region = &regions[r];
+        int threads = MIN(numberOfThreads, results[i].threadCount);
+        for (int j = 0; j < threads; j++)
+        {
+            int32_t cpu = results[i].cpulist[j];
+            if (cpu >= 0)
+                ok &= (fwrite(&cpu, sizeof(int32_t), 1, file) == 1);
+        }
+        for (int j = 0; j < threads; j++)
+        {
+            if (results[i].cpulist[j] >= 0)
+                ok &= (fwrite(&results[i].count[j], sizeof(uint32_t), 1, file) == 1);
+        }
+        pos += region->threadCount * (sizeof(int32_t) + sizeof(uint32_t));
+        ok &= writePadding(file, &pos);
+        for (int j = 0; j < threads; j++)
+        {
+            if (results[i].cpulist[j] >= 0)
+                ok &= (fwrite(&results[i].time[j], sizeof(double), 1, file) == 1);
+        }
+        for (int j = 0; j < threads; j++)
+        {
+            if (results[i].cpulist[j] >= 0)
+                ok &= (fwrite(results[i].counters[j], sizeof(double), region->eventCount, file) == region->eventCount);
+        }
+        pos += region->threadCount * (1 + region->eventCount) * sizeof(double);
+        if (results[i].children)
+        {
+            for (int j = 0; j < threads; j++)
+            {
+                if (results[i].cpulist[j] >= 0)
+                {
+                    double* children = (results[i].children[j] ? results[i].children[j] : emptyValues);
+                    ok &= (fwrite(children, sizeof(double), region->eventCount + 1, file) == region->eventCount + 1);
+                }
+            }
+            pos += region->threadCount * (region->eventCount + 1) * sizeof(double);
+        }
+        if (results[i].overheads)
+        {
+            for (int j = 0; j < threads; j++)
+            {
+                if (results[i].cpulist[j] >= 0)
+                {
+                    double* overheads = (results[i].overheads[j] ? results[i].overheads[j] : emptyValues);
+                    ok &= (fwrite(overheads, sizeof(double), region->eventCount + 1, file) == region->eventCount + 1);
+                }
+            }
+            pos += region->threadCount * (region->eventCount + 1) * sizeof(double);
+        }
+        if (results[i].sampled)
+        {
+            for (int j = 0; j < threads; j++)
+            {
+                if (results[i].cpulist[j] >= 0)
+                    ok &= (fwrite(results[i].errors[j], sizeof(double), region->eventCount + 1, file) == region->eventCount + 1);
+            }
+            for (int j = 0; j < threads; j++)
+            {
+                if (results[i].cpulist[j] >= 0)
+                    ok &= (fwrite(&results[i].sampled[j], sizeof(uint32_t), 1, file) == 1);
+            }
+            pos += region->threadCount * ((region->eventCount + 1) * sizeof(double) + sizeof(uint32_t));
+        }
+        for (int h = 0; h < results[i].histCount && histEvents[r]; h++)
+        {
+            int32_t event = histEvents[r][h];
+            if (event >= -1)
+                ok &= (fwrite(&event, sizeof(int32_t), 1, file) == 1);
+        }
+        pos += region->histCount * sizeof(int32_t);
+        ok &= writePadding(file, &pos);
+        for (int j = 0; j < threads && histEvents[r]; j++)
+        {
+            if (results[i].cpulist[j] < 0)
+                continue;
+            for (int h = 0; h < results[i].histCount; h++)
+            {
+                uint32_t* buckets = results[i].histograms[(j * results[i].histCount) + h];
+                if (histEvents[r][h] < -1)
+                    continue;
+                ok &= (fwrite((buckets ? buckets : emptyHistogram), sizeof(uint32_t), HISTOGRAM_BUCKETS, file) == HISTOGRAM_BUCKETS);
+            }
+        }
+        pos += ((uint64_t)region->threadCount) * region->histCount * HISTOGRAM_BUCKETS * sizeof(uint32_t);
+        r++;
+    }
+    if (fclose(file) != 0 || !ok)
+    {
+        fprintf(stderr, "Failed to write Marker file %s\n", markerfile);
+        ret = -EIO;
+    }
+cleanup:
+    for (int r = 0; r < newNumberOfRegions && histEvents; r++)
+    {
+        free(histEvents[r]);
+    }
+    free(histEvents);
+    free(regions);
+    free(newRegionIDs);
+    free(emptyHistogram);
+    free(emptyValues);
+    return ret;
+}
+
 /* #####   FUNCTION DEFINITIONS  -  EXPORTED FUNCTIONS   ################## */
 
 void
@@ -166,6 +1173,9 @@ likwid_markerInit(void)
     char* perfpid = getenv("LIKWID_PERF_EXECPID");
     char* debugStr = getenv("LIKWID_DEBUG");
     char* pinStr = getenv("LIKWID_PIN");
+    char* histStr = getenv("LIKWID_MARKER_HISTOGRAM");
+    char* sampleStr = getenv("LIKWID_MARKER_SAMPLE");
+    char* overheadStr = getenv("LIKWID_MARKER_OVERHEAD");
     char execpid[20];
     /* Dirty hack to avoid nonnull warnings */
     int (*ownatoi)(const char*);
@@ -194,7 +1204,7 @@ likwid_markerInit(void)
     topology_init();
     numa_init();
     affinity_init();
-    hashTable_init();
+    markerGeneration++;
 
 #ifndef LIKWID_USE_PERFEVENT
     HPMmode(atoi(modeStr));
@@ -272,6 +1282,38 @@ likwid_markerInit(void)
     bstrListDestroy(eventStrings);
     bdestroy(bEventStr);
 
+    int maxEvents = 0;
+    for (i=0; i<numberOfGroups; i++)
+    {
+        maxEvents = MAX(maxEvents, groupSet->groups[groups[i]].numberOfEvents);
+    }
+    numHistograms = 0;
+    if ((histStr != NULL) && (strcmp(histStr, "0") != 0))
+    {
+        if (setupHistograms(histStr, maxEvents) < 0)
+        {
+            fprintf(stderr,"Cannot allocate space for histogram handling.\n");
+        }
+    }
+    if (sampleStr != NULL)
+    {
+        setupSampleRates(sampleStr);
+    }
+    if ((overheadStr != NULL) && (strcmp(overheadStr, "0") != 0))
+    {
+        if (setupOverheads(maxEvents) < 0)
+        {
+            fprintf(stderr,"Cannot allocate space for overhead correction.\n");
+        }
+    }
+    hashTable_init(maxEvents, numHistograms);
+    maxRegionHandles = hashTable_getMaxRegions();
+    regionHandles = (bstring*) calloc(maxRegionHandles, sizeof(bstring));
+    if (!regionHandles)
+    {
+        fprintf(stderr,"Cannot allocate space for region handles.\n");
+        maxRegionHandles = 0;
+    }
     for (i=0; i<num_cpus; i++)
     {
         hashTable_initThread(threads2Cpu[i]);
@@ -292,6 +1334,7 @@ likwid_markerInit(void)
 
     perfmon_setupCounters(groupSet->activeGroup);
     perfmon_startCounters();
+    calibrateOverhead(getThreadIdentity());
 }
 
 void
@@ -332,6 +1375,7 @@ likwid_markerThreadInit(void)
             DEBUG_PRINT(DEBUGLEV_DEVELOP, Pin thread %lu to CPU %d currently %d, gettid(), threads2Cpu[myID % num_cpus], sched_getcpu());
         }
     }
+    calibrateOverhead(getThreadIdentity());
 }
 
 void
@@ -350,6 +1394,7 @@ likwid_markerNextGroup(void)
     {
         DEBUG_PRINT(DEBUGLEV_DEVELOP, Switch from group %d to group %d, groupSet->activeGroup, next_group);
         i = perfmon_switchActiveGroup(next_group);
+        calibrateOverhead(getThreadIdentity());
     }
     return;
 }
@@ -381,6 +1426,8 @@ likwid_markerClose(void)
         fprintf(stderr, "No threads or regions defined in hash table\n");
         return;
     }
+    subtractOverheads(results, numberOfRegions, numberOfThreads);
+    extrapolateSamples(results, numberOfRegions, numberOfThreads);
     markerfile = getenv("LIKWID_FILEPATH");
     if (markerfile == NULL)
     {
@@ -393,34 +1440,33 @@ likwid_markerClose(void)
     {
         return;
     }
+    int newNumberOfRegions = 0;
     for (int i=0; i<numberOfRegions; i++)
     {
         validRegions[i] = 0;
+        for (int j=0; j<numberOfThreads; j++)
+        {
+            validRegions[i] += results[i].count[j];
+        }
+        if (validRegions[i] > 0)
+            newNumberOfRegions++;
+        else
+            fprintf(stderr, "WARN: Skipping region %s for evaluation.\n", bdata(results[i].tag));
     }
-    file = fopen(markerfile,"w");
-
-    if (file != NULL)
+    if (newNumberOfRegions < numberOfRegions)
+    {
+        fprintf(stderr, "WARN: Regions are skipped because:\n");
+        fprintf(stderr, "      - The region was only registered\n");
+        fprintf(stderr, "      - The region was started but never stopped\n");
+        fprintf(stderr, "      - The region was never started but stopped\n");
+    }
+    if (!useTextMarkerFile())
+    {
+        writeBinaryMarkerFile(markerfile, results, numberOfRegions, validRegions, numberOfThreads);
+    }
+    else if ((file = fopen(markerfile,"w")) != NULL)
     {
-        int newNumberOfRegions = 0;
         int newRegionID = 0;
-        for (int i=0; i<numberOfRegions; i++)
-        {
-            for (int j=0; j<numberOfThreads; j++)
-            {
-                validRegions[i] += results[i].count[j];
-            }
-            if (validRegions[i] > 0)
-                newNumberOfRegions++;
-            else
-                fprintf(stderr, "WARN: Skipping region %s for evaluation.\n", bdata(results[i].tag));
-        }
-        if (newNumberOfRegions < numberOfRegions)
-        {
-            fprintf(stderr, "WARN: Regions are skipped because:\n");
-            fprintf(stderr, "      - The region was only registered\n");
-            fprintf(stderr, "      - The region was started but never stopped\n");
-            fprintf(stderr, "      - The region was never started but stopped\n");
-        }
         DEBUG_PRINT(DEBUGLEV_DEVELOP,
                 Creating Marker file %s with %d regions %d groups and %d threads,
                 markerfile, newNumberOfRegions, numberOfGroups, numberOfThreads);
@@ -439,6 +1485,7 @@ likwid_markerClose(void)
             bdestroy(tmp);
             newRegionID++;
         }
+        writeParents(file, results, numberOfRegions, validRegions);
         newRegionID = 0;
         for (int i=0; i<numberOfRegions; i++)
         {
@@ -463,6 +1510,10 @@ likwid_markerClose(void)
                 fprintf(file,"%s\n", bdata(l));
                 DEBUG_PRINT(DEBUGLEV_DEVELOP, %s, bdata(l));
                 bdestroy(l);
+                writeThreadValues(file, 'C', newRegionID, &results[i], results[i].children, j);
+                writeThreadValues(file, 'O', newRegionID, &results[i], results[i].overheads, j);
+                writeSamples(file, newRegionID, &results[i], j);
+                writeHistograms(file, newRegionID, &results[i], j);
             }
             newRegionID++;
         }
@@ -492,11 +1543,66 @@ likwid_markerClose(void)
         free(results[i].count);
         free(results[i].cpulist);
         free(results[i].counters);
+        if (results[i].histograms)
+        {
+            free(results[i].histograms);
+        }
+        if (results[i].sampled)
+        {
+            for (int j=0;j<numberOfThreads; j++)
+            {
+                free(results[i].errors[j]);
+            }
+            free(results[i].errors);
+            free(results[i].sampled);
+        }
+        if (results[i].children)
+        {
+            for (int j=0;j<numberOfThreads; j++)
+            {
+                free(results[i].children[j]);
+            }
+            free(results[i].children);
+        }
+        if (results[i].overheads)
+        {
+            for (int j=0;j<numberOfThreads; j++)
+            {
+                free(results[i].overheads[j]);
+            }
+            free(results[i].overheads);
+        }
     }
     if (results != NULL)
     {
         free(results);
     }
+    if (histogramOfEvent)
+    {
+        free(histogramOfEvent);
+        histogramOfEvent = NULL;
+    }
+    numHistograms = 0;
+    for (int i=0; i<numSampleRates; i++)
+    {
+        bdestroy(sampleRates[i].tag);
+    }
+    free(sampleRates);
+    sampleRates = NULL;
+    numSampleRates = 0;
+    free(markerOverheads);
+    free(overheadCalibrated);
+    markerOverheads = NULL;
+    overheadCalibrated = NULL;
+    overheadCorrection = 0;
+    for (int i=0; i<numRegionHandles; i++)
+    {
+        bdestroy(regionHandles[i]);
+    }
+    free(regionHandles);
+    regionHandles = NULL;
+    numRegionHandles = 0;
+    maxRegionHandles = 0;
     perfmon_finalize();
     HPMfinalize();
     likwid_init = 0;
@@ -527,38 +1633,43 @@ likwid_markerWriteFile(const char* markerfile)
         return -EFAULT;
     }
 
-    file = fopen(markerfile,"w");
-    if (file != NULL)
+    int newNumberOfRegions = 0;
+    validRegions = (int*)malloc(numberOfRegions*sizeof(int));
+    if (!validRegions)
     {
-        int newNumberOfRegions = 0;
-        int newRegionID = 0;
-        validRegions = (int*)malloc(numberOfRegions*sizeof(int));
-        if (!validRegions)
-        {
-            return -EFAULT;
-        }
-        for (int i=0; i<numberOfRegions; i++)
-        {
-            validRegions[i] = 0;
-        }
-        for (int i=0; i<numberOfRegions; i++)
-        {
-            for (int j=0; j<numberOfThreads; j++)
-            {
-                validRegions[i] += perfmon_getCountOfRegion(i, j);
-            }
-            if (validRegions[i] > 0)
-                newNumberOfRegions++;
-            else
-                fprintf(stderr, "WARN: Skipping region %s for evaluation.\n", perfmon_getTagOfRegion(i));
-        }
-        if (newNumberOfRegions < numberOfRegions)
+        return -EFAULT;
+    }
+    for (int i=0; i<numberOfRegions; i++)
+    {
+        validRegions[i] = 0;
+        for (int j=0; j<numberOfThreads; j++)
         {
-            fprintf(stderr, "WARN: Regions are skipped because:\n");
-            fprintf(stderr, "      - The region was only registered\n");
-            fprintf(stderr, "      - The region was started but never stopped\n");
-            fprintf(stderr, "      - The region was never started but stopped\n");
+            validRegions[i] += perfmon_getCountOfRegion(i, j);
         }
+        if (validRegions[i] > 0)
+            newNumberOfRegions++;
+        else
+            fprintf(stderr, "WARN: Skipping region %s for evaluation.\n", perfmon_getTagOfRegion(i));
+    }
+    if (newNumberOfRegions < numberOfRegions)
+    {
+        fprintf(stderr, "WARN: Regions are skipped because:\n");
+        fprintf(stderr, "      - The region was only registered\n");
+        fprintf(stderr, "      - The region was started but never stopped\n");
+        fprintf(stderr, "      - The region was never started but stopped\n");
+    }
+    if (!useTextMarkerFile())
+    {
+        int ret = writeBinaryMarkerFile(markerfile, markerResults, numberOfRegions,
+                                        validRegions, numberOfThreads);
+        free(validRegions);
+        return ret;
+    }
+
+    file = fopen(markerfile,"w");
+    if (file != NULL)
+    {
+        int newRegionID = 0;
         DEBUG_PRINT(DEBUGLEV_DEVELOP,
                 Creating Marker file %s with %d regions %d groups and %d threads,
                 markerfile, newNumberOfRegions, numberOfGroups, numberOfThreads);
@@ -577,6 +1688,7 @@ likwid_markerWriteFile(const char* markerfile)
             bdestroy(tmp);
             newRegionID++;
         }
+        writeParents(file, markerResults, numberOfRegions, validRegions);
         int *cpulist = (int*) malloc(numberOfThreads * sizeof(int));
         if (cpulist == NULL)
         {
@@ -613,6 +1725,10 @@ likwid_markerWriteFile(const char* markerfile)
                 fprintf(file,"%s\n", bdata(l));
                 DEBUG_PRINT(DEBUGLEV_DEVELOP, %s, bdata(l));
                 bdestroy(l);
+                writeThreadValues(file, 'C', newRegionID, &markerResults[i], markerResults[i].children, j);
+                writeThreadValues(file, 'O', newRegionID, &markerResults[i], markerResults[i].overheads, j);
+                writeSamples(file, newRegionID, &markerResults[i], j);
+                writeHistograms(file, newRegionID, &markerResults[i], j);
             }
             newRegionID++;
         }
@@ -627,6 +1743,24 @@ likwid_markerWriteFile(const char* markerfile)
     }
 }
 
+int
+likwid_markerSetSampleRate(const char* regionTag, int rate, int random)
+{
+    int ret = 0;
+    if ( ! likwid_init )
+    {
+        return -EFAULT;
+    }
+    if ((regionTag == NULL) || (rate < 1))
+    {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&globalLock);
+    ret = setSampleRate(regionTag, strlen(regionTag), rate, (random != 0));
+    pthread_mutex_unlock(&globalLock);
+    return ret;
+}
+
 int
 likwid_markerRegisterRegion(const char* regionTag)
 {
@@ -638,14 +1772,17 @@ likwid_markerRegisterRegion(const char* regionTag)
     int ret = 0;
     uint64_t tmp = 0x0ULL;
     LikwidThreadResults* results = NULL;
-    bstring tag = bformat("%.*s-%d", 100, regionTag, groupSet->activeGroup);
-    int cpu_id = hashTable_get(tag, &results);
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    LikwidThreadResults* parent = getEnclosingRegion(getRegionStack());
+    bstring tag = getRegionKey(regionTag, 100, parent);
+    int cpu_id = hashTable_getList(ident->list, tag, &results);
     bdestroy(tag);
     if (!results)
     {
         fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
         return -EFAULT;
     }
+    results->parent = parent;
 
 #ifndef LIKWID_USE_PERFEVENT
     // Add CPU to access layer if ACCESSMODE is direct or accessdaemon
@@ -657,32 +1794,34 @@ likwid_markerRegisterRegion(const char* regionTag)
     return ret;
 }
 
-int
-likwid_markerStartRegion(const char* regionTag)
+static int
+markerStartRegion(const char* regionTag, MarkerThreadIdentity* ident, MarkerRegionStack* stack, LikwidThreadResults* results)
 {
-    LikwidThreadResults* results = NULL;
-    if ( ! likwid_init )
+    int cpu_id = ident->cpuId;
+    int thread_id = ident->threadId;
+    if (results->state == MARKER_STATE_START)
     {
-        return -EFAULT;
+        fprintf(stderr, "WARN: Region %s was already started\n", regionTag);
     }
-    int myCPU = likwid_getProcessorId();
-    if (getThreadID(myCPU) < 0)
+    if (stack->depth >= LIKWID_MARKER_MAX_DEPTH)
     {
+        fprintf(stderr, "ERROR: Cannot start region %s, too many nested regions (max. %d)\n",
+                regionTag, LIKWID_MARKER_MAX_DEPTH);
         return -EFAULT;
     }
-
-    bstring tag = bformat("%.*s-%d", 100, regionTag, groupSet->activeGroup);
-    int cpu_id = hashTable_get(tag, &results);
-    if (!results)
+    stack->regions[stack->depth++] = results;
+    if (results->sampleRate == 0)
     {
-        fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
-        return -EFAULT;
+        resolveSampleRate(results);
     }
-    int thread_id = getThreadID(cpu_id);
-    if (results->state == MARKER_STATE_START)
+    if ((results->sampleRate > 1) && (!sampleCall(results)))
     {
-        fprintf(stderr, "WARN: Region %s was already started\n", regionTag);
+        /* Not measured, only the call is counted */
+        results->measuring = 0;
+        results->state = MARKER_STATE_START;
+        return 0;
     }
+    results->measuring = 1;
     perfmon_readCountersCpu(cpu_id);
     results->cpuID = cpu_id;
     for(int i=0;i<groupSet->groups[groupSet->activeGroup].numberOfEvents;i++)
@@ -706,61 +1845,64 @@ likwid_markerStartRegion(const char* regionTag)
     }
     results->state = MARKER_STATE_START;
 
-    bdestroy(tag);
     timer_start(&(results->startTime));
     return 0;
 }
 
-int
-likwid_markerStopRegion(const char* regionTag)
+static int
+markerStopRegion(const char* regionTag, MarkerThreadIdentity* ident, LikwidThreadResults* results, TimerData* timestamp)
 {
-    if (! likwid_init)
-    {
-        return -EFAULT;
-    }
-
-    TimerData timestamp;
-    LikwidThreadResults* results = NULL;
-    timer_stop(&timestamp);
     double result = 0.0;
-    int cpu_id;
-    int myCPU = likwid_getProcessorId();
-    if (getThreadID(myCPU) < 0)
+    int cpu_id = ident->cpuId;
+    int thread_id = ident->threadId;
+    if (results->state != MARKER_STATE_START)
     {
+        fprintf(stderr, "WARN: Stopping an unknown/not-started region %s\n", regionTag);
         return -EFAULT;
     }
-    int thread_id;
-    bstring tag = bformat("%.*s-%d", 100, regionTag, groupSet->activeGroup);
-    if (use_locks == 1)
+    results->groupID = groupSet->activeGroup;
+    results->count++;
+    /* Nested regions are accounted in their enclosing region for the exclusive
+     * values, all calls inside of its measured calls are counted */
+    LikwidThreadResults* parent = results->parent;
+    if ((parent != NULL) && ((parent->state != MARKER_STATE_START) || (!parent->measuring)))
     {
-        pthread_mutex_lock(&threadLocks[myCPU]);
+        parent = NULL;
     }
-
-    cpu_id = hashTable_get(tag, &results);
-    if (!results)
+    if (parent)
     {
-        fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
-        if (use_locks == 1)
+        if (results->parentResets != parent->resets)
         {
-            pthread_mutex_unlock(&threadLocks[myCPU]);
+            results->parentCalls = 0;
+            results->parentSampled = 0;
+            results->parentTime = 0;
+            memset(results->parentPMcounters, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
+            results->parentResets = parent->resets;
         }
-        return -EFAULT;
+        results->parentCalls++;
     }
-    thread_id = getThreadID(cpu_id);
-    if (results->state != MARKER_STATE_START)
+    if (!results->measuring)
     {
-        fprintf(stderr, "WARN: Stopping an unknown/not-started region %s\n", regionTag);
-        if (use_locks == 1)
-        {
-            pthread_mutex_unlock(&threadLocks[myCPU]);
-        }
-        return -EFAULT;
+        results->state = MARKER_STATE_STOP;
+        return 0;
+    }
+    results->sampled++;
+    results->startTime.stop.int64 = timestamp->stop.int64;
+    double runtime = timer_print(&(results->startTime));
+    results->time += runtime;
+    if (parent)
+    {
+        results->parentSampled++;
+        results->parentTime += runtime;
+    }
+    if (results->sampleRate > 1)
+    {
+        results->timeSquares += runtime * runtime;
+    }
+    if (results->histograms)
+    {
+        histogram_record(results->histograms, (uint64_t)(runtime * 1.0E9));
     }
-    results->groupID = groupSet->activeGroup;
-    results->startTime.stop.int64 = timestamp.stop.int64;
-    results->time += timer_print(&(results->startTime));
-    results->count++;
-    bdestroy(tag);
 
     perfmon_readCountersCpu(cpu_id);
 
@@ -774,16 +1916,30 @@ likwid_markerStopRegion(const char* regionTag)
                                             results->StartOverflows[i]);
             DEBUG_PRINT(DEBUGLEV_DEVELOP, STOP [%s] READ EVENT [%d=%d] EVENT %d VALUE %llu DIFF %f, regionTag, thread_id, cpu_id, i,
                             LLU_CAST groupSet->groups[groupSet->activeGroup].events[i].threadCounter[thread_id].counterData, result);
-            if ((counter_map[groupSet->groups[groupSet->activeGroup].events[i].index].type != THERMAL) &&
-                (counter_map[groupSet->groups[groupSet->activeGroup].events[i].index].type != VOLTAGE) &&
-                (counter_map[groupSet->groups[groupSet->activeGroup].events[i].index].type != MBOX0TMP))
+            if (isAccumulatingCounter(groupSet->groups[groupSet->activeGroup].events[i].index))
             {
                 results->PMcounters[i] += result;
+                if (results->sampleRate > 1)
+                {
+                    results->PMcountersSquares[i] += result * result;
+                }
+                if (parent)
+                {
+                    results->parentPMcounters[i] += result;
+                }
             }
             else
             {
                 results->PMcounters[i] = result;
             }
+            if ((numHistograms > 1) && (results->histograms) && (result >= 0))
+            {
+                int h = histogramOfEvent[(groupSet->activeGroup * histogramMaxEvents) + i];
+                if (h > 0)
+                {
+                    histogram_record(results->histograms + (h * HISTOGRAM_BUCKETS), (uint64_t)(result + 0.5));
+                }
+            }
         }
         else
         {
@@ -791,11 +1947,282 @@ likwid_markerStopRegion(const char* regionTag)
         }
     }
     results->state = MARKER_STATE_STOP;
+    return 0;
+}
+
+/* Resolve the thread results of a region handle for the active group. The
+ * first access of a thread to a handle in a group goes through the hash
+ * table, all following accesses are served from the per-thread handle cache */
+static int
+getHandleResults(int handle, MarkerThreadIdentity* ident, LikwidThreadResults* parent, LikwidThreadResults** results)
+{
+    uint32_t slot = (handle * numberOfGroups) + groupSet->activeGroup;
+    hashTable_getHandle(ident->list, slot, results);
+    /* The cache holds the region of the last call path the handle was used in */
+    if ((*results == NULL) || ((*results)->parent != parent))
+    {
+        bstring tag = getRegionKey(bdata(regionHandles[handle]), blength(regionHandles[handle]), parent);
+        hashTable_setHandle(ident->list, slot, tag, results);
+        bdestroy(tag);
+        if (*results)
+        {
+            (*results)->parent = parent;
+        }
+    }
+    return ident->cpuId;
+}
+
+/* Start and stop of a region by tag. The table is a parameter, so the overhead
+ * calibration runs the same code on a table that is not part of the results */
+static int
+markerStartRegionTag(const char* regionTag, MarkerThreadIdentity* ident, ThreadList* list)
+{
+    LikwidThreadResults* results = NULL;
+    int cpu_id = ident->cpuId;
+    int ret = 0;
+    MarkerRegionStack* stack = getRegionStack();
+    LikwidThreadResults* parent = getEnclosingRegion(stack);
+    if ((overheadCorrection) && (parent == NULL))
+    {
+        /* Threads that did not call likwid_markerThreadInit and switched groups.
+         * Enclosing regions would count the calibration runs. */
+        calibrateOverhead(ident);
+    }
+    bstring tag = getRegionKey(regionTag, 100, parent);
     if (use_locks == 1)
     {
-        pthread_mutex_unlock(&threadLocks[myCPU]);
+        pthread_mutex_lock(&threadLocks[cpu_id]);
     }
-    return 0;
+    hashTable_getList(list, tag, &results);
+    bdestroy(tag);
+    if (!results)
+    {
+        fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
+        ret = -EFAULT;
+    }
+    else
+    {
+        results->parent = parent;
+        ret = markerStartRegion(regionTag, ident, stack, results);
+    }
+    if (use_locks == 1)
+    {
+        pthread_mutex_unlock(&threadLocks[cpu_id]);
+    }
+    return ret;
+}
+
+static int
+markerStopRegionTag(const char* regionTag, MarkerThreadIdentity* ident, TimerData* timestamp)
+{
+    LikwidThreadResults* results = NULL;
+    int ret = 0;
+    MarkerRegionStack* stack = getRegionStack();
+    int idx = findRegion(stack, regionTag, 100);
+    if (idx < 0)
+    {
+        fprintf(stderr, "WARN: Stopping an unknown/not-started region %s\n", regionTag);
+        ret = -EFAULT;
+    }
+    else
+    {
+        int cpu_id = ident->cpuId;
+        results = stack->regions[idx];
+        popRegion(stack, idx);
+        if (use_locks == 1)
+        {
+            pthread_mutex_lock(&threadLocks[cpu_id]);
+        }
+        ret = markerStopRegion(regionTag, ident, results, timestamp);
+        if (use_locks == 1)
+        {
+            pthread_mutex_unlock(&threadLocks[cpu_id]);
+        }
+    }
+    return ret;
+}
+
+int
+likwid_markerStartRegion(const char* regionTag)
+{
+    if ( ! likwid_init )
+    {
+        return -EFAULT;
+    }
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    if (ident->threadId < 0)
+    {
+        return -EFAULT;
+    }
+    return markerStartRegionTag(regionTag, ident, ident->list);
+}
+
+int
+likwid_markerStopRegion(const char* regionTag)
+{
+    if (! likwid_init)
+    {
+        return -EFAULT;
+    }
+
+    TimerData timestamp;
+    timer_stop(&timestamp);
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    if (ident->threadId < 0)
+    {
+        return -EFAULT;
+    }
+    return markerStopRegionTag(regionTag, ident, &timestamp);
+}
+
+int
+likwid_markerRegisterRegionH(const char* regionTag, int* handle)
+{
+    int i = 0;
+    if ( ! likwid_init )
+    {
+        return -EFAULT;
+    }
+    if ((regionTag == NULL) || (handle == NULL))
+    {
+        return -EINVAL;
+    }
+    bstring tag = bformat("%.*s", 100, regionTag);
+
+    pthread_mutex_lock(&globalLock);
+    for (i = 0; i < numRegionHandles; i++)
+    {
+        if (bstrcmp(regionHandles[i], tag) == 0)
+        {
+            break;
+        }
+    }
+    if (i == numRegionHandles)
+    {
+        if (numRegionHandles >= maxRegionHandles)
+        {
+            pthread_mutex_unlock(&globalLock);
+            fprintf(stderr, "ERROR: Too many region handles for %s, increase LIKWID_MARKER_MAX_REGIONS (currently %d)\n",
+                    regionTag, maxRegionHandles);
+            bdestroy(tag);
+            return -ENOMEM;
+        }
+        regionHandles[numRegionHandles] = bstrcpy(tag);
+        __atomic_store_n(&numRegionHandles, numRegionHandles + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&globalLock);
+    bdestroy(tag);
+
+    *handle = i;
+    return likwid_markerRegisterRegion(regionTag);
+}
+
+int
+likwid_markerStartRegionH(int handle)
+{
+    LikwidThreadResults* results = NULL;
+    if ( ! likwid_init )
+    {
+        return -EFAULT;
+    }
+    if ((handle < 0) || (handle >= __atomic_load_n(&numRegionHandles, __ATOMIC_ACQUIRE)))
+    {
+        return -EINVAL;
+    }
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    if (ident->threadId < 0)
+    {
+        return -EFAULT;
+    }
+
+    int cpu_id = ident->cpuId;
+    int ret = 0;
+    MarkerRegionStack* stack = getRegionStack();
+    if ((overheadCorrection) && (stack->depth == 0))
+    {
+        calibrateOverhead(ident);
+    }
+    if (use_locks == 1)
+    {
+        pthread_mutex_lock(&threadLocks[cpu_id]);
+    }
+    getHandleResults(handle, ident, getEnclosingRegion(stack), &results);
+    if (!results)
+    {
+        fprintf(stderr, "ERROR: Failed to get thread data for handle %d\n", handle);
+        ret = -EFAULT;
+    }
+    else
+    {
+        ret = markerStartRegion(bdata(results->label), ident, stack, results);
+    }
+    if (use_locks == 1)
+    {
+        pthread_mutex_unlock(&threadLocks[cpu_id]);
+    }
+    return ret;
+}
+
+int
+likwid_markerStopRegionH(int handle)
+{
+    if (! likwid_init)
+    {
+        return -EFAULT;
+    }
+
+    TimerData timestamp;
+    LikwidThreadResults* results = NULL;
+    timer_stop(&timestamp);
+    int ret = 0;
+    if ((handle < 0) || (handle >= __atomic_load_n(&numRegionHandles, __ATOMIC_ACQUIRE)))
+    {
+        return -EINVAL;
+    }
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    if (ident->threadId < 0)
+    {
+        return -EFAULT;
+    }
+
+    MarkerRegionStack* stack = getRegionStack();
+    int idx = -1;
+    uint32_t slot = (handle * numberOfGroups) + groupSet->activeGroup;
+    hashTable_getHandle(ident->list, slot, &results);
+    for (int i = stack->depth - 1; i >= 0 && results; i--)
+    {
+        if (stack->regions[i] == results)
+        {
+            idx = i;
+            break;
+        }
+    }
+    if (idx < 0)
+    {
+        /* The handle was started in another call path since */
+        idx = findRegion(stack, bdata(regionHandles[handle]), blength(regionHandles[handle]));
+    }
+    if (idx < 0)
+    {
+        fprintf(stderr, "WARN: Stopping an unknown/not-started region with handle %d\n", handle);
+        ret = -EFAULT;
+    }
+    else
+    {
+        int cpu_id = ident->cpuId;
+        results = stack->regions[idx];
+        popRegion(stack, idx);
+        if (use_locks == 1)
+        {
+            pthread_mutex_lock(&threadLocks[cpu_id]);
+        }
+        ret = markerStopRegion(bdata(results->label), ident, results, &timestamp);
+        if (use_locks == 1)
+        {
+            pthread_mutex_unlock(&threadLocks[cpu_id]);
+        }
+    }
+    return ret;
 }
 
 void
@@ -814,19 +2241,26 @@ likwid_markerGetRegion(
         return;
     }
     int length = 0;
-    int cpu_id;
-    int myCPU = likwid_getProcessorId();
-    int thread_id;
+    MarkerThreadIdentity* ident = getThreadIdentity();
     LikwidThreadResults* results = NULL;
-    bstring tag = bformat("%.*s-%d", 100, regionTag, groupSet->activeGroup);
+    LikwidThreadResults* parent = getEnclosingRegion(getRegionStack());
+    bstring tag = getRegionKey(regionTag, 100, parent);
 
-    cpu_id = hashTable_get(tag, &results);
+    hashTable_getList(ident->list, tag, &results);
     if (!results)
     {
         fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
+        bdestroy(tag);
         return;
     }
-    thread_id = getThreadID(myCPU);
+    results->parent = parent;
+    /* Values of sampled regions are extrapolated to all calls */
+    double scale = 1.0;
+    if ((results->sampleRate > 1) && (results->sampled > 0))
+    {
+        scale = ((double)results->count) / results->sampled;
+    }
+    double* overhead = (overheadCorrection ? getOverhead(ident->cpuId, groupSet->activeGroup) : NULL);
     if (count != NULL)
     {
         *count = results->count;
@@ -834,6 +2268,11 @@ likwid_markerGetRegion(
     if (time != NULL)
     {
         *time = results->time;
+        if (overhead)
+        {
+            subtractOverhead(time, NULL, results->sampled, overhead[0]);
+        }
+        *time *= scale;
     }
     if (nr_events != NULL && events != NULL && *nr_events > 0)
     {
@@ -841,6 +2280,14 @@ likwid_markerGetRegion(
         for(int i=0;i<length;i++)
         {
             events[i] = results->PMcounters[i];
+            if (isAccumulatingCounter(groupSet->groups[groupSet->activeGroup].events[i].index))
+            {
+                if (overhead)
+                {
+                    subtractOverhead(&events[i], NULL, results->sampled, overhead[i+1]);
+                }
+                events[i] *= scale;
+            }
         }
         *nr_events = length;
     }
@@ -857,20 +2304,22 @@ likwid_markerResetRegion(const char* regionTag)
     {
         return -EFAULT;
     }
-    int cpu_id;
-    int myCPU = likwid_getProcessorId();
-    if (getThreadID(myCPU) < 0)
+    MarkerThreadIdentity* ident = getThreadIdentity();
+    if (ident->threadId < 0)
     {
         return -EFAULT;
     }
-    bstring tag = bformat("%.*s-%d", 100, regionTag, groupSet->activeGroup);
+    LikwidThreadResults* parent = getEnclosingRegion(getRegionStack());
+    bstring tag = getRegionKey(regionTag, 100, parent);
 
-    cpu_id = hashTable_get(tag, &results);
+    hashTable_getList(ident->list, tag, &results);
+    bdestroy(tag);
     if (!results)
     {
         fprintf(stderr, "ERROR: Failed to get thread data for tag %s\n", regionTag);
         return -EFAULT;
     }
+    results->parent = parent;
     if (results->state != MARKER_STATE_STOP)
     {
         fprintf(stderr, "ERROR: Can only reset stopped regions\n");
@@ -879,9 +2328,23 @@ likwid_markerResetRegion(const char* regionTag)
 
     memset(results->StartPMcounters, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
     memset(results->PMcounters, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
-    memset(results->StartOverflows, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
+    memset(results->StartOverflows, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(int));
+    memset(results->PMcountersSquares, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
     results->count = 0;
     results->time = 0;
+    results->sampled = 0;
+    results->sampleCountdown = 0;
+    results->timeSquares = 0;
+    results->parentCalls = 0;
+    results->parentSampled = 0;
+    results->parentTime = 0;
+    memset(results->parentPMcounters, 0, groupSet->groups[groupSet->activeGroup].numberOfEvents*sizeof(double));
+    /* The sums of the nested regions refer to the calls before the reset */
+    results->resets++;
+    if (results->histograms)
+    {
+        memset(results->histograms, 0, numHistograms * HISTOGRAM_BUCKETS * sizeof(uint32_t));
+    }
     timer_reset(&results->startTime);
     return 0;
 }
@@ -922,6 +2385,8 @@ likwid_pinThread(int processorId)
         ERROR_PRINT("ERROR: Pinning of thread to CPU %d failed\n", processorId);
         return FALSE;
     }
+    threadIdentity.valid = 0;
+    perfmon_resetThreadAffinity();
 
     return TRUE;
 }
@@ -942,6 +2407,8 @@ likwid_pinProcess(int processorId)
         ERROR_PRINT("ERROR: Pinning of process to CPU %d failed\n", processorId);
         return FALSE;
     }
+    threadIdentity.valid = 0;
+    perfmon_resetThreadAffinity();
 
     return TRUE;
 }
@@ -31,6 +31,7 @@
 
 /* #####   HEADER FILE INCLUDES   ######################################### */
 
+#include <math.h>
 #include <pwd.h>
 #include <sched.h>
 #include <stdio.h>
@@ -395,6 +396,88 @@ static int lua_likwid_getLastResult(lua_State *L) {
   return 1;
 }
 
+static int lua_likwid_getResultQuality(lua_State *L) {
+  int groupId, eventId, threadId;
+  double result = 0;
+  groupId = lua_tonumber(L, 1);
+  eventId = lua_tonumber(L, 2);
+  threadId = lua_tonumber(L, 3);
+  result = perfmon_getResultQuality(groupId - 1, eventId - 1, threadId - 1);
+  lua_pushnumber(L, result);
+  return 1;
+}
+
+static int lua_likwid_setSamplingPeriod(lua_State *L) {
+  int ret;
+  uint64_t period = (uint64_t)lua_tointeger(L, 1);
+  ret = perfmon_setSamplingPeriod(period);
+  lua_pushinteger(L, ret);
+  return 1;
+}
+
+static int lua_likwid_getSamples(lua_State *L) {
+  int groupId, eventId, threadId;
+  PerfmonSample *samples = NULL;
+  groupId = lua_tonumber(L, 1);
+  eventId = lua_tonumber(L, 2);
+  threadId = lua_tonumber(L, 3);
+  int n = perfmon_getSamples(groupId - 1, eventId - 1, threadId - 1, &samples);
+  lua_newtable(L);
+  for (int i = 0; i < n; i++) {
+    lua_pushinteger(L, i + 1);
+    lua_newtable(L);
+    lua_pushstring(L, "address");
+    lua_pushinteger(L, (lua_Integer)samples[i].address);
+    lua_settable(L, -3);
+    lua_pushstring(L, "offset");
+    lua_pushinteger(L, (lua_Integer)samples[i].offset);
+    lua_settable(L, -3);
+    lua_pushstring(L, "count");
+    lua_pushinteger(L, (lua_Integer)samples[i].count);
+    lua_settable(L, -3);
+    lua_pushstring(L, "module");
+    if (samples[i].module != NULL)
+      lua_pushstring(L, samples[i].module);
+    else
+      lua_pushnil(L);
+    lua_settable(L, -3);
+    lua_settable(L, -3);
+  }
+  return 1;
+}
+
+static int lua_likwid_setCgroup(lua_State *L) {
+  const char *path = NULL;
+  if (lua_isstring(L, 1))
+    path = lua_tostring(L, 1);
+  lua_pushinteger(L, perfmon_setCgroup(path));
+  return 1;
+}
+
+static int lua_likwid_getNumberOfTasks(lua_State *L) {
+  int groupId = lua_tonumber(L, 1);
+  lua_pushinteger(L, perfmon_getNumberOfTasks(groupId - 1));
+  return 1;
+}
+
+static int lua_likwid_getTaskId(lua_State *L) {
+  int groupId = lua_tonumber(L, 1);
+  int taskId = lua_tonumber(L, 2);
+  lua_pushinteger(L, perfmon_getTaskId(groupId - 1, taskId - 1));
+  return 1;
+}
+
+static int lua_likwid_getTaskResult(lua_State *L) {
+  int groupId, eventId, taskId;
+  double result = 0;
+  groupId = lua_tonumber(L, 1);
+  eventId = lua_tonumber(L, 2);
+  taskId = lua_tonumber(L, 3);
+  result = perfmon_getTaskResult(groupId - 1, eventId - 1, taskId - 1);
+  lua_pushnumber(L, result);
+  return 1;
+}
+
 static int lua_likwid_getMetric(lua_State *L) {
   int groupId, metricId, threadId;
   double result = 0;
@@ -417,6 +500,48 @@ static int lua_likwid_getLastMetric(lua_State *L) {
   return 1;
 }
 
+static int lua_likwid_pushMetricsAll(lua_State *L,
+                                     int (*getMetrics)(int, double *)) {
+  int groupId, nmetrics, nthreads;
+  double *results = NULL;
+  if (perfmon_isInitialized == 0) {
+    return 0;
+  }
+  groupId = lua_tonumber(L, 1);
+  nmetrics = perfmon_getNumberOfMetrics(groupId - 1);
+  nthreads = perfmon_getNumberOfThreads();
+  if ((nmetrics <= 0) || (nthreads <= 0)) {
+    lua_newtable(L);
+    return 1;
+  }
+  results = malloc(nmetrics * nthreads * sizeof(double));
+  if ((!results) || (getMetrics(groupId - 1, results) < 0)) {
+    free(results);
+    return 0;
+  }
+  lua_newtable(L);
+  for (int m = 0; m < nmetrics; m++) {
+    lua_pushinteger(L, m + 1);
+    lua_newtable(L);
+    for (int t = 0; t < nthreads; t++) {
+      lua_pushinteger(L, t + 1);
+      lua_pushnumber(L, results[m * nthreads + t]);
+      lua_settable(L, -3);
+    }
+    lua_settable(L, -3);
+  }
+  free(results);
+  return 1;
+}
+
+static int lua_likwid_getMetricsAll(lua_State *L) {
+  return lua_likwid_pushMetricsAll(L, perfmon_getMetricsAll);
+}
+
+static int lua_likwid_getLastMetricsAll(lua_State *L) {
+  return lua_likwid_pushMetricsAll(L, perfmon_getLastMetricsAll);
+}
+
 static int lua_likwid_getNumberOfGroups(lua_State *L) {
   int number;
   if (perfmon_isInitialized == 0) {
@@ -2306,6 +2431,86 @@ static int lua_likwid_markerRegionMetric(lua_State *L) {
   return 1;
 }
 
+static int lua_likwid_markerRegionParent(lua_State *L) {
+  int region = lua_tointeger(L, -1);
+  lua_pushinteger(L, perfmon_getParentOfRegion(region - 1) + 1);
+  return 1;
+}
+
+static int lua_likwid_markerRegionExclusiveTime(lua_State *L) {
+  int region = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(L, perfmon_getExclusiveTimeOfRegion(region - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionExclusiveResult(lua_State *L) {
+  int region = lua_tointeger(L, -3);
+  int event = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(L, perfmon_getExclusiveResultOfRegionThread(
+                        region - 1, event - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionExclusiveMetric(lua_State *L) {
+  int region = lua_tointeger(L, -3);
+  int metric = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(L, perfmon_getExclusiveMetricOfRegionThread(
+                        region - 1, metric - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionOverhead(lua_State *L) {
+  int region = lua_tointeger(L, -3);
+  int event = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(
+      L, perfmon_getOverheadOfRegionThread(region - 1, event - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionUncorrectedMetric(lua_State *L) {
+  int region = lua_tointeger(L, -3);
+  int metric = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(L, perfmon_getUncorrectedMetricOfRegionThread(
+                        region - 1, metric - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionSampled(lua_State *L) {
+  int region = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushinteger(L, perfmon_getSampledCountOfRegion(region - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionError(lua_State *L) {
+  int region = lua_tointeger(L, -3);
+  int event = lua_tointeger(L, -2);
+  int thread = lua_tointeger(L, -1);
+  lua_pushnumber(
+      L, perfmon_getErrorOfRegionThread(region - 1, event - 1, thread - 1));
+  return 1;
+}
+
+static int lua_likwid_markerRegionPercentile(lua_State *L) {
+  int region = lua_tointeger(L, -4);
+  int event = lua_tointeger(L, -3);
+  int thread = lua_tointeger(L, -2);
+  double percentile = lua_tonumber(L, -1);
+  double result =
+      perfmon_getRegionPercentile(region - 1, event - 1, thread - 1, percentile);
+  if (isnan(result)) {
+    lua_pushnil(L);
+  } else {
+    lua_pushnumber(L, result);
+  }
+  return 1;
+}
+
 static int lua_likwid_initFreq(lua_State *L) {
   lua_pushnumber(L, freq_init());
   return 1;
@@ -3915,8 +4120,17 @@ int __attribute__((visibility("default"))) luaopen_liblikwid(lua_State *L) {
   // Perfmon results functions
   lua_register(L, "likwid_getResult", lua_likwid_getResult);
   lua_register(L, "likwid_getLastResult", lua_likwid_getLastResult);
+  lua_register(L, "likwid_getResultQuality", lua_likwid_getResultQuality);
+  lua_register(L, "likwid_setSamplingPeriod", lua_likwid_setSamplingPeriod);
+  lua_register(L, "likwid_getSamples", lua_likwid_getSamples);
+  lua_register(L, "likwid_setCgroup", lua_likwid_setCgroup);
+  lua_register(L, "likwid_getNumberOfTasks", lua_likwid_getNumberOfTasks);
+  lua_register(L, "likwid_getTaskId", lua_likwid_getTaskId);
+  lua_register(L, "likwid_getTaskResult", lua_likwid_getTaskResult);
   lua_register(L, "likwid_getMetric", lua_likwid_getMetric);
   lua_register(L, "likwid_getLastMetric", lua_likwid_getLastMetric);
+  lua_register(L, "likwid_getMetricsAll", lua_likwid_getMetricsAll);
+  lua_register(L, "likwid_getLastMetricsAll", lua_likwid_getLastMetricsAll);
   lua_register(L, "likwid_getNumberOfGroups", lua_likwid_getNumberOfGroups);
   lua_register(L, "likwid_getRuntimeOfGroup", lua_likwid_getRuntimeOfGroup);
   lua_register(L, "likwid_getIdOfActiveGroup", lua_likwid_getIdOfActiveGroup);
@@ -4016,6 +4230,21 @@ int __attribute__((visibility("default"))) luaopen_liblikwid(lua_State *L) {
   lua_register(L, "likwid_markerRegionCount", lua_likwid_markerRegionCount);
   lua_register(L, "likwid_markerRegionResult", lua_likwid_markerRegionResult);
   lua_register(L, "likwid_markerRegionMetric", lua_likwid_markerRegionMetric);
+  lua_register(L, "likwid_markerRegionPercentile",
+               lua_likwid_markerRegionPercentile);
+  lua_register(L, "likwid_markerRegionSampled", lua_likwid_markerRegionSampled);
+  lua_register(L, "likwid_markerRegionError", lua_likwid_markerRegionError);
+  lua_register(L, "likwid_markerRegionParent", lua_likwid_markerRegionParent);
+  lua_register(L, "likwid_markerRegionExclusiveTime",
+               lua_likwid_markerRegionExclusiveTime);
+  lua_register(L, "likwid_markerRegionExclusiveResult",
+               lua_likwid_markerRegionExclusiveResult);
+  lua_register(L, "likwid_markerRegionExclusiveMetric",
+               lua_likwid_markerRegionExclusiveMetric);
+  lua_register(L, "likwid_markerRegionOverhead",
+               lua_likwid_markerRegionOverhead);
+  lua_register(L, "likwid_markerRegionUncorrectedMetric",
+               lua_likwid_markerRegionUncorrectedMetric);
   // CPU frequency functions
   lua_register(L, "likwid_initFreq", lua_likwid_initFreq);
   lua_register(L, "likwid_finalizeFreq", lua_likwid_finalizeFreq);
@@ -38,6 +38,11 @@
 #include <float.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <types.h>
 #include <likwid.h>
@@ -48,7 +53,9 @@
 #include <registers.h>
 #include <topology.h>
 #include <access.h>
+#include <configuration.h>
 #include <perfgroup.h>
+#include <histogram.h>
 #if !defined(__ARM_ARCH_7A__) && !defined(__ARM_ARCH_8A)
 #include <cpuid.h>
 #endif
@@ -108,6 +115,7 @@ char** translate_types = NULL;
 char** archRegisterTypeNames = NULL;
 
 int perfmon_numCounters = 0;
+int perfmon_numVirtualCounters = 0;
 int perfmon_numCoreCounters = 0;
 int perfmon_numArchEvents = 0;
 int perfmon_initialized = 0;
@@ -115,10 +123,20 @@ int perfmon_verbosity = DEBUGLEV_ONLY_ERROR;
 int maps_checked = 0;
 uint64_t **currentConfig = NULL;
 static int added_generic_event = 0;
+#ifdef LIKWID_USE_PERFEVENT
+/* With perf_event, the kernel multiplexes more core events than the hardware
+ * has counters. The counter map is extended by virtual PMC counters. */
+#define PERFMON_VIRTUAL_PMC_FACTOR 4
+static RegisterMap* arch_counter_map = NULL;
+static int arch_numCounters = 0;
+#endif
 
 PerfmonGroupSet* groupSet = NULL;
 LikwidResults* markerResults = NULL;
 int markerRegions = 0;
+/* Mapping of a binary Marker file, the marker results point into it */
+static void* markerMap = NULL;
+static size_t markerMapSize = 0;
 
 int (*perfmon_startCountersThread) (int thread_id, PerfmonEventSet* eventSet) = NULL;
 int (*perfmon_stopCountersThread) (int thread_id, PerfmonEventSet* eventSet) = NULL;
@@ -179,21 +197,203 @@ char* default_translate_types[NUM_UNITS] = {
 
 /* #####   FUNCTION DEFINITIONS  -  LOCAL TO THIS SOURCE FILE   ########### */
 
+/* Hash indices for the name lookups in the event map, the counter map and
+ * the counter limits of the events. The maps are selected at runtime and the
+ * generic event is appended to the event map, so the indices are (re)built
+ * on first use for the current map. Open addressing with linear probing,
+ * the slots contain the position in the indexed array or -1. */
+typedef struct {
+    int size;
+    int count;
+    int* slots;
+    void* map;
+    int mapEntries;
+} PerfmonNameIndex;
+
+typedef struct {
+    char* limit;
+    uint64_t* mask;
+} PerfmonLimitMask;
+
+static PerfmonNameIndex eventIndex = {0, 0, NULL, NULL, 0};
+static PerfmonNameIndex counterIndex = {0, 0, NULL, NULL, 0};
+static PerfmonNameIndex limitIndex = {0, 0, NULL, NULL, 0};
+static PerfmonLimitMask* limitMasks = NULL;
+static int limitMaskCounters = 0;
+
+static const char*
+eventIndexName(int i)
+{
+    return eventHash[i].name;
+}
+
+static const char*
+counterIndexName(int i)
+{
+    return counter_map[i].key;
+}
+
+static const char*
+limitIndexName(int i)
+{
+    return limitMasks[i].limit;
+}
+
+static uint32_t
+perfmon_hashName(const char* name, int len)
+{
+    uint32_t hash = 2166136261U;
+    for (int i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619U;
+    }
+    return hash;
+}
+
 static int
-getIndexAndType (bstring reg, RegisterIndex* index, RegisterType* type)
+perfmon_findName(PerfmonNameIndex* idx, const char* (*getName)(int), const char* name, int len)
 {
-    int ret = FALSE;
+    if (idx->size == 0)
+    {
+        return -1;
+    }
+    uint32_t h = perfmon_hashName(name, len) & (idx->size - 1);
+    while (idx->slots[h] >= 0)
+    {
+        const char* n = getName(idx->slots[h]);
+        if ((strncmp(n, name, len) == 0) && (n[len] == '\0'))
+        {
+            return idx->slots[h];
+        }
+        h = (h + 1) & (idx->size - 1);
+    }
+    return -1;
+}
+
+static int
+perfmon_insertName(PerfmonNameIndex* idx, const char* (*getName)(int), int entry)
+{
+    const char* name = getName(entry);
+    uint32_t h = 0;
+    /* Keep the load factor below 1/2 */
+    if (2 * (idx->count + 1) > idx->size)
+    {
+        int size = (idx->size > 0 ? 2 * idx->size : 256);
+        int* slots = malloc(size * sizeof(int));
+        if (!slots)
+        {
+            return -ENOMEM;
+        }
+        memset(slots, -1, size * sizeof(int));
+        for (int i = 0; i < idx->size; i++)
+        {
+            if (idx->slots[i] >= 0)
+            {
+                const char* n = getName(idx->slots[i]);
+                h = perfmon_hashName(n, strlen(n)) & (size - 1);
+                while (slots[h] >= 0)
+                {
+                    h = (h + 1) & (size - 1);
+                }
+                slots[h] = idx->slots[i];
+            }
+        }
+        free(idx->slots);
+        idx->slots = slots;
+        idx->size = size;
+    }
+    /* The first entry with a name wins like in a linear search */
+    if (perfmon_findName(idx, getName, name, strlen(name)) >= 0)
+    {
+        return 0;
+    }
+    h = perfmon_hashName(name, strlen(name)) & (idx->size - 1);
+    while (idx->slots[h] >= 0)
+    {
+        h = (h + 1) & (idx->size - 1);
+    }
+    idx->slots[h] = entry;
+    idx->count++;
+    return 0;
+}
+
+static void
+perfmon_clearNameIndex(PerfmonNameIndex* idx)
+{
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->size = 0;
+    idx->count = 0;
+    idx->map = NULL;
+    idx->mapEntries = 0;
+}
 
+static void
+perfmon_clearLimitMasks(void)
+{
+    for (int i = 0; i < limitIndex.mapEntries; i++)
+    {
+        free(limitMasks[i].limit);
+        free(limitMasks[i].mask);
+    }
+    free(limitMasks);
+    limitMasks = NULL;
+    perfmon_clearNameIndex(&limitIndex);
+}
+
+/* Returns the index for the map or NULL if it cannot be built. The lookup
+ * falls back to a linear search then. */
+static PerfmonNameIndex*
+perfmon_getNameIndex(PerfmonNameIndex* idx, void* map, int entries, const char* (*getName)(int))
+{
+    if ((idx->map == map) && (idx->mapEntries == entries) && (idx->size > 0))
+    {
+        return idx;
+    }
+    perfmon_clearNameIndex(idx);
+    for (int i = 0; i < entries; i++)
+    {
+        if (perfmon_insertName(idx, getName, i) < 0)
+        {
+            perfmon_clearNameIndex(idx);
+            return NULL;
+        }
+    }
+    idx->map = map;
+    idx->mapEntries = entries;
+    return idx;
+}
+
+static int
+getCounterMapIndex(bstring reg)
+{
+    PerfmonNameIndex* idx = perfmon_getNameIndex(&counterIndex, counter_map, perfmon_numCounters, counterIndexName);
+    if (idx)
+    {
+        return perfmon_findName(idx, counterIndexName, bdata(reg), blength(reg));
+    }
     for (int i=0; i< perfmon_numCounters; i++)
     {
         if (biseqcstr(reg, counter_map[i].key))
         {
-            *index = counter_map[i].index;
-            *type = counter_map[i].type;
-            ret = TRUE;
-            break;
+            return i;
         }
     }
+    return -1;
+}
+
+static int
+getIndexAndType (bstring reg, RegisterIndex* index, RegisterType* type)
+{
+    int ret = FALSE;
+    int i = getCounterMapIndex(reg);
+
+    if (i >= 0)
+    {
+        *index = counter_map[i].index;
+        *type = counter_map[i].type;
+        ret = TRUE;
+    }
 
     return ret;
 }
@@ -326,8 +526,89 @@ checkAccess(bstring reg, RegisterIndex index, RegisterType oldtype, int force)
     return type;
 }
 
+#ifdef LIKWID_USE_PERFEVENT
 static int
-checkCounter(bstring counterName, const char* limit)
+perfmon_init_virtual_counters(void)
+{
+    int numPmc = 0;
+    int numVirtual = 0;
+    int lastPmc = -1;
+    RegisterMap* map = NULL;
+    if (arch_counter_map != NULL || counter_map == NULL)
+    {
+        return 0;
+    }
+#ifdef _ARCH_PPC
+    /* POWER events are bound to a specific counter */
+    return 0;
+#endif
+    for (int i = 0; i < perfmon_numCounters; i++)
+    {
+        if (counter_map[i].type == PMC)
+        {
+            numPmc++;
+            lastPmc = i;
+        }
+    }
+    if (numPmc == 0)
+    {
+        return 0;
+    }
+    numVirtual = (PERFMON_VIRTUAL_PMC_FACTOR - 1) * numPmc;
+    map = malloc((perfmon_numCounters + numVirtual) * sizeof(RegisterMap));
+    if (map == NULL)
+    {
+        return -ENOMEM;
+    }
+    memcpy(map, counter_map, perfmon_numCounters * sizeof(RegisterMap));
+    for (int i = 0; i < numVirtual; i++)
+    {
+        RegisterMap* r = &map[perfmon_numCounters + i];
+        *r = counter_map[lastPmc];
+        r->index = (RegisterIndex)(perfmon_numCounters + i);
+        r->key = malloc(20 * sizeof(char));
+        if (r->key == NULL)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                free(map[perfmon_numCounters + j].key);
+            }
+            free(map);
+            return -ENOMEM;
+        }
+        snprintf(r->key, 20, "PMC%d", numPmc + i);
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Added %d virtual PMC counters for multiplexing, numVirtual);
+    arch_counter_map = counter_map;
+    arch_numCounters = perfmon_numCounters;
+    counter_map = map;
+    perfmon_numCounters += numVirtual;
+    perfmon_numVirtualCounters = numVirtual;
+    return 0;
+}
+
+static void
+perfmon_finalize_virtual_counters(void)
+{
+    if (arch_counter_map == NULL)
+    {
+        return;
+    }
+    for (int i = arch_numCounters; i < perfmon_numCounters; i++)
+    {
+        free(counter_map[i].key);
+    }
+    free(counter_map);
+    counter_map = arch_counter_map;
+    perfmon_numCounters = arch_numCounters;
+    perfmon_numVirtualCounters = 0;
+    arch_counter_map = NULL;
+    arch_numCounters = 0;
+}
+#endif
+
+static int
+checkCounterLimit(bstring counterName, const char* limit)
 {
     int i;
     struct bstrList* tokens;
@@ -353,19 +634,110 @@ checkCounter(bstring counterName, const char* limit)
     return ret;
 }
 
+/* The counters allowed by a limit string are evaluated once for all
+ * counters of the map and stored as bit mask */
+static uint64_t*
+getLimitMask(const char* limit)
+{
+    int i = 0;
+    int words = (perfmon_numCounters + 63) / 64;
+    PerfmonLimitMask* tmp = NULL;
+    if ((limitIndex.map != counter_map) || (limitMaskCounters != perfmon_numCounters))
+    {
+        perfmon_clearLimitMasks();
+        limitIndex.map = counter_map;
+        limitMaskCounters = perfmon_numCounters;
+    }
+    i = perfmon_findName(&limitIndex, limitIndexName, limit, strlen(limit));
+    if (i >= 0)
+    {
+        return limitMasks[i].mask;
+    }
+    tmp = realloc(limitMasks, (limitIndex.mapEntries + 1) * sizeof(PerfmonLimitMask));
+    if (!tmp)
+    {
+        return NULL;
+    }
+    limitMasks = tmp;
+    i = limitIndex.mapEntries;
+    limitMasks[i].limit = strdup(limit);
+    limitMasks[i].mask = calloc(words > 0 ? words : 1, sizeof(uint64_t));
+    if ((!limitMasks[i].limit) || (!limitMasks[i].mask))
+    {
+        free(limitMasks[i].limit);
+        free(limitMasks[i].mask);
+        return NULL;
+    }
+    for (int j = 0; j < perfmon_numCounters; j++)
+    {
+        bstring cstr = bfromcstr(counter_map[j].key);
+        if (checkCounterLimit(cstr, limit))
+        {
+            limitMasks[i].mask[j / 64] |= (1ULL << (j % 64));
+        }
+        bdestroy(cstr);
+    }
+    if (perfmon_insertName(&limitIndex, limitIndexName, i) < 0)
+    {
+        free(limitMasks[i].limit);
+        free(limitMasks[i].mask);
+        return NULL;
+    }
+    limitIndex.mapEntries++;
+    return limitMasks[i].mask;
+}
+
+static int
+checkCounterIndex(int counter, const char* limit)
+{
+    int ret = FALSE;
+    uint64_t* mask = getLimitMask(limit);
+    if (!mask)
+    {
+        bstring cstr = bfromcstr(counter_map[counter].key);
+        ret = checkCounterLimit(cstr, limit);
+        bdestroy(cstr);
+        return ret;
+    }
+    return ((mask[counter / 64] >> (counter % 64)) & 0x1ULL ? TRUE : FALSE);
+}
+
+static int
+checkCounter(bstring counterName, const char* limit)
+{
+    int i = getCounterMapIndex(counterName);
+    if (i < 0)
+    {
+        return checkCounterLimit(counterName, limit);
+    }
+    return checkCounterIndex(i, limit);
+}
+
 static int
 getEvent(bstring event_str, bstring counter_str, PerfmonEvent* event)
 {
     int ret = FALSE;
-    for (int i=0; i< perfmon_numArchEvents; i++)
+    int i = -1;
+    PerfmonNameIndex* idx = perfmon_getNameIndex(&eventIndex, eventHash, perfmon_numArchEvents, eventIndexName);
+    if (idx)
     {
-        if (biseqcstr(event_str, eventHash[i].name))
+        i = perfmon_findName(idx, eventIndexName, bdata(event_str), blength(event_str));
+    }
+    else
+    {
+        for (i = 0; i < perfmon_numArchEvents; i++)
         {
-            *event = eventHash[i];
-            ret = TRUE;
-            break;
+            if (biseqcstr(event_str, eventHash[i].name))
+            {
+                break;
+            }
         }
     }
+    if ((i >= 0) && (i < perfmon_numArchEvents))
+    {
+        *event = eventHash[i];
+        ret = TRUE;
+    }
 
     return ret;
 }
@@ -739,6 +1111,55 @@ getCounterTypeOffset(int index)
     return off;
 }
 
+int
+perfmon_prefetchCounters(int thread_id, PerfmonEventSet* eventSet, int uncore)
+{
+    int count = 0;
+    int cpu_id = groupSet->threads[thread_id].processorId;
+    AccessDataRecord* records = NULL;
+
+    /* The records are filled in the prefetch buffer of the CPU, which only
+     * exists if the access layer can batch requests (access daemon) */
+    records = HPMprefetchBuffer(cpu_id, 2 * eventSet->numberOfEvents);
+    if (!records)
+    {
+        return 0;
+    }
+    for (int i = 0; i < eventSet->numberOfEvents; i++)
+    {
+        RegisterType type = eventSet->events[i].type;
+        RegisterIndex index = eventSet->events[i].index;
+        if (eventSet->events[i].threadCounter[thread_id].init != TRUE)
+        {
+            continue;
+        }
+        /* Only plain counter registers, the other core types are either
+         * derived from shared registers or read through perf_event */
+        if ((type == THERMAL) || (type == VOLTAGE) || (type == PERF) || (type == METRICS))
+        {
+            continue;
+        }
+        if ((type != PMC) && (type != FIXED) && (!uncore))
+        {
+            continue;
+        }
+        memset(&records[count], 0, sizeof(AccessDataRecord));
+        records[count].device = counter_map[index].device;
+        records[count].reg = counter_map[index].counterRegister;
+        records[count].type = DAEMON_READ;
+        count++;
+        if (counter_map[index].counterRegister2 != 0x0)
+        {
+            memset(&records[count], 0, sizeof(AccessDataRecord));
+            records[count].device = counter_map[index].device;
+            records[count].reg = counter_map[index].counterRegister2;
+            records[count].type = DAEMON_READ;
+            count++;
+        }
+    }
+    return HPMprefetch(cpu_id, records, count);
+}
+
 void
 perfmon_setVerbosity(int level)
 {
@@ -841,24 +1262,18 @@ perfmon_check_counter_map(int cpu_id)
         {
             continue;
         }
-        bstring estr = bfromcstr(eventHash[i].name);
         for (int j=0;j<perfmon_numCounters; j++)
         {
             if (counter_map[j].type == NOTYPE)
             {
                 continue;
             }
-            PerfmonEvent event;
-            bstring cstr = bfromcstr(counter_map[j].key);
-            if (getEvent(estr, cstr, &event) && checkCounter(cstr, eventHash[i].limit))
+            if (checkCounterIndex(j, eventHash[i].limit))
             {
                 found = 1;
-                bdestroy(cstr);
                 break;
             }
-            bdestroy(cstr);
         }
-        bdestroy(estr);
         if (!found)
         {
             DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot respect limit %s. Removing event %s, eventHash[i].limit, eventHash[i].name);
@@ -2110,6 +2525,14 @@ perfmon_init(int nrThreads, const int* threadsToCpu)
         HPMfinalize();
         return ret;
     }
+#ifdef LIKWID_USE_PERFEVENT
+    ret = perfmon_init_virtual_counters();
+    if (ret < 0)
+    {
+        ERROR_PRINT(Failed to add virtual counters for %s, cpuid_info.name);
+        return ret;
+    }
+#endif
 
     /* Initialize function pointer to current architecture functions */
     ret = perfmon_init_funcs(&initialize_power, &initialize_thermal);
@@ -2170,6 +2593,8 @@ perfmon_init(int nrThreads, const int* threadsToCpu)
     return 0;
 }
 
+static void perfmon_stopReaderPool(void);
+
 void
 perfmon_finalize(void)
 {
@@ -2232,7 +2657,13 @@ perfmon_finalize(void)
     power_finalize();
 #ifndef LIKWID_USE_PERFEVENT
     HPMfinalize();
+#else
+    perfmon_finalize_virtual_counters();
 #endif
+    perfmon_stopReaderPool();
+    perfmon_clearNameIndex(&eventIndex);
+    perfmon_clearNameIndex(&counterIndex);
+    perfmon_clearLimitMasks();
     if (eventHash && added_generic_event)
     {
         if (eventHash[perfmon_numArchEvents-1].limit)
@@ -2251,6 +2682,84 @@ perfmon_finalize(void)
     return;
 }
 
+/* Variables of the metric formulas besides the counter names. In the
+ * variable array of the compiled formulas they follow the counters of the
+ * group. */
+typedef enum {
+    METRIC_VAR_TIME = 0,
+    METRIC_VAR_INVERSECLOCK,
+    METRIC_VAR_TRUE,
+    METRIC_VAR_FALSE,
+    METRIC_VAR_NUMADOMAINS,
+    METRIC_VAR_SOCKETS,
+    NUM_METRIC_VARS
+} PerfmonMetricVar;
+
+static char* metricVarNames[NUM_METRIC_VARS] = {
+    "time",
+    "inverseClock",
+    "true",
+    "false",
+    "num_numadomains",
+    "num_sockets",
+};
+
+static void
+perfmon_compileMetrics(PerfmonEventSet* eventSet)
+{
+    int i = 0;
+    int numVars = eventSet->numberOfEvents + NUM_METRIC_VARS;
+    char** names = NULL;
+    eventSet->numMetricExprs = 0;
+    eventSet->metricExprs = NULL;
+    if (eventSet->group.nmetrics == 0)
+    {
+        return;
+    }
+    names = malloc(numVars * sizeof(char*));
+    eventSet->metricExprs = calloc(eventSet->group.nmetrics, sizeof(CalcExpr*));
+    if ((!names) || (!eventSet->metricExprs))
+    {
+        free(names);
+        free(eventSet->metricExprs);
+        eventSet->metricExprs = NULL;
+        return;
+    }
+    for (i = 0; i < eventSet->numberOfEvents; i++)
+    {
+        names[i] = eventSet->group.counters[i];
+    }
+    for (i = 0; i < NUM_METRIC_VARS; i++)
+    {
+        names[eventSet->numberOfEvents + i] = metricVarNames[i];
+    }
+    for (i = 0; i < eventSet->group.nmetrics; i++)
+    {
+        if (calculate_compile(eventSet->group.metricformulas[i], numVars, names, &eventSet->metricExprs[i]) < 0)
+        {
+            DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot compile formula %s. Using string substitution, eventSet->group.metricformulas[i]);
+        }
+    }
+    eventSet->numMetricExprs = eventSet->group.nmetrics;
+    free(names);
+}
+
+static void
+perfmon_freeMetrics(PerfmonEventSet* eventSet)
+{
+    int i = 0;
+    if (eventSet->metricExprs)
+    {
+        for (i = 0; i < eventSet->numMetricExprs; i++)
+        {
+            calculate_free(eventSet->metricExprs[i]);
+        }
+        free(eventSet->metricExprs);
+        eventSet->metricExprs = NULL;
+    }
+    eventSet->numMetricExprs = 0;
+}
+
 int
 perfmon_addEventSet(const char* eventCString)
 {
@@ -2305,6 +2814,9 @@ perfmon_addEventSet(const char* eventCString)
         groupSet->groups[0].rdtscTime = 0;
         groupSet->groups[0].runTime = 0;
         groupSet->groups[0].numberOfEvents = 0;
+        groupSet->groups[0].numMetricExprs = 0;
+        groupSet->groups[0].metricExprs = NULL;
+        groupSet->groups[0].threadTimes = NULL;
     }
 
     if ((groupSet->numberOfActiveGroups > 0) && (groupSet->numberOfActiveGroups == groupSet->numberOfGroups))
@@ -2319,6 +2831,9 @@ perfmon_addEventSet(const char* eventCString)
         groupSet->groups[groupSet->numberOfActiveGroups].rdtscTime = 0;
         groupSet->groups[groupSet->numberOfActiveGroups].runTime = 0;
         groupSet->groups[groupSet->numberOfActiveGroups].numberOfEvents = 0;
+        groupSet->groups[groupSet->numberOfActiveGroups].numMetricExprs = 0;
+        groupSet->groups[groupSet->numberOfActiveGroups].metricExprs = NULL;
+        groupSet->groups[groupSet->numberOfActiveGroups].threadTimes = NULL;
         DEBUG_PLAIN_PRINT(DEBUGLEV_INFO, Allocating new group structure for group.);
     }
     DEBUG_PRINT(DEBUGLEV_INFO, Currently %d groups of %d active,
@@ -2498,6 +3013,7 @@ past_checks:
                 event->threadCounter[j].fullResult = 0.0;
                 event->threadCounter[j].lastResult = 0.0;
                 event->threadCounter[j].overflows = 0;
+                event->threadCounter[j].quality = 1.0;
                 event->threadCounter[j].init = FALSE;
             }
 
@@ -2532,6 +3048,8 @@ past_checks:
         (eventSet->regTypeMask4 != 0x0ULL)))
     {
         eventSet->state = STATE_NONE;
+        perfmon_compileMetrics(eventSet);
+        eventSet->threadTimes = calloc(groupSet->numberOfThreads, sizeof(PerfmonThreadTime));
         groupSet->numberOfActiveGroups++;
         return groupSet->numberOfActiveGroups-1;
     }
@@ -2557,10 +3075,91 @@ perfmon_delEventSet(int groupID)
 {
     if (groupID >= groupSet->numberOfGroups || groupID < 0)
         return;
+    perfmon_freeMetrics(&groupSet->groups[groupID]);
+    if (groupSet->groups[groupID].threadTimes)
+    {
+        free(groupSet->groups[groupID].threadTimes);
+        groupSet->groups[groupID].threadTimes = NULL;
+    }
     perfgroup_returnGroup(&groupSet->groups[groupID].group);
     return;
 }
 
+#ifdef LIKWID_USE_PERFEVENT
+/* The perf_event setup of a CPU consists of many perf_event_open calls. The
+ * CPUs are set up by a small pool of threads, the number can be changed with
+ * LIKWID_SETUP_THREADS (1 sets up the CPUs serially). */
+#define PERFMON_SETUP_MAX_WORKERS 16
+
+typedef struct {
+    int groupId;
+    int next;
+    int ret;
+} PerfmonSetupWork;
+
+static void*
+perfmon_setupCountersWorker(void* arg)
+{
+    PerfmonSetupWork* work = (PerfmonSetupWork*)arg;
+    int i = 0;
+    while ((i = __sync_fetch_and_add(&work->next, 1)) < groupSet->numberOfThreads)
+    {
+        int ret = perfmon_setupCountersThread(groupSet->threads[i].thread_id, &groupSet->groups[work->groupId]);
+        if (ret < 0)
+        {
+            __sync_bool_compare_and_swap(&work->ret, 0, ret);
+        }
+    }
+    return NULL;
+}
+
+static int
+perfmon_setupCountersParallel(int groupId)
+{
+    int numWorkers = PERFMON_SETUP_MAX_WORKERS;
+    int started = 0;
+    pthread_t* workers = NULL;
+    PerfmonSetupWork work = {groupId, 0, 0};
+    char* env = getenv("LIKWID_SETUP_THREADS");
+    if (env != NULL)
+    {
+        numWorkers = atoi(env);
+    }
+    if (numWorkers > groupSet->numberOfThreads)
+    {
+        numWorkers = groupSet->numberOfThreads;
+    }
+    if (numWorkers > 1)
+    {
+        workers = malloc((numWorkers-1) * sizeof(pthread_t));
+    }
+    if (workers != NULL)
+    {
+        for (started = 0; started < numWorkers-1; started++)
+        {
+            if (pthread_create(&workers[started], NULL, perfmon_setupCountersWorker, &work) != 0)
+            {
+                break;
+            }
+        }
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Setup of %d CPUs with %d threads, groupSet->numberOfThreads, started+1);
+    perfmon_setupCountersWorker(&work);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    if (work.ret < 0)
+    {
+        fprintf(stderr, "Setup of counters failed for thread %d\n", (work.ret+1)*-1);
+        return work.ret;
+    }
+    groupSet->activeGroup = groupId;
+    return 0;
+}
+#endif
+
 int
 __perfmon_setupCountersThread(int thread_id, int groupId)
 {
@@ -2610,6 +3209,17 @@ perfmon_setupCounters(int groupId)
         return -ENOENT;
     }
 
+#ifdef LIKWID_USE_PERFEVENT
+    for(i=0;i<groupSet->numberOfThreads && force_setup;i++)
+    {
+        memset(currentConfig[groupSet->threads[i].processorId], 0, NUM_PMC * sizeof(uint64_t));
+    }
+    ret = perfmon_setupCountersParallel(groupId);
+    if (ret != 0)
+    {
+        return ret;
+    }
+#else
     for(i=0;i<groupSet->numberOfThreads;i++)
     {
         if (force_setup)
@@ -2622,10 +3232,38 @@ perfmon_setupCounters(int groupId)
             return ret;
         }
     }
+#endif
     groupSet->groups[groupId].state = STATE_SETUP;
     return 0;
 }
 
+static inline void
+perfmon_startThreadTime(PerfmonEventSet* eventSet, int threadId)
+{
+    if (eventSet->threadTimes)
+    {
+        PerfmonThreadTime* tt = &eventSet->threadTimes[threadId];
+        timer_start(&tt->timer);
+        tt->timer.stop = tt->timer.start;
+    }
+}
+
+/* The interval of a read starts at the previous read of the thread, so the
+ * intervals of a thread are contiguous even if the threads are read one
+ * after the other */
+static inline void
+perfmon_readThreadTime(PerfmonEventSet* eventSet, int threadId)
+{
+    if (eventSet->threadTimes)
+    {
+        PerfmonThreadTime* tt = &eventSet->threadTimes[threadId];
+        tt->timer.start = tt->timer.stop;
+        timer_stop(&tt->timer);
+        tt->lastTime = timer_print(&tt->timer);
+        tt->runTime += tt->lastTime;
+    }
+}
+
 int
 __perfmon_startCounters(int groupId)
 {
@@ -2649,6 +3287,7 @@ __perfmon_startCounters(int groupId)
         {
             return -groupSet->threads[i].thread_id-1;
         }
+        perfmon_startThreadTime(&groupSet->groups[groupId], i);
     }
     groupSet->groups[groupId].state = STATE_START;
     timer_start(&groupSet->groups[groupId].timer);
@@ -2721,6 +3360,7 @@ __perfmon_stopCounters(int groupId)
         {
             return -groupSet->threads[i].thread_id-1;
         }
+        perfmon_readThreadTime(&groupSet->groups[groupId], i);
     }
 
     for (i=0; i<perfmon_getNumberOfEvents(groupId); i++)
@@ -2791,6 +3431,273 @@ perfmon_stopGroupCounters(int groupId)
     return __perfmon_stopCounters(groupId);
 }
 
+static int
+perfmon_readCountersResults(int groupId, int threadId)
+{
+    int j = 0;
+    double result = 0.0;
+    int ret = perfmon_readCountersThread(threadId, &groupSet->groups[groupId]);
+    perfmon_readThreadTime(&groupSet->groups[groupId], threadId);
+    HPMprefetchClear(groupSet->threads[threadId].processorId);
+    if (ret)
+    {
+        return -threadId-1;
+    }
+    for (j=0; j < groupSet->groups[groupId].numberOfEvents; j++)
+    {
+        if (groupSet->groups[groupId].events[j].type != NOTYPE)
+        {
+            result = (double)calculateResult(groupId, j, threadId);
+            groupSet->groups[groupId].events[j].threadCounter[threadId].lastResult = result;
+            groupSet->groups[groupId].events[j].threadCounter[threadId].fullResult += result;
+            groupSet->groups[groupId].events[j].threadCounter[threadId].startData =
+                groupSet->groups[groupId].events[j].threadCounter[threadId].counterData;
+        }
+    }
+    return 0;
+}
+
+/* Optional pool of reader threads for perfmon_readCounters, enabled with
+ * LIKWID_READ_THREADS=1. Each CPU socket gets a worker that is pinned to the
+ * measured hardware threads of the socket and reads them, so the register
+ * accesses stay local and all sockets are read at the same time. The workers
+ * wait on a barrier until the next read. The wakeup from the barrier differs
+ * per worker, with LIKWID_READ_DEADLINE=<usec> the workers spin until a
+ * common deadline after the release and start reading at the same TSC. */
+typedef struct {
+    pthread_t thread;
+    int numThreads;
+    int* threadIds;
+    cpu_set_t cpuset;
+    int ret;
+} PerfmonReader;
+
+typedef struct {
+    int numReaders;
+    PerfmonReader* readers;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    pthread_mutex_t lock;
+    int groupId;
+    int stop;
+    double deadline;
+    TimerData release;
+} PerfmonReaderPool;
+
+static PerfmonReaderPool* readerPool = NULL;
+static int readerPoolDisabled = 0;
+
+static void*
+perfmon_readerMain(void* arg)
+{
+    PerfmonReader* reader = (PerfmonReader*)arg;
+    int stop = 0;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &reader->cpuset);
+    /* Wait until all readers are created and the barriers are initialized */
+    pthread_mutex_lock(&readerPool->lock);
+    stop = readerPool->stop;
+    pthread_mutex_unlock(&readerPool->lock);
+    if (stop)
+    {
+        return NULL;
+    }
+    while (1)
+    {
+        pthread_barrier_wait(&readerPool->start);
+        if (readerPool->stop)
+        {
+            break;
+        }
+        if (readerPool->deadline > 0)
+        {
+            TimerData t = readerPool->release;
+            do {
+                timer_stop(&t);
+            } while (timer_print(&t) < readerPool->deadline);
+        }
+        reader->ret = 0;
+        for (int i = 0; i < reader->numThreads; i++)
+        {
+            int ret = perfmon_readCountersResults(readerPool->groupId, reader->threadIds[i]);
+            if (ret && !reader->ret)
+            {
+                reader->ret = ret;
+            }
+        }
+        pthread_barrier_wait(&readerPool->done);
+    }
+    return NULL;
+}
+
+static void
+perfmon_stopReaderPool(void)
+{
+    if (readerPool)
+    {
+        readerPool->stop = 1;
+        pthread_barrier_wait(&readerPool->start);
+        for (int i = 0; i < readerPool->numReaders; i++)
+        {
+            pthread_join(readerPool->readers[i].thread, NULL);
+            free(readerPool->readers[i].threadIds);
+        }
+        pthread_barrier_destroy(&readerPool->start);
+        pthread_barrier_destroy(&readerPool->done);
+        pthread_mutex_destroy(&readerPool->lock);
+        free(readerPool->readers);
+        free(readerPool);
+        readerPool = NULL;
+    }
+    readerPoolDisabled = 0;
+}
+
+static int
+perfmon_startReaderPool(void)
+{
+    int i = 0, j = 0, started = 0;
+    int numSockets = cpuid_topology.numSockets;
+    PerfmonReaderPool* pool = NULL;
+    char* env = getenv("LIKWID_READ_THREADS");
+    if ((env == NULL) || (atoi(env) <= 0) || (numSockets <= 0))
+    {
+        return -EINVAL;
+    }
+    /* Every other thread than the main thread would start its own access
+     * daemons at its first read. With the shared daemon, the readers use the
+     * worker connections of their socket. */
+    if ((config.daemonMode == ACCESSMODE_DAEMON) &&
+        ((getenv("LIKWID_ACCESS_SHARED_DAEMON") == NULL) || (atoi(getenv("LIKWID_ACCESS_SHARED_DAEMON")) <= 0)))
+    {
+        DEBUG_PRINT(DEBUGLEV_INFO, LIKWID_READ_THREADS requires LIKWID_ACCESS_SHARED_DAEMON=1 with the access daemon);
+        return -EINVAL;
+    }
+    pool = calloc(1, sizeof(PerfmonReaderPool));
+    if (!pool)
+    {
+        return -ENOMEM;
+    }
+    pool->readers = calloc(numSockets, sizeof(PerfmonReader));
+    if (!pool->readers)
+    {
+        free(pool);
+        return -ENOMEM;
+    }
+    for (i = 0; i < numSockets; i++)
+    {
+        PerfmonReader* reader = &pool->readers[pool->numReaders];
+        CPU_ZERO(&reader->cpuset);
+        for (j = 0; j < groupSet->numberOfThreads; j++)
+        {
+            int cpu = groupSet->threads[j].processorId;
+            if (affinity_thread2socket_lookup[cpu] != i)
+            {
+                continue;
+            }
+            if (!reader->threadIds)
+            {
+                reader->threadIds = malloc(groupSet->numberOfThreads * sizeof(int));
+                if (!reader->threadIds)
+                {
+                    break;
+                }
+            }
+            reader->threadIds[reader->numThreads++] = j;
+            CPU_SET(cpu, &reader->cpuset);
+        }
+        if (reader->numThreads > 0)
+        {
+            pool->numReaders++;
+        }
+    }
+    /* Every measured thread needs a reader */
+    for (i = 0, j = 0; i < pool->numReaders; i++)
+    {
+        j += pool->readers[i].numThreads;
+    }
+    if ((j != groupSet->numberOfThreads) || (pool->numReaders < 2))
+    {
+        for (i = 0; i < numSockets; i++)
+        {
+            free(pool->readers[i].threadIds);
+        }
+        free(pool->readers);
+        free(pool);
+        return -EINVAL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_mutex_lock(&pool->lock);
+    readerPool = pool;
+    for (started = 0; started < pool->numReaders; started++)
+    {
+        if (pthread_create(&pool->readers[started].thread, NULL, perfmon_readerMain, &pool->readers[started]) != 0)
+        {
+            break;
+        }
+    }
+    if (started < pool->numReaders)
+    {
+        pool->stop = 1;
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 0; i < started; i++)
+        {
+            pthread_join(pool->readers[i].thread, NULL);
+        }
+        for (i = 0; i < numSockets; i++)
+        {
+            free(pool->readers[i].threadIds);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->readers);
+        free(pool);
+        readerPool = NULL;
+        return -EAGAIN;
+    }
+    pthread_barrier_init(&pool->start, NULL, pool->numReaders + 1);
+    pthread_barrier_init(&pool->done, NULL, pool->numReaders + 1);
+    pthread_mutex_unlock(&pool->lock);
+    env = getenv("LIKWID_READ_DEADLINE");
+    if (env != NULL)
+    {
+        pool->deadline = atof(env) * 1E-6;
+    }
+    DEBUG_PRINT(DEBUGLEV_DEVELOP, Reading counters with %d threads, pool->numReaders);
+    return 0;
+}
+
+/* Returns 1 if no reader pool is available and the caller has to read the
+ * threads itself */
+static int
+perfmon_readCountersPool(int groupId)
+{
+    int ret = 0;
+    if ((!readerPool) && (!readerPoolDisabled))
+    {
+        if (perfmon_startReaderPool() < 0)
+        {
+            readerPoolDisabled = 1;
+        }
+    }
+    if (!readerPool)
+    {
+        return 1;
+    }
+    readerPool->groupId = groupId;
+    if (readerPool->deadline > 0)
+    {
+        timer_start(&readerPool->release);
+    }
+    pthread_barrier_wait(&readerPool->start);
+    pthread_barrier_wait(&readerPool->done);
+    for (int i = 0; i < readerPool->numReaders; i++)
+    {
+        if (readerPool->readers[i].ret && (!ret || readerPool->readers[i].ret > ret))
+        {
+            ret = readerPool->readers[i].ret;
+        }
+    }
+    return ret;
+}
+
 int
 __perfmon_readCounters(int groupId, int threadId)
 {
@@ -2815,29 +3722,26 @@ __perfmon_readCounters(int groupId, int threadId)
     groupSet->groups[groupId].runTime += groupSet->groups[groupId].rdtscTime;
     if (threadId == -1)
     {
-        for (threadId = 0; threadId<groupSet->numberOfThreads; threadId++)
+        ret = perfmon_readCountersPool(groupId);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        for (threadId = 0; ret > 0 && threadId<groupSet->numberOfThreads; threadId++)
         {
-            ret = perfmon_readCountersThread(threadId, &groupSet->groups[groupId]);
+            ret = perfmon_readCountersResults(groupId, threadId);
             if (ret)
             {
-                return -threadId-1;
-            }
-            for (j=0; j < groupSet->groups[groupId].numberOfEvents; j++)
-            {
-                if (groupSet->groups[groupId].events[j].type != NOTYPE)
-                {
-                    result = (double)calculateResult(groupId, j, threadId);
-                    groupSet->groups[groupId].events[j].threadCounter[threadId].lastResult = result;
-                    groupSet->groups[groupId].events[j].threadCounter[threadId].fullResult += result;
-                    groupSet->groups[groupId].events[j].threadCounter[threadId].startData =
-                        groupSet->groups[groupId].events[j].threadCounter[threadId].counterData;
-                }
+                return ret;
             }
+            ret = 1;
         }
     }
     else if ((threadId >= 0) && (threadId < groupSet->numberOfThreads))
     {
         ret = perfmon_readCountersThread(threadId, &groupSet->groups[groupId]);
+        perfmon_readThreadTime(&groupSet->groups[groupId], threadId);
+        HPMprefetchClear(groupSet->threads[threadId].processorId);
         if (ret)
         {
             return -threadId-1;
@@ -3018,11 +3922,8 @@ perfmon_getLastResult(int groupId, int eventId, int threadId)
 }
 
 double
-perfmon_getMetric(int groupId, int metricId, int threadId)
+perfmon_getResultQuality(int groupId, int eventId, int threadId)
 {
-    int e = 0;
-    double result = 0;
-    CounterList clist;
     if (unlikely(groupSet == NULL))
     {
         return NAN;
@@ -3040,117 +3941,189 @@ perfmon_getMetric(int groupId, int metricId, int threadId)
     {
         groupId = groupSet->activeGroup;
     }
-    if (groupSet->groups[groupId].group.nmetrics == 0)
+    if (eventId >= groupSet->groups[groupId].numberOfEvents)
     {
+        printf("ERROR: EventID greater than defined events\n");
         return NAN;
     }
-    if ((metricId < 0) || (metricId >= groupSet->groups[groupId].group.nmetrics))
+    if (threadId >= groupSet->numberOfThreads)
     {
+        printf("ERROR: ThreadID greater than defined threads\n");
         return NAN;
     }
-    timer_init();
-    init_clist(&clist);
-    for (e=0;e<groupSet->groups[groupId].numberOfEvents;e++)
+    if (groupSet->groups[groupId].events[eventId].type == NOTYPE)
+        return NAN;
+
+    return groupSet->groups[groupId].events[eventId].threadCounter[threadId].quality;
+}
+
+int
+perfmon_setSamplingPeriod(uint64_t period)
+{
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_setSamplingPeriod_perfevent(period);
+#else
+    ERROR_PLAIN_PRINT(Sampling requires ACCESSMODE=perf_event);
+    return -ENOTSUP;
+#endif
+}
+
+void
+perfmon_resetThreadAffinity(void)
+{
+#ifdef LIKWID_USE_PERFEVENT
+    perfmon_resetAffinity_perfevent();
+#endif
+}
+
+int
+perfmon_setCgroup(const char* path)
+{
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_setCgroup_perfevent(path);
+#else
+    ERROR_PLAIN_PRINT(Counting per cgroup requires ACCESSMODE=perf_event);
+    return -ENOTSUP;
+#endif
+}
+
+int
+perfmon_getSamples(int groupId, int eventId, int threadId, PerfmonSample** samples)
+{
+    if (samples == NULL)
     {
-        add_to_clist(&clist,groupSet->groups[groupId].group.counters[e],
-                     perfmon_getResult(groupId, e, threadId));
+        return -EINVAL;
     }
-    add_to_clist(&clist, "time", perfmon_getTimeOfGroup(groupId));
-    add_to_clist(&clist, "inverseClock", 1.0/timer_getCycleClock());
-    add_to_clist(&clist, "true", 1);
-    add_to_clist(&clist, "false", 0);
-    add_to_clist(&clist, "num_numadomains", numa_info.numberOfNodes);
-    int cpu = 0, sock_cpu = 0, err = 0, num_socks = 0;
-    for (e=0; e<groupSet->numberOfThreads; e++)
+    *samples = NULL;
+    if (unlikely(groupSet == NULL))
     {
-        if (groupSet->threads[e].thread_id == threadId)
-        {
-            cpu = groupSet->threads[e].processorId;
-        }
+        return -EINVAL;
     }
-    sock_cpu = socket_lock[affinity_thread2socket_lookup[cpu]];
-    num_socks = cpuid_topology.numSockets;
-    if (cpuid_info.isIntel && cpuid_info.model == SKYLAKEX && cpuid_topology.numDies != cpuid_topology.numSockets)
+    if (perfmon_initialized != 1)
     {
-        sock_cpu = die_lock[affinity_thread2die_lookup[cpu]];
-        num_socks = cpuid_topology.numDies;
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
     }
-    add_to_clist(&clist, "num_sockets", num_socks);
-    if (cpu != sock_cpu)
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
     {
-        for (e=0; e<groupSet->numberOfThreads; e++)
-        {
-            if (groupSet->threads[e].processorId == sock_cpu)
-            {
-                sock_cpu = groupSet->threads[e].thread_id;
-            }
-        }
-        for (e=0;e<groupSet->groups[groupId].numberOfEvents;e++)
-        {
-            if (perfmon_isUncoreCounter(groupSet->groups[groupId].group.counters[e]) &&
-                !perfmon_isUncoreCounter(groupSet->groups[groupId].group.metricformulas[metricId]))
-            {
-                err = update_clist(&clist,groupSet->groups[groupId].group.counters[e], perfmon_getResult(groupId, e, sock_cpu));
-                if (err < 0)
-                {
-                    DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot add socket result of counter %s for thread %d, groupSet->groups[groupId].group.counters[e], threadId);
-                }
-            }
-        }
+        groupId = groupSet->activeGroup;
     }
-    e = calc_metric(groupSet->groups[groupId].group.metricformulas[metricId], &clist, &result);
-    if (e < 0)
+    if (groupId < 0 || groupId >= groupSet->numberOfActiveGroups)
     {
-        result = 0.0;
-        //ERROR_PRINT(Cannot calculate formula %s, groupSet->groups[groupId].group.metricformulas[metricId]);
+        return -EINVAL;
     }
-    destroy_clist(&clist);
-    return result;
+    if (eventId < 0 || eventId >= groupSet->groups[groupId].numberOfEvents)
+    {
+        return -EINVAL;
+    }
+    if (threadId < 0 || threadId >= groupSet->numberOfThreads)
+    {
+        return -EINVAL;
+    }
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_getSamplesThread_perfevent(threadId, &groupSet->groups[groupId], eventId, samples);
+#else
+    return 0;
+#endif
 }
-double
-perfmon_getLastMetric(int groupId, int metricId, int threadId)
+
+int
+perfmon_getNumberOfTasks(int groupId)
 {
-    int e = 0;
-    double result = 0;
-    CounterList clist;
     if (unlikely(groupSet == NULL))
     {
-        return NAN;
+        return -EINVAL;
     }
     if (perfmon_initialized != 1)
     {
         ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
-        return NAN;
-    }
-    if (groupSet->numberOfActiveGroups == 0)
-    {
-        return NAN;
+        return -EINVAL;
     }
     if ((groupId < 0) && (groupSet->activeGroup >= 0))
     {
         groupId = groupSet->activeGroup;
     }
-    if (groupSet->groups[groupId].group.nmetrics == 0)
+    if (groupId < 0 || groupId >= groupSet->numberOfActiveGroups)
     {
-        return NAN;
+        return -EINVAL;
     }
-    if ((metricId < 0) || (metricId >= groupSet->groups[groupId].group.nmetrics))
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_getNumberOfTasks_perfevent(&groupSet->groups[groupId]);
+#else
+    return 0;
+#endif
+}
+
+int
+perfmon_getTaskId(int groupId, int taskId)
+{
+    if (unlikely(groupSet == NULL))
     {
-        return NAN;
+        return -EINVAL;
     }
-    timer_init();
-    init_clist(&clist);
-    for (e=0;e<groupSet->groups[groupId].numberOfEvents;e++)
+    if (perfmon_initialized != 1)
     {
-        add_to_clist(&clist,groupSet->groups[groupId].group.counters[e],
-                     perfmon_getLastResult(groupId, e, threadId));
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
     }
-    add_to_clist(&clist, "time", perfmon_getLastTimeOfGroup(groupId));
-    add_to_clist(&clist, "inverseClock", 1.0/timer_getCycleClock());
-    add_to_clist(&clist, "true", 1);
-    add_to_clist(&clist, "false", 0);
-    add_to_clist(&clist, "num_numadomains", numa_info.numberOfNodes);
-    int cpu = 0, sock_cpu = 0, err = 0, num_socks = 0;
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if (groupId < 0 || groupId >= groupSet->numberOfActiveGroups)
+    {
+        return -EINVAL;
+    }
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_getTaskId_perfevent(&groupSet->groups[groupId], taskId);
+#else
+    return -EINVAL;
+#endif
+}
+
+double
+perfmon_getTaskResult(int groupId, int eventId, int taskId)
+{
+    if (unlikely(groupSet == NULL))
+    {
+        return NAN;
+    }
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return NAN;
+    }
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if (groupId < 0 || groupId >= groupSet->numberOfActiveGroups)
+    {
+        return NAN;
+    }
+    if (eventId < 0 || eventId >= groupSet->groups[groupId].numberOfEvents)
+    {
+        return NAN;
+    }
+#ifdef LIKWID_USE_PERFEVENT
+    return perfmon_getTaskResult_perfevent(&groupSet->groups[groupId], eventId, taskId);
+#else
+    return NAN;
+#endif
+}
+
+/* Fills the variables following the counters and returns the thread that
+ * measured the socket-wide counters for threadId or -1 for threadId itself */
+static int
+perfmon_initMetricVars(int numEvents, int threadId, double time, double* vars)
+{
+    int e = 0;
+    int cpu = 0, sock_cpu = 0, num_socks = 0;
+    vars[numEvents + METRIC_VAR_TIME] = time;
+    vars[numEvents + METRIC_VAR_INVERSECLOCK] = 1.0/timer_getCycleClock();
+    vars[numEvents + METRIC_VAR_TRUE] = 1;
+    vars[numEvents + METRIC_VAR_FALSE] = 0;
+    vars[numEvents + METRIC_VAR_NUMADOMAINS] = numa_info.numberOfNodes;
     for (e=0; e<groupSet->numberOfThreads; e++)
     {
         if (groupSet->threads[e].thread_id == threadId)
@@ -3162,42 +4135,312 @@ perfmon_getLastMetric(int groupId, int metricId, int threadId)
     num_socks = cpuid_topology.numSockets;
     if (cpuid_info.isIntel && cpuid_info.model == SKYLAKEX && cpuid_topology.numDies != cpuid_topology.numSockets)
     {
-        num_socks = cpuid_topology.numDies;
         sock_cpu = die_lock[affinity_thread2die_lookup[cpu]];
+        num_socks = cpuid_topology.numDies;
+    }
+    vars[numEvents + METRIC_VAR_SOCKETS] = num_socks;
+    if (cpu == sock_cpu)
+    {
+        return -1;
+    }
+    for (e=0; e<groupSet->numberOfThreads; e++)
+    {
+        if (groupSet->threads[e].processorId == sock_cpu)
+        {
+            sock_cpu = groupSet->threads[e].thread_id;
+        }
+    }
+    return sock_cpu;
+}
+
+static int
+perfmon_calcMetric(PerfmonEventSet* eventSet, int metricId, double* vars, double* result)
+{
+    int e = 0, err = 0;
+    CounterList clist;
+    if ((metricId < eventSet->numMetricExprs) && (eventSet->metricExprs[metricId] != NULL))
+    {
+        return calculate_eval(eventSet->metricExprs[metricId], vars, result);
+    }
+    /* The formula could not be compiled, substitute the values in the string */
+    init_clist(&clist);
+    for (e=0;e<eventSet->numberOfEvents;e++)
+    {
+        add_to_clist(&clist, eventSet->group.counters[e], vars[e]);
+    }
+    for (e=0;e<NUM_METRIC_VARS;e++)
+    {
+        add_to_clist(&clist, metricVarNames[e], vars[eventSet->numberOfEvents + e]);
     }
-    add_to_clist(&clist, "num_sockets", num_socks);
-    if (cpu != sock_cpu)
+    err = calc_metric(eventSet->group.metricformulas[metricId], &clist, result);
+    destroy_clist(&clist);
+    return err;
+}
+
+double
+perfmon_getMetric(int groupId, int metricId, int threadId)
+{
+    int e = 0;
+    double result = 0;
+    int sock_thread = -1;
+    PerfmonEventSet* eventSet = NULL;
+    if (unlikely(groupSet == NULL))
+    {
+        return NAN;
+    }
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return NAN;
+    }
+    if (groupSet->numberOfActiveGroups == 0)
+    {
+        return NAN;
+    }
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if (groupSet->groups[groupId].group.nmetrics == 0)
+    {
+        return NAN;
+    }
+    if ((metricId < 0) || (metricId >= groupSet->groups[groupId].group.nmetrics))
+    {
+        return NAN;
+    }
+    eventSet = &groupSet->groups[groupId];
+    double vars[eventSet->numberOfEvents + NUM_METRIC_VARS];
+    timer_init();
+    for (e=0;e<eventSet->numberOfEvents;e++)
+    {
+        vars[e] = perfmon_getResult(groupId, e, threadId);
+    }
+    sock_thread = perfmon_initMetricVars(eventSet->numberOfEvents, threadId, perfmon_getTimeOfThread(groupId, threadId), vars);
+    if ((sock_thread >= 0) && (!perfmon_isUncoreCounter(eventSet->group.metricformulas[metricId])))
     {
-        for (e=0; e<groupSet->numberOfThreads; e++)
+        for (e=0;e<eventSet->numberOfEvents;e++)
         {
-            if (groupSet->threads[e].processorId == sock_cpu)
+            if (perfmon_isUncoreCounter(eventSet->group.counters[e]))
             {
-                sock_cpu = groupSet->threads[e].thread_id;
+                vars[e] = perfmon_getResult(groupId, e, sock_thread);
             }
         }
-        for (e=0;e<groupSet->groups[groupId].numberOfEvents;e++)
+    }
+    e = perfmon_calcMetric(eventSet, metricId, vars, &result);
+    if (e < 0)
+    {
+        result = 0.0;
+        //ERROR_PRINT(Cannot calculate formula %s, groupSet->groups[groupId].group.metricformulas[metricId]);
+    }
+    return result;
+}
+double
+perfmon_getLastMetric(int groupId, int metricId, int threadId)
+{
+    int e = 0;
+    double result = 0;
+    int sock_thread = -1;
+    PerfmonEventSet* eventSet = NULL;
+    if (unlikely(groupSet == NULL))
+    {
+        return NAN;
+    }
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return NAN;
+    }
+    if (groupSet->numberOfActiveGroups == 0)
+    {
+        return NAN;
+    }
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if (groupSet->groups[groupId].group.nmetrics == 0)
+    {
+        return NAN;
+    }
+    if ((metricId < 0) || (metricId >= groupSet->groups[groupId].group.nmetrics))
+    {
+        return NAN;
+    }
+    eventSet = &groupSet->groups[groupId];
+    double vars[eventSet->numberOfEvents + NUM_METRIC_VARS];
+    timer_init();
+    for (e=0;e<eventSet->numberOfEvents;e++)
+    {
+        vars[e] = perfmon_getLastResult(groupId, e, threadId);
+    }
+    sock_thread = perfmon_initMetricVars(eventSet->numberOfEvents, threadId, perfmon_getLastTimeOfThread(groupId, threadId), vars);
+    if ((sock_thread >= 0) && (!perfmon_isUncoreCounter(eventSet->group.metricformulas[metricId])))
+    {
+        for (e=0;e<eventSet->numberOfEvents;e++)
         {
-            if (perfmon_isUncoreCounter(groupSet->groups[groupId].group.counters[e]) &&
-                !perfmon_isUncoreCounter(groupSet->groups[groupId].group.metricformulas[metricId]))
+            if (perfmon_isUncoreCounter(eventSet->group.counters[e]))
             {
-                err = update_clist(&clist,groupSet->groups[groupId].group.counters[e], perfmon_getLastResult(groupId, e, sock_cpu));
-                if (err < 0)
-                {
-                    DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot add socket result of counter %s for thread %d, groupSet->groups[groupId].group.counters[e], threadId);
-                }
+                vars[e] = perfmon_getLastResult(groupId, e, sock_thread);
             }
         }
     }
-    e = calc_metric(groupSet->groups[groupId].group.metricformulas[metricId], &clist, &result);
+    e = perfmon_calcMetric(eventSet, metricId, vars, &result);
     if (e < 0)
     {
         result = 0.0;
         //ERROR_PRINT(Cannot calculate formula %s, groupSet->groups[groupId].group.metricformulas[metricId]);
     }
-    destroy_clist(&clist);
     return result;
 }
 
+/* Evaluates all metrics of a group for all threads. The counter results
+ * are collected once per group into a matrix with one row per variable and
+ * one column per thread, and every compiled formula is evaluated for all
+ * columns at once. */
+static int
+perfmon_getMetricsAllOf(int groupId, double* out,
+                        double (*getResult)(int, int, int),
+                        double (*getTime)(int, int))
+{
+    int e = 0, m = 0, t = 0;
+    int numThreads = 0, numVars = 0, needSocket = 0;
+    int* sockThread = NULL;
+    double* vars = NULL;
+    double* sockVars = NULL;
+    double fixed[NUM_METRIC_VARS];
+    PerfmonEventSet* eventSet = NULL;
+    if (unlikely(groupSet == NULL) || (out == NULL))
+    {
+        return -EINVAL;
+    }
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (groupSet->numberOfActiveGroups == 0)
+    {
+        return -EINVAL;
+    }
+    if ((groupId < 0) && (groupSet->activeGroup >= 0))
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if ((groupId < 0) || (groupId >= groupSet->numberOfActiveGroups))
+    {
+        return -EINVAL;
+    }
+    eventSet = &groupSet->groups[groupId];
+    if (eventSet->group.nmetrics == 0)
+    {
+        return 0;
+    }
+    numThreads = groupSet->numberOfThreads;
+    numVars = eventSet->numberOfEvents + NUM_METRIC_VARS;
+    sockThread = malloc(numThreads * sizeof(int));
+    vars = malloc(numVars * numThreads * sizeof(double));
+    sockVars = malloc(numVars * numThreads * sizeof(double));
+    if ((!sockThread) || (!vars) || (!sockVars))
+    {
+        free(sockThread);
+        free(vars);
+        free(sockVars);
+        return -ENOMEM;
+    }
+    timer_init();
+    for (e=0;e<eventSet->numberOfEvents;e++)
+    {
+        for (t=0;t<numThreads;t++)
+        {
+            vars[e*numThreads + t] = getResult(groupId, e, t);
+        }
+    }
+    /* The socket lookup is done once per thread instead of once per metric */
+    for (t=0;t<numThreads;t++)
+    {
+        sockThread[t] = perfmon_initMetricVars(0, t, 0, fixed);
+        if ((sockThread[t] >= 0) && (sockThread[t] < numThreads))
+        {
+            needSocket = 1;
+        }
+        else
+        {
+            sockThread[t] = -1;
+        }
+    }
+    for (e=0;e<NUM_METRIC_VARS;e++)
+    {
+        for (t=0;t<numThreads;t++)
+        {
+            vars[(eventSet->numberOfEvents+e)*numThreads + t] = fixed[e];
+        }
+    }
+    /* Each thread has its own measurement interval */
+    for (t=0;t<numThreads;t++)
+    {
+        vars[(eventSet->numberOfEvents+METRIC_VAR_TIME)*numThreads + t] = getTime(groupId, t);
+    }
+    /* Variant with the socket results for the uncore counters used by all
+     * formulas without uncore counters */
+    memcpy(sockVars, vars, numVars * numThreads * sizeof(double));
+    if (needSocket)
+    {
+        for (e=0;e<eventSet->numberOfEvents;e++)
+        {
+            if (!perfmon_isUncoreCounter(eventSet->group.counters[e]))
+            {
+                continue;
+            }
+            for (t=0;t<numThreads;t++)
+            {
+                if (sockThread[t] >= 0)
+                {
+                    sockVars[e*numThreads + t] = vars[e*numThreads + sockThread[t]];
+                }
+            }
+        }
+    }
+    for (m=0;m<eventSet->group.nmetrics;m++)
+    {
+        double* mvars = (perfmon_isUncoreCounter(eventSet->group.metricformulas[m]) ? vars : sockVars);
+        double* mout = &out[m*numThreads];
+        if ((m < eventSet->numMetricExprs) && (eventSet->metricExprs[m] != NULL) &&
+            (calculate_evalMany(eventSet->metricExprs[m], numThreads, mvars, mout) == 0))
+        {
+            continue;
+        }
+        for (t=0;t<numThreads;t++)
+        {
+            double tvars[numVars];
+            for (e=0;e<numVars;e++)
+            {
+                tvars[e] = mvars[e*numThreads + t];
+            }
+            if (perfmon_calcMetric(eventSet, m, tvars, &mout[t]) < 0)
+            {
+                mout[t] = 0.0;
+            }
+        }
+    }
+    free(sockThread);
+    free(vars);
+    free(sockVars);
+    return 0;
+}
+
+int
+perfmon_getMetricsAll(int groupId, double* out)
+{
+    return perfmon_getMetricsAllOf(groupId, out, perfmon_getResult, perfmon_getTimeOfThread);
+}
+
+int
+perfmon_getLastMetricsAll(int groupId, double* out)
+{
+    return perfmon_getMetricsAllOf(groupId, out, perfmon_getLastResult, perfmon_getLastTimeOfThread);
+}
+
 int
 __perfmon_switchActiveGroupThread(int thread_id, int new_group)
 {
@@ -3346,6 +4589,52 @@ perfmon_getLastTimeOfGroup(int groupId)
     return groupSet->groups[groupId].rdtscTime;
 }
 
+double
+perfmon_getTimeOfThread(int groupId, int threadId)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (groupId < 0)
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if ((threadId < 0) || (threadId >= groupSet->numberOfThreads))
+    {
+        return -EINVAL;
+    }
+    if (!groupSet->groups[groupId].threadTimes)
+    {
+        return groupSet->groups[groupId].runTime;
+    }
+    return groupSet->groups[groupId].threadTimes[threadId].runTime;
+}
+
+double
+perfmon_getLastTimeOfThread(int groupId, int threadId)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (groupId < 0)
+    {
+        groupId = groupSet->activeGroup;
+    }
+    if ((threadId < 0) || (threadId >= groupSet->numberOfThreads))
+    {
+        return -EINVAL;
+    }
+    if (!groupSet->groups[groupId].threadTimes)
+    {
+        return groupSet->groups[groupId].rdtscTime;
+    }
+    return groupSet->groups[groupId].threadTimes[threadId].lastTime;
+}
+
 uint64_t
 perfmon_getMaxCounterValue(RegisterType type)
 {
@@ -3609,262 +4898,810 @@ perfmon_getTagOfRegion(int region)
     {
         return NULL;
     }
-    if (markerResults == NULL)
+    if (markerResults == NULL)
+    {
+        return NULL;
+    }
+    return bdata(markerResults[region].tag);
+}
+
+int
+perfmon_getEventsOfRegion(int region)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL)
+    {
+        return 0;
+    }
+    return markerResults[region].eventCount;
+}
+
+int
+perfmon_getMetricsOfRegion(int region)
+{
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL)
+    {
+        return 0;
+    }
+    return perfmon_getNumberOfMetrics(markerResults[region].groupID);
+}
+
+int
+perfmon_getThreadsOfRegion(int region)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL)
+    {
+        return 0;
+    }
+    return markerResults[region].threadCount;
+}
+
+int
+perfmon_getCpulistOfRegion(int region, int count, int* cpulist)
+{
+    int i;
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL)
+    {
+        return 0;
+    }
+    if (cpulist == NULL)
+    {
+        return -EINVAL;
+    }
+    for (i=0; i< MIN(count, markerResults[region].threadCount); i++)
+    {
+        cpulist[i] = markerResults[region].cpulist[i];
+    }
+    return MIN(count, markerResults[region].threadCount);
+}
+
+double
+perfmon_getTimeOfRegion(int region, int thread)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (thread < 0 || thread >= groupSet->numberOfThreads)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL || markerResults[region].time == NULL)
+    {
+        return 0.0;
+    }
+    return markerResults[region].time[thread];
+}
+
+int
+perfmon_getCountOfRegion(int region, int thread)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (thread < 0 || thread >= groupSet->numberOfThreads)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL || markerResults[region].count == NULL)
+    {
+        return 0.0;
+    }
+    return markerResults[region].count[thread];
+}
+
+double
+perfmon_getResultOfRegionThread(int region, int event, int thread)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return -EINVAL;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return -EINVAL;
+    }
+    if (markerResults == NULL)
+    {
+        return 0;
+    }
+    if (thread < 0 || thread >= markerResults[region].threadCount)
+    {
+        return -EINVAL;
+    }
+    if (event < 0 || event >= markerResults[region].eventCount)
+    {
+        return -EINVAL;
+    }
+    if (markerResults[region].counters[thread] == NULL)
+    {
+        return 0.0;
+    }
+    return markerResults[region].counters[thread][event];
+}
+
+/* Values used for the metrics of a region */
+#define REGION_VALUES_INCLUSIVE 0
+#define REGION_VALUES_EXCLUSIVE 1
+#define REGION_VALUES_UNCORRECTED 2
+
+static double
+getRegionResult(int region, int event, int thread, int mode)
+{
+    switch (mode)
+    {
+        case REGION_VALUES_EXCLUSIVE:
+            return perfmon_getExclusiveResultOfRegionThread(region, event, thread);
+        case REGION_VALUES_UNCORRECTED:
+            return perfmon_getResultOfRegionThread(region, event, thread) +
+                   perfmon_getOverheadOfRegionThread(region, event, thread);
+        default:
+            return perfmon_getResultOfRegionThread(region, event, thread);
+    }
+}
+
+static double
+getRegionTime(int region, int thread, int mode)
+{
+    switch (mode)
+    {
+        case REGION_VALUES_EXCLUSIVE:
+            return perfmon_getExclusiveTimeOfRegion(region, thread);
+        case REGION_VALUES_UNCORRECTED:
+            return perfmon_getTimeOfRegion(region, thread) +
+                   perfmon_getOverheadOfRegionThread(region, -1, thread);
+        default:
+            return perfmon_getTimeOfRegion(region, thread);
+    }
+}
+
+static double
+getMetricOfRegionThread(int region, int metricId, int threadId, int mode)
+{
+    int e = 0, err = 0;
+    double result = 0.0;
+    int sock_thread = -1;
+    PerfmonEventSet* eventSet = NULL;
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return NAN;
+    }
+    if (region < 0 || region >= markerRegions)
+    {
+        return NAN;
+    }
+    if (markerResults == NULL)
+    {
+        return NAN;
+    }
+    if (threadId < 0 || threadId >= markerResults[region].threadCount)
+    {
+        return NAN;
+    }
+    if (metricId < 0 || metricId >= groupSet->groups[markerResults[region].groupID].group.nmetrics)
+    {
+        return NAN;
+    }
+    eventSet = &groupSet->groups[markerResults[region].groupID];
+    double vars[eventSet->numberOfEvents + NUM_METRIC_VARS];
+    timer_init();
+    for (e=0;e<eventSet->numberOfEvents;e++)
+    {
+        vars[e] = (e < markerResults[region].eventCount ? getRegionResult(region, e, threadId, mode) : 0.0);
+    }
+    sock_thread = perfmon_initMetricVars(eventSet->numberOfEvents, threadId, getRegionTime(region, threadId, mode), vars);
+    if ((sock_thread >= 0) && (!perfmon_isUncoreCounter(eventSet->group.metricformulas[metricId])))
+    {
+        for (e=0;e<markerResults[region].eventCount && e<eventSet->numberOfEvents;e++)
+        {
+            if (perfmon_isUncoreCounter(eventSet->group.counters[e]))
+            {
+                vars[e] = getRegionResult(region, e, sock_thread, mode);
+            }
+        }
+    }
+    err = perfmon_calcMetric(eventSet, metricId, vars, &result);
+    if (err < 0)
+    {
+        ERROR_PRINT(Cannot calculate formula %s, eventSet->group.metricformulas[metricId]);
+    }
+    return result;
+}
+
+double
+perfmon_getMetricOfRegionThread(int region, int metricId, int threadId)
+{
+    return getMetricOfRegionThread(region, metricId, threadId, REGION_VALUES_INCLUSIVE);
+}
+
+double
+perfmon_getExclusiveMetricOfRegionThread(int region, int metricId, int threadId)
+{
+    return getMetricOfRegionThread(region, metricId, threadId, REGION_VALUES_EXCLUSIVE);
+}
+
+double
+perfmon_getUncorrectedMetricOfRegionThread(int region, int metricId, int threadId)
+{
+    return getMetricOfRegionThread(region, metricId, threadId, REGION_VALUES_UNCORRECTED);
+}
+
+double
+perfmon_getOverheadOfRegionThread(int region, int event, int thread)
+{
+    if (perfmon_initialized != 1)
+    {
+        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
+        return NAN;
+    }
+    if (region < 0 || region >= markerRegions || markerResults == NULL)
+    {
+        return NAN;
+    }
+    if (thread < 0 || thread >= markerResults[region].threadCount)
+    {
+        return NAN;
+    }
+    if (event < -1 || event >= markerResults[region].eventCount)
+    {
+        return NAN;
+    }
+    if (markerResults[region].overheads == NULL || markerResults[region].overheads[thread] == NULL)
     {
-        return NULL;
+        return 0.0;
     }
-    return bdata(markerResults[region].tag);
+    return markerResults[region].overheads[thread][event + 1];
 }
 
 int
-perfmon_getEventsOfRegion(int region)
+perfmon_getParentOfRegion(int region)
 {
     if (perfmon_initialized != 1)
     {
         ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return -EINVAL;
     }
-    if (region < 0 || region >= markerRegions)
+    if (region < 0 || region >= markerRegions || markerResults == NULL)
     {
         return -EINVAL;
     }
-    if (markerResults == NULL)
+    return markerResults[region].parent;
+}
+
+double
+perfmon_getExclusiveTimeOfRegion(int region, int thread)
+{
+    double time = perfmon_getTimeOfRegion(region, thread);
+    if (time <= 0 || markerResults == NULL || markerResults[region].children == NULL ||
+        thread >= markerResults[region].threadCount || markerResults[region].children[thread] == NULL)
     {
-        return 0;
+        return time;
     }
-    return markerResults[region].eventCount;
+    return MAX(time - markerResults[region].children[thread][0], 0.0);
 }
 
-int
-perfmon_getMetricsOfRegion(int region)
+double
+perfmon_getExclusiveResultOfRegionThread(int region, int event, int thread)
 {
-    if (region < 0 || region >= markerRegions)
+    double result = perfmon_getResultOfRegionThread(region, event, thread);
+    if (result < 0 || markerResults == NULL || markerResults[region].children == NULL ||
+        markerResults[region].children[thread] == NULL)
     {
-        return -EINVAL;
+        return result;
     }
-    if (markerResults == NULL)
+    /* Only counters that are summed up over the calls contain the nested regions */
+    int index = groupSet->groups[markerResults[region].groupID].events[event].index;
+    if ((counter_map[index].type == THERMAL) ||
+        (counter_map[index].type == VOLTAGE) ||
+        (counter_map[index].type == MBOX0TMP))
     {
-        return 0;
+        return result;
     }
-    return perfmon_getNumberOfMetrics(markerResults[region].groupID);
+    return MAX(result - markerResults[region].children[thread][event + 1], 0.0);
 }
 
-int
-perfmon_getThreadsOfRegion(int region)
+/* Reads the sums of nested regions (C) and the subtracted overheads (O) */
+static int
+readMarkerThreadValues(char* buf, int* regionCPUs, int regions, int cpus)
 {
-    if (perfmon_initialized != 1)
+    int regionid = 0, cpu = 0, nevents = 0, offset = 0;
+    int cpuidx = -1;
+    char* ptr = NULL;
+    LikwidResults* res = NULL;
+    double*** values = NULL;
+    if (sscanf(buf, "%*c %d %d %d %n", &regionid, &cpu, &nevents, &offset) != 3)
     {
-        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return -EINVAL;
     }
-    if (region < 0 || region >= markerRegions)
+    if (regionid < 0 || regionid >= regions)
     {
         return -EINVAL;
     }
-    if (markerResults == NULL)
+    res = &markerResults[regionid];
+    for (int i = 0; i < regionCPUs[regionid]; i++)
     {
-        return 0;
+        if (res->cpulist[i] == cpu)
+        {
+            cpuidx = i;
+        }
     }
-    return markerResults[region].threadCount;
+    if (cpuidx < 0 || nevents != res->eventCount)
+    {
+        return -EINVAL;
+    }
+    values = (buf[0] == 'C' ? &res->children : &res->overheads);
+    if (*values == NULL)
+    {
+        *values = calloc(cpus, sizeof(double*));
+        if (*values == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    if ((*values)[cpuidx] == NULL)
+    {
+        (*values)[cpuidx] = calloc(nevents + 1, sizeof(double));
+        if ((*values)[cpuidx] == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    ptr = strtok(buf + offset, " \n");
+    for (int k = 0; k <= nevents && ptr != NULL; k++)
+    {
+        sscanf(ptr, "%lf", &(*values)[cpuidx][k]);
+        ptr = strtok(NULL, " \n");
+    }
+    return 0;
 }
 
-int
-perfmon_getCpulistOfRegion(int region, int count, int* cpulist)
+static int
+readMarkerSamples(char* buf, int* regionCPUs, int regions, int cpus)
 {
-    int i;
-    if (perfmon_initialized != 1)
+    int regionid = 0, cpu = 0, nevents = 0, offset = 0;
+    unsigned int sampled = 0;
+    int cpuidx = -1;
+    char* ptr = NULL;
+    LikwidResults* res = NULL;
+    if (sscanf(buf, "S %d %d %u %d %n", &regionid, &cpu, &sampled, &nevents, &offset) != 4)
     {
-        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return -EINVAL;
     }
-    if (region < 0 || region >= markerRegions)
+    if (regionid < 0 || regionid >= regions)
     {
         return -EINVAL;
     }
-    if (markerResults == NULL)
+    res = &markerResults[regionid];
+    for (int i = 0; i < regionCPUs[regionid]; i++)
     {
-        return 0;
+        if (res->cpulist[i] == cpu)
+        {
+            cpuidx = i;
+        }
     }
-    if (cpulist == NULL)
+    if (cpuidx < 0 || nevents != res->eventCount)
     {
         return -EINVAL;
     }
-    for (i=0; i< MIN(count, markerResults[region].threadCount); i++)
+    if (res->sampled == NULL)
     {
-        cpulist[i] = markerResults[region].cpulist[i];
+        res->sampled = malloc(cpus * sizeof(uint32_t));
+        res->errors = calloc(cpus, sizeof(double*));
+        if (!res->sampled || !res->errors)
+        {
+            free(res->sampled);
+            free(res->errors);
+            res->sampled = NULL;
+            res->errors = NULL;
+            return -ENOMEM;
+        }
+        /* Marks threads without a sampling line, they measured all calls */
+        for (int i = 0; i < cpus; i++)
+        {
+            res->sampled[i] = UINT32_MAX;
+        }
     }
-    return MIN(count, markerResults[region].threadCount);
+    if (res->errors[cpuidx] == NULL)
+    {
+        res->errors[cpuidx] = calloc(nevents + 1, sizeof(double));
+        if (res->errors[cpuidx] == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    res->sampled[cpuidx] = sampled;
+    ptr = strtok(buf + offset, " \n");
+    for (int k = 0; k <= nevents && ptr != NULL; k++)
+    {
+        sscanf(ptr, "%lf", &res->errors[cpuidx][k]);
+        ptr = strtok(NULL, " \n");
+    }
+    return 0;
 }
 
-double
-perfmon_getTimeOfRegion(int region, int thread)
+static int
+readMarkerHistogram(char* buf, int* regionCPUs, int regions, int cpus)
 {
-    if (perfmon_initialized != 1)
+    int regionid = 0, cpu = 0, event = 0, offset = 0;
+    int cpuidx = -1;
+    char* ptr = NULL;
+    LikwidResults* res = NULL;
+    if (sscanf(buf, "H %d %d %d %n", &regionid, &cpu, &event, &offset) != 3)
     {
-        ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return -EINVAL;
     }
-    if (region < 0 || region >= markerRegions)
+    if (regionid < 0 || regionid >= regions)
     {
         return -EINVAL;
     }
-    if (thread < 0 || thread >= groupSet->numberOfThreads)
+    res = &markerResults[regionid];
+    for (int i = 0; i < regionCPUs[regionid]; i++)
+    {
+        if (res->cpulist[i] == cpu)
+        {
+            cpuidx = i;
+        }
+    }
+    if (cpuidx < 0 || event < -1 || event >= res->eventCount)
     {
         return -EINVAL;
     }
-    if (markerResults == NULL || markerResults[region].time == NULL)
+    if (res->histograms == NULL)
     {
-        return 0.0;
+        res->histCount = res->eventCount + 1;
+        res->histEvents = malloc(res->histCount * sizeof(int));
+        res->histograms = calloc(cpus * res->histCount, sizeof(uint32_t*));
+        if (!res->histEvents || !res->histograms)
+        {
+            free(res->histEvents);
+            free(res->histograms);
+            res->histEvents = NULL;
+            res->histograms = NULL;
+            res->histCount = 0;
+            return -ENOMEM;
+        }
+        for (int h = 0; h < res->histCount; h++)
+        {
+            res->histEvents[h] = h - 1;
+        }
     }
-    return markerResults[region].time[thread];
+    uint32_t** buckets = &res->histograms[(cpuidx * res->histCount) + event + 1];
+    if (*buckets == NULL)
+    {
+        *buckets = calloc(HISTOGRAM_BUCKETS, sizeof(uint32_t));
+        if (*buckets == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+    ptr = strtok(buf + offset, " \n");
+    while (ptr != NULL)
+    {
+        uint32_t b = 0, c = 0;
+        if (sscanf(ptr, "%u,%u", &b, &c) == 2 && b < HISTOGRAM_BUCKETS)
+        {
+            (*buckets)[b] += c;
+        }
+        ptr = strtok(NULL, " \n");
+    }
+    return 0;
 }
 
 int
-perfmon_getCountOfRegion(int region, int thread)
+perfmon_getSampledCountOfRegion(int region, int thread)
 {
     if (perfmon_initialized != 1)
     {
         ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return -EINVAL;
     }
-    if (region < 0 || region >= markerRegions)
+    if (region < 0 || region >= markerRegions || markerResults == NULL)
     {
         return -EINVAL;
     }
-    if (thread < 0 || thread >= groupSet->numberOfThreads)
+    if (thread < 0 || thread >= markerResults[region].threadCount)
     {
         return -EINVAL;
     }
-    if (markerResults == NULL || markerResults[region].count == NULL)
+    if (markerResults[region].sampled == NULL)
     {
-        return 0.0;
+        return markerResults[region].count[thread];
     }
-    return markerResults[region].count[thread];
+    return markerResults[region].sampled[thread];
 }
 
 double
-perfmon_getResultOfRegionThread(int region, int event, int thread)
+perfmon_getErrorOfRegionThread(int region, int event, int thread)
 {
     if (perfmon_initialized != 1)
     {
         ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
-        return -EINVAL;
-    }
-    if (region < 0 || region >= markerRegions)
-    {
-        return -EINVAL;
+        return NAN;
     }
-    if (markerResults == NULL)
+    if (region < 0 || region >= markerRegions || markerResults == NULL)
     {
-        return 0;
+        return NAN;
     }
     if (thread < 0 || thread >= markerResults[region].threadCount)
     {
-        return -EINVAL;
+        return NAN;
     }
-    if (event < 0 || event >= markerResults[region].eventCount)
+    if (event < -1 || event >= markerResults[region].eventCount)
     {
-        return -EINVAL;
+        return NAN;
     }
-    if (markerResults[region].counters[thread] == NULL)
+    if (markerResults[region].sampled == NULL || markerResults[region].errors[thread] == NULL)
     {
         return 0.0;
     }
-    return markerResults[region].counters[thread][event];
+    return markerResults[region].errors[thread][event + 1];
 }
 
 double
-perfmon_getMetricOfRegionThread(int region, int metricId, int threadId)
+perfmon_getRegionPercentile(int region, int event, int thread, double percentile)
 {
-    int e = 0, err = 0;
-    double result = 0.0;
-    CounterList clist;
+    double result = NAN;
+    uint32_t* merged = NULL;
     if (perfmon_initialized != 1)
     {
         ERROR_PLAIN_PRINT(Perfmon module not properly initialized);
         return NAN;
     }
-    if (region < 0 || region >= markerRegions)
+    if (region < 0 || region >= markerRegions || markerResults == NULL)
     {
         return NAN;
     }
-    if (markerResults == NULL)
+    LikwidResults* res = &markerResults[region];
+    int hist = -1;
+    for (int h = 0; h < res->histCount && res->histEvents; h++)
     {
-        return NAN;
+        if (res->histEvents[h] == event)
+        {
+            hist = h;
+        }
     }
-    if (threadId < 0 || threadId >= markerResults[region].threadCount)
+    if (res->histograms == NULL || hist < 0)
     {
         return NAN;
     }
-    if (metricId < 0 || metricId >= groupSet->groups[markerResults[region].groupID].group.nmetrics)
+    if (thread >= res->threadCount || percentile < 0.0 || percentile > 100.0)
     {
         return NAN;
     }
-    timer_init();
-    init_clist(&clist);
-    for (e=0;e<markerResults[region].eventCount;e++)
+    if (thread >= 0)
     {
-        err = add_to_clist(&clist,
-                     groupSet->groups[markerResults[region].groupID].group.counters[e],
-                     perfmon_getResultOfRegionThread(region, e, threadId));
-        if (err)
+        uint32_t* buckets = res->histograms[(thread * res->histCount) + hist];
+        if (buckets == NULL)
         {
-            printf("Cannot add counter %s to counter list for metric calculation\n",
-                    counter_map[groupSet->groups[markerResults[region].groupID].events[e].index].key);
-            destroy_clist(&clist);
-            return 0;
+            return NAN;
         }
+        result = histogram_percentile(buckets, percentile);
     }
-    add_to_clist(&clist, "time", perfmon_getTimeOfRegion(region, threadId));
-    add_to_clist(&clist, "inverseClock", 1.0/timer_getCycleClock());
-    add_to_clist(&clist, "true", 1);
-    add_to_clist(&clist, "false", 0);
-    add_to_clist(&clist, "num_numadomains", numa_info.numberOfNodes);
-    int cpu = 0, sock_cpu = 0, num_socks = 0;
-    for (e=0; e<groupSet->numberOfThreads; e++)
+    else
     {
-        if (groupSet->threads[e].thread_id == threadId)
+        merged = calloc(HISTOGRAM_BUCKETS, sizeof(uint32_t));
+        if (merged == NULL)
         {
-            cpu = groupSet->threads[e].processorId;
+            return NAN;
+        }
+        for (int t = 0; t < res->threadCount; t++)
+        {
+            uint32_t* buckets = res->histograms[(t * res->histCount) + hist];
+            if (buckets)
+            {
+                histogram_add(merged, buckets);
+            }
         }
+        result = histogram_percentile(merged, percentile);
+        free(merged);
     }
-    sock_cpu = socket_lock[affinity_thread2socket_lookup[cpu]];
-    num_socks = cpuid_topology.numSockets;
-    if (cpuid_info.isIntel && cpuid_info.model == SKYLAKEX && cpuid_topology.numDies != cpuid_topology.numSockets)
+    /* The runtime is recorded in nanoseconds */
+    if (event < 0 && !isnan(result))
     {
-        sock_cpu = die_lock[affinity_thread2die_lookup[cpu]];
-        num_socks = cpuid_topology.numDies;
+        result *= 1.0E-9;
     }
-    add_to_clist(&clist, "num_sockets", num_socks);
-    if (cpu != sock_cpu)
+    return result;
+}
+
+#define MARKER_FILE_CHECK(offset, size, align) \
+    (((offset) % (align) == 0) && (offset) <= markerMapSize && (size) <= markerMapSize - (offset))
+
+static int
+readBinaryMarkerFile(const char* filename)
+{
+    int fd = -1;
+    struct stat st;
+    char* map = NULL;
+    LikwidMarkerFileHeader* header = NULL;
+    LikwidMarkerFileRegion* regions = NULL;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return -errno;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(LikwidMarkerFileHeader))
     {
-        for (e=0; e<groupSet->numberOfThreads; e++)
+        close(fd);
+        return -EINVAL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map Marker file %s: %s\n", filename, strerror(errno));
+        return -errno;
+    }
+    markerMap = map;
+    markerMapSize = st.st_size;
+    header = (LikwidMarkerFileHeader*)map;
+    if (header->version != LIKWID_MARKER_FILE_VERSION ||
+        header->fileSize != markerMapSize ||
+        header->numberOfRegions < 0 || header->numberOfThreads < 0 ||
+        !MARKER_FILE_CHECK(header->regionOffset, header->numberOfRegions * sizeof(LikwidMarkerFileRegion), 8) ||
+        !MARKER_FILE_CHECK(header->stringOffset, header->stringSize, 1))
+    {
+        fprintf(stderr, "Marker file %s has an unsupported version or is corrupted.\n", filename);
+        goto failed;
+    }
+    regions = (LikwidMarkerFileRegion*)(map + header->regionOffset);
+
+    markerResults = realloc(markerResults, header->numberOfRegions * sizeof(LikwidResults));
+    if (header->numberOfRegions > 0 && markerResults == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %lu bytes for the marker results storage\n",
+                header->numberOfRegions * sizeof(LikwidResults));
+        goto failed;
+    }
+    memset(markerResults, 0, header->numberOfRegions * sizeof(LikwidResults));
+    markerRegions = header->numberOfRegions;
+    for (int i = 0; i < header->numberOfRegions; i++)
+    {
+        LikwidMarkerFileRegion* region = &regions[i];
+        LikwidResults* res = &markerResults[i];
+        uint64_t threads = region->threadCount;
+        uint64_t histSize = threads * region->histCount * header->histogramBuckets * sizeof(uint32_t);
+        if (region->tagOffset >= header->stringSize ||
+            memchr(map + header->stringOffset + region->tagOffset, '\0',
+                   header->stringSize - region->tagOffset) == NULL ||
+            !MARKER_FILE_CHECK(region->cpulistOffset, threads * sizeof(int32_t), 4) ||
+            !MARKER_FILE_CHECK(region->countOffset, threads * sizeof(uint32_t), 4) ||
+            !MARKER_FILE_CHECK(region->timeOffset, threads * sizeof(double), 8) ||
+            !MARKER_FILE_CHECK(region->counterOffset, threads * region->eventCount * sizeof(double), 8) ||
+            (region->errorOffset != 0 &&
+             !MARKER_FILE_CHECK(region->errorOffset, threads * (region->eventCount + 1) * sizeof(double), 8)) ||
+            (region->sampledOffset != 0 &&
+             !MARKER_FILE_CHECK(region->sampledOffset, threads * sizeof(uint32_t), 4)) ||
+            (region->childOffset != 0 &&
+             !MARKER_FILE_CHECK(region->childOffset, threads * (region->eventCount + 1) * sizeof(double), 8)) ||
+            (region->overheadOffset != 0 &&
+             !MARKER_FILE_CHECK(region->overheadOffset, threads * (region->eventCount + 1) * sizeof(double), 8)) ||
+            region->parent < -1 || region->parent >= header->numberOfRegions ||
+            !MARKER_FILE_CHECK(region->histEventOffset, region->histCount * sizeof(int32_t), 4) ||
+            !MARKER_FILE_CHECK(region->histogramOffset, histSize, 4))
+        {
+            fprintf(stderr, "Region %d in Marker file %s is corrupted.\n", i, filename);
+            goto failed;
+        }
+        res->tag = bfromcstr(map + header->stringOffset + region->tagOffset);
+        res->groupID = region->groupID;
+        res->parent = region->parent;
+        res->threadCount = region->threadCount;
+        res->eventCount = region->eventCount;
+        res->cpulist = (int*)(map + region->cpulistOffset);
+        res->count = (uint32_t*)(map + region->countOffset);
+        res->time = (double*)(map + region->timeOffset);
+        res->counters = malloc(threads * sizeof(double*));
+        if (threads > 0 && res->counters == NULL)
+        {
+            goto failed;
+        }
+        for (uint64_t j = 0; j < threads; j++)
         {
-            if (groupSet->threads[e].processorId == sock_cpu)
+            res->counters[j] = ((double*)(map + region->counterOffset)) + (j * region->eventCount);
+        }
+        if (region->errorOffset != 0 && region->sampledOffset != 0)
+        {
+            res->errors = malloc(threads * sizeof(double*));
+            if (threads > 0 && res->errors == NULL)
+            {
+                goto failed;
+            }
+            res->sampled = (uint32_t*)(map + region->sampledOffset);
+            for (uint64_t j = 0; j < threads; j++)
             {
-                sock_cpu = groupSet->threads[e].thread_id;
+                res->errors[j] = ((double*)(map + region->errorOffset)) + (j * (region->eventCount + 1));
             }
         }
-        for (e=0;e<markerResults[region].eventCount;e++)
+        if (region->childOffset != 0)
         {
-            if (perfmon_isUncoreCounter(groupSet->groups[markerResults[region].groupID].group.counters[e]) &&
-                !perfmon_isUncoreCounter(groupSet->groups[markerResults[region].groupID].group.metricformulas[metricId]))
+            res->children = malloc(threads * sizeof(double*));
+            if (threads > 0 && res->children == NULL)
             {
-                err = update_clist(&clist,groupSet->groups[markerResults[region].groupID].group.counters[e], perfmon_getResultOfRegionThread(region, e, sock_cpu));
-                if (err < 0)
-                {
-                    DEBUG_PRINT(DEBUGLEV_DEVELOP, Cannot add socket result of counter %s for thread %d, groupSet->groups[markerResults[region].groupID].group.counters[e], threadId);
-                }
+                goto failed;
+            }
+            for (uint64_t j = 0; j < threads; j++)
+            {
+                res->children[j] = ((double*)(map + region->childOffset)) + (j * (region->eventCount + 1));
+            }
+        }
+        if (region->overheadOffset != 0)
+        {
+            res->overheads = malloc(threads * sizeof(double*));
+            if (threads > 0 && res->overheads == NULL)
+            {
+                goto failed;
+            }
+            for (uint64_t j = 0; j < threads; j++)
+            {
+                res->overheads[j] = ((double*)(map + region->overheadOffset)) + (j * (region->eventCount + 1));
+            }
+        }
+        /* Histograms are only usable if they were written with the same bucket layout */
+        if (region->histCount > 0 && header->histogramBuckets == HISTOGRAM_BUCKETS)
+        {
+            res->histograms = malloc(threads * region->histCount * sizeof(uint32_t*));
+            if (threads > 0 && res->histograms == NULL)
+            {
+                goto failed;
+            }
+            res->histCount = region->histCount;
+            res->histEvents = (int*)(map + region->histEventOffset);
+            for (uint64_t j = 0; j < threads * region->histCount; j++)
+            {
+                res->histograms[j] = ((uint32_t*)(map + region->histogramOffset)) + (j * HISTOGRAM_BUCKETS);
             }
         }
     }
-    err = calc_metric(groupSet->groups[markerResults[region].groupID].group.metricformulas[metricId], &clist, &result);
-    if (err < 0)
-    {
-        ERROR_PRINT(Cannot calculate formula %s, groupSet->groups[markerResults[region].groupID].group.metricformulas[metricId]);
-    }
-    destroy_clist(&clist);
-    return result;
+    groupSet->numberOfThreads = header->numberOfThreads;
+    return header->numberOfRegions;
+failed:
+    perfmon_destroyMarkerResults();
+    return -EINVAL;
 }
 
 int
@@ -3892,11 +5729,23 @@ perfmon_readMarkerFile(const char* filename)
     {
         return -EINVAL;
     }
+    if (markerResults != NULL)
+    {
+        perfmon_destroyMarkerResults();
+    }
     fp = fopen(filename, "r");
     if (fp == NULL)
     {
         fprintf(stderr, "Error opening file %s\n", filename);
+        return -errno;
+    }
+    if (fread(buf, 1, strlen(LIKWID_MARKER_FILE_MAGIC), fp) == strlen(LIKWID_MARKER_FILE_MAGIC) &&
+        strncmp(buf, LIKWID_MARKER_FILE_MAGIC, strlen(LIKWID_MARKER_FILE_MAGIC)) == 0)
+    {
+        fclose(fp);
+        return readBinaryMarkerFile(filename);
     }
+    rewind(fp);
     ptr = fgets(buf, sizeof(buf), fp);
     ret = sscanf(buf, "%d %d %d", &cpus, &regions, &groups);
     if (ret != 3)
@@ -3926,6 +5775,14 @@ perfmon_readMarkerFile(const char* filename)
     {
         regionCPUs[i] = 0;
         markerResults[i].threadCount = cpus;
+        markerResults[i].histCount = 0;
+        markerResults[i].histEvents = NULL;
+        markerResults[i].histograms = NULL;
+        markerResults[i].sampled = NULL;
+        markerResults[i].errors = NULL;
+        markerResults[i].parent = -1;
+        markerResults[i].children = NULL;
+        markerResults[i].overheads = NULL;
         markerResults[i].time = (double*) malloc(cpus * sizeof(double));
         if (!markerResults[i].time)
         {
@@ -3983,10 +5840,45 @@ perfmon_readMarkerFile(const char* filename)
     }
     while (fgets(buf, sizeof(buf), fp))
     {
-        if (strchr(buf,':'))
+        if (buf[0] == 'H')
+        {
+            ret = readMarkerHistogram(buf, regionCPUs, regions, cpus);
+            if (ret < 0)
+            {
+                fprintf(stderr, "Line %s not a valid histogram line\n", buf);
+            }
+        }
+        else if (buf[0] == 'S')
+        {
+            ret = readMarkerSamples(buf, regionCPUs, regions, cpus);
+            if (ret < 0)
+            {
+                fprintf(stderr, "Line %s not a valid sampling line\n", buf);
+            }
+        }
+        else if (buf[0] == 'C' || buf[0] == 'O')
+        {
+            ret = readMarkerThreadValues(buf, regionCPUs, regions, cpus);
+            if (ret < 0)
+            {
+                fprintf(stderr, "Line %s not a valid nested regions or overhead line\n", buf);
+            }
+        }
+        else if (buf[0] == 'P')
+        {
+            int regionid = 0, parent = -1;
+            if (sscanf(buf, "P %d %d", &regionid, &parent) != 2 ||
+                regionid < 0 || regionid >= regions || parent < -1 || parent >= regions)
+            {
+                fprintf(stderr, "Line %s not a valid parent line\n", buf);
+                continue;
+            }
+            markerResults[regionid].parent = parent;
+        }
+        else if (strchr(buf,':'))
         {
             int regionid = 0, groupid = -1;
-            char regiontag[140];
+            char regiontag[300];
             char* ptr = NULL;
             char* colonptr = NULL;
             // zero out ALL of regiontag due to replacing %s with %Nc
@@ -4050,6 +5942,13 @@ perfmon_readMarkerFile(const char* filename)
     for ( uint32_t i=0; i < regions; i++ )
     {
         markerResults[i].threadCount = regionCPUs[i];
+        for (int j = 0; j < regionCPUs[i] && markerResults[i].sampled; j++)
+        {
+            if (markerResults[i].sampled[j] == UINT32_MAX)
+            {
+                markerResults[i].sampled[j] = markerResults[i].count[j];
+            }
+        }
     }
     free(regionCPUs);
     fclose(fp);
@@ -4060,7 +5959,21 @@ void
 perfmon_destroyMarkerResults()
 {
     int i = 0, j = 0;
-    if (markerResults != NULL)
+    if (markerResults != NULL && markerMap != NULL)
+    {
+        /* Only the pointer arrays are allocated, the values are in the mapping */
+        for (i = 0; i < markerRegions; i++)
+        {
+            free(markerResults[i].counters);
+            free(markerResults[i].histograms);
+            free(markerResults[i].errors);
+            free(markerResults[i].children);
+            free(markerResults[i].overheads);
+            bdestroy(markerResults[i].tag);
+        }
+        free(markerResults);
+    }
+    else if (markerResults != NULL)
     {
         for (i = 0; i < markerRegions; i++)
         {
@@ -4072,8 +5985,50 @@ perfmon_destroyMarkerResults()
                 free(markerResults[i].counters[j]);
             }
             free(markerResults[i].counters);
+            if (markerResults[i].histograms)
+            {
+                for (j = 0; j < markerResults[i].threadCount * markerResults[i].histCount; j++)
+                {
+                    free(markerResults[i].histograms[j]);
+                }
+                free(markerResults[i].histograms);
+                free(markerResults[i].histEvents);
+            }
+            if (markerResults[i].sampled)
+            {
+                for (j = 0; j < markerResults[i].threadCount; j++)
+                {
+                    free(markerResults[i].errors[j]);
+                }
+                free(markerResults[i].errors);
+                free(markerResults[i].sampled);
+            }
+            if (markerResults[i].children)
+            {
+                for (j = 0; j < markerResults[i].threadCount; j++)
+                {
+                    free(markerResults[i].children[j]);
+                }
+                free(markerResults[i].children);
+            }
+            if (markerResults[i].overheads)
+            {
+                for (j = 0; j < markerResults[i].threadCount; j++)
+                {
+                    free(markerResults[i].overheads[j]);
+                }
+                free(markerResults[i].overheads);
+            }
             bdestroy(markerResults[i].tag);
         }
         free(markerResults);
     }
+    if (markerMap != NULL)
+    {
+        munmap(markerMap, markerMapSize);
+        markerMap = NULL;
+        markerMapSize = 0;
+    }
+    markerResults = NULL;
+    markerRegions = 0;
 }
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include <likwid-marker.h>
+
+#define SIZE 1000000
+#define ITER 1000
+
+double sum = 0, a[SIZE], b[SIZE], c[SIZE];
+
+int main(int argc, char* argv[])
+{
+    double alpha = 3.14;
+
+    /* Initialize */
+    for (int i=0; i<SIZE; i++)
+    {
+        a[i] = 1.0/(double) i;
+        b[i] = 1.0;
+        c[i] = (double) i;
+    }
+    LIKWID_MARKER_INIT;
+
+    printf("Main running on core %d\n", likwid_getProcessorId());
+
+
+/****************************************************/
+#pragma omp parallel
+    {
+        int handle = -1;
+        int threadId = omp_get_thread_num();
+        int chunk = SIZE/omp_get_num_threads();
+        LIKWID_MARKER_THREADINIT;
+        LIKWID_MARKER_REGISTER_H("handle", &handle);
+        printf("Thread %d running on core %d uses handle %d\n", threadId, likwid_getProcessorId(), handle);
+
+#pragma omp barrier
+        for (int j = 0; j < ITER; j++)
+        {
+            LIKWID_MARKER_START_H(handle);
+            for (int i = threadId*chunk; i < (threadId+1)*chunk; i++)
+            {
+                a[i] = b[i] + alpha * c[i];
+            }
+            LIKWID_MARKER_STOP_H(handle);
+        }
+    }
+/****************************************************/
+
+    for (int i=0; i<SIZE; i++)
+    {
+        sum += a[i];
+    }
+    LIKWID_MARKER_CLOSE;
+    printf( "OK, dofp result = %e\n", sum);
+}
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <likwid-marker.h>
+
+#define SIZE  100000
+#define OUTER 10
+#define INNER 1000
+
+double sum = 0, a[SIZE], b[SIZE], c[SIZE];
+
+static void work(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        a[i] = b[i] + 3.14 * c[i];
+    }
+    sum += a[n/2];
+}
+
+/* Nested regions with a sampled child: "outer" is measured at every call,
+ * only every 100th call of "inner" is measured. The exclusive results of
+ * "outer" have to match the results of "reference", which does the same
+ * work as "outer" without the nested region.
+ * Run with: likwid-perfctr -C 0 -g CLOCK -m ./testmarker-sample */
+int main(int argc, char* argv[])
+{
+    for (int i = 0; i < SIZE; i++)
+    {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = (double) i;
+    }
+    LIKWID_MARKER_INIT;
+    LIKWID_MARKER_SAMPLE("inner", 100);
+
+    for (int j = 0; j < OUTER; j++)
+    {
+        LIKWID_MARKER_START("reference");
+        work(SIZE);
+        LIKWID_MARKER_STOP("reference");
+    }
+
+    for (int j = 0; j < OUTER; j++)
+    {
+        LIKWID_MARKER_START("outer");
+        work(SIZE);
+        for (int k = 0; k < INNER; k++)
+        {
+            LIKWID_MARKER_START("inner");
+            work(SIZE/100);
+            LIKWID_MARKER_STOP("inner");
+        }
+        LIKWID_MARKER_STOP("outer");
+    }
+
+    LIKWID_MARKER_CLOSE;
+    printf( "OK, dofp result = %e\n", sum);
+}